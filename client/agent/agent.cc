@@ -0,0 +1,302 @@
+/*
+ * agent.cc
+ */
+
+#include "agent.hh"
+
+/*
+ * constructor of Agent
+ *
+ * @param path - path of the unix socket to listen on
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ */
+Agent::Agent(char* path, int userID, int securetype)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(path_)) {
+        fprintf(stderr, "Error: the agent socket path should be shorter than %d bytes!\n", (int)sizeof(path_));
+        exit(1);
+    }
+    strcpy(path_, path);
+
+    /* a requester that goes away must not kill the agent, and neither must a dropped server */
+    signal(SIGPIPE, SIG_IGN);
+
+    session_ = new MetadedupSession(userID, securetype, true);
+
+    cwdFd_ = open(".", O_RDONLY | O_DIRECTORY);
+    if (cwdFd_ == -1) {
+        fprintf(stderr, "Error: fail to open the working directory %d!\n", errno);
+        exit(1);
+    }
+
+    /* a socket file left by a killed agent would make bind fail */
+    unlink(path_);
+    listenSock_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSock_ == -1) {
+        fprintf(stderr, "Error initializing agent socket %d\n", errno);
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path_);
+    if (bind(listenSock_, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error binding agent socket %s %d\n", path_, errno);
+        exit(1);
+    }
+    /* the socket is closed to other users before it listens, whatever the umask */
+    if (chmod(path_, S_IRUSR | S_IWUSR) == -1) {
+        fprintf(stderr, "Error setting the mode of agent socket %s %d\n", path_, errno);
+        exit(1);
+    }
+    if (listen(listenSock_, AGENT_BACKLOG) == -1) {
+        fprintf(stderr, "Error listening on agent socket %s %d\n", path_, errno);
+        exit(1);
+    }
+    printf("agent listening on %s\n", path_);
+}
+
+/*
+ * destructor of Agent
+ */
+Agent::~Agent()
+{
+    close(listenSock_);
+    unlink(path_);
+    close(cwdFd_);
+    delete session_;
+}
+
+/*
+ * serve a request
+ *
+ * @param request - the request
+ * @param fds - working directory, stdout and stderr of the requester
+ *
+ * @return - AGENT_OK or AGENT_FAIL
+ */
+int Agent::serve(request_t* request, int* fds)
+{
+    bool success = false;
+
+    /* the output of the request goes to the requester */
+    fflush(stdout);
+    fflush(stderr);
+    int savedOut = dup(STDOUT_FILENO);
+    int savedErr = dup(STDERR_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[2], STDERR_FILENO);
+
+    if ((request->userID != session_->getUserID()) || (request->securetype != session_->getSecureType())) {
+        fprintf(stderr, "Error: the agent serves user %d with another security type, run CLIENT without the agent!\n",
+            session_->getUserID());
+    } else if (fchdir(fds[0]) == -1) {
+        fprintf(stderr, "Error: fail to enter the working directory of the request %d!\n", errno);
+    } else {
+        if (request->action == AGENT_UPLOAD) {
+            success = session_->uploadFile(request->name, request->mode);
+        } else if (request->action == AGENT_RESTORE) {
+            char outName[DIR_MAX_SIZE + 3];
+            sprintf(outName, "%s.d", request->name);
+            success = session_->restoreFile(request->name, outName);
+        } else {
+            fprintf(stderr, "Error: unknown agent action %d!\n", request->action);
+        }
+        if (fchdir(cwdFd_) == -1) {
+            fprintf(stderr, "Error: fail to return to the working directory of the agent %d!\n", errno);
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedOut, STDOUT_FILENO);
+    dup2(savedErr, STDERR_FILENO);
+    close(savedOut);
+    close(savedErr);
+    return success ? AGENT_OK : AGENT_FAIL;
+}
+
+/*
+ * serve requests until the process is killed
+ */
+void Agent::run()
+{
+    while (true) {
+        int sock = accept(listenSock_, NULL, NULL);
+        if (sock == -1) {
+            if (errno != EINTR) {
+                fprintf(stderr, "Error accepting %d\n", errno);
+            }
+            continue;
+        }
+
+        /* requests run with the credentials of the agent, so they are only taken from its own user */
+        struct ucred cred;
+        socklen_t credSize = sizeof(cred);
+        if ((getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &credSize) == -1) || (cred.uid != getuid())) {
+            fprintf(stderr, "Error: the agent refuses a request of another user!\n");
+            close(sock);
+            continue;
+        }
+
+        /* a requester that sends nothing only holds the agent for a while */
+        struct timeval timeout;
+        timeout.tv_sec = AGENT_RECV_TIMEOUT;
+        timeout.tv_usec = 0;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1) {
+            fprintf(stderr, "Error setting options %d\n", errno);
+            close(sock);
+            continue;
+        }
+
+        /* the descriptors come with the first bytes of the request */
+        request_t request;
+        int fds[AGENT_NUM_FDS];
+        int numOfFds = 0;
+        char control[CMSG_SPACE(sizeof(int) * AGENT_NUM_FDS)];
+        struct iovec iov;
+        struct msghdr msg;
+        iov.iov_base = &request;
+        iov.iov_len = sizeof(request);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        long total = recvmsg(sock, &msg, 0);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if ((total > 0) && (cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+            numOfFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * numOfFds);
+        }
+        while ((total > 0) && (total < (long)sizeof(request))) {
+            long ret = recv(sock, (char*)&request + total, sizeof(request) - total, 0);
+            if (ret <= 0) {
+                total = ret;
+                break;
+            }
+            total += ret;
+        }
+
+        int result = AGENT_FAIL;
+        if ((total == (long)sizeof(request)) && (numOfFds == AGENT_NUM_FDS)
+            && (request.nameSize > 1) && (request.nameSize <= DIR_MAX_SIZE + 1)
+            && (request.name[request.nameSize - 1] == '\0')) {
+            result = serve(&request, fds);
+        } else {
+            fprintf(stderr, "Error: malformed agent request!\n");
+        }
+        for (int i = 0; i < numOfFds; i++) {
+            close(fds[i]);
+        }
+        if (send(sock, &result, sizeof(int), MSG_NOSIGNAL) == -1) {
+            fprintf(stderr, "Error sending agent result %d\n", errno);
+        }
+        close(sock);
+    }
+}
+
+/*
+ * submit a request to an agent and wait for it to finish
+ *
+ * @param path - path of the unix socket of the agent
+ * @param action - AGENT_UPLOAD or AGENT_RESTORE
+ * @param mode - upload mode
+ * @param name - full path of the file
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ *
+ * @return - AGENT_OK, AGENT_FAIL, or AGENT_UNREACHABLE if no agent listens on the path
+ */
+int Agent::submit(char* path, int action, int mode, char* name, int userID, int securetype)
+{
+    struct sockaddr_un addr;
+    request_t request;
+
+    if ((strlen(path) >= sizeof(addr.sun_path)) || (strlen(name) > DIR_MAX_SIZE)) {
+        return AGENT_UNREACHABLE;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return AGENT_UNREACHABLE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return AGENT_UNREACHABLE;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.action = action;
+    request.mode = mode;
+    request.userID = userID;
+    request.securetype = securetype;
+    request.nameSize = strlen(name) + 1;
+    memcpy(request.name, name, request.nameSize);
+
+    /* the agent works in the directory of the requester and prints to its output */
+    int fds[AGENT_NUM_FDS];
+    fds[0] = open(".", O_RDONLY | O_DIRECTORY);
+    fds[1] = STDOUT_FILENO;
+    fds[2] = STDERR_FILENO;
+    if (fds[0] == -1) {
+        fprintf(stderr, "Error: fail to open the working directory %d!\n", errno);
+        close(sock);
+        return AGENT_FAIL;
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    char control[CMSG_SPACE(sizeof(int) * AGENT_NUM_FDS)];
+    struct iovec iov;
+    struct msghdr msg;
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * AGENT_NUM_FDS);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * AGENT_NUM_FDS);
+
+    long total = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    close(fds[0]);
+    while ((total > 0) && (total < (long)sizeof(request))) {
+        long ret = send(sock, (char*)&request + total, sizeof(request) - total, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            total = ret;
+            break;
+        }
+        total += ret;
+    }
+    if (total != (long)sizeof(request)) {
+        fprintf(stderr, "Error sending agent request %d\n", errno);
+        close(sock);
+        return AGENT_FAIL;
+    }
+
+    /* wait for the agent to finish the request */
+    int result;
+    int received = 0;
+    while (received < (int)sizeof(int)) {
+        long ret = recv(sock, (char*)&result + received, sizeof(int) - received, 0);
+        if (ret <= 0) {
+            fprintf(stderr, "Error: the agent closed the request!\n");
+            close(sock);
+            return AGENT_FAIL;
+        }
+        received += ret;
+    }
+    close(sock);
+    return result;
+}
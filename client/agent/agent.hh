@@ -0,0 +1,117 @@
+/*
+ * agent.hh
+ */
+
+#ifndef __AGENT_HH__
+#define __AGENT_HH__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metadedup.hh"
+
+/* request actions */
+#define AGENT_UPLOAD 1
+#define AGENT_RESTORE 2
+
+/* request results */
+#define AGENT_OK 0
+#define AGENT_FAIL 1
+#define AGENT_UNREACHABLE (-1)
+
+/* number of descriptors passed with a request: working directory, stdout and stderr of the requester */
+#define AGENT_NUM_FDS 3
+
+/* number of pending requests the agent accepts */
+#define AGENT_BACKLOG 16
+
+/* time a requester has to send its request before the agent drops it (s) */
+#define AGENT_RECV_TIMEOUT 10
+
+/*
+ * local agent that serves uploads and restores of thin CLIENT invocations
+ *
+ * the agent keeps a warm session, so the OpenSSL locks, the configuration, the
+ * share cache and the server connections are set up once instead of per file.
+ * requests are served one at a time in the working directory of the requester,
+ * which keeps the temporary key and recipe files and the config files where a
+ * plain CLIENT run would use them. the agent runs with the credentials of its
+ * user, so only processes of the same user may connect to it
+ */
+class Agent {
+private:
+    /* request structure */
+    typedef struct {
+        int action;
+        int mode;
+        int userID;
+        int securetype;
+        int nameSize;
+        char name[DIR_MAX_SIZE + 1];
+    } request_t;
+
+    /* warm session of the agent */
+    MetadedupSession* session_;
+
+    /* listening socket and its path */
+    int listenSock_;
+    char path_[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+    /* working directory of the agent, restored after each request */
+    int cwdFd_;
+
+    /*
+     * serve a request
+     *
+     * @param request - the request
+     * @param fds - working directory, stdout and stderr of the requester
+     *
+     * @return - AGENT_OK or AGENT_FAIL
+     */
+    int serve(request_t* request, int* fds);
+
+public:
+    /*
+     * constructor of Agent
+     *
+     * @param path - path of the unix socket to listen on
+     * @param userID - ID of the user
+     * @param securetype - encryption and hash type
+     */
+    Agent(char* path, int userID, int securetype);
+
+    /*
+     * destructor of Agent
+     */
+    ~Agent();
+
+    /*
+     * serve requests until the process is killed
+     */
+    void run();
+
+    /*
+     * submit a request to an agent and wait for it to finish
+     *
+     * @param path - path of the unix socket of the agent
+     * @param action - AGENT_UPLOAD or AGENT_RESTORE
+     * @param mode - upload mode
+     * @param name - full path of the file
+     * @param userID - ID of the user
+     * @param securetype - encryption and hash type
+     *
+     * @return - AGENT_OK, AGENT_FAIL, or AGENT_UNREACHABLE if no agent listens on the path
+     */
+    static int submit(char* path, int action, int mode, char* name, int userID, int securetype);
+};
+
+#endif
@@ -0,0 +1,1065 @@
+/*
+ * metadedup.cc
+ */
+
+#include "metadedup.hh"
+
+using namespace std;
+
+pthread_mutex_t MetadedupSession::sessionLock_ = PTHREAD_MUTEX_INITIALIZER;
+int MetadedupSession::numOfSessions_ = 0;
+
+/*
+ * check if a chunk only contains zero bytes
+ *
+ * @param data - the chunk
+ * @param size - the size of the chunk
+ *
+ * @return - a boolean value that indicates if the chunk is all zero
+ */
+static bool isZeroChunk(unsigned char* data, int size)
+{
+    return (size > 0) && (data[0] == 0) && (memcmp(data, data + 1, size - 1) == 0);
+}
+
+/*
+ * constructor of UploadStream (use MetadedupSession::openUpload)
+ *
+ * @param conf - the configuration of the session
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ * @param name - full path of the file
+ * @param nameSize - size of the full path, including the terminating zero
+ * @param size - size of the file
+ * @param mode - upload mode
+ * @param shareCacheObj - share cache kept by the session (NULL for a cache of this stream)
+ * @param sockets - connections kept by the session (NULL for connecting to ./config-u)
+ */
+UploadStream::UploadStream(Configuration* conf, int userID, int securetype, char* name, int nameSize, long size, int mode,
+    ShareCache* shareCacheObj, Socket** sockets)
+{
+    int n = conf->getN();
+
+    size_ = size;
+    written_ = 0;
+    zeroRun_ = 0;
+    totalChunks_ = 0;
+    addWaitTime_ = 0;
+    wallTime_ = 0;
+
+    /* a small file needs no more chunking buffer than its size */
+    bufferSize_ = conf->getBufferSize();
+    if (size_ < bufferSize_) {
+        bufferSize_ = size_;
+    }
+    bufferLen_ = 0;
+    bufferOffset_ = 0;
+    buffer_ = (unsigned char*)malloc(sizeof(unsigned char) * bufferSize_);
+    chunkEndIndexList_ = (int*)malloc(sizeof(int) * conf->getListSize());
+
+    /* the uploader is built before the encoder that feeds it, and no stage is started after one fails */
+    uploaderObj_ = NULL;
+    encoderObj_ = NULL;
+    chunkerObj_ = new Chunker(VAR_SIZE_TYPE, conf->getAvgChunkSize(), conf->getMinChunkSize(), conf->getMaxChunkSize());
+    valid_ = chunkerObj_->isValid();
+    if (valid_ && ((mode == UPLOAD_FULL) || (mode == UPLOAD_NULL_SINK))) {
+        uploaderObj_ = new Uploader(n, n, userID, name, nameSize, mode == UPLOAD_NULL_SINK,
+            conf->getStreamBufferSize(), conf->getQueueDepth(), (mode == UPLOAD_NULL_SINK) ? NULL : sockets);
+        valid_ = uploaderObj_->isValid();
+    }
+    if (valid_ && (mode != UPLOAD_CHUNK_ONLY)) {
+        encoderObj_ = new Encoder(CAONT_RS_TYPE, n, conf->getM(), conf->getR(), securetype, uploaderObj_,
+            conf->getCompressionLevel(), conf->getShareCacheSize(), conf->getQueueDepth(), shareCacheObj,
+            conf->getMinSegmentSize(), conf->getAvgSegmentSize(), conf->getMaxSegmentSize());
+        valid_ = encoderObj_->isValid();
+        if (!valid_ && (uploaderObj_ != NULL)) {
+            uploaderObj_->abort();
+        }
+    }
+    startTime_ = stageTimeNow();
+    if (!valid_) {
+        return;
+    }
+
+    /* the file header goes first */
+    Encoder::Secret_Item_t header;
+    header.type = 1;
+    memcpy(header.file_header.data, name, nameSize);
+    header.file_header.fullNameSize = nameSize;
+    header.file_header.fileSize = size_;
+    addSecret(&header);
+}
+
+/*
+ * destructor of UploadStream
+ */
+UploadStream::~UploadStream()
+{
+    delete uploaderObj_;
+    delete chunkerObj_;
+    delete encoderObj_;
+    free(buffer_);
+    free(chunkEndIndexList_);
+}
+
+/*
+ * hand a secret over to the encoder, or drop it when only chunking is measured
+ *
+ * @param item - the secret
+ */
+void UploadStream::addSecret(Encoder::Secret_Item_t* item)
+{
+    if (encoderObj_ == NULL) {
+        if (item->type == 0) {
+            free(item->secret.data);
+        }
+        return;
+    }
+    double start = stageTimeNow();
+    encoderObj_->add(item);
+    addWaitTime_ += stageTimeNow() - start;
+}
+
+/*
+ * add the current run of zero bytes as zero secrets, which are neither encoded nor uploaded
+ *
+ * @param end - whether the run ends the file
+ */
+void UploadStream::addZeroSecrets(bool end)
+{
+    while (zeroRun_ > 0) {
+        Encoder::Secret_Item_t input;
+        input.type = 0;
+        input.secret.secretID = totalChunks_;
+        input.secret.secretSize = (zeroRun_ > MAX_ZERO_SECRET_SIZE) ? MAX_ZERO_SECRET_SIZE : (int)zeroRun_;
+        input.secret.data = NULL;
+        input.secret.end = 0;
+        input.secret.zero = 1;
+        zeroRun_ -= input.secret.secretSize;
+        if (end && zeroRun_ == 0)
+            input.secret.end = 1;
+        addSecret(&input);
+        totalChunks_++;
+    }
+}
+
+/*
+ * chunk the chunking buffer and add its chunks as secrets
+ */
+void UploadStream::processBuffer()
+{
+    int numOfChunks;
+    int count = 0;
+    int preEnd = -1;
+
+    if (bufferLen_ == 0) {
+        return;
+    }
+    chunkerObj_->chunking(buffer_, bufferLen_, chunkEndIndexList_, &numOfChunks);
+    while (count < numOfChunks) {
+
+        int secretSize = chunkEndIndexList_[count] - preEnd;
+        if (isZeroChunk(buffer_ + preEnd + 1, secretSize)) {
+            /* defer zero chunks so that consecutive ones become a single zero secret */
+            zeroRun_ += secretSize;
+        } else {
+            addZeroSecrets(false);
+
+            Encoder::Secret_Item_t input;
+            input.type = 0;
+            input.secret.secretID = totalChunks_;
+            input.secret.secretSize = secretSize;
+            input.secret.data = (unsigned char*)malloc(sizeof(unsigned char) * secretSize);
+            memcpy(input.secret.data, buffer_ + preEnd + 1, input.secret.secretSize);
+            input.secret.end = 0;
+            input.secret.zero = 0;
+
+            if (bufferOffset_ + chunkEndIndexList_[count] + 1 == size_)
+                input.secret.end = 1;
+            addSecret(&input);
+
+            totalChunks_++;
+        }
+        preEnd = chunkEndIndexList_[count];
+        count++;
+    }
+    bufferOffset_ += bufferLen_;
+    bufferLen_ = 0;
+}
+
+/*
+ * write the next bytes of the file
+ *
+ * @param data - the bytes
+ * @param size - the number of bytes
+ *
+ * @return - a boolean value that indicates if the bytes are accepted
+ */
+bool UploadStream::write(unsigned char* data, long size)
+{
+    if (written_ + size > size_) {
+        fprintf(stderr, "Error: writing beyond the file size %ld!\n", size_);
+        return false;
+    }
+    while (size > 0) {
+        int len = (size < bufferSize_ - bufferLen_) ? (int)size : bufferSize_ - bufferLen_;
+        memcpy(buffer_ + bufferLen_, data, len);
+        bufferLen_ += len;
+        written_ += len;
+        data += len;
+        size -= len;
+
+        /* a full buffer (or the end of the file) is chunked right away */
+        if ((bufferLen_ == bufferSize_) || (written_ == size_)) {
+            processBuffer();
+        }
+    }
+    return true;
+}
+
+/*
+ * write the next bytes of the file as zero bytes (e.g., a hole of a sparse file)
+ *
+ * @param size - the number of zero bytes
+ *
+ * @return - a boolean value that indicates if the bytes are accepted
+ */
+bool UploadStream::writeZeros(long size)
+{
+    if (written_ + size > size_) {
+        fprintf(stderr, "Error: writing beyond the file size %ld!\n", size_);
+        return false;
+    }
+
+    /* the data before the zero bytes ends at a chunk boundary */
+    processBuffer();
+    bufferOffset_ += size;
+    written_ += size;
+    zeroRun_ += size;
+    return true;
+}
+
+/*
+ * finish the upload and wait for the pipeline to drain
+ *
+ * a file with missing bytes is completed with zero bytes, so the pipeline always ends
+ *
+ * @return - a boolean value that indicates if the whole file was written and uploaded
+ */
+bool UploadStream::close()
+{
+    bool complete = (written_ == size_);
+
+    if (!complete) {
+        fprintf(stderr, "Error: only %ld of %ld bytes are written, the rest is uploaded as zero bytes!\n", written_, size_);
+        writeZeros(size_ - written_);
+    }
+    processBuffer();
+
+    /* a trailing zero run ends the file */
+    addZeroSecrets(true);
+
+    if ((encoderObj_ != NULL) && !encoderObj_->indicateEnd()) {
+        complete = false;
+    }
+    if (uploaderObj_ != NULL) {
+        long long total = 0, unique = 0;
+        if (!uploaderObj_->indicateEnd(&total, &unique)) {
+            fprintf(stderr, "Error: the upload of the file failed!\n");
+            complete = false;
+        }
+    }
+    wallTime_ = stageTimeNow() - startTime_;
+    return complete;
+}
+
+/*
+ * print the statistics of each upload stage after the stream is closed
+ */
+void UploadStream::reportStages()
+{
+    /* the chunking stage is busy for all of its time except the waits on the encoder */
+    StageStat_t chunkStat;
+    chunkStat.items = totalChunks_;
+    chunkStat.bytes = size_;
+    chunkStat.busyTime = wallTime_ - addWaitTime_;
+
+    stageStatReportHead();
+    stageStatReport("chunk", &chunkStat, 1, wallTime_, -1);
+    if (encoderObj_ != NULL) {
+        encoderObj_->reportStages(wallTime_);
+    }
+    if (uploaderObj_ != NULL) {
+        uploaderObj_->reportStages(wallTime_);
+    }
+    if ((encoderObj_ != NULL) && (uploaderObj_ != NULL)) {
+        encoderObj_->reportSegments(uploaderObj_->getMetaDuplicates());
+    }
+}
+
+/*
+ * constructor of RestoreStream (use MetadedupSession::openRestore)
+ *
+ * @param conf - the configuration of the session
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ * @param name - full path of the file
+ * @param nameSize - size of the full path, including the terminating zero
+ * @param fp - the file to restore into, or NULL for reading the file with read()
+ * @param sockets - connections kept by the session (NULL for connecting to ./config-d)
+ * @param chunkCacheObj - cache of decoded chunks kept by the session (NULL for none)
+ * @param offset - the offset of the first byte restored
+ * @param length - the number of bytes restored (-1 for the rest of the file)
+ * @param decodeThreads - number of decoding threads (-1 for the configured number)
+ */
+RestoreStream::RestoreStream(Configuration* conf, int userID, int securetype, char* name, int nameSize, FILE* fp, Socket** sockets,
+    ChunkCache* chunkCacheObj, long offset, long length, int decodeThreads)
+{
+    memcpy(name_, name, nameSize);
+    nameSize_ = nameSize;
+    n_ = conf->getN();
+    k_ = conf->getK();
+    restoreMode_ = conf->getRestoreMode();
+    success_ = false;
+    closed_ = false;
+
+    /* without a file the decoder writes into a pipe, which the caller reads */
+    readFd_ = -1;
+    out_ = fp;
+    if (out_ == NULL) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fprintf(stderr, "Error: fail to create the restore pipe %d!\n", errno);
+        } else {
+            readFd_ = fds[0];
+            out_ = fdopen(fds[1], "wb");
+        }
+    }
+
+    kShareIDList_ = (int*)malloc(sizeof(int) * k_);
+    for (int i = 0; i < k_; i++)
+        kShareIDList_[i] = i;
+
+    decoderObj_ = new Decoder(CAONT_RS_TYPE, n_, conf->getM(), conf->getR(), securetype, conf->getStreamBufferSize(),
+        (decodeThreads >= 0) ? decodeThreads : conf->getDecodeThreads());
+    downloaderObj_ = new Downloader(n_, k_, userID, decoderObj_, name_, nameSize_, conf->getQueueDepth(), sockets);
+    valid_ = downloaderObj_->isValid();
+    if (!valid_) {
+        /* nothing is added to the decoder, it is stopped so that the stream can be deleted */
+        decoderObj_->setTotal(1);
+        decoderObj_->addEnd();
+        decoderObj_->indicateEnd();
+        if (readFd_ >= 0) {
+            fclose(out_);
+            ::close(readFd_);
+            readFd_ = -1;
+        }
+        closed_ = true;
+        return;
+    }
+    decoderObj_->setFilePointer(out_);
+    decoderObj_->setShareIDList(kShareIDList_);
+    downloaderObj_->setChunkCache(chunkCacheObj);
+    if ((offset > 0) || (length >= 0)) {
+        downloaderObj_->setRange(offset, (length >= 0) ? length : LONG_MAX);
+    }
+
+    pthread_create(&tid_, 0, &restoreThread, (void*)this);
+}
+
+/*
+ * destructor of RestoreStream
+ */
+RestoreStream::~RestoreStream()
+{
+    if (!closed_) {
+        close();
+    }
+    delete downloaderObj_;
+    delete decoderObj_;
+    free(kShareIDList_);
+}
+
+/*
+ * thread that downloads the file recipe and the shares, and feeds the decoder
+ *
+ * @param param - the restore stream
+ */
+void* RestoreStream::restoreThread(void* param)
+{
+    RestoreStream* obj = (RestoreStream*)param;
+
+    /* a hedged restore needs the metadata of the spare clouds too */
+    int numOfCloud = (obj->restoreMode_ == RESTORE_HEDGED) ? obj->n_ : obj->k_;
+
+    bool started = false;
+    if (obj->downloaderObj_->downloadKeyFile(obj->name_, numOfCloud)) {
+        if (obj->restoreMode_ != RESTORE_RECIPE) {
+            /* the decoder is stopped even when shares are missing, so the stream still ends */
+            started = true;
+            obj->success_ = obj->downloaderObj_->streamFile(obj->name_, obj->nameSize_, numOfCloud);
+            if (!obj->decoderObj_->indicateEnd()) {
+                obj->success_ = false;
+            }
+        } else if (obj->downloaderObj_->preDownloadFile(obj->name_, obj->nameSize_, obj->k_) == -1) {
+            started = true;
+            obj->success_ = obj->downloaderObj_->downloadFile(obj->name_, obj->nameSize_, obj->k_);
+            if (!obj->decoderObj_->indicateEnd()) {
+                obj->success_ = false;
+            }
+        }
+    }
+    if (!started) {
+        /* nothing was added to the decoder, it is stopped so that the stream can be deleted */
+        obj->decoderObj_->setTotal(1);
+        obj->decoderObj_->addEnd();
+        obj->decoderObj_->indicateEnd();
+    }
+    obj->downloaderObj_->indicateEnd();
+
+    /* closing the write end of the pipe tells the reader that the file ends */
+    if (obj->readFd_ >= 0) {
+        fclose(obj->out_);
+    }
+    return NULL;
+}
+
+/*
+ * read the next bytes of the file (only for a stream opened without a file)
+ *
+ * @param buffer - the buffer for the bytes <return>
+ * @param size - the size of the buffer
+ *
+ * @return - the number of bytes read, 0 at the end of the file, or -1 on errors
+ */
+long RestoreStream::read(unsigned char* buffer, long size)
+{
+    long ret;
+
+    if (readFd_ < 0) {
+        fprintf(stderr, "Error: the restore stream writes into a file and cannot be read!\n");
+        return -1;
+    }
+    do {
+        ret = ::read(readFd_, buffer, size);
+    } while ((ret < 0) && (errno == EINTR));
+    return ret;
+}
+
+/*
+ * wait for the restore to finish, discarding the bytes that are not read
+ *
+ * @return - a boolean value that indicates if the restore succeeded
+ */
+bool RestoreStream::close()
+{
+    if (closed_) {
+        return success_;
+    }
+
+    /* drain the pipe, so that the decoder never writes into a closed pipe */
+    if (readFd_ >= 0) {
+        unsigned char buffer[4096];
+        while (read(buffer, sizeof(buffer)) > 0) {
+        }
+        ::close(readFd_);
+        readFd_ = -1;
+    }
+    pthread_join(tid_, NULL);
+    closed_ = true;
+    return success_;
+}
+
+/*
+ * constructor of MetadedupSession
+ *
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type (HIGH_SEC_PAIR_TYPE or LOW_SEC_PAIR_TYPE)
+ * @param warm - whether to keep the share cache and the server connections across streams
+ */
+MetadedupSession::MetadedupSession(int userID, int securetype, bool warm)
+{
+    userID_ = userID;
+    securetype_ = securetype;
+    valid_ = true;
+    warm_ = warm;
+    shareCacheObj_ = NULL;
+    chunkCacheObj_ = NULL;
+    uploadSockets_ = NULL;
+    restoreSockets_ = NULL;
+
+    confObj_ = new Configuration();
+
+    /* the chunk sizes can be tuned without recompiling, e.g. METADEDUP_CHUNK_SIZE=8:32:64 (in KB) */
+    char* chunkSetting = getenv("METADEDUP_CHUNK_SIZE");
+    if (chunkSetting != NULL) {
+        int minSize, avgSize, maxSize;
+        if ((sscanf(chunkSetting, "%d:%d:%d", &minSize, &avgSize, &maxSize) != 3) || (maxSize > MAX_SECRET_SIZE / 1024)
+            || !confObj_->setChunkSize(minSize * 1024, avgSize * 1024, maxSize * 1024)) {
+            fprintf(stderr, "Error: METADEDUP_CHUNK_SIZE should be min:avg:max in KB with 0 < min < avg < max <= %d and avg a power of two!\n",
+                MAX_SECRET_SIZE / 1024);
+            valid_ = false;
+        }
+    }
+
+    /* the memory budget can be set without recompiling, e.g. METADEDUP_MEMORY_BUDGET=256 (in MB) */
+    char* budgetSetting = getenv("METADEDUP_MEMORY_BUDGET");
+    if (budgetSetting != NULL) {
+        int budget;
+        if ((sscanf(budgetSetting, "%d", &budget) != 1) || !confObj_->setMemoryBudget(budget)) {
+            fprintf(stderr, "Error: METADEDUP_MEMORY_BUDGET should be the budget in MB (0 for the default sizes)!\n");
+            valid_ = false;
+        }
+    }
+    applyMemoryBudget();
+
+    /* chunks are encoded as single secrets, so they are bounded by the codec */
+    if (confObj_->getMaxChunkSize() > MAX_SECRET_SIZE) {
+        fprintf(stderr, "Error: maxChunkSize should be at most MAX_SECRET_SIZE (%d)!\n", MAX_SECRET_SIZE);
+        valid_ = false;
+    }
+    if ((securetype_ != HIGH_SEC_PAIR_TYPE) && (securetype_ != LOW_SEC_PAIR_TYPE)) {
+        fprintf(stderr, "Error: the security type should be HIGH_SEC_PAIR_TYPE or LOW_SEC_PAIR_TYPE!\n");
+        valid_ = false;
+    }
+
+    /* the metadata chunk size can be tuned without recompiling, e.g. METADEDUP_SEGMENT_SIZE=256:512:1024 (in KB) */
+    char* segmentSetting = getenv("METADEDUP_SEGMENT_SIZE");
+    if (segmentSetting != NULL) {
+        int minSize, avgSize, maxSize;
+        if ((sscanf(segmentSetting, "%d:%d:%d", &minSize, &avgSize, &maxSize) != 3) || (maxSize > 1024 * 1024) || (minSize > maxSize) || (avgSize > maxSize)
+            || !setSegmentSize(minSize * 1024, avgSize * 1024, maxSize * 1024)) {
+            fprintf(stderr, "Error: METADEDUP_SEGMENT_SIZE should be min:avg:max in KB with 0 < min <= avg <= max <= 1GB!\n");
+            valid_ = false;
+        }
+    }
+
+    /* the restore mode can be chosen for a run, e.g. METADEDUP_RESTORE=recipe for the recipe upload round trip */
+    char* restoreSetting = getenv("METADEDUP_RESTORE");
+    if (restoreSetting != NULL) {
+        if (strcmp(restoreSetting, "recipe") == 0) {
+            confObj_->setRestoreMode(RESTORE_RECIPE);
+        } else if (strcmp(restoreSetting, "stream") == 0) {
+            confObj_->setRestoreMode(RESTORE_STREAM);
+        } else if (strcmp(restoreSetting, "hedged") == 0) {
+            confObj_->setRestoreMode(RESTORE_HEDGED);
+        } else {
+            fprintf(stderr, "Error: METADEDUP_RESTORE should be hedged, stream or recipe!\n");
+            valid_ = false;
+        }
+    }
+
+    /* the chunk cache can be enabled for a run, e.g. METADEDUP_CHUNK_CACHE=1024 for a cache of 1GB */
+    char* chunkCacheSetting = getenv("METADEDUP_CHUNK_CACHE");
+    if (chunkCacheSetting != NULL) {
+        int size;
+        if ((sscanf(chunkCacheSetting, "%d", &size) != 1) || (size < 0)) {
+            fprintf(stderr, "Error: METADEDUP_CHUNK_CACHE should be the size of the chunk cache in MB!\n");
+            valid_ = false;
+        } else {
+            confObj_->setChunkCacheSize(size);
+        }
+    }
+
+    pthread_mutex_lock(&sessionLock_);
+    if (numOfSessions_ == 0) {
+        if (!CryptoPrimitive::opensslLockSetup()) {
+            fprintf(stderr, "Error: fail to set up OpenSSL locks!\n");
+            valid_ = false;
+        }
+    }
+    numOfSessions_++;
+    pthread_mutex_unlock(&sessionLock_);
+
+    /* the share cache is only checked against the convergent key, so it stays valid across files */
+    if (valid_ && warm_) {
+        shareCacheObj_ = new ShareCache(confObj_->getShareCacheSize(), confObj_->getN(), HASH_SIZE);
+        valid_ = shareCacheObj_->isValid();
+    }
+
+    /* the chunk cache is on disk, so it is kept by every session; its slots are pinned within the session */
+    if (valid_ && (confObj_->getChunkCacheSize() != CHUNK_CACHE_OFF)) {
+        chunkCacheObj_ = new ChunkCache(confObj_->getChunkCachePath(), confObj_->getChunkCacheSize(), confObj_->getMaxChunkSize());
+    }
+
+    if (valid_ && (confObj_->getMemoryBudget() > 0)) {
+        printf("memory budget %d MB: read buffer %d KB, stream buffers %d KB, queue depth %d, share cache %d\n",
+            confObj_->getMemoryBudget(), confObj_->getBufferSize() / 1024, confObj_->getStreamBufferSize() / 1024,
+            confObj_->getQueueDepth(), confObj_->getShareCacheSize());
+    }
+}
+
+/*
+ * destructor of MetadedupSession
+ */
+MetadedupSession::~MetadedupSession()
+{
+    closeSockets(&uploadSockets_, 2 * confObj_->getN());
+    closeSockets(&restoreSockets_, 2 * confObj_->getN());
+    delete shareCacheObj_;
+    if (chunkCacheObj_ != NULL) {
+        printf("chunk cache: %lld hits in %lld lookups\n", chunkCacheObj_->hits_, chunkCacheObj_->lookups_);
+        delete chunkCacheObj_;
+    }
+
+    pthread_mutex_lock(&sessionLock_);
+    numOfSessions_--;
+    if (numOfSessions_ == 0) {
+        CryptoPrimitive::opensslLockCleanup();
+    }
+    pthread_mutex_unlock(&sessionLock_);
+    delete confObj_;
+}
+
+/*
+ * check the full path of a file
+ *
+ * @param name - full path of the file
+ *
+ * @return - the size of the full path including the terminating zero, or 0 if it is too long
+ */
+int MetadedupSession::checkName(char* name)
+{
+    int nameSize = strlen(name) + 1;
+
+    if (nameSize > DIR_MAX_SIZE + 1) {
+        fprintf(stderr, "Error: the full path of the file should be at most %d bytes!\n", DIR_MAX_SIZE);
+        return 0;
+    }
+    return nameSize;
+}
+
+/*
+ * get the connections of a warm session, reconnecting if one of them failed
+ *
+ * @param sockets - the connections, connected if NULL <return>
+ * @param configName - the config file that lists the servers
+ * @param num - the number of connections
+ *
+ * @return - the connections, or NULL if the config file cannot be read
+ */
+Socket** MetadedupSession::warmSockets(Socket*** sockets, const char* configName, int num)
+{
+    if (*sockets != NULL) {
+        /* a failed connection is out of sync with its server, so all of them are reconnected */
+        for (int i = 0; i < num; i++) {
+            if ((*sockets)[i]->failed_) {
+                printf("reconnecting to the servers in %s\n", configName);
+                closeSockets(sockets, num);
+                break;
+            }
+        }
+    }
+    if (*sockets == NULL) {
+        *sockets = Socket::connectConfig(configName, num, userID_);
+    }
+    return *sockets;
+}
+
+/*
+ * close the connections of a warm session
+ *
+ * @param sockets - the connections, set to NULL <return>
+ * @param num - the number of connections
+ */
+void MetadedupSession::closeSockets(Socket*** sockets, int num)
+{
+    if (*sockets == NULL) {
+        return;
+    }
+    for (int i = 0; i < num; i++) {
+        delete (*sockets)[i];
+    }
+    free(*sockets);
+    *sockets = NULL;
+}
+
+/*
+ * open a stream for uploading a file
+ *
+ * @param name - full path of the file, which names the file on the servers
+ * @param size - size of the file
+ * @param mode - upload mode (UPLOAD_FULL, or a benchmark mode)
+ *
+ * @return - the stream, or NULL on errors
+ */
+UploadStream* MetadedupSession::openUpload(char* name, long size, int mode)
+{
+    int nameSize = checkName(name);
+
+    if (!valid_ || (nameSize == 0)) {
+        return NULL;
+    }
+    if (size <= 0) {
+        fprintf(stderr, "Error: the file to upload should not be empty!\n");
+        return NULL;
+    }
+    if ((mode < UPLOAD_FULL) || (mode > UPLOAD_CHUNK_ONLY)) {
+        fprintf(stderr, "Error: unknown upload mode %d!\n", mode);
+        return NULL;
+    }
+    if ((mode == UPLOAD_FULL) && (access("./config-u", R_OK) != 0)) {
+        fprintf(stderr, "Error: fail to open config file ./config-u!\n");
+        return NULL;
+    }
+
+    Socket** sockets = NULL;
+    if (warm_ && (mode == UPLOAD_FULL)) {
+        sockets = warmSockets(&uploadSockets_, "./config-u", 2 * confObj_->getN());
+        if (sockets == NULL) {
+            return NULL;
+        }
+    }
+
+    UploadStream* stream = new UploadStream(confObj_, userID_, securetype_, name, nameSize, size, mode, shareCacheObj_, sockets);
+    if (!stream->isValid()) {
+        delete stream;
+        return NULL;
+    }
+    return stream;
+}
+
+/*
+ * open a stream for restoring a file
+ *
+ * @param name - full path of the file when it was uploaded
+ * @param fp - the file to restore into, or NULL for reading the file with RestoreStream::read()
+ *
+ * @return - the stream, or NULL on errors
+ */
+RestoreStream* MetadedupSession::openRestore(char* name, FILE* fp, long offset, long length)
+{
+    int nameSize = checkName(name);
+
+    if (!valid_ || (nameSize == 0)) {
+        return NULL;
+    }
+    if (offset < 0) {
+        fprintf(stderr, "Error: the offset of the range to restore should not be negative!\n");
+        return NULL;
+    }
+    if (access("./config-d", R_OK) != 0) {
+        fprintf(stderr, "Error: fail to open config file ./config-d!\n");
+        return NULL;
+    }
+
+    Socket** sockets = NULL;
+    if (warm_) {
+        sockets = warmSockets(&restoreSockets_, "./config-d", 2 * confObj_->getN());
+        if (sockets == NULL) {
+            return NULL;
+        }
+    }
+
+    RestoreStream* stream = new RestoreStream(confObj_, userID_, securetype_, name, nameSize, fp, sockets, chunkCacheObj_, offset, length);
+    if (!stream->isValid()) {
+        delete stream;
+        return NULL;
+    }
+    return stream;
+}
+
+/*
+ * size the buffers, queues and share cache of the session to its memory budget
+ */
+void MetadedupSession::applyMemoryBudget()
+{
+    /* size the buffers for the metadata and data streams of each cloud, and for the
+       queues of the encoding threads and the upload streams (restore has fewer queues) */
+    confObj_->applyMemoryBudget(2 * confObj_->getN(), 2 * NUM_THREADS + 2 * confObj_->getN());
+}
+
+/*
+ * set the sizes of the chunks of the next uploads
+ *
+ * @param minSize - minimum chunk size
+ * @param avgSize - average chunk size, a power of two
+ * @param maxSize - maximum chunk size, at most MAX_SECRET_SIZE
+ *
+ * @return - a boolean value that indicates if the sizes satisfy 0 < min < avg < max <= MAX_SECRET_SIZE
+ */
+bool MetadedupSession::setChunkSize(int minSize, int avgSize, int maxSize)
+{
+    /* chunks are encoded as single secrets, so they are bounded by the codec */
+    if ((maxSize > MAX_SECRET_SIZE) || !confObj_->setChunkSize(minSize, avgSize, maxSize)) {
+        return false;
+    }
+
+    /* the budget counts each queued chunk at the maximum chunk size */
+    applyMemoryBudget();
+    return true;
+}
+
+/*
+ * set the sizes of the segments that form metadata chunks for the next uploads
+ *
+ * @param minSize - minimum bytes of shares covered by a metadata chunk
+ * @param avgSize - average bytes of shares covered by a metadata chunk
+ * @param maxSize - maximum bytes of shares covered by a metadata chunk
+ *
+ * @return - a boolean value that indicates if the sizes satisfy 0 < min <= avg <= max
+ */
+bool MetadedupSession::setSegmentSize(int minSize, int avgSize, int maxSize)
+{
+    return confObj_->setSegmentSize(minSize, avgSize, maxSize);
+}
+
+/*
+ * upload a file from the disk, skipping its holes without reading them
+ *
+ * @param name - full path of the file
+ * @param mode - upload mode (UPLOAD_FULL, or a benchmark mode)
+ *
+ * @return - a boolean value that indicates if the file is uploaded
+ */
+bool MetadedupSession::uploadFile(char* name, int mode)
+{
+    FILE* fin = fopen(name, "r");
+    if (fin == NULL) {
+        fprintf(stderr, "Error: fail to open %s!\n", name);
+        return false;
+    }
+    /* get file size */
+    fseek(fin, 0, SEEK_END);
+    long size = ftell(fin);
+    fseek(fin, 0, SEEK_SET);
+
+    UploadStream* stream = openUpload(name, size, mode);
+    if (stream == NULL) {
+        fclose(fin);
+        return false;
+    }
+
+    unsigned char* buffer = (unsigned char*)malloc(sizeof(unsigned char) * READ_BUFFER_SIZE);
+    int fd = fileno(fin);
+    long total = 0;
+    while (total < size) {
+
+        /* skip the hole at the current offset without reading it */
+        long dataStart = lseek(fd, total, SEEK_DATA);
+        if (dataStart < 0) {
+            /* ENXIO means no data until the end, otherwise holes are not supported */
+            dataStart = (errno == ENXIO) ? size : total;
+        }
+        if (dataStart > total) {
+            stream->writeZeros(dataStart - total);
+        }
+        total = dataStart;
+        if (total == size) {
+            break;
+        }
+
+        /* read up to the next hole */
+        long dataEnd = lseek(fd, total, SEEK_HOLE);
+        if (dataEnd < 0 || dataEnd > size) {
+            dataEnd = size;
+        }
+        fseek(fin, total, SEEK_SET);
+        while (total < dataEnd) {
+
+            int toRead = (dataEnd - total < READ_BUFFER_SIZE) ? (int)(dataEnd - total) : READ_BUFFER_SIZE;
+            int ret = fread(buffer, 1, toRead, fin);
+            if (ret <= 0) {
+                /* the stream completes the file with zero bytes on close */
+                fprintf(stderr, "Error: fail to read %s at offset %ld!\n", name, total);
+                break;
+            }
+            stream->write(buffer, ret);
+            total += ret;
+        }
+        if (total < dataEnd) {
+            break;
+        }
+    }
+    free(buffer);
+    fclose(fin);
+
+    bool success = stream->close();
+    stream->reportStages();
+    delete stream;
+    return success;
+}
+
+/*
+ * restore a file to the disk
+ *
+ * @param name - full path of the file when it was uploaded
+ * @param outName - path of the restored file
+ *
+ * @return - a boolean value that indicates if the file is restored
+ */
+bool MetadedupSession::restoreFile(char* name, char* outName)
+{
+    return restoreRange(name, outName, 0, -1);
+}
+
+/*
+ * read a byte range of a file, which is cut short at the end of the file
+ *
+ * @param name - full path of the file when it was uploaded
+ * @param offset - the offset of the first byte
+ * @param length - the number of bytes
+ * @param buffer - the buffer for the bytes <return>
+ *
+ * @return - the number of bytes read, or -1 on errors
+ */
+long MetadedupSession::readRange(char* name, long offset, long length, unsigned char* buffer)
+{
+    if (length < 0) {
+        fprintf(stderr, "Error: the length of the range to read should not be negative!\n");
+        return -1;
+    }
+
+    RestoreStream* stream = openRestore(name, NULL, offset, length);
+    if (stream == NULL) {
+        return -1;
+    }
+    long total = 0;
+    while (total < length) {
+        long ret = stream->read(buffer + total, length - total);
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    bool success = stream->close();
+    delete stream;
+    return success ? total : -1;
+}
+
+/*
+ * restore a byte range of a file to the disk
+ *
+ * @param name - full path of the file when it was uploaded
+ * @param outName - path of the restored bytes
+ * @param offset - the offset of the first byte
+ * @param length - the number of bytes (-1 for the rest of the file)
+ *
+ * @return - a boolean value that indicates if the range is restored
+ */
+bool MetadedupSession::restoreRange(char* name, char* outName, long offset, long length)
+{
+    FILE* fw = fopen(outName, "wb");
+    if (fw == NULL) {
+        fprintf(stderr, "Error: fail to create %s!\n", outName);
+        return false;
+    }
+
+    RestoreStream* stream = openRestore(name, fw, offset, length);
+    if (stream == NULL) {
+        fclose(fw);
+        return false;
+    }
+    bool success = stream->close();
+    delete stream;
+    fclose(fw);
+    return success;
+}
+
+/*
+ * thread of a multi-file restore that restores one file at a time over its own connections
+ *
+ * @param param - the files of the restore
+ */
+void* MetadedupSession::restoreLane(void* param)
+{
+    restoreBatch_t* batch = (restoreBatch_t*)param;
+    MetadedupSession* obj = batch->session;
+    int n = obj->confObj_->getN();
+    Socket** sockets = NULL;
+
+    while (true) {
+        pthread_mutex_lock(&batch->lock);
+        int i = batch->nextFile++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->numOfFiles) {
+            break;
+        }
+
+        int nameSize = obj->checkName(batch->names[i]);
+        if ((nameSize == 0) || (obj->warmSockets(&sockets, "./config-d", 2 * n) == NULL)) {
+            continue;
+        }
+        FILE* fw = fopen(batch->outNames[i], "wb");
+        if (fw == NULL) {
+            fprintf(stderr, "Error: fail to create %s!\n", batch->outNames[i]);
+            continue;
+        }
+
+        RestoreStream* stream = new RestoreStream(obj->confObj_, obj->userID_, obj->securetype_, batch->names[i], nameSize, fw,
+            sockets, obj->chunkCacheObj_, 0, -1, batch->decodeThreads);
+        bool success = stream->close();
+        delete stream;
+        fclose(fw);
+
+        if (success) {
+            pthread_mutex_lock(&batch->lock);
+            batch->numOfRestored++;
+            pthread_mutex_unlock(&batch->lock);
+        } else {
+            fprintf(stderr, "Error: fail to restore %s!\n", batch->names[i]);
+        }
+    }
+    obj->closeSockets(&sockets, 2 * n);
+    return NULL;
+}
+
+/*
+ * restore many files to the disk, several at a time
+ *
+ * @param names - full paths of the files when they were uploaded
+ * @param outNames - paths of the restored files
+ * @param numOfFiles - the number of files
+ *
+ * @return - the number of files restored
+ */
+int MetadedupSession::restoreFiles(char** names, char** outNames, int numOfFiles)
+{
+    if (!valid_) {
+        return 0;
+    }
+    if (access("./config-d", R_OK) != 0) {
+        fprintf(stderr, "Error: fail to open config file ./config-d!\n");
+        return 0;
+    }
+
+    int numOfLanes = confObj_->getRestoreLanes();
+    if (numOfLanes > numOfFiles) {
+        numOfLanes = numOfFiles;
+    }
+    if (numOfLanes < 1) {
+        return 0;
+    }
+
+    restoreBatch_t batch;
+    batch.session = this;
+    batch.names = names;
+    batch.outNames = outNames;
+    batch.numOfFiles = numOfFiles;
+    batch.nextFile = 0;
+    batch.numOfRestored = 0;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    /* the files in flight split the decoding threads, so they do not take a core each per file */
+    batch.decodeThreads = confObj_->getDecodeThreads();
+    if (batch.decodeThreads == 0) {
+        batch.decodeThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    batch.decodeThreads /= numOfLanes;
+    if (batch.decodeThreads < 1) {
+        batch.decodeThreads = 1;
+    }
+
+    pthread_t* tid = (pthread_t*)malloc(sizeof(pthread_t) * numOfLanes);
+    for (int i = 0; i < numOfLanes; i++) {
+        pthread_create(&tid[i], 0, &restoreLane, (void*)&batch);
+    }
+    for (int i = 0; i < numOfLanes; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    free(tid);
+    pthread_mutex_destroy(&batch.lock);
+
+    printf("%d of %d files restored\n", batch.numOfRestored, numOfFiles);
+    return batch.numOfRestored;
+}
@@ -0,0 +1,486 @@
+/*
+ * metadedup.hh
+ */
+
+#ifndef __METADEDUP_HH__
+#define __METADEDUP_HH__
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CDCodec.hh"
+#include "CryptoPrimitive.hh"
+#include "chunkCache.hh"
+#include "chunker.hh"
+#include "conf.hh"
+#include "decoder.hh"
+#include "downloader.hh"
+#include "encoder.hh"
+#include "shareCache.hh"
+#include "socket.hh"
+#include "stageStat.hh"
+#include "uploader.hh"
+
+/* upload modes, the benchmark modes stop the upload pipeline after a given stage */
+#define UPLOAD_FULL 0
+#define UPLOAD_NULL_SINK 1
+#define UPLOAD_ENCODE_ONLY 2
+#define UPLOAD_CHUNK_ONLY 3
+
+/* size of the buffer for reading a file in MetadedupSession::uploadFile, the stream buffers the chunking itself */
+#define READ_BUFFER_SIZE (1 << 20)
+
+/*
+ * upload stream of a file
+ *
+ * bytes are written in order and chunked as they come, so the caller does not need
+ * the whole file in memory. the file size is stored in the file header before any
+ * data, so it has to be given when the stream is opened
+ */
+class UploadStream {
+private:
+    /* pipeline objects (encoder and uploader are NULL in the benchmark modes that skip them) */
+    Chunker* chunkerObj_;
+    Encoder* encoderObj_;
+    Uploader* uploaderObj_;
+
+    /* chunking buffer */
+    unsigned char* buffer_;
+    int bufferSize_;
+    int bufferLen_;
+
+    /* file offset of the chunking buffer */
+    long bufferOffset_;
+
+    /* chunk end list of the chunking buffer */
+    int* chunkEndIndexList_;
+
+    /* file size, and the number of bytes written so far */
+    long size_;
+    long written_;
+
+    /* zero bytes seen but not yet added as zero secrets */
+    long zeroRun_;
+
+    /* number of secrets added so far */
+    int totalChunks_;
+
+    /* time when the stream is opened, and the time spent waiting on the encoder input buffers */
+    double startTime_;
+    double addWaitTime_;
+
+    /* wall time of the whole upload, set when the stream is closed */
+    double wallTime_;
+
+    /* whether all stages of the pipeline are started */
+    bool valid_;
+
+    /*
+     * hand a secret over to the encoder, or drop it when only chunking is measured
+     *
+     * @param item - the secret
+     */
+    void addSecret(Encoder::Secret_Item_t* item);
+
+    /*
+     * add the current run of zero bytes as zero secrets, which are neither encoded nor uploaded
+     *
+     * @param end - whether the run ends the file
+     */
+    void addZeroSecrets(bool end);
+
+    /*
+     * chunk the chunking buffer and add its chunks as secrets
+     */
+    void processBuffer();
+
+public:
+    /*
+     * constructor of UploadStream (use MetadedupSession::openUpload)
+     *
+     * @param conf - the configuration of the session
+     * @param userID - ID of the user
+     * @param securetype - encryption and hash type
+     * @param name - full path of the file
+     * @param nameSize - size of the full path, including the terminating zero
+     * @param size - size of the file
+     * @param mode - upload mode
+     * @param shareCacheObj - share cache kept by the session (NULL for a cache of this stream)
+     * @param sockets - connections kept by the session (NULL for connecting to ./config-u)
+     */
+    UploadStream(Configuration* conf, int userID, int securetype, char* name, int nameSize, long size, int mode,
+        ShareCache* shareCacheObj, Socket** sockets);
+
+    /*
+     * destructor of UploadStream
+     */
+    ~UploadStream();
+
+    /*
+     * check if all stages of the pipeline are started (openUpload only returns such streams)
+     *
+     * @return - a boolean value that indicates if the stream can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * write the next bytes of the file
+     *
+     * @param data - the bytes
+     * @param size - the number of bytes
+     *
+     * @return - a boolean value that indicates if the bytes are accepted
+     */
+    bool write(unsigned char* data, long size);
+
+    /*
+     * write the next bytes of the file as zero bytes (e.g., a hole of a sparse file)
+     *
+     * @param size - the number of zero bytes
+     *
+     * @return - a boolean value that indicates if the bytes are accepted
+     */
+    bool writeZeros(long size);
+
+    /*
+     * finish the upload and wait for the pipeline to drain
+     *
+     * a file with missing bytes is completed with zero bytes, so the pipeline always ends
+     *
+     * @return - a boolean value that indicates if the whole file was written and uploaded
+     */
+    bool close();
+
+    /*
+     * print the statistics of each upload stage after the stream is closed
+     */
+    void reportStages();
+};
+
+/*
+ * restore stream of a file
+ *
+ * the file is downloaded and decoded by background threads, either into a given
+ * file (which keeps its holes) or into a pipe that the caller reads
+ */
+class RestoreStream {
+private:
+    /* pipeline objects */
+    Decoder* decoderObj_;
+    Downloader* downloaderObj_;
+
+    /* full path of the file */
+    char name_[DIR_MAX_SIZE + 1];
+    int nameSize_;
+
+    /* number of clouds, and number of clouds the shares of a secret are downloaded from */
+    int n_;
+    int k_;
+
+    /* how the shares are downloaded (RESTORE_RECIPE, RESTORE_STREAM or RESTORE_HEDGED) */
+    int restoreMode_;
+
+    /* IDs of the clouds the shares are downloaded from */
+    int* kShareIDList_;
+
+    /* output file of the decoder, and the read end of the pipe when the caller reads the file */
+    FILE* out_;
+    int readFd_;
+
+    /* the thread that drives the download */
+    pthread_t tid_;
+
+    /* whether the restore succeeded, and whether the stream is closed */
+    bool success_;
+    bool closed_;
+
+    /* whether the downloader is started */
+    bool valid_;
+
+    /*
+     * thread that downloads the file recipe and the shares, and feeds the decoder
+     *
+     * @param param - the restore stream
+     */
+    static void* restoreThread(void* param);
+
+public:
+    /*
+     * constructor of RestoreStream (use MetadedupSession::openRestore)
+     *
+     * @param conf - the configuration of the session
+     * @param userID - ID of the user
+     * @param securetype - encryption and hash type
+     * @param name - full path of the file
+     * @param nameSize - size of the full path, including the terminating zero
+     * @param fp - the file to restore into, or NULL for reading the file with read()
+     * @param sockets - connections kept by the session (NULL for connecting to ./config-d)
+     * @param chunkCacheObj - cache of decoded chunks kept by the session (NULL for none)
+     * @param offset - the offset of the first byte restored
+     * @param length - the number of bytes restored (-1 for the rest of the file)
+     * @param decodeThreads - number of decoding threads (-1 for the configured number)
+     */
+    RestoreStream(Configuration* conf, int userID, int securetype, char* name, int nameSize, FILE* fp, Socket** sockets,
+        ChunkCache* chunkCacheObj = NULL, long offset = 0, long length = -1, int decodeThreads = -1);
+
+    /*
+     * destructor of RestoreStream
+     */
+    ~RestoreStream();
+
+    /*
+     * check if the downloader is started (openRestore only returns such streams)
+     *
+     * @return - a boolean value that indicates if the stream can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * read the next bytes of the file (only for a stream opened without a file)
+     *
+     * @param buffer - the buffer for the bytes <return>
+     * @param size - the size of the buffer
+     *
+     * @return - the number of bytes read, 0 at the end of the file, or -1 on errors
+     */
+    long read(unsigned char* buffer, long size);
+
+    /*
+     * wait for the restore to finish, discarding the bytes that are not read
+     *
+     * @return - a boolean value that indicates if the restore succeeded
+     */
+    bool close();
+};
+
+/*
+ * client session, which holds the configuration of a user
+ *
+ * the streams of a session are meant to run one (or a few) at a time. each stream
+ * runs its own pipeline: an upload starts NUM_THREADS encoding threads, 2n upload
+ * threads and 2n server connections, and a restore its own decoding threads and
+ * connections. nothing is pooled across streams, so streams running at the same
+ * time work, but each adds the threads and connections of a whole pipeline.
+ * streams of the same file name share the temporary key and recipe files next to
+ * the file, so they should not overlap
+ *
+ * a warm session only saves the setup between streams: it keeps its share cache
+ * and its server connections for the next stream, so its streams have to run one
+ * at a time
+ */
+class MetadedupSession {
+private:
+    /* files of a multi-file restore, taken in order by its lanes */
+    typedef struct {
+        MetadedupSession* session;
+        char** names;
+        char** outNames;
+        int numOfFiles;
+        int nextFile;
+        int numOfRestored;
+        int decodeThreads;
+        pthread_mutex_t lock;
+    } restoreBatch_t;
+
+    /* configuration of the session */
+    Configuration* confObj_;
+
+    /* ID of the user */
+    int userID_;
+
+    /* encryption and hash type */
+    int securetype_;
+
+    /* whether the configuration is usable */
+    bool valid_;
+
+    /* whether the share cache and the connections are kept across streams */
+    bool warm_;
+
+    /* share cache kept across uploads (warm sessions only) */
+    ShareCache* shareCacheObj_;
+
+    /* on-disk cache of decoded chunks shared by the restores of the session (NULL for disabled) */
+    ChunkCache* chunkCacheObj_;
+
+    /* connections kept across uploads and restores (warm sessions only, NULL until first used) */
+    Socket** uploadSockets_;
+    Socket** restoreSockets_;
+
+    /* the OpenSSL locks are set up by the first session and cleaned up by the last one */
+    static pthread_mutex_t sessionLock_;
+    static int numOfSessions_;
+
+    /*
+     * check the full path of a file
+     *
+     * @param name - full path of the file
+     *
+     * @return - the size of the full path including the terminating zero, or 0 if it is too long
+     */
+    int checkName(char* name);
+
+    /*
+     * get the connections of a warm session, reconnecting if one of them failed
+     *
+     * @param sockets - the connections, connected if NULL <return>
+     * @param configName - the config file that lists the servers
+     * @param num - the number of connections
+     *
+     * @return - the connections, or NULL if the config file cannot be read
+     */
+    Socket** warmSockets(Socket*** sockets, const char* configName, int num);
+
+    /*
+     * close the connections of a warm session
+     *
+     * @param sockets - the connections, set to NULL <return>
+     * @param num - the number of connections
+     */
+    void closeSockets(Socket*** sockets, int num);
+
+    /*
+     * size the buffers, queues and share cache of the session to its memory budget
+     */
+    void applyMemoryBudget();
+
+    /*
+     * thread of a multi-file restore that restores one file at a time over its own connections
+     *
+     * @param param - the files of the restore
+     */
+    static void* restoreLane(void* param);
+
+public:
+    /*
+     * constructor of MetadedupSession
+     *
+     * @param userID - ID of the user
+     * @param securetype - encryption and hash type (HIGH_SEC_PAIR_TYPE or LOW_SEC_PAIR_TYPE)
+     * @param warm - whether to keep the share cache and the server connections across streams
+     */
+    MetadedupSession(int userID, int securetype, bool warm = false);
+
+    /*
+     * destructor of MetadedupSession
+     */
+    ~MetadedupSession();
+
+    /*
+     * open a stream for uploading a file
+     *
+     * @param name - full path of the file, which names the file on the servers
+     * @param size - size of the file
+     * @param mode - upload mode (UPLOAD_FULL, or a benchmark mode)
+     *
+     * @return - the stream, or NULL on errors
+     */
+    UploadStream* openUpload(char* name, long size, int mode = UPLOAD_FULL);
+
+    /*
+     * open a stream for restoring a file, or a byte range of it
+     *
+     * only the metadata chunks covering the range are decrypted, found from the sizes in the metadata tree
+     * of the key recipes, and only the shares of the secrets overlapping it are downloaded
+     *
+     * @param name - full path of the file when it was uploaded
+     * @param fp - the file to restore into, or NULL for reading the file with RestoreStream::read()
+     * @param offset - the offset of the first byte restored
+     * @param length - the number of bytes restored (-1 for the rest of the file)
+     *
+     * @return - the stream, or NULL on errors
+     */
+    RestoreStream* openRestore(char* name, FILE* fp = NULL, long offset = 0, long length = -1);
+
+    /*
+     * upload a file from the disk, skipping its holes without reading them
+     *
+     * @param name - full path of the file
+     * @param mode - upload mode (UPLOAD_FULL, or a benchmark mode)
+     *
+     * @return - a boolean value that indicates if the file is uploaded
+     */
+    bool uploadFile(char* name, int mode = UPLOAD_FULL);
+
+    /*
+     * restore a file to the disk
+     *
+     * @param name - full path of the file when it was uploaded
+     * @param outName - path of the restored file
+     *
+     * @return - a boolean value that indicates if the file is restored
+     */
+    bool restoreFile(char* name, char* outName);
+
+    /*
+     * read a byte range of a file, which is cut short at the end of the file
+     *
+     * @param name - full path of the file when it was uploaded
+     * @param offset - the offset of the first byte
+     * @param length - the number of bytes
+     * @param buffer - the buffer for the bytes <return>
+     *
+     * @return - the number of bytes read, or -1 on errors
+     */
+    long readRange(char* name, long offset, long length, unsigned char* buffer);
+
+    /*
+     * restore a byte range of a file to the disk
+     *
+     * @param name - full path of the file when it was uploaded
+     * @param outName - path of the restored bytes
+     * @param offset - the offset of the first byte
+     * @param length - the number of bytes (-1 for the rest of the file)
+     *
+     * @return - a boolean value that indicates if the range is restored
+     */
+    bool restoreRange(char* name, char* outName, long offset, long length);
+
+    /*
+     * restore many files to the disk, several at a time
+     *
+     * each of the files in flight runs over a set of connections kept for the whole restore, and
+     * the decoding threads are split among them, so small files do not pay a connection setup each
+     *
+     * @param names - full paths of the files when they were uploaded
+     * @param outNames - paths of the restored files
+     * @param numOfFiles - the number of files
+     *
+     * @return - the number of files restored
+     */
+    int restoreFiles(char** names, char** outNames, int numOfFiles);
+
+    /*
+     * set the sizes of the chunks of the next uploads
+     *
+     * @param minSize - minimum chunk size
+     * @param avgSize - average chunk size, a power of two
+     * @param maxSize - maximum chunk size, at most MAX_SECRET_SIZE
+     *
+     * @return - a boolean value that indicates if the sizes satisfy 0 < min < avg < max <= MAX_SECRET_SIZE
+     */
+    bool setChunkSize(int minSize, int avgSize, int maxSize);
+
+    /*
+     * set the sizes of the segments that form metadata chunks for the next uploads
+     *
+     * @param minSize - minimum bytes of shares covered by a metadata chunk
+     * @param avgSize - average bytes of shares covered by a metadata chunk
+     * @param maxSize - maximum bytes of shares covered by a metadata chunk
+     *
+     * @return - a boolean value that indicates if the sizes satisfy 0 < min <= avg <= max
+     */
+    bool setSegmentSize(int minSize, int avgSize, int maxSize);
+
+    /* ID of the user */
+    inline int getUserID() { return userID_; }
+
+    /* encryption and hash type */
+    inline int getSecureType() { return securetype_; }
+};
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * codec and crypto microbenchmark
+ *
+ * measures CDCodec encoding/decoding throughput and raw CryptoPrimitive
+ * hash/cipher throughput in isolation, without chunking or networking.
+ * results are printed to stdout as CSV, one line per case:
+ *
+ *   bench,cdType,secType,n,k,secretSize,op,iterations,seconds,MBps
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "CDCodec.hh"
+#include "CryptoPrimitive.hh"
+
+/*minimum measuring time per case in seconds*/
+#define BENCH_DEFAULT_SECONDS 0.5
+/*maximum number of shares in the sweep*/
+#define BENCH_MAX_N 16
+
+/*secret sizes in the sweep*/
+static const int secretSizeList[] = { 1 << 10, 2 << 10, 4 << 10, 8 << 10, 16 << 10, 32 << 10, 64 << 10 };
+static const int numOfSecretSizes = sizeof(secretSizeList) / sizeof(int);
+
+/*(n, k) configurations in the sweep*/
+static const int nkList[][2] = { { 4, 3 }, { 6, 4 }, { 8, 6 }, { 5, 3 }, { 10, 8 } };
+static const int numOfNK = sizeof(nkList) / sizeof(nkList[0]);
+
+static const char* cdTypeName[] = { "CRSSS", "AONT-RS", "OLD-CAONT-RS", "CAONT-RS" };
+static const char* secTypeName[] = { "HIGH", "LOW", "SHA256", "SHA1" };
+
+static double minSeconds = BENCH_DEFAULT_SECONDS;
+
+static double timerNow()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char* bench, const char* cdType, const char* secType, int n, int k,
+    int secretSize, const char* op, long iterations, double seconds)
+{
+    double mbps = ((double)secretSize * iterations) / (1 << 20) / seconds;
+
+    printf("%s,%s,%s,%d,%d,%d,%s,%ld,%.6f,%.2f\n", bench, cdType, secType, n, k, secretSize, op, iterations, seconds, mbps);
+    fflush(stdout);
+}
+
+void usage()
+{
+    printf("usage: ./BENCH [codec|crypto|all] [seconds per case]\n");
+    exit(1);
+}
+
+/*
+ * measure encoding and decoding of one CDCodec configuration over the secret size sweep
+ *
+ * @param cdType - convergent dispersal type
+ * @param secType - security type of the CryptoPrimitive
+ * @param n - total number of shares
+ * @param k - minimum number of shares for reconstruction
+ *
+ * @return - a boolean value that indicates if all cases succeed
+ */
+static bool benchCodec(int cdType, int secType, int n, int k)
+{
+    unsigned char *secretBuffer, *shareBuffer, *kShareBuffer, *restoreBuffer;
+    int kShareIDList[BENCH_MAX_N], degradedIDList[BENCH_MAX_N];
+    int m = n - k, r = k - 1;
+    int i, s, secretSize, shareSize;
+    long iterations;
+    double start, elapsed;
+    bool ret = true;
+
+    CryptoPrimitive* cryptoObj = new CryptoPrimitive(secType);
+    CDCodec* cdCodecObj = new CDCodec(cdType, n, m, r, cryptoObj);
+
+    secretBuffer = (unsigned char*)malloc(MAX_SECRET_SIZE);
+    shareBuffer = (unsigned char*)malloc((MAX_SECRET_SIZE + 64 * k) * n);
+    kShareBuffer = (unsigned char*)malloc((MAX_SECRET_SIZE + 64 * k) * n);
+    restoreBuffer = (unsigned char*)malloc(MAX_SECRET_SIZE);
+
+    srand(n * 131 + k);
+    for (i = 0; i < MAX_SECRET_SIZE; i++) {
+        secretBuffer[i] = rand() & 0xff;
+    }
+
+    /*the first k shares (systematic fast path) and the last k shares (degraded read)*/
+    for (i = 0; i < k; i++) {
+        kShareIDList[i] = i;
+        degradedIDList[i] = m + i;
+    }
+
+    for (s = 0; s < numOfSecretSizes; s++) {
+        secretSize = secretSizeList[s];
+
+        /*encoding*/
+        iterations = 0;
+        start = timerNow();
+        do {
+            /*vary one byte so that every iteration encodes a distinct secret*/
+            secretBuffer[0] = iterations & 0xff;
+            if (!cdCodecObj->encoding(secretBuffer, secretSize, shareBuffer, &shareSize)) {
+                fprintf(stderr, "Error: encoding fails for %s n=%d k=%d size=%d\n", cdTypeName[cdType], n, k, secretSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        report("codec", cdTypeName[cdType], secTypeName[secType], n, k, secretSize, "encode", iterations, elapsed);
+
+        /*decoding from the first k shares*/
+        iterations = 0;
+        start = timerNow();
+        do {
+            if (!cdCodecObj->decoding(shareBuffer, kShareIDList, shareSize, secretSize, restoreBuffer)) {
+                fprintf(stderr, "Error: decoding fails for %s n=%d k=%d size=%d\n", cdTypeName[cdType], n, k, secretSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        report("codec", cdTypeName[cdType], secTypeName[secType], n, k, secretSize, "decode", iterations, elapsed);
+
+        /*decoding from the last k shares, which requires matrix inversion*/
+        for (i = 0; i < k; i++) {
+            memcpy(kShareBuffer + shareSize * i, shareBuffer + shareSize * degradedIDList[i], shareSize);
+        }
+        iterations = 0;
+        start = timerNow();
+        do {
+            if (!cdCodecObj->decoding(kShareBuffer, degradedIDList, shareSize, secretSize, restoreBuffer)) {
+                fprintf(stderr, "Error: degraded decoding fails for %s n=%d k=%d size=%d\n", cdTypeName[cdType], n, k, secretSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        if (memcmp(restoreBuffer, secretBuffer, secretSize) != 0) {
+            fprintf(stderr, "Error: restored secret mismatches for %s n=%d k=%d size=%d\n", cdTypeName[cdType], n, k, secretSize);
+            ret = false;
+            break;
+        }
+        report("codec", cdTypeName[cdType], secTypeName[secType], n, k, secretSize, "degraded-decode", iterations, elapsed);
+    }
+
+    free(secretBuffer);
+    free(shareBuffer);
+    free(kShareBuffer);
+    free(restoreBuffer);
+    delete cdCodecObj;
+    delete cryptoObj;
+
+    return ret;
+}
+
+/*
+ * measure raw hash generation and encryption/decryption of one CryptoPrimitive type over the secret size sweep
+ *
+ * @param secType - the type of CryptoPrimitive
+ *
+ * @return - a boolean value that indicates if all cases succeed
+ */
+static bool benchCrypto(int secType)
+{
+    unsigned char *dataBuffer, *cipherBuffer;
+    unsigned char hash[64], key[64];
+    int i, s, dataSize;
+    long iterations;
+    double start, elapsed;
+    bool ret = true;
+    bool withCipher = (secType == HIGH_SEC_PAIR_TYPE) || (secType == LOW_SEC_PAIR_TYPE);
+
+    CryptoPrimitive* cryptoObj = new CryptoPrimitive(secType);
+
+    dataBuffer = (unsigned char*)malloc(MAX_SECRET_SIZE);
+    cipherBuffer = (unsigned char*)malloc(MAX_SECRET_SIZE);
+    for (i = 0; i < MAX_SECRET_SIZE; i++) {
+        dataBuffer[i] = rand() & 0xff;
+    }
+    memset(key, 0x5a, sizeof(key));
+
+    for (s = 0; s < numOfSecretSizes; s++) {
+        dataSize = secretSizeList[s];
+
+        iterations = 0;
+        start = timerNow();
+        do {
+            if (!cryptoObj->generateHash(dataBuffer, dataSize, hash)) {
+                fprintf(stderr, "Error: hash generation fails for %s size=%d\n", secTypeName[secType], dataSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        report("crypto", "-", secTypeName[secType], 0, 0, dataSize, "hash", iterations, elapsed);
+
+        if (!withCipher) {
+            continue;
+        }
+
+        /*the key changes every iteration as it does per chunk in CAONT-RS*/
+        iterations = 0;
+        start = timerNow();
+        do {
+            key[0] = iterations & 0xff;
+            if (!cryptoObj->encryptWithKey(dataBuffer, dataSize, key, cipherBuffer)) {
+                fprintf(stderr, "Error: encryption fails for %s size=%d\n", secTypeName[secType], dataSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        report("crypto", "-", secTypeName[secType], 0, 0, dataSize, "encrypt", iterations, elapsed);
+
+        iterations = 0;
+        start = timerNow();
+        do {
+            key[0] = iterations & 0xff;
+            if (!cryptoObj->decryptWithKey(cipherBuffer, dataSize, key, dataBuffer)) {
+                fprintf(stderr, "Error: decryption fails for %s size=%d\n", secTypeName[secType], dataSize);
+                ret = false;
+                break;
+            }
+            iterations++;
+            elapsed = timerNow() - start;
+        } while (elapsed < minSeconds);
+        if (!ret) {
+            break;
+        }
+        report("crypto", "-", secTypeName[secType], 0, 0, dataSize, "decrypt", iterations, elapsed);
+    }
+
+    free(dataBuffer);
+    free(cipherBuffer);
+    delete cryptoObj;
+
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    bool runCodec = true, runCrypto = true, ok = true;
+    int cdType, secType, i;
+
+    if (argc > 3) {
+        usage();
+    }
+    if (argc >= 2) {
+        if (strcmp(argv[1], "codec") == 0) {
+            runCrypto = false;
+        } else if (strcmp(argv[1], "crypto") == 0) {
+            runCodec = false;
+        } else if (strcmp(argv[1], "all") != 0) {
+            usage();
+        }
+    }
+    if (argc == 3) {
+        minSeconds = atof(argv[2]);
+        if (minSeconds <= 0) {
+            usage();
+        }
+    }
+
+    /* initialize openssl locks */
+    if (!CryptoPrimitive::opensslLockSetup()) {
+        printf("fail to set up OpenSSL locks\n");
+        return 1;
+    }
+
+    printf("bench,cdType,secType,n,k,secretSize,op,iterations,seconds,MBps\n");
+
+    if (runCrypto) {
+        for (secType = HIGH_SEC_PAIR_TYPE; secType <= SHA1_TYPE; secType++) {
+            ok = benchCrypto(secType) && ok;
+        }
+    }
+
+    if (runCodec) {
+        for (cdType = CRSSS_TYPE; cdType <= CAONT_RS_TYPE; cdType++) {
+            for (secType = HIGH_SEC_PAIR_TYPE; secType <= LOW_SEC_PAIR_TYPE; secType++) {
+                for (i = 0; i < numOfNK; i++) {
+                    ok = benchCodec(cdType, secType, nkList[i][0], nkList[i][1]) && ok;
+                }
+            }
+        }
+    }
+
+    CryptoPrimitive::opensslLockCleanup();
+
+    return ok ? 0 : 1;
+}
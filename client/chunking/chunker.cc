@@ -18,6 +18,9 @@
 Chunker::Chunker(bool chunkerType, int avgChunkSize, int minChunkSize, int maxChunkSize, int slidingWinSize)
 {
     chunkerType_ = chunkerType;
+    valid_ = true;
+    powerLUT_ = NULL;
+    removeLUT_ = NULL;
 
     if (chunkerType_ == FIX_SIZE_TYPE) { /*fixed-size chunker*/
         avgChunkSize_ = avgChunkSize;
@@ -33,11 +36,13 @@ Chunker::Chunker(bool chunkerType, int avgChunkSize, int minChunkSize, int maxCh
 
         if (minChunkSize >= avgChunkSize) {
             fprintf(stderr, "Error: minChunkSize should be smaller than avgChunkSize!\n");
-            exit(1);
+            valid_ = false;
+            return;
         }
         if (maxChunkSize <= avgChunkSize) {
             fprintf(stderr, "Error: maxChunkSize should be larger than avgChunkSize!\n");
-            exit(1);
+            valid_ = false;
+            return;
         }
         avgChunkSize_ = avgChunkSize;
         minChunkSize_ = minChunkSize;
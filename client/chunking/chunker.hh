@@ -46,6 +46,9 @@ private:
     /*the value for determining an anchor*/
     uint32_t anchorValue_;
 
+    /*whether the chunk sizes are valid*/
+    bool valid_;
+
     /*
     * divide a buffer into a number of fixed-size chunks
     *
@@ -89,6 +92,13 @@ public:
          */
     ~Chunker();
 
+    /*
+    * check if the chunker is constructed with valid chunk sizes
+    *
+    * @return - a boolean value that indicates if the chunker can be used
+    */
+    inline bool isValid() { return valid_; }
+
     /*
     * divide a buffer into a number of chunks
     *
@@ -66,6 +66,7 @@ CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive* cryptoObj)
         /*allocate some space for storing k data blocks to be encoded by Rabin's IDA*/
         erasureCodingDataSize_ = (bytesPerSecretWord_ * (alignedSecretBufferSize_ / (bytesPerSecretWord_ * secretWordsPerGroup_))) * k_;
         erasureCodingData_ = (unsigned char*)malloc(sizeof(unsigned char) * erasureCodingDataSize_);
+        alignedShares_ = (unsigned char*)malloc(sizeof(unsigned char) * erasureCodingDataSize_);
 
         /*initialize the gf_t object using defaults*/
         bitsPerGFWord_ = 8; /*8 bits for the use of GF(256)*/
@@ -86,6 +87,8 @@ CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive* cryptoObj)
         /*allocate two k * k matrices for decoding*/
         squareMatrix_ = (int*)malloc(sizeof(int) * k_ * k_);
         inverseMatrix_ = (int*)malloc(sizeof(int) * k_ * k_);
+        invertedShareIDList_ = (int*)malloc(sizeof(int) * k_);
+        invertedShareIDList_[0] = -1;
 
         fprintf(stderr, "\nA CDCodec based on CRSSS has been constructed! \n");
         fprintf(stderr, "Parameters: \n");
@@ -160,6 +163,7 @@ CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive* cryptoObj)
         /*allocate some space for storing k data blocks to be encoded by systematic Cauchy RS code*/
         erasureCodingDataSize_ = (bytesPerSecretWord_ * (((alignedSecretBufferSize_ / bytesPerSecretWord_) + 1) / k_)) * k_;
         erasureCodingData_ = (unsigned char*)malloc(sizeof(unsigned char) * erasureCodingDataSize_);
+        alignedShares_ = (unsigned char*)malloc(sizeof(unsigned char) * erasureCodingDataSize_);
 
         /*initialize the gf_t object using defaults*/
         bitsPerGFWord_ = 8; /*8 bits for the use of GF(256)*/
@@ -191,6 +195,9 @@ CDCodec::CDCodec(int CDType, int n, int m, int r, CryptoPrimitive* cryptoObj)
         /*allocate two k * k matrices for decoding*/
         squareMatrix_ = (int*)malloc(sizeof(int) * k_ * k_);
         inverseMatrix_ = (int*)malloc(sizeof(int) * k_ * k_);
+        invertedShareIDList_ = (int*)malloc(sizeof(int) * k_);
+        invertedShareIDList_[0] = -1;
+
         if (CDType_ == AONT_RS_TYPE) {
             fprintf(stderr, "\nA CDCodec based on AONT-RS has been constructed! \n");
         }
@@ -232,6 +239,7 @@ CDCodec::~CDCodec()
         free(alignedSecretBuffer_);
 
         free(erasureCodingData_);
+        free(alignedShares_);
 
         /*free the gf_t object*/
         gf_free(&gfObj_, 1);
@@ -240,6 +248,7 @@ CDCodec::~CDCodec()
 
         free(squareMatrix_);
         free(inverseMatrix_);
+        free(invertedShareIDList_);
 
         fprintf(stderr, "\nThe CDCodec based on CRSSS has been destructed! \n");
         fprintf(stderr, "\n");
@@ -259,6 +268,7 @@ CDCodec::~CDCodec()
         }
 
         free(erasureCodingData_);
+        free(alignedShares_);
 
         /*free the gf_t object*/
         gf_free(&gfObj_, 1);
@@ -267,6 +277,7 @@ CDCodec::~CDCodec()
 
         free(squareMatrix_);
         free(inverseMatrix_);
+        free(invertedShareIDList_);
         if (CDType_ == AONT_RS_TYPE) {
             fprintf(stderr, "\nThe CDCodec based on AONT-RS has been destructed! \n");
         }
@@ -280,6 +291,111 @@ CDCodec::~CDCodec()
     }
 }
 
+/*
+ * generate the last m shares from the k data shares using systematic Cauchy RS code
+ *
+ * @param data - a buffer that stores the k data shares
+ * @param parity - a buffer for storing the m parity shares <return>
+ * @param shareSize - the size of each share
+ */
+void CDCodec::parityEncoding(unsigned char* data, unsigned char* parity, int shareSize)
+{
+    int coef;
+    int i, j;
+
+    for (i = 0; i < m_; i++) {
+        for (j = 0; j < k_; j++) {
+            coef = distributionMatrix_[k_ * (k_ + i) + j];
+            if (j == 0) {
+                gfObj_.multiply_region.w32(&gfObj_, data + shareSize * j,
+                    parity + shareSize * i, coef, shareSize, 0);
+            } else {
+                gfObj_.multiply_region.w32(&gfObj_, data + shareSize * j,
+                    parity + shareSize * i, coef, shareSize, 1);
+            }
+        }
+    }
+}
+
+/*
+ * recover the k data shares into erasureCodingData_ from any k shares
+ *
+ * @param shares - pointers to the k shares
+ * @param kShareIDList - a list that stores the IDs of the k shares
+ * @param shareSize - the size of each share
+ *
+ * @return - a boolean value that indicates if the decoding succeeds
+ */
+bool CDCodec::kSharesDecoding(unsigned char** shares, int* kShareIDList, int shareSize)
+{
+    int coef;
+    int i, j;
+
+    /*with a systematic code, the first k shares in order are the data shares themselves*/
+    if (CDType_ != CRSSS_TYPE) {
+        for (i = 0; i < k_; i++) {
+            if (kShareIDList[i] != i) {
+                break;
+            }
+        }
+        if (i == k_) {
+            for (i = 0; i < k_; i++) {
+                memcpy(erasureCodingData_ + shareSize * i, shares[i], shareSize);
+            }
+            return 1;
+        }
+    }
+
+    /*the inverse matrix is kept for the shares it was computed for, as consecutive secrets mostly come from the same shares*/
+    for (i = 0; i < k_; i++) {
+        if (kShareIDList[i] != invertedShareIDList_[i]) {
+            break;
+        }
+    }
+    if (i < k_) {
+        /*store the k rows (corresponding to the k shares) of the distribution matrix into squareMatrix_*/
+        for (i = 0; i < k_; i++) {
+            for (j = 0; j < k_; j++) {
+                squareMatrix_[k_ * i + j] = distributionMatrix_[k_ * kShareIDList[i] + j];
+            }
+        }
+
+        /*invert squareMatrix_ into inverseMatrix_*/
+        if (!squareMatrixInverting()) {
+            fprintf(stderr, "Error: a k * k submatrix of the distribution matrix is noninvertible!\n");
+            invertedShareIDList_[0] = -1;
+
+            return 0;
+        }
+        memcpy(invertedShareIDList_, kShareIDList, sizeof(int) * k_);
+    }
+
+    /*GF region multiplication needs the source and destination aligned alike, so a share received at another alignment is copied first*/
+    unsigned char* alignedShares[k_];
+    for (i = 0; i < k_; i++) {
+        alignedShares[i] = shares[i];
+        if (((uintptr_t)shares[i] % SHARE_ALIGNMENT) != ((uintptr_t)erasureCodingData_ % SHARE_ALIGNMENT)) {
+            alignedShares[i] = alignedShares_ + shareSize * i;
+            memcpy(alignedShares[i], shares[i], shareSize);
+        }
+    }
+
+    for (i = 0; i < k_; i++) {
+        for (j = 0; j < k_; j++) {
+            coef = inverseMatrix_[k_ * i + j];
+            if (j == 0) {
+                gfObj_.multiply_region.w32(&gfObj_, alignedShares[j],
+                    erasureCodingData_ + shareSize * i, coef, shareSize, 0);
+            } else {
+                gfObj_.multiply_region.w32(&gfObj_, alignedShares[j],
+                    erasureCodingData_ + shareSize * i, coef, shareSize, 1);
+            }
+        }
+    }
+
+    return 1;
+}
+
 /*
  * invert the square matrix squareMatrix_ into inverseMatrix_ in GF
  *
@@ -512,7 +628,7 @@ bool CDCodec::crsssEncoding(unsigned char* secretBuffer, int secretSize, unsigne
 /*
  * decode the secret from k = n - m shares using CRSSS
  *
- * @param shareBuffer - a buffer that stores the k shares 
+ * @param shares - pointers to the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share 
  * @param secretSize - the size of the secret
@@ -520,11 +636,10 @@ bool CDCodec::crsssEncoding(unsigned char* secretBuffer, int secretSize, unsigne
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::crsssDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+bool CDCodec::crsssDecoding(unsigned char** shares, int* kShareIDList, int shareSize,
     int secretSize, unsigned char* secretBuffer)
 {
     int numOfGroups, alignedSecretSize;
-    int coef;
     int i, j;
 
     if ((shareSize % bytesPerSecretWord_) != 0) {
@@ -552,32 +667,9 @@ bool CDCodec::crsssDecoding(unsigned char* shareBuffer, int* kShareIDList, int s
         return 0;
     }
 
-    /*store the k rows (corresponding to the k shares) of the distribution matrix into squareMatrix_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            squareMatrix_[k_ * i + j] = distributionMatrix_[k_ * kShareIDList[i] + j];
-        }
-    }
-
-    /*invert squareMatrix_ into inverseMatrix_*/
-    if (!squareMatrixInverting()) {
-        fprintf(stderr, "Error: a k * k submatrix of the distribution matrix is noninvertible!\n");
-
-        return 0;
-    }
-
     /*perform IDA decoding*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = inverseMatrix_[k_ * i + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 1);
-            }
-        }
+    if (!kSharesDecoding(shares, kShareIDList, shareSize)) {
+        return 0;
     }
 
     /*check the integrity of each group of k - r secret words using the corresponding r hashes, and also restore the secret*/
@@ -631,7 +723,7 @@ bool CDCodec::aontRSEncoding(unsigned char* secretBuffer, int secretSize,
 {
     int alignedSecretSize, numOfSecretWords;
     int coef;
-    int i, j;
+    int i;
 
     /*align the secret size into alignedSecretSize*/
     if (((secretSize + bytesPerSecretWord_) % (bytesPerSecretWord_ * k_)) == 0) {
@@ -706,18 +798,7 @@ bool CDCodec::aontRSEncoding(unsigned char* secretBuffer, int secretSize,
     memcpy(shareBuffer, erasureCodingData_, alignedSecretSize + bytesPerSecretWord_);
 
     /*generate only the last m shares from the AONT package*/
-    for (i = 0; i < m_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = distributionMatrix_[k_ * (k_ + i) + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 1);
-            }
-        }
-    }
+    parityEncoding(erasureCodingData_, shareBuffer + (*shareSize) * k_, (*shareSize));
 
     return 1;
 }
@@ -725,7 +806,7 @@ bool CDCodec::aontRSEncoding(unsigned char* secretBuffer, int secretSize,
 /*
  * decode the secret from k = n - m shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
  *
- * @param shareBuffer - a buffer that stores the k shares 
+ * @param shares - pointers to the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share 
  * @param secretSize - the size of the secret
@@ -733,12 +814,12 @@ bool CDCodec::aontRSEncoding(unsigned char* secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::aontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+bool CDCodec::aontRSDecoding(unsigned char** shares, int* kShareIDList, int shareSize,
     int secretSize, unsigned char* secretBuffer)
 {
     int alignedSecretSize, numOfSecretWords;
     int coef;
-    int i, j;
+    int i;
 
     if ((shareSize % bytesPerSecretWord_) != 0) {
         fprintf(stderr, "Error: the share size (i.e. %d bytes) should be a multiple of secret word size (i.e. %d bytes)!\n",
@@ -765,32 +846,9 @@ bool CDCodec::aontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int
         return 0;
     }
 
-    /*store the k rows (corresponding to the k shares) of the distribution matrix into squareMatrix_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            squareMatrix_[k_ * i + j] = distributionMatrix_[k_ * kShareIDList[i] + j];
-        }
-    }
-
-    /*invert squareMatrix_ into inverseMatrix_*/
-    if (!squareMatrixInverting()) {
-        fprintf(stderr, "Error: a k * k submatrix of the distribution matrix is noninvertible!\n");
-
-        return 0;
-    }
-
     /*perform RS decoding and obtain the AONT package in erasureCodingData_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = inverseMatrix_[k_ * i + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 1);
-            }
-        }
+    if (!kSharesDecoding(shares, kShareIDList, shareSize)) {
+        return 0;
     }
 
     /*generate a hash from the first numOfSecretWords AONT words, and temporarily store it into key_*/
@@ -845,7 +903,7 @@ bool CDCodec::caontRSOldEncoding(unsigned char* secretBuffer, int secretSize,
 {
     int alignedSecretSize, numOfSecretWords;
     int coef;
-    int i, j;
+    int i;
 
     /*align the secret size into alignedSecretSize*/
     if (((secretSize + bytesPerSecretWord_) % (bytesPerSecretWord_ * k_)) == 0) {
@@ -921,18 +979,7 @@ bool CDCodec::caontRSOldEncoding(unsigned char* secretBuffer, int secretSize,
     memcpy(shareBuffer, erasureCodingData_, alignedSecretSize + bytesPerSecretWord_);
 
     /*generate only the last m shares from the CAONT package*/
-    for (i = 0; i < m_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = distributionMatrix_[k_ * (k_ + i) + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 1);
-            }
-        }
-    }
+    parityEncoding(erasureCodingData_, shareBuffer + (*shareSize) * k_, (*shareSize));
 
     return 1;
 }
@@ -940,7 +987,7 @@ bool CDCodec::caontRSOldEncoding(unsigned char* secretBuffer, int secretSize,
 /*
  * decode the secret from k = n - m shares using old CAONT-RS (proposed in the HotStorage '14 paper)
  *
- * @param shareBuffer - a buffer that stores the k shares 
+ * @param shares - pointers to the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share 
  * @param secretSize - the size of the secret
@@ -948,12 +995,12 @@ bool CDCodec::caontRSOldEncoding(unsigned char* secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::caontRSOldDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+bool CDCodec::caontRSOldDecoding(unsigned char** shares, int* kShareIDList, int shareSize,
     int secretSize, unsigned char* secretBuffer)
 {
     int alignedSecretSize, numOfSecretWords;
     int coef;
-    int i, j;
+    int i;
 
     if ((shareSize % bytesPerSecretWord_) != 0) {
         fprintf(stderr, "Error: the share size (i.e. %d bytes) should be a multiple of secret word size (i.e. %d bytes)!\n",
@@ -980,32 +1027,9 @@ bool CDCodec::caontRSOldDecoding(unsigned char* shareBuffer, int* kShareIDList,
         return 0;
     }
 
-    /*store the k rows (corresponding to the k shares) of the distribution matrix into squareMatrix_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            squareMatrix_[k_ * i + j] = distributionMatrix_[k_ * kShareIDList[i] + j];
-        }
-    }
-
-    /*invert squareMatrix_ into inverseMatrix_*/
-    if (!squareMatrixInverting()) {
-        fprintf(stderr, "Error: a k * k submatrix of the distribution matrix is noninvertible!\n");
-
-        return 0;
-    }
-
     /*perform RS decoding and obtain the CAONT package in erasureCodingData_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = inverseMatrix_[k_ * i + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 1);
-            }
-        }
+    if (!kSharesDecoding(shares, kShareIDList, shareSize)) {
+        return 0;
     }
 
     /*generate a hash from the first numOfSecretWords CAONT words, and temporarily store it into key_*/
@@ -1060,55 +1084,90 @@ bool CDCodec::caontRSOldDecoding(unsigned char* shareBuffer, int* kShareIDList,
 }
 
 /*
- * encode a secret into n shares using CAONT-RS
+ * get the aligned size of a secret using CAONT-RS
+ *
+ * @param secretSize - the size of the secret
+ *
+ * @return - the aligned secret size (i.e. the CAONT package size minus one word, a multiple of k words)
+ */
+int CDCodec::caontRSAlignedSize(int secretSize)
+{
+    if (((secretSize + bytesPerSecretWord_) % (bytesPerSecretWord_ * k_)) == 0) {
+        return secretSize;
+    }
+
+    return (bytesPerSecretWord_ * k_) * (((secretSize + bytesPerSecretWord_) / (bytesPerSecretWord_ * k_)) + 1) - bytesPerSecretWord_;
+}
+
+/*
+ * copy a secret into alignedSecretBuffer_ and put its hash key into key_ using CAONT-RS
  *
  * @param secretBuffer - a buffer that stores the secret
  * @param secretSize - the size of the secret
- * @param shareBuffer - a buffer for storing the n generated shares <return>
- * @param shareSize - the size of each share <return>
+ * @param key - the hash key of the secret, or NULL for generating it
  *
- * @return - a boolean value that indicates if the encoding succeeds
+ * @return - the aligned secret size, or -1 if the preparation fails
  */
-bool CDCodec::caontRSEncoding(unsigned char* secretBuffer, int secretSize,
-    unsigned char* shareBuffer, int* shareSize)
+int CDCodec::caontRSKeyPreparing(unsigned char* secretBuffer, int secretSize, unsigned char* key)
 {
     int alignedSecretSize;
-    int coef;
-    int i, j;
 
     /*align the secret size into alignedSecretSize*/
-    if (((secretSize + bytesPerSecretWord_) % (bytesPerSecretWord_ * k_)) == 0) {
-        alignedSecretSize = secretSize;
-    } else {
-        alignedSecretSize = (bytesPerSecretWord_ * k_) * (((secretSize + bytesPerSecretWord_) / (bytesPerSecretWord_ * k_)) + 1) - bytesPerSecretWord_;
-    }
+    alignedSecretSize = caontRSAlignedSize(secretSize);
     if (alignedSecretBufferSize_ < alignedSecretSize) {
         fprintf(stderr, "Error: please use an internal alignedSecretBuffer_[] of size >= %d bytes!\n", alignedSecretSize);
 
-        return 0;
+        return -1;
     }
 
-    /*deduce the share size into shareSize*/
-    (*shareSize) = bytesPerSecretWord_ * (((alignedSecretSize / bytesPerSecretWord_) + 1) / k_);
-
     /*copy the secret from secretBuffer to alignedSecretBuffer_*/
     memcpy(alignedSecretBuffer_, secretBuffer, secretSize);
     if (alignedSecretSize != secretSize) {
         memset(alignedSecretBuffer_ + secretSize, 0, alignedSecretSize - secretSize);
     }
 
-    /*Step 1: generate a CAONT package from the secret, and store it into erasureCodingData_*/
+    /*generate a hash key from the aligned secret, unless it is given*/
+    if (key != NULL) {
+        memcpy(key_, key, bytesPerSecretWord_);
+    } else if (!cryptoObj_->generateHash(alignedSecretBuffer_, alignedSecretSize, key_)) {
+        fprintf(stderr, "Error: fail in the hash calculation!\n");
 
-    /*+a) generate the main part of the CAONT package from the secret, and store them into erasureCodingData_*/
+        return -1;
+    }
 
-    /*generate a hash key from the aligned secret*/
+    return alignedSecretSize;
+}
 
-    if (!cryptoObj_->generateHash(alignedSecretBuffer_, alignedSecretSize, key_)) {
-        fprintf(stderr, "Error: fail in the hash calculation!\n");
+/*
+ * encode a secret into n shares using CAONT-RS
+ *
+ * @param secretBuffer - a buffer that stores the secret
+ * @param secretSize - the size of the secret
+ * @param shareBuffer - a buffer for storing the n generated shares <return>
+ * @param shareSize - the size of each share <return>
+ * @param key - the hash key of the secret, or NULL for generating it
+ *
+ * @return - a boolean value that indicates if the encoding succeeds
+ */
+bool CDCodec::caontRSEncoding(unsigned char* secretBuffer, int secretSize,
+    unsigned char* shareBuffer, int* shareSize, unsigned char* key)
+{
+    int alignedSecretSize;
+    int coef;
 
+    /*Step 1: generate a CAONT package from the secret, and store it into erasureCodingData_*/
+
+    /*+a) generate the main part of the CAONT package from the secret, and store them into erasureCodingData_*/
+
+    /*align the secret and get its hash key*/
+    alignedSecretSize = caontRSKeyPreparing(secretBuffer, secretSize, key);
+    if (alignedSecretSize < 0) {
         return 0;
     }
 
+    /*deduce the share size into shareSize*/
+    (*shareSize) = bytesPerSecretWord_ * (((alignedSecretSize / bytesPerSecretWord_) + 1) / k_);
+
     /*encrypt alignedSizeConstant_ of size alignedSecretSize with the hash key, and 
       temporarily store the ciphertext into erasureCodingData_*/
     if (!cryptoObj_->encryptWithKey(alignedSizeConstant_, alignedSecretSize, key_, erasureCodingData_)) {
@@ -1140,18 +1199,7 @@ bool CDCodec::caontRSEncoding(unsigned char* secretBuffer, int secretSize,
     memcpy(shareBuffer, erasureCodingData_, alignedSecretSize + bytesPerSecretWord_);
 
     /*generate only the last m shares from the CAONT package*/
-    for (i = 0; i < m_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = distributionMatrix_[k_ * (k_ + i) + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, erasureCodingData_ + (*shareSize) * j,
-                    shareBuffer + (*shareSize) * (k_ + i), coef, (*shareSize), 1);
-            }
-        }
-    }
+    parityEncoding(erasureCodingData_, shareBuffer + (*shareSize) * k_, (*shareSize));
 
     return 1;
 }
@@ -1159,7 +1207,7 @@ bool CDCodec::caontRSEncoding(unsigned char* secretBuffer, int secretSize,
 /*
  * decode the secret from k = n - m shares using CAONT-RS
  *
- * @param shareBuffer - a buffer that stores the k shares 
+ * @param shares - pointers to the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share 
  * @param secretSize - the size of the secret
@@ -1167,12 +1215,11 @@ bool CDCodec::caontRSEncoding(unsigned char* secretBuffer, int secretSize,
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::caontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+bool CDCodec::caontRSDecoding(unsigned char** shares, int* kShareIDList, int shareSize,
     int secretSize, unsigned char* secretBuffer)
 {
     int alignedSecretSize;
     int coef;
-    int i, j;
 
     if ((shareSize % bytesPerSecretWord_) != 0) {
         fprintf(stderr, "Error: the share size (i.e. %d bytes) should be a multiple of secret word size (i.e. %d bytes)!\n",
@@ -1198,32 +1245,9 @@ bool CDCodec::caontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int
         return 0;
     }
 
-    /*store the k rows (corresponding to the k shares) of the distribution matrix into squareMatrix_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            squareMatrix_[k_ * i + j] = distributionMatrix_[k_ * kShareIDList[i] + j];
-        }
-    }
-
-    /*invert squareMatrix_ into inverseMatrix_*/
-    if (!squareMatrixInverting()) {
-        fprintf(stderr, "Error: a k * k submatrix of the distribution matrix is noninvertible!\n");
-
-        return 0;
-    }
-
     /*perform RS decoding and obtain the CAONT package in erasureCodingData_*/
-    for (i = 0; i < k_; i++) {
-        for (j = 0; j < k_; j++) {
-            coef = inverseMatrix_[k_ * i + j];
-            if (j == 0) {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 0);
-            } else {
-                gfObj_.multiply_region.w32(&gfObj_, shareBuffer + shareSize * j,
-                    erasureCodingData_ + shareSize * i, coef, shareSize, 1);
-            }
-        }
+    if (!kSharesDecoding(shares, kShareIDList, shareSize)) {
+        return 0;
     }
 
     /*generate a hash from the main part of the CAONT package, and temporarily store it into key_*/
@@ -1275,10 +1299,11 @@ bool CDCodec::caontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int
  * @param secretSize - the size of the secret
  * @param shareBuffer - a buffer for storing the n generated shares <return>
  * @param shareSize - the size of each share <return>
+ * @param key - the hash key from generateConvergentKey(), or NULL for generating it (only for CAONT-RS)
  *
  * @return - a boolean value that indicates if the encoding succeeds
  */
-bool CDCodec::encoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize)
+bool CDCodec::encoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize, unsigned char* key)
 {
     bool success = 0;
 
@@ -1295,7 +1320,7 @@ bool CDCodec::encoding(unsigned char* secretBuffer, int secretSize, unsigned cha
     }
 
     if (CDType_ == CAONT_RS_TYPE) { /*CDCodec based on CAONT-RS*/
-        success = caontRSEncoding(secretBuffer, secretSize, shareBuffer, shareSize);
+        success = caontRSEncoding(secretBuffer, secretSize, shareBuffer, shareSize, key);
     }
 
     return success;
@@ -1304,7 +1329,7 @@ bool CDCodec::encoding(unsigned char* secretBuffer, int secretSize, unsigned cha
 /*
  * decode the secret from k = n - m shares
  *
- * @param shareBuffer - a buffer that stores the k shares 
+ * @param shares - pointers to the k shares
  * @param kShareIDList - a list that stores the IDs of the k shares
  * @param shareSize - the size of each share 
  * @param secretSize - the size of the secret
@@ -1312,26 +1337,116 @@ bool CDCodec::encoding(unsigned char* secretBuffer, int secretSize, unsigned cha
  *
  * @return - a boolean value that indicates if the decoding succeeds
  */
-bool CDCodec::decoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+bool CDCodec::decoding(unsigned char** shares, int* kShareIDList, int shareSize,
     int secretSize, unsigned char* secretBuffer)
 {
     bool success = 0;
 
     if (CDType_ == CRSSS_TYPE) { /*CDCodec based on CRSSS*/
-        success = crsssDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = crsssDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == AONT_RS_TYPE) { /*CDCodec based on AONT-RS*/
-        success = aontRSDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = aontRSDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == OLD_CAONT_RS_TYPE) { /*CDCodec based on old CAONT-RS*/
-        success = caontRSOldDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = caontRSOldDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     if (CDType_ == CAONT_RS_TYPE) { /*CDCodec based on CAONT-RS*/
-        success = caontRSDecoding(shareBuffer, kShareIDList, shareSize, secretSize, secretBuffer);
+        success = caontRSDecoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
     }
 
     return success;
 }
+
+/*
+ * decode the secret from k = n - m shares stored one after another
+ *
+ * @param shareBuffer - a buffer that stores the k shares
+ * @param kShareIDList - a list that stores the IDs of the k shares
+ * @param shareSize - the size of each share
+ * @param secretSize - the size of the secret
+ * @param secretBuffer - a buffer for storing the secret <return>
+ *
+ * @return - a boolean value that indicates if the decoding succeeds
+ */
+bool CDCodec::decoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+    int secretSize, unsigned char* secretBuffer)
+{
+    unsigned char* shares[k_];
+
+    for (int i = 0; i < k_; i++) {
+        shares[i] = shareBuffer + shareSize * i;
+    }
+
+    return decoding(shares, kShareIDList, shareSize, secretSize, secretBuffer);
+}
+
+/*
+ * generate the convergent hash key of a secret (only for CAONT-RS)
+ *
+ * the key can be passed to encoding() of the same secret, so that it is not hashed again
+ *
+ * @param secretBuffer - a buffer that stores the secret
+ * @param secretSize - the size of the secret
+ * @param key - a buffer (of at least the hash size) for storing the key <return>
+ *
+ * @return - a boolean value that indicates if the key is generated
+ */
+bool CDCodec::generateConvergentKey(unsigned char* secretBuffer, int secretSize, unsigned char* key)
+{
+    if (CDType_ != CAONT_RS_TYPE) {
+        return 0;
+    }
+
+    if (caontRSKeyPreparing(secretBuffer, secretSize, NULL) < 0) {
+        return 0;
+    }
+    memcpy(key, key_, bytesPerSecretWord_);
+
+    return 1;
+}
+
+/*
+ * get the size of the aligned secret carried by shares of a given size
+ *
+ * @param shareSize - the size of each share
+ *
+ * @return - the aligned secret size (i.e. the maximum secret size that decoding can restore)
+ */
+int CDCodec::getAlignedSecretSize(int shareSize)
+{
+    if (CDType_ == CRSSS_TYPE) {
+        return bytesPerGroup_ * (shareSize / bytesPerSecretWord_);
+    }
+
+    return shareSize * k_ - bytesPerSecretWord_;
+}
+
+/*
+ * get the size of each share generated from a secret of a given size
+ *
+ * @param secretSize - the size of the secret
+ *
+ * @return - the share size (i.e. the shareSize returned by encoding())
+ */
+int CDCodec::getShareSize(int secretSize)
+{
+    int alignedSecretSize;
+
+    if (CDType_ == CRSSS_TYPE) {
+        if ((secretSize % bytesPerGroup_) == 0) {
+            alignedSecretSize = secretSize;
+        } else {
+            alignedSecretSize = bytesPerGroup_ * ((secretSize / bytesPerGroup_) + 1);
+        }
+
+        return bytesPerSecretWord_ * (alignedSecretSize / bytesPerGroup_);
+    }
+
+    alignedSecretSize = caontRSAlignedSize(secretSize);
+
+    return bytesPerSecretWord_ * (((alignedSecretSize / bytesPerSecretWord_) + 1) / k_);
+}
@@ -5,6 +5,7 @@
 #ifndef __CDCODEC_HH__
 #define __CDCODEC_HH__
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,9 @@ extern "C" {
 
 #define MAX_SECRET_SIZE (64 << 10)
 
+/*macro for the alignment that GF region multiplication keeps between source and destination*/
+#define SHARE_ALIGNMENT 16
+
 class CDCodec {
 private:
     /*convergent dispersal type*/
@@ -71,6 +75,9 @@ private:
     int erasureCodingDataSize_;
     unsigned char* erasureCodingData_;
 
+    /*a buffer of the same size for the shares that are not aligned like erasureCodingData_*/
+    unsigned char* alignedShares_;
+
     /*number of bits per GF word*/
     int bitsPerGFWord_;
     /*gf_t object for accelerating GF calculation*/
@@ -83,6 +90,29 @@ private:
     int* squareMatrix_;
     int* inverseMatrix_;
 
+    /*the IDs of the k shares that inverseMatrix_ decodes (the first is -1 if none)*/
+    int* invertedShareIDList_;
+
+    /*
+     * generate the last m shares from the k data shares using systematic Cauchy RS code
+     *
+     * @param data - a buffer that stores the k data shares
+     * @param parity - a buffer for storing the m parity shares <return>
+     * @param shareSize - the size of each share
+     */
+    void parityEncoding(unsigned char* data, unsigned char* parity, int shareSize);
+
+    /*
+     * recover the k data shares into erasureCodingData_ from any k shares
+     *
+     * @param shares - pointers to the k shares
+     * @param kShareIDList - a list that stores the IDs of the k shares
+     * @param shareSize - the size of each share
+     *
+     * @return - a boolean value that indicates if the decoding succeeds
+     */
+    bool kSharesDecoding(unsigned char** shares, int* kShareIDList, int shareSize);
+
     /*
      * invert the square matrix squareMatrix_ into inverseMatrix_ in GF
      *
@@ -105,7 +135,7 @@ private:
     /*
      * decode the secret from k = n - m shares using CRSSS
      *
-     * @param shareBuffer - a buffer that stores the k shares 
+     * @param shares - pointers to the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share 
      * @param secretSize - the size of the secret
@@ -113,7 +143,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool crsssDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
+    bool crsssDecoding(unsigned char** shares, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
 
     /*
      * encode a secret into n shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
@@ -131,7 +161,7 @@ private:
     /*
      * decode the secret from k = n - m shares using AONT-RS (proposed by Jason K. Resch and James S. Plank)
      *
-     * @param shareBuffer - a buffer that stores the k shares 
+     * @param shares - pointers to the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share 
      * @param secretSize - the size of the secret
@@ -139,7 +169,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool aontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize,
+    bool aontRSDecoding(unsigned char** shares, int* kShareIDList, int shareSize,
         int secretSize, unsigned char* secretBuffer);
 
     /*
@@ -157,7 +187,7 @@ private:
     /*
      * decode the secret from k = n - m shares using old CAONT-RS (proposed in the HotStorage '14 paper)
      *
-     * @param shareBuffer - a buffer that stores the k shares 
+     * @param shares - pointers to the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share 
      * @param secretSize - the size of the secret
@@ -165,7 +195,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool caontRSOldDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
+    bool caontRSOldDecoding(unsigned char** shares, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
 
     /*
      * encode a secret into n shares using CAONT-RS
@@ -174,15 +204,36 @@ private:
      * @param secretSize - the size of the secret
      * @param shareBuffer - a buffer for storing the n generated shares <return>
      * @param shareSize - the size of each share <return>
+     * @param key - the hash key of the secret, or NULL for generating it
      *
      * @return - a boolean value that indicates if the encoding succeeds
      */
-    bool caontRSEncoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize);
+    bool caontRSEncoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize, unsigned char* key);
+
+    /*
+     * get the aligned size of a secret using CAONT-RS
+     *
+     * @param secretSize - the size of the secret
+     *
+     * @return - the aligned secret size (i.e. the CAONT package size minus one word, a multiple of k words)
+     */
+    int caontRSAlignedSize(int secretSize);
+
+    /*
+     * copy a secret into alignedSecretBuffer_ and put its hash key into key_ using CAONT-RS
+     *
+     * @param secretBuffer - a buffer that stores the secret
+     * @param secretSize - the size of the secret
+     * @param key - the hash key of the secret, or NULL for generating it
+     *
+     * @return - the aligned secret size, or -1 if the preparation fails
+     */
+    int caontRSKeyPreparing(unsigned char* secretBuffer, int secretSize, unsigned char* key);
 
     /*
      * decode the secret from k = n - m shares using CAONT-RS
      *
-     * @param shareBuffer - a buffer that stores the k shares 
+     * @param shares - pointers to the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share 
      * @param secretSize - the size of the secret
@@ -190,7 +241,7 @@ private:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
-    bool caontRSDecoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
+    bool caontRSDecoding(unsigned char** shares, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
 
 public:
     /*variables for hash generation and data encryption*/
@@ -223,15 +274,16 @@ public:
      * @param secretSize - the size of the secret
      * @param shareBuffer - a buffer for storing the n generated shares <return>
      * @param shareSize - the size of each share <return>
+     * @param key - the hash key from generateConvergentKey(), or NULL for generating it (only for CAONT-RS)
      *
      * @return - a boolean value that indicates if the encoding succeeds
      */
-    bool encoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize);
+    bool encoding(unsigned char* secretBuffer, int secretSize, unsigned char* shareBuffer, int* shareSize, unsigned char* key = NULL);
 
     /*
      * decode the secret from k = n - m shares
      *
-     * @param shareBuffer - a buffer that stores the k shares 
+     * @param shares - pointers to the k shares
      * @param kShareIDList - a list that stores the IDs of the k shares
      * @param shareSize - the size of each share 
      * @param secretSize - the size of the secret
@@ -239,7 +291,51 @@ public:
      *
      * @return - a boolean value that indicates if the decoding succeeds
      */
+    bool decoding(unsigned char** shares, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
+
+    /*
+     * decode the secret from k = n - m shares stored one after another
+     *
+     * @param shareBuffer - a buffer that stores the k shares
+     * @param kShareIDList - a list that stores the IDs of the k shares
+     * @param shareSize - the size of each share
+     * @param secretSize - the size of the secret
+     * @param secretBuffer - a buffer for storing the secret <return>
+     *
+     * @return - a boolean value that indicates if the decoding succeeds
+     */
     bool decoding(unsigned char* shareBuffer, int* kShareIDList, int shareSize, int secretSize, unsigned char* secretBuffer);
+
+    /*
+     * generate the convergent hash key of a secret (only for CAONT-RS)
+     *
+     * the key can be passed to encoding() of the same secret, so that it is not hashed again
+     *
+     * @param secretBuffer - a buffer that stores the secret
+     * @param secretSize - the size of the secret
+     * @param key - a buffer (of at least the hash size) for storing the key <return>
+     *
+     * @return - a boolean value that indicates if the key is generated
+     */
+    bool generateConvergentKey(unsigned char* secretBuffer, int secretSize, unsigned char* key);
+
+    /*
+     * get the size of the aligned secret carried by shares of a given size
+     *
+     * @param shareSize - the size of each share
+     *
+     * @return - the aligned secret size (i.e. the maximum secret size that decoding can restore)
+     */
+    int getAlignedSecretSize(int shareSize);
+
+    /*
+     * get the size of each share generated from a secret of a given size
+     *
+     * @param secretSize - the size of the secret
+     *
+     * @return - the share size (i.e. the shareSize returned by encoding())
+     */
+    int getShareSize(int secretSize);
 };
 
 #endif
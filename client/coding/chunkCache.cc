@@ -0,0 +1,245 @@
+/*
+ * chunkCache.cc
+ */
+
+#include "chunkCache.hh"
+
+/*
+ * constructor of ChunkCache, which locks the cache file and creates it or resets one of another size
+ *
+ * @param path - path of the cache file
+ * @param size - size of the cache in MB, or CHUNK_CACHE_OFF
+ * @param maxSecretSize - the maximum size of a cached secret
+ */
+ChunkCache::ChunkCache(const char* path, int size, int maxSecretSize)
+{
+    fd_ = -1;
+    numOfSlots_ = 0;
+    maxSecretSize_ = maxSecretSize;
+    slotSize_ = sizeof(slotHead_t) + maxSecretSize;
+    pins_ = NULL;
+    hits_ = 0;
+    lookups_ = 0;
+    for (int i = 0; i < CHUNK_CACHE_NUM_LOCKS; i++) {
+        pthread_mutex_init(&locks_[i], NULL);
+    }
+    if (size == CHUNK_CACHE_OFF) {
+        return;
+    }
+    if (size < CHUNK_CACHE_OFF) {
+        fprintf(stderr, "Error: size of the chunk cache should be >= 0, restoring without it!\n");
+        return;
+    }
+
+    long numOfSlots = (long)size * 1024 * 1024 / slotSize_;
+    numOfSlots_ = (numOfSlots < 1) ? 1 : ((numOfSlots > INT_MAX) ? INT_MAX : (int)numOfSlots);
+    fd_ = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd_ < 0) {
+        fprintf(stderr, "Error: fail to open the chunk cache %s (%d), restoring without it!\n", path, errno);
+        return;
+    }
+    if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Error: the chunk cache %s is used by another process, restoring without it!\n", path);
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    /*a cache of another size is emptied, since its slots are mapped differently*/
+    cacheHead_t head;
+    if ((pread(fd_, &head, sizeof(head), 0) != sizeof(head)) || (memcmp(head.magic, CHUNK_CACHE_MAGIC, sizeof(head.magic)) != 0)
+        || (head.slotSize != slotSize_) || (head.numOfSlots != numOfSlots_)) {
+        memcpy(head.magic, CHUNK_CACHE_MAGIC, sizeof(head.magic));
+        head.slotSize = slotSize_;
+        head.numOfSlots = numOfSlots_;
+        /*the slots are left as a hole, which reads as empty*/
+        if ((ftruncate(fd_, 0) != 0) || (ftruncate(fd_, CHUNK_CACHE_HEADER_SIZE + (long)slotSize_ * numOfSlots_) != 0)
+            || (pwrite(fd_, &head, sizeof(head), 0) != sizeof(head))) {
+            fprintf(stderr, "Error: fail to create the chunk cache %s (%d), restoring without it!\n", path, errno);
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+    }
+
+    pins_ = (int*)malloc(sizeof(int) * numOfSlots_);
+    memset(pins_, 0, sizeof(int) * numOfSlots_);
+}
+
+/*
+ * destructor of ChunkCache
+ */
+ChunkCache::~ChunkCache()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    free(pins_);
+    for (int i = 0; i < CHUNK_CACHE_NUM_LOCKS; i++) {
+        pthread_mutex_destroy(&locks_[i]);
+    }
+}
+
+/*
+ * check if the cache is enabled
+ *
+ * @return - a boolean value that indicates if the cache is enabled
+ */
+bool ChunkCache::isEnabled()
+{
+    return fd_ >= 0;
+}
+
+/*
+ * get the slot of a key
+ *
+ * @param key - the key
+ *
+ * @return - the index of the slot
+ */
+int ChunkCache::slot(unsigned char* key)
+{
+    return fpSlot(key, numOfSlots_);
+}
+
+/*
+ * get the checksum of a secret in a slot
+ *
+ * @param key - the key of the secret
+ * @param data - the secret
+ * @param secretSize - the size of the secret
+ *
+ * @return - the checksum
+ */
+unsigned int ChunkCache::checksum(unsigned char* key, unsigned char* data, int secretSize)
+{
+    uLong crc = crc32(0L, key, CHUNK_CACHE_KEY_SIZE);
+    return crc32(crc, data, secretSize);
+}
+
+/*
+ * read the secret in a slot and check it against a key
+ *
+ * @param index - the index of the slot
+ * @param key - the key
+ * @param secretSize - the size of the secret
+ * @param data - a buffer of secretSize bytes for the secret <return>
+ *
+ * @return - a boolean value that indicates if the slot holds the secret
+ */
+bool ChunkCache::readSlot(int index, unsigned char* key, int secretSize, unsigned char* data)
+{
+    slotHead_t head;
+    long offset = CHUNK_CACHE_HEADER_SIZE + (long)slotSize_ * index;
+
+    if ((pread(fd_, &head, sizeof(head), offset) != sizeof(head)) || (head.secretSize != secretSize)
+        || (memcmp(head.key, key, CHUNK_CACHE_KEY_SIZE) != 0)) {
+        return false;
+    }
+    if (pread(fd_, data, secretSize, offset + sizeof(head)) != secretSize) {
+        return false;
+    }
+    return head.checksum == checksum(key, data, secretSize);
+}
+
+/*
+ * look up a secret, and pin its slot if it is cached
+ *
+ * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+ * @param secretSize - the size of the secret
+ *
+ * @return - a boolean value that indicates if the secret is cached (and pinned)
+ */
+bool ChunkCache::lookup(unsigned char* key, int secretSize)
+{
+    if ((fd_ < 0) || (secretSize <= 0) || (secretSize > maxSecretSize_)) {
+        return false;
+    }
+
+    /*the whole secret is checked, so a pinned slot is only missing if another process replaced it*/
+    unsigned char data[secretSize];
+    int index = slot(key);
+    pthread_mutex_t* lock = &locks_[index % CHUNK_CACHE_NUM_LOCKS];
+    pthread_mutex_lock(lock);
+    bool hit = readSlot(index, key, secretSize, data);
+    if (hit) {
+        pins_[index]++;
+    }
+    pthread_mutex_unlock(lock);
+
+    __sync_add_and_fetch(&lookups_, 1);
+    if (hit) {
+        __sync_add_and_fetch(&hits_, 1);
+    }
+    return hit;
+}
+
+/*
+ * read a secret found by lookup
+ *
+ * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+ * @param secretSize - the size of the secret
+ * @param data - a buffer of secretSize bytes for the secret <return>
+ *
+ * @return - a boolean value that indicates if the secret is read
+ */
+bool ChunkCache::read(unsigned char* key, int secretSize, unsigned char* data)
+{
+    if ((fd_ < 0) || (secretSize <= 0) || (secretSize > maxSecretSize_)) {
+        return false;
+    }
+
+    /*the slot is pinned, so it is not written by this process while it is read*/
+    return readSlot(slot(key), key, secretSize, data);
+}
+
+/*
+ * unpin the slot of a secret found by lookup
+ *
+ * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+ */
+void ChunkCache::release(unsigned char* key)
+{
+    if (fd_ < 0) {
+        return;
+    }
+
+    int index = slot(key);
+    pthread_mutex_t* lock = &locks_[index % CHUNK_CACHE_NUM_LOCKS];
+    pthread_mutex_lock(lock);
+    if (pins_[index] > 0) {
+        pins_[index]--;
+    }
+    pthread_mutex_unlock(lock);
+}
+
+/*
+ * insert a decoded secret, unless its slot is pinned
+ *
+ * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+ * @param data - the secret
+ * @param secretSize - the size of the secret
+ */
+void ChunkCache::insert(unsigned char* key, unsigned char* data, int secretSize)
+{
+    if ((fd_ < 0) || (secretSize <= 0) || (secretSize > maxSecretSize_)) {
+        return;
+    }
+
+    /*the header and the secret go in one write, so a reader sees either a whole slot or a bad checksum*/
+    unsigned char buffer[sizeof(slotHead_t) + secretSize];
+    slotHead_t* head = (slotHead_t*)buffer;
+    memcpy(head->key, key, CHUNK_CACHE_KEY_SIZE);
+    head->secretSize = secretSize;
+    head->checksum = checksum(key, data, secretSize);
+    memcpy(buffer + sizeof(slotHead_t), data, secretSize);
+
+    int index = slot(key);
+    pthread_mutex_t* lock = &locks_[index % CHUNK_CACHE_NUM_LOCKS];
+    pthread_mutex_lock(lock);
+    if ((pins_[index] == 0)
+        && (pwrite(fd_, buffer, sizeof(buffer), CHUNK_CACHE_HEADER_SIZE + (long)slotSize_ * index) != (ssize_t)sizeof(buffer))) {
+        fprintf(stderr, "Error: fail to write the chunk cache (%d)!\n", errno);
+    }
+    pthread_mutex_unlock(lock);
+}
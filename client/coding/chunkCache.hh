@@ -0,0 +1,177 @@
+/*
+ * chunkCache.hh
+ */
+
+#ifndef __CHUNKCACHE_HH__
+#define __CHUNKCACHE_HH__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "fpSet.hh"
+
+/*size of a key in the cache (the fingerprint of the first share of a secret)*/
+#define CHUNK_CACHE_KEY_SIZE 32
+
+/*size of the file header, the slots start after it*/
+#define CHUNK_CACHE_HEADER_SIZE 4096
+
+/*number of locks the slots are spread over*/
+#define CHUNK_CACHE_NUM_LOCKS 64
+
+/*magic number at the start of a cache file*/
+#define CHUNK_CACHE_MAGIC "MDCHUNK1"
+
+/*macro for disabling the cache*/
+#define CHUNK_CACHE_OFF 0
+
+/*
+ * bounded on-disk cache of decoded secrets, keyed by the fingerprint of their first share
+ *
+ * the shares of a secret are deterministic (CAONT-RS), so a secret shared by several
+ * versions of a file has the same key in each of them and is restored from the cache
+ * instead of being downloaded and decoded again. the cache file is direct mapped with a
+ * slot of the maximum secret size per entry (a colliding secret replaces the old entry),
+ * so its size is fixed when it is created. each slot is checked with a checksum, so a
+ * slot torn by a crash is a miss; a slot that a restore is about to read is pinned, so the
+ * restores of this process do not replace it. the pins are not shared between processes,
+ * so the file is locked by one process at a time and the others restore without a cache
+ */
+class ChunkCache {
+private:
+    /*header of the cache file*/
+    typedef struct {
+        char magic[8];
+        int slotSize;
+        int numOfSlots;
+    } cacheHead_t;
+
+    /*header of a slot, followed by the secret*/
+    typedef struct {
+        unsigned char key[CHUNK_CACHE_KEY_SIZE];
+        int secretSize;
+        unsigned int checksum;
+    } slotHead_t;
+
+    /*descriptor of the cache file, -1 for disabled*/
+    int fd_;
+
+    /*number of slots*/
+    int numOfSlots_;
+
+    /*size of a slot, and the maximum size of a secret in it*/
+    int slotSize_;
+    int maxSecretSize_;
+
+    /*number of restores about to read each slot*/
+    int* pins_;
+
+    /*locks of the slots, so that a slot is not replaced between its lookup and its pin*/
+    pthread_mutex_t locks_[CHUNK_CACHE_NUM_LOCKS];
+
+    /*
+     * get the slot of a key
+     *
+     * @param key - the key
+     *
+     * @return - the index of the slot
+     */
+    int slot(unsigned char* key);
+
+    /*
+     * get the checksum of a secret in a slot
+     *
+     * @param key - the key of the secret
+     * @param data - the secret
+     * @param secretSize - the size of the secret
+     *
+     * @return - the checksum
+     */
+    unsigned int checksum(unsigned char* key, unsigned char* data, int secretSize);
+
+    /*
+     * read the secret in a slot and check it against a key
+     *
+     * @param index - the index of the slot
+     * @param key - the key
+     * @param secretSize - the size of the secret
+     * @param data - a buffer of secretSize bytes for the secret <return>
+     *
+     * @return - a boolean value that indicates if the slot holds the secret
+     */
+    bool readSlot(int index, unsigned char* key, int secretSize, unsigned char* data);
+
+public:
+    /*number of hits and lookups*/
+    long long hits_;
+    long long lookups_;
+
+    /*
+     * constructor of ChunkCache, which locks the cache file and creates it or resets one of another size
+     *
+     * @param path - path of the cache file
+     * @param size - size of the cache in MB, or CHUNK_CACHE_OFF
+     * @param maxSecretSize - the maximum size of a cached secret
+     */
+    ChunkCache(const char* path, int size, int maxSecretSize);
+
+    /*
+     * destructor of ChunkCache
+     */
+    ~ChunkCache();
+
+    /*
+     * check if the cache is enabled
+     *
+     * @return - a boolean value that indicates if the cache is enabled
+     */
+    bool isEnabled();
+
+    /*
+     * look up a secret, and pin its slot if it is cached
+     *
+     * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+     * @param secretSize - the size of the secret
+     *
+     * @return - a boolean value that indicates if the secret is cached (and pinned)
+     */
+    bool lookup(unsigned char* key, int secretSize);
+
+    /*
+     * read a secret found by lookup
+     *
+     * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+     * @param secretSize - the size of the secret
+     * @param data - a buffer of secretSize bytes for the secret <return>
+     *
+     * @return - a boolean value that indicates if the secret is read
+     */
+    bool read(unsigned char* key, int secretSize, unsigned char* data);
+
+    /*
+     * unpin the slot of a secret found by lookup
+     *
+     * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+     */
+    void release(unsigned char* key);
+
+    /*
+     * insert a decoded secret, unless its slot is pinned
+     *
+     * @param key - the key of the secret (CHUNK_CACHE_KEY_SIZE bytes)
+     * @param data - the secret
+     * @param secretSize - the size of the secret
+     */
+    void insert(unsigned char* key, unsigned char* data, int secretSize);
+};
+
+#endif
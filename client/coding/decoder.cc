@@ -17,7 +17,21 @@ void* Decoder::thread_handler(void* param)
     int index = ((param_decoder*)param)->index;
     Decoder* obj = ((param_decoder*)param)->obj;
     free(param);
-    int i = 0;
+    long i = 0;
+
+    /* buffer for the aligned form of a compressed secret, grown on demand */
+    Compressor decompressObj;
+    unsigned char* compressBuffer = NULL;
+    int compressBufferSize = 0;
+    int alignedSecretSize;
+
+    /* buffer of a secret written into the file by this thread, grown on demand */
+    char* secretBuffer = NULL;
+    int secretBufferSize = 0;
+
+    /* share IDs of the secret being decoded */
+    int* shareIDList = (int*)malloc(sizeof(int) * obj->n_);
+    int* kShareIDList;
 
     /* main loop for decode shares into secret */
     while (true) {
@@ -26,10 +40,96 @@ void* Decoder::thread_handler(void* param)
 
         /* get share objects */
         obj->inputbuffer_[index]->Extract(&temp);
+        /* a share without data that is neither a zero nor a cached secret stops the thread */
+        if ((temp.shares[0] == NULL) && !temp.zero && !temp.cached) {
+            break;
+        }
 
-        /* decode shares */
-        input.secretSize = temp.secretSize;
-        obj->decodeObj_[index]->decoding((unsigned char*)temp.data, obj->kShareIDList_, temp.shareSize, temp.secretSize, (unsigned char*)input.data);
+        kShareIDList = obj->kShareIDList_;
+        if (temp.shareMask != 0) {
+            int count = 0;
+            for (int j = 0; j < obj->n_; j++) {
+                if (temp.shareMask & (1 << j)) {
+                    shareIDList[count++] = j;
+                }
+            }
+            kShareIDList = shareIDList;
+        }
+
+        /* decode shares (a zero secret has nothing to decode, it is left as a hole) */
+        input.zero = temp.zero;
+        input.data = NULL;
+        input.secretSize = (temp.secretSize < 0) ? -temp.secretSize : temp.secretSize;
+
+        /* only the part of the secret within the restored range is output */
+        long start = (temp.offset > obj->rangeStart_) ? temp.offset : obj->rangeStart_;
+        long end = temp.offset + input.secretSize;
+        if (end > obj->rangeEnd_) {
+            end = obj->rangeEnd_;
+        }
+        int skip = (int)(start - temp.offset);
+        int length = (end > start) ? (int)(end - start) : 0;
+        if (temp.zero) {
+            input.secretSize = length;
+        } else {
+            /* a seekable file takes the secret at its offset right away, a pipe gets it through the collect thread */
+            char* output;
+            if (obj->seekable_) {
+                if (secretBufferSize < input.secretSize) {
+                    secretBufferSize = input.secretSize;
+                    secretBuffer = (char*)realloc(secretBuffer, sizeof(char) * secretBufferSize);
+                }
+                output = secretBuffer;
+            } else {
+                output = (char*)malloc(sizeof(char) * input.secretSize);
+                input.data = output;
+            }
+
+            /* a secret that is not restored fails the file, and none of its stale bytes are output or cached */
+            bool restored = true;
+            if (temp.cached) {
+                /* a cached secret is pinned until the restore ends, so it is only gone if its slot is damaged */
+                if (!obj->chunkCacheObj_->read(temp.key, input.secretSize, (unsigned char*)output)) {
+                    fprintf(stderr, "Error: cached secret %d is lost during the restore!\n", temp.secretID);
+                    restored = false;
+                }
+            } else if (temp.secretSize < 0) {
+                /* compressed secret: restore the whole aligned secret, then inflate it */
+                int restoredSize;
+                alignedSecretSize = obj->decodeObj_[index]->getAlignedSecretSize(temp.shareSize);
+                if (compressBufferSize < alignedSecretSize) {
+                    compressBufferSize = alignedSecretSize;
+                    compressBuffer = (unsigned char*)realloc(compressBuffer, sizeof(unsigned char) * compressBufferSize);
+                }
+                if (!obj->decodeObj_[index]->decoding((unsigned char**)temp.shares, kShareIDList, temp.shareSize, alignedSecretSize, compressBuffer)
+                    || !decompressObj.decompress(compressBuffer, alignedSecretSize, (unsigned char*)output, input.secretSize, &restoredSize)
+                    || (restoredSize != input.secretSize)) {
+                    fprintf(stderr, "Error: fail to restore compressed secret %d!\n", temp.secretID);
+                    restored = false;
+                }
+            } else if (!obj->decodeObj_[index]->decoding((unsigned char**)temp.shares, kShareIDList, temp.shareSize, temp.secretSize, (unsigned char*)output)) {
+                fprintf(stderr, "Error: fail to restore secret %d!\n", temp.secretID);
+                restored = false;
+            }
+            if (!restored) {
+                obj->failed_ = true;
+                length = 0;
+            } else if (!temp.cached && (obj->chunkCacheObj_ != NULL)) {
+                obj->chunkCacheObj_->insert(temp.key, (unsigned char*)output, input.secretSize);
+            }
+
+            if (obj->seekable_) {
+                obj->writeSecret(output + skip, length, start - obj->rangeStart_);
+            } else if (skip > 0) {
+                memmove(output, output + skip, length);
+            }
+            input.secretSize = length;
+
+            /* the shares are no longer needed, so their receive buffers can be reused */
+            for (int j = 0; !temp.cached && (j < obj->k_); j++) {
+                sharedBufferRelease(temp.buffers[j]);
+            }
+        }
 
         /* add secret into output buffer */
         obj->outputbuffer_[index]->Insert(&input, sizeof(input));
@@ -38,20 +138,49 @@ void* Decoder::thread_handler(void* param)
             break;
         }
     }
+    free(compressBuffer);
+    free(secretBuffer);
+    free(shareIDList);
     return NULL;
 }
 
+/*
+ * write a decoded secret into the file at its offset
+ *
+ * @param data - the secret
+ * @param size - the size of the secret
+ * @param offset - the offset of the secret from the start of the file
+ */
+void Decoder::writeSecret(char* data, int size, long offset)
+{
+    long written = 0;
+    while (written < size) {
+        ssize_t ret = pwrite(fd_, data + written, size - written, baseOffset_ + offset + written);
+        if (ret <= 0) {
+            if ((ret < 0) && (errno == EINTR)) {
+                continue;
+            }
+            fprintf(stderr, "Error: fail to write the restored file at offset %ld (%d)!\n", offset + written, errno);
+            failed_ = true;
+            return;
+        }
+        written += ret;
+    }
+}
+
 /*
  * collect thread for sequencially get secrets
  *
+ * secrets come back in the order they were added; in a pipe they are written in that order,
+ * while in a seekable file the decoding threads already wrote them and they are only counted
  */
 void* Decoder::collect(void* param)
 {
 
     /* parse parameters */
-    char* buf = (char*)malloc(FWRITE_BUFFER_SIZE);
     Decoder* obj = (Decoder*)param;
-    int count = 0;
+    char* buf = (char*)malloc(obj->writeBufferSize_);
+    long count = 0;
     int i;
     int out_index = 0;
 
@@ -59,21 +188,39 @@ void* Decoder::collect(void* param)
     while (true) {
 
         /* according to thread sequence */
-        for (i = 0; i < DECODE_NUM_THREADS; i++) {
+        for (i = 0; i < obj->numOfThreads_; i++) {
             Secret_t temp;
 
             /* extract secret object */
             obj->outputbuffer_[i]->Extract(&temp);
 
-            /* if write buffer full then write to file */
-            if (out_index + temp.secretSize > FWRITE_BUFFER_SIZE) {
-                fwrite(buf, out_index, 1, obj->fw_);
-                out_index = 0;
-            }
+            if (obj->seekable_) {
+                /* written by the decoding thread, or a hole */
+            } else if (temp.zero) {
+                /* a pipe cannot have holes, so the zero bytes go through the write buffer */
+                int left = temp.secretSize;
+                while (left > 0) {
+                    if (out_index == obj->writeBufferSize_) {
+                        fwrite(buf, out_index, 1, obj->fw_);
+                        out_index = 0;
+                    }
+                    int len = (left < obj->writeBufferSize_ - out_index) ? left : obj->writeBufferSize_ - out_index;
+                    memset(buf + out_index, 0, len);
+                    out_index += len;
+                    left -= len;
+                }
+            } else {
+                /* if write buffer full then write to file */
+                if (out_index + temp.secretSize > obj->writeBufferSize_) {
+                    fwrite(buf, out_index, 1, obj->fw_);
+                    out_index = 0;
+                }
 
-            /* copy secret to write buffer */
-            memcpy(buf + out_index, temp.data, temp.secretSize);
-            out_index += temp.secretSize;
+                /* copy secret to write buffer */
+                memcpy(buf + out_index, temp.data, temp.secretSize);
+                out_index += temp.secretSize;
+                free(temp.data);
+            }
 
             /* if this is the last secret, write to file and  exit the collect */
             count++;
@@ -82,6 +229,11 @@ void* Decoder::collect(void* param)
                 if (out_index > 0) {
                     fwrite(buf, out_index, 1, obj->fw_);
                 }
+                /* holes are not allocated by writing, so the file is set to the end of its secrets */
+                long size = ((obj->nextOffset_ < obj->rangeEnd_) ? obj->nextOffset_ : obj->rangeEnd_) - obj->rangeStart_;
+                if (obj->seekable_ && (ftruncate(obj->fd_, obj->baseOffset_ + ((size > 0) ? size : 0)) != 0)) {
+                    fprintf(stderr, "Error: fail to set the size of the restored file!\n");
+                }
                 free(buf);
                 return NULL;
             }
@@ -98,19 +250,43 @@ void* Decoder::collect(void* param)
  * @param m - reliability degree
  * @param r - confidentiality degree
  * @param securetype - encryption and hash type
+ * @param writeBufferSize - size of the buffer for writing the restored file into a pipe
+ * @param numOfThreads - number of decoder threads (0 for one per online core)
  */
-Decoder::Decoder(int type, int n, int m, int r, int securetype)
+Decoder::Decoder(int type, int n, int m, int r, int securetype, int writeBufferSize, int numOfThreads)
 {
     int i;
     n_ = n;
+    k_ = n - m;
+    writeBufferSize_ = writeBufferSize;
+    seekable_ = true;
+    fd_ = -1;
+    baseOffset_ = 0;
+    failed_ = false;
+    addCount_ = 0;
+    nextOffset_ = 0;
+    rangeStart_ = 0;
+    rangeEnd_ = LONG_MAX;
+    chunkCacheObj_ = NULL;
+
+    /* decoding is the costly part of a restore, so it gets every core unless told otherwise */
+    numOfThreads_ = (numOfThreads > 0) ? numOfThreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numOfThreads_ < 1) {
+        numOfThreads_ = 1;
+    }
+    if (numOfThreads_ > DECODE_MAX_THREADS) {
+        numOfThreads_ = DECODE_MAX_THREADS;
+    }
 
     /* initialization */
-    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*) * n_);
-    inputbuffer_ = (RingBuffer<ShareChunk_t>**)malloc(sizeof(RingBuffer<ShareChunk_t>*) * DECODE_NUM_THREADS);
-    outputbuffer_ = (RingBuffer<Secret_t>**)malloc(sizeof(RingBuffer<Secret_t>*) * DECODE_NUM_THREADS);
+    tid_ = (pthread_t*)malloc(sizeof(pthread_t) * (numOfThreads_ + 1));
+    cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*) * numOfThreads_);
+    decodeObj_ = (CDCodec**)malloc(sizeof(CDCodec*) * numOfThreads_);
+    inputbuffer_ = (RingBuffer<ShareChunk_t>**)malloc(sizeof(RingBuffer<ShareChunk_t>*) * numOfThreads_);
+    outputbuffer_ = (RingBuffer<Secret_t>**)malloc(sizeof(RingBuffer<Secret_t>*) * numOfThreads_);
 
     /* initialization for variables of each thread */
-    for (i = 0; i < DECODE_NUM_THREADS; i++) {
+    for (i = 0; i < numOfThreads_; i++) {
         inputbuffer_[i] = new RingBuffer<ShareChunk_t>(DECODE_RB_SIZE, true, 1);
         outputbuffer_[i] = new RingBuffer<Secret_t>(DECODE_RB_SIZE, true, 1);
         cryptoObj_[i] = new CryptoPrimitive(securetype);
@@ -124,16 +300,33 @@ Decoder::Decoder(int type, int n, int m, int r, int securetype)
     }
 
     /* create collect thread */
-    pthread_create(&tid_[DECODE_NUM_THREADS], 0, &collect, (void*)this);
+    pthread_create(&tid_[numOfThreads_], 0, &collect, (void*)this);
 }
 
 /* 
  * test whether the decode thread returned
+ *
+ * @return - 1 if every secret is restored, 0 if a secret could not be restored
  */
 int Decoder::indicateEnd()
 {
-    pthread_join(tid_[DECODE_NUM_THREADS], NULL);
-    return 1;
+    pthread_join(tid_[numOfThreads_], NULL);
+
+    /* the decoding threads wait on their input buffers, so they are stopped before the buffers are deleted */
+    ShareChunk_t stop;
+    stop.shares[0] = NULL;
+    stop.secretSize = 0;
+    stop.shareSize = 0;
+    stop.secretID = 0;
+    stop.zero = 0;
+    stop.cached = 0;
+    stop.shareMask = 0;
+    stop.offset = 0;
+    for (int i = 0; i < numOfThreads_; i++) {
+        inputbuffer_[i]->Insert(&stop, sizeof(stop));
+        pthread_join(tid_[i], NULL);
+    }
+    return failed_ ? 0 : 1;
 }
 
 /*
@@ -141,7 +334,7 @@ int Decoder::indicateEnd()
  */
 Decoder::~Decoder()
 {
-    for (int i = 0; i < DECODE_NUM_THREADS; i++) {
+    for (int i = 0; i < numOfThreads_; i++) {
         delete (decodeObj_[i]);
         delete (cryptoObj_[i]);
         delete (inputbuffer_[i]);
@@ -149,22 +342,42 @@ Decoder::~Decoder()
     }
     free(inputbuffer_);
     free(outputbuffer_);
+    free(decodeObj_);
     free(cryptoObj_);
+    free(tid_);
 }
 
 /*
  * add interface for add item into decode input buffer
  *
- * @param item - the input object
- * @param index - the index of thread
+ * @param item - the input object, whose secret follows the one added before it in the file
  *
  */
-int Decoder::add(ShareChunk_t* item, int index)
+int Decoder::add(ShareChunk_t* item)
 {
-    inputbuffer_[index]->Insert(item, sizeof(ShareChunk_t));
+    item->offset = nextOffset_;
+    nextOffset_ += (item->secretSize < 0) ? -item->secretSize : item->secretSize;
+    inputbuffer_[addCount_ % numOfThreads_]->Insert(item, sizeof(ShareChunk_t));
+    addCount_++;
     return 1;
 }
 
+/*
+ * add an empty zero secret, which stops the decoder of a file that has no more secrets to add
+ */
+int Decoder::addEnd()
+{
+    ShareChunk_t end;
+    end.shares[0] = NULL;
+    end.secretSize = 0;
+    end.shareSize = 0;
+    end.secretID = 0;
+    end.zero = 1;
+    end.cached = 0;
+    end.shareMask = 0;
+    return add(&end);
+}
+
 /*
  * set the file pointer
  *
@@ -173,6 +386,65 @@ int Decoder::add(ShareChunk_t* item, int index)
 int Decoder::setFilePointer(FILE* fp)
 {
     fw_ = fp;
+    seekable_ = (fseek(fp, 0, SEEK_CUR) == 0);
+    if (seekable_) {
+        /* the secrets bypass the stream, so anything it buffered goes first */
+        fflush(fp);
+        fd_ = fileno(fp);
+        baseOffset_ = ftell(fp);
+    }
+    return 1;
+}
+
+/*
+ * set the size of the restored file
+ *
+ * @param fileSize - the size of the file
+ */
+int Decoder::setFileSize(long fileSize)
+{
+    /* the extent is set once, so the decoder threads never extend the file while writing at their offsets */
+    long size = ((fileSize < rangeEnd_) ? fileSize : rangeEnd_) - rangeStart_;
+    if (seekable_ && (size > 0) && (ftruncate(fd_, baseOffset_ + size) != 0)) {
+        fprintf(stderr, "Error: fail to allocate %ld bytes for the restored file!\n", size);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * restore only a byte range of the file, the bytes of the secrets outside it are dropped
+ *
+ * @param offset - the offset of the range in the original file
+ * @param length - the length of the range
+ */
+int Decoder::setRange(long offset, long length)
+{
+    rangeStart_ = offset;
+    rangeEnd_ = (length > LONG_MAX - offset) ? LONG_MAX : offset + length;
+    nextOffset_ = offset;
+    return 1;
+}
+
+/*
+ * set the offset in the original file of the next secret added, when the secrets before it are left out
+ *
+ * @param offset - the offset of the secret
+ */
+int Decoder::setNextOffset(long offset)
+{
+    nextOffset_ = offset;
+    return 1;
+}
+
+/*
+ * set the cache of decoded secrets
+ *
+ * @param cache - the cache (NULL for none)
+ */
+int Decoder::setChunkCache(ChunkCache* cache)
+{
+    chunkCacheObj_ = cache;
     return 1;
 }
 
@@ -193,7 +465,7 @@ int Decoder::setShareIDList(int* list)
  * @param n - the total number of secrets in the file
  *
  */
-int Decoder::setTotal(int totalSecrets)
+int Decoder::setTotal(long totalSecrets)
 {
     totalSecrets_ = totalSecrets;
     return 1;
@@ -8,18 +8,21 @@
 #include "BasicRingBuffer.hh"
 #include "CDCodec.hh"
 #include "CryptoPrimitive.hh"
+#include "chunkCache.hh"
+#include "compressor.hh"
+#include "sharedBuffer.hh"
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 
-/* num of decoder threads */
-#define DECODE_NUM_THREADS 2
+/* max num of decoder threads */
+#define DECODE_MAX_THREADS 64
 
-/* ringbuffer size */
-#define DECODE_RB_SIZE (2)
+/* max num of shares of a secret */
+#define DECODE_MAX_SHARES 16
 
-/* max secret size */
-#define SECRET_SIZE (16 * 1024)
-
-/* max share buffer size */
-#define SHARE_BUFFER_SIZE (4 * 16 * 1024)
+/* ringbuffer size of each decoder thread */
+#define DECODE_RB_SIZE (16)
 
 /* max write buffer size */
 #define FWRITE_BUFFER_SIZE (4 * 1024 * 1024)
@@ -32,19 +35,41 @@ public:
         Decoder* obj; // decoder object pointer
     } param_decoder;
 
-    /* secret metadata structure */
+    /*
+     * secret metadata structure (a zero secret is a run of secretSize zero bytes without data)
+     *
+     * data is allocated with malloc by the decoding thread and freed by the collect thread;
+     * a secret already written into the file by the decoding thread has no data
+     */
     typedef struct {
-        char data[SECRET_SIZE];
+        char* data;
         int secretSize;
         int secretID;
+        int zero;
     } Secret_t;
 
-    /* share metadata structure */
+    /*
+     * share metadata structure (a negative secretSize marks a compressed secret of size -secretSize)
+     *
+     * shares point to the k shares where they were received, and each holds a reference to its buffer,
+     * which the decoding thread drops; shareMask has a bit set for each cloud the shares come from, in
+     * ascending order, or is 0 for the shares of the k share ID list; offset is the position of the
+     * secret in the file, set by add
+     *
+     * with a chunk cache, key is the key of the secret in it; a cached secret has no shares and is
+     * read from the cache, any other secret is inserted into the cache once it is decoded
+     */
     typedef struct {
-        char data[SHARE_BUFFER_SIZE];
+        char* shares[DECODE_MAX_SHARES];
+        SharedBuffer_t* buffers[DECODE_MAX_SHARES];
         int secretSize;
         int shareSize;
         int secretID;
+        int zero;
+        int cached;
+        int shareMask;
+        long offset;
+        unsigned char key[CHUNK_CACHE_KEY_SIZE];
     } ShareChunk_t;
 
     /* input share buffer */
@@ -53,18 +78,47 @@ public:
     /* output secret buffer */
     RingBuffer<Secret_t>** outputbuffer_;
 
-    /* thread id array */
-    pthread_t tid_[DECODE_NUM_THREADS + 1];
+    /* number of decoder threads */
+    int numOfThreads_;
+
+    /* thread id array (the decoder threads, then the collect thread) */
+    pthread_t* tid_;
+
+    /* number of secrets added, which picks the thread of the next one */
+    long addCount_;
+
+    /* offset of the next secret added in the original file */
+    long nextOffset_;
+
+    /* byte range of the original file that is restored, the output file starts at rangeStart_ */
+    long rangeStart_;
+    long rangeEnd_;
 
     /* total number of secrets */
-    int totalSecrets_;
+    long totalSecrets_;
+
+    /* size of the buffer for writing the restored file */
+    int writeBufferSize_;
 
     /* total number of clouds */
     int n_;
 
+    /* number of shares of a secret */
+    int k_;
+
     /* output file pointer */
     FILE* fw_;
 
+    /* whether the output file can seek over zero secrets (not a pipe), in which case the decoder threads write into it directly */
+    bool seekable_;
+
+    /* descriptor and starting offset of a seekable output file */
+    int fd_;
+    long baseOffset_;
+
+    /* whether a secret could not be restored, in which case the restored file is not valid */
+    volatile bool failed_;
+
     /* share ID list pointer */
     int* kShareIDList_;
 
@@ -72,7 +126,10 @@ public:
     CryptoPrimitive** cryptoObj_;
 
     /* decode object array */
-    CDCodec* decodeObj_[DECODE_NUM_THREADS];
+    CDCodec** decodeObj_;
+
+    /* cache of decoded secrets (NULL for none) */
+    ChunkCache* chunkCacheObj_;
 
     /*
      * decoder constructor
@@ -82,12 +139,16 @@ public:
      * @param m - reliability degree
      * @param r - confidentiality degree
      * @param securetype - encryption and hash type
+     * @param writeBufferSize - size of the buffer for writing the restored file into a pipe
+     * @param numOfThreads - number of decoder threads (0 for one per online core)
      */
     Decoder(int type,
         int n,
         int m,
         int r,
-        int securetype);
+        int securetype,
+        int writeBufferSize = FWRITE_BUFFER_SIZE,
+        int numOfThreads = 0);
 
     /*
      * destructor of decoder
@@ -99,7 +160,7 @@ public:
      *
      * @param total - the total number of secrets
      */
-    int setTotal(int totalSecrets);
+    int setTotal(long totalSecrets);
 
     /*
      * set the file output pointer
@@ -108,6 +169,35 @@ public:
      */
     int setFilePointer(FILE* fp);
 
+    /*
+     * set the size of the restored file, which is allocated up front in a seekable file
+     *
+     * @param fileSize - the size of the file
+     */
+    int setFileSize(long fileSize);
+
+    /*
+     * restore only a byte range of the file, the bytes of the secrets outside it are dropped
+     *
+     * @param offset - the offset of the range in the original file
+     * @param length - the length of the range
+     */
+    int setRange(long offset, long length);
+
+    /*
+     * set the offset in the original file of the next secret added, when the secrets before it are left out
+     *
+     * @param offset - the offset of the secret
+     */
+    int setNextOffset(long offset);
+
+    /*
+     * set the cache of decoded secrets
+     *
+     * @param cache - the cache (NULL for none)
+     */
+    int setChunkCache(ChunkCache* cache);
+
     /*
      * set the k shareID list
      *
@@ -116,20 +206,33 @@ public:
     int setShareIDList(int* list);
 
     /*
-     * add a share into particular ringbuffer
+     * add the shares of the next secret of the file, in file order
      *
      * @param item - the share object item
-     * @param index - the index of targeting ringbuffer
      */
-    int add(ShareChunk_t* item, int index);
+    int add(ShareChunk_t* item);
+
+    /*
+     * add an empty zero secret, which stops the decoder of a file that has no more secrets to add
+     */
+    int addEnd();
 
     /*
      * test if it's the end of decoding a file
      *
-     *
+     * @return - 1 if every secret is restored, 0 if a secret could not be restored
      */
     int indicateEnd();
 
+    /*
+     * write a decoded secret into the seekable output file
+     *
+     * @param data - the secret
+     * @param size - the size of the secret
+     * @param offset - the offset of the secret in the file
+     */
+    void writeSecret(char* data, int size, long offset);
+
     /*
      * thread handler for decode shares into secret
      *
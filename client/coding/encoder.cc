@@ -20,6 +20,10 @@ void* Encoder::thread_handler(void* param)
     Encoder* obj = ((param_encoder*)param)->obj;
     free(param);
 
+    /* buffer for the compressed form of a secret */
+    unsigned char* compressBuffer = (unsigned char*)malloc(sizeof(unsigned char) * MAX_SECRET_SIZE);
+    int compressedSize;
+
     /* main loop for getting secrets and encode them into shares*/
     while (true) {
 
@@ -27,6 +31,10 @@ void* Encoder::thread_handler(void* param)
         Secret_Item_t temp;
         ShareChunk_Item_t input;
         obj->inputbuffer_[index]->Extract(&temp);
+        if (temp.type == STOP_OBJECT) {
+            break;
+        }
+        double start = stageTimeNow();
 
         /* get the object type */
         int type = temp.type;
@@ -36,18 +44,59 @@ void* Encoder::thread_handler(void* param)
         if (type == FILE_OBJECT) {
             /* if it's file header */
             memcpy(&input.file_header, &temp.file_header, sizeof(fileHead_t));
+        } else if (temp.secret.zero) {
+
+            /* if it's a zero secret, there is nothing to encode */
+            input.share_chunk.data = NULL;
+            input.share_chunk.shareSize = 0;
+            input.share_chunk.compressed = 0;
+            input.share_chunk.keyed = 0;
+            input.share_chunk.cached = 0;
+            input.share_chunk.zero = 1;
+            input.share_chunk.secretID = temp.secret.secretID;
+            input.share_chunk.secretSize = temp.secret.secretSize;
+            input.share_chunk.end = temp.secret.end;
         } else {
 
-            /* if it's share object */
-            obj->encodeObj_[index]->encoding(temp.secret.data, temp.secret.secretSize, input.share_chunk.data, &(input.share_chunk.shareSize));
+            /* if it's share object, encode its compressed form when that is smaller */
+            unsigned char* secret = temp.secret.data;
+            int secretSize = temp.secret.secretSize;
+            input.share_chunk.compressed = 0;
+            if (obj->compressObj_[index]->compress(temp.secret.data, temp.secret.secretSize, compressBuffer, &compressedSize)) {
+                secret = compressBuffer;
+                secretSize = compressedSize;
+                input.share_chunk.compressed = 1;
+            }
+            input.share_chunk.data = (unsigned char*)malloc(sizeof(unsigned char) * obj->n_ * obj->encodeObj_[index]->getShareSize(secretSize));
+
+            /* reuse the shares of a repeated secret, found by its convergent key */
+            input.share_chunk.keyed = 0;
+            input.share_chunk.cached = 0;
+            if (obj->shareCacheObj_->isEnabled()) {
+                memset(input.share_chunk.key, 0, KEY_SIZE);
+                if (obj->encodeObj_[index]->generateConvergentKey(secret, secretSize, input.share_chunk.key)) {
+                    input.share_chunk.keyed = 1;
+                    input.share_chunk.cached = obj->shareCacheObj_->lookup(input.share_chunk.key, temp.secret.secretSize,
+                        input.share_chunk.compressed, input.share_chunk.data, &(input.share_chunk.shareSize), input.share_chunk.shareFPList);
+                }
+            }
+            if (!input.share_chunk.cached) {
+                obj->encodeObj_[index]->encoding(secret, secretSize, input.share_chunk.data, &(input.share_chunk.shareSize),
+                    input.share_chunk.keyed ? input.share_chunk.key : NULL);
+            }
+            free(temp.secret.data);
+            input.share_chunk.zero = 0;
             input.share_chunk.secretID = temp.secret.secretID;
             input.share_chunk.secretSize = temp.secret.secretSize;
             input.share_chunk.end = temp.secret.end;
         }
 
+        stageStatAdd(&obj->encodeStat_[index], start, (type == FILE_OBJECT) ? 0 : temp.secret.secretSize);
+
         /* add the object to output buffer */
         obj->outputbuffer_[index]->Insert(&input, sizeof(input));
     }
+    free(compressBuffer);
     return NULL;
 }
 
@@ -65,13 +114,9 @@ void* Encoder::collect(void* param)
     Encoder* obj = (Encoder*)param;
     //metadata chunk part
     // init metachunk temp store
-    uint64_t segSizeTemp[obj->n_];
     int metaChunkCounter[obj->n_];
-    int metaChunkID[obj->n_];
     for (int i = 0; i < obj->n_; i++) {
-        segSizeTemp[i] = 0;
         metaChunkCounter[i] = 0;
-        metaChunkID[i] = -1;
     }
     unsigned char** metaChunkBuffer_ = (unsigned char**)malloc(sizeof(unsigned char*) * obj->n_);
     for (int i = 0; i < obj->n_; i++) {
@@ -86,11 +131,27 @@ void* Encoder::collect(void* param)
         ShareChunk_Item_t temp;
         obj->outputbuffer_[nextBufferIndex]->Extract(&temp);
         nextBufferIndex = (nextBufferIndex + 1) % NUM_THREADS;
+        /* the start is moved forward by the time spent waiting on the uploader */
+        double start = stageTimeNow();
+        double addStart;
 
         /* get the object type */
         int type = temp.type;
         Uploader::Item_t input;
 
+        /* without an uploader (encoding benchmark), shares are dropped here */
+        if (obj->uploadObj_ == NULL) {
+            if (type == FILE_OBJECT) {
+                continue;
+            }
+            free(temp.share_chunk.data);
+            stageStatAdd(&obj->collectStat_, start, temp.share_chunk.secretSize);
+            if (temp.share_chunk.end == 1) {
+                break;
+            }
+            continue;
+        }
+
         if (type == FILE_OBJECT) {
             Uploader::ItemMeta_t inputMeta;
             /* if it's file header, directly transform the object to uploader */
@@ -110,30 +171,33 @@ void* Encoder::collect(void* param)
             inputMeta.fileObj.file_header.numOfComingSecrets = 0;
             inputMeta.fileObj.file_header.sizeOfComingSecrets = 0;
 
-            unsigned char tmp[temp.file_header.fullNameSize * 32];
+            /* the name is padded to whole secret words of each of the k data shares, plus one word for the
+               CAONT tail, so a short name takes more than a few bytes per share */
+            unsigned char tmp[obj->n_ * (temp.file_header.fullNameSize + 32 * (obj->n_ + 1))];
             int tmp_s;
 
             //encode pathname into shares for privacy
 
-            obj->encodeObj_[0]->encoding(temp.file_header.data, temp.file_header.fullNameSize, tmp, &(tmp_s));
+            obj->encodeObj_[NUM_THREADS]->encoding(temp.file_header.data, temp.file_header.fullNameSize, tmp, &(tmp_s));
 
             input.fileObj.file_header.fullNameSize = tmp_s;
             inputMeta.fileObj.file_header.fullNameSize = tmp_s;
 
-#ifndef ENCODE_ONLY_MODE
             /* add the object to each cloud's uploader buffer */
             for (int i = 0; i < obj->n_; i++) {
 
-                //copy the corresponding share as file name
+                //copy the corresponding share as file name (freed by the uploader)
+                input.fileObj.data = (unsigned char*)malloc(sizeof(unsigned char) * tmp_s);
+                inputMeta.fileObj.data = (unsigned char*)malloc(sizeof(unsigned char) * tmp_s);
                 memcpy(input.fileObj.data, tmp + i * tmp_s, input.fileObj.file_header.fullNameSize);
                 memcpy(inputMeta.fileObj.data, tmp + i * tmp_s, inputMeta.fileObj.file_header.fullNameSize);
                 obj->uploadObj_->add(&input, sizeof(input), i);
                 obj->uploadObj_->addMeta(&inputMeta, sizeof(inputMeta), i);
             }
-#endif
         } else {
 
             /* if it's share object */
+            unsigned char shareFPList[SHARE_CACHE_MAX_SHARES * HASH_SIZE];
             for (int i = 0; i < obj->n_; i++) {
 
                 input.type = SHARE_OBJECT;
@@ -143,101 +207,129 @@ void* Encoder::collect(void* param)
                 input.shareObj.share_header.secretID = temp.share_chunk.secretID;
                 input.shareObj.share_header.secretSize = temp.share_chunk.secretSize;
                 input.shareObj.share_header.shareSize = shareSize;
-                memcpy(input.shareObj.data, temp.share_chunk.data + (i * shareSize), shareSize);
+                if (temp.share_chunk.zero) {
+                    /* a zero secret has no share, the uploader only accounts for its size */
+                    input.type = ZERO_OBJECT;
+                    input.shareObj.data = NULL;
+                } else {
+                    /* the uploader frees the share after copying it into its container */
+                    input.shareObj.data = (unsigned char*)malloc(sizeof(unsigned char) * shareSize);
+                    memcpy(input.shareObj.data, temp.share_chunk.data + (i * shareSize), shareSize);
+                }
                 /* see if it's the last secret of a file */
                 if (temp.share_chunk.end == 1)
-                    input.type = SHARE_END;
-#ifdef ENCODE_ONLY_MODE
-                if (temp.share_chunk.end == 1)
-                    pthread_exit(NULL);
-#else
+                    input.type = temp.share_chunk.zero ? ZERO_END : SHARE_END;
 
                 //meta chunk maker part -> make different meta chunk for each part of data chunk share
 
                 metaNode metaChunkTemp;
+                /* keep reserved bytes zeroed so that identical metadata chunks stay identical */
+                memset(&metaChunkTemp, 0, sizeof(metaNode));
+                metaChunkTemp.compressed = temp.share_chunk.compressed;
+                metaChunkTemp.zero = temp.share_chunk.zero;
                 metaChunkTemp.secretID = input.shareObj.share_header.secretID;
                 metaChunkTemp.shareSize = input.shareObj.share_header.shareSize;
                 metaChunkTemp.secretSize = input.shareObj.share_header.secretSize;
-                obj->cryptoObj_[NUM_THREADS]->generateHash((unsigned char*)input.shareObj.data, metaChunkTemp.shareSize, metaChunkTemp.shareFP);
+                /* a zero secret keeps the all-zero fingerprint */
+                if (temp.share_chunk.cached) {
+                    memcpy(metaChunkTemp.shareFP, temp.share_chunk.shareFPList + i * HASH_SIZE, HASH_SIZE);
+                } else if (!temp.share_chunk.zero) {
+                    obj->cryptoObj_[NUM_THREADS]->generateHash((unsigned char*)input.shareObj.data, metaChunkTemp.shareSize, metaChunkTemp.shareFP);
+                    memcpy(shareFPList + i * HASH_SIZE, metaChunkTemp.shareFP, HASH_SIZE);
+                }
                 memcpy(input.shareObj.share_header.shareFP, metaChunkTemp.shareFP, HASH_SIZE);
-                segSizeTemp[i] += metaChunkTemp.shareSize;
+                /* a share that would take the segment beyond its maximum size starts a new one */
+                if (obj->segmenterObj_->exceeds(i, metaChunkTemp.shareSize)) {
+                    start += obj->flushMetaChunk(i, metaChunkBuffer_[i], metaChunkCounter[i], false);
+                    metaChunkCounter[i] = 0;
+                    obj->segmenterObj_->endSegment(i, SEGMENT_MAX);
+                }
                 memcpy(metaChunkBuffer_[i] + metaChunkCounter[i] * sizeof(metaChunkTemp), &metaChunkTemp, sizeof(metaChunkTemp));
                 metaChunkCounter[i]++;
 
+                addStart = stageTimeNow();
                 obj->uploadObj_->add(&input, sizeof(input), i);
+                start += stageTimeNow() - addStart;
 
-                // segment function
-                char* buffer = (char*)malloc(sizeof(char) * 32);
-                memset(buffer, 0, 32);
-                memcpy(buffer, metaChunkTemp.shareFP, 32);
-                int metaFP = *(int*)buffer;
-                int rem = metaFP & (DIVISOR - 1);
-                int ret_flag = 0;
-                if (rem == PATTERN) {
-                    ret_flag = 1;
-                }
-                free(buffer);
-
-                if (ret_flag == 1 || segSizeTemp[i] > MAX_SEGMENT_SIZE || input.type == SHARE_END) {
-
-                    Uploader::ItemMeta_t metaChunkUploadObj;
-                    metaChunkUploadObj.type = SHARE_OBJECT;
-                    if (input.type == SHARE_END) {
-                        metaChunkUploadObj.type = SHARE_END;
-                    }
-                    metaChunkUploadObj.shareObj.share_header.secretID = metaChunkID[i];
-                    metaChunkID[i]--;
-                    metaChunkUploadObj.shareObj.share_header.secretSize = metaChunkCounter[i] * sizeof(metaNode);
-                    metaChunkUploadObj.shareObj.share_header.shareSize = metaChunkCounter[i] * sizeof(metaNode);
-                    //encrypt
-                    unsigned char key[KEY_SIZE];
-                    obj->cryptoObj_[NUM_THREADS]->generateHash((unsigned char*)metaChunkBuffer_[i], metaChunkUploadObj.shareObj.share_header.shareSize, key);
-                    unsigned char encOutTemp[metaChunkUploadObj.shareObj.share_header.secretSize];
-                    bool encFlag = obj->cryptoObj_[NUM_THREADS]->encryptWithKey(metaChunkBuffer_[i], metaChunkUploadObj.shareObj.share_header.secretSize, key, encOutTemp);
-                    if (!encFlag) {
-                        printf("error in encrypt first 32B of new metadata chunk id = %d\n", metaChunkUploadObj.shareObj.share_header.secretID);
-                    }
-                    //add to uploader
-                    memcpy(metaChunkUploadObj.shareObj.data, encOutTemp, metaChunkUploadObj.shareObj.share_header.secretSize);
-                    obj->cryptoObj_[NUM_THREADS]->generateHash((unsigned char*)metaChunkUploadObj.shareObj.data, metaChunkUploadObj.shareObj.share_header.shareSize, metaChunkUploadObj.shareObj.share_header.shareFP);
-                    obj->uploadObj_->addMeta(&metaChunkUploadObj, sizeof(metaChunkUploadObj), i);
-                    memset(metaChunkBuffer_[i], 0, SECRET_SIZE);
-                    segSizeTemp[i] = 0;
+                /* end the segment at a content-defined boundary, when the metadata chunk is full, or with the file */
+                int reason = obj->segmenterObj_->add(i, metaChunkTemp.shareFP, metaChunkTemp.shareSize, temp.share_chunk.end == 1);
+                if (reason != SEGMENT_OPEN) {
+                    start += obj->flushMetaChunk(i, metaChunkBuffer_[i], metaChunkCounter[i], temp.share_chunk.end == 1);
                     metaChunkCounter[i] = 0;
-                    // write key recipe
-                    char* buffer = (char*)malloc(sizeof(char) * 32);
-                    memset(buffer, 0, 32);
-                    sprintf(buffer, "share-%d.key", i);
-                    string writeName(buffer);
-                    FILE* fp = fopen(buffer, "ab+");
-                    if (fp == NULL)
-                        printf("can't open key file\n");
-                    fseek(fp, 0, SEEK_END);
-                    fwrite(&metaChunkUploadObj.shareObj.share_header.secretID, sizeof(int), 1, fp);
-                    fwrite(metaChunkUploadObj.shareObj.share_header.shareFP, HASH_SIZE, 1, fp);
-                    fwrite(key, HASH_SIZE, 1, fp);
-                    fclose(fp);
-                    free(buffer);
+                    obj->segmenterObj_->endSegment(i, reason);
                 }
-#endif
+            }
+            /* keep the shares of a newly encoded secret for its repeats */
+            if (temp.share_chunk.keyed && !temp.share_chunk.cached) {
+                obj->shareCacheObj_->insert(temp.share_chunk.key, temp.share_chunk.secretSize, temp.share_chunk.compressed,
+                    temp.share_chunk.data, temp.share_chunk.shareSize, shareFPList);
+            }
+            free(temp.share_chunk.data);
+            stageStatAdd(&obj->collectStat_, start, temp.share_chunk.secretSize);
+            if (temp.share_chunk.end == 1) {
+                break;
             }
         }
     }
     // clean up segment & metachunk maker function param
-    delete metaChunkBuffer_;
     for (int i = 0; i < obj->n_; i++) {
-        delete metaChunkBuffer_[i];
+        free(metaChunkBuffer_[i]);
     }
+    free(metaChunkBuffer_);
     return NULL;
 }
 
+/*
+ * print the statistics of the metadata chunks after the file is collected
+ *
+ * @param duplicates - number of metadata chunks found duplicate by the servers
+ */
+void Encoder::reportSegments(long long duplicates)
+{
+    segmenterObj_->report(sizeof(metaNode));
+    recipeTreeObj_->report(duplicates);
+}
+
+/*
+ * encrypt a metadata chunk, hand it to the uploader and add its key to the metadata tree
+ *
+ * @param index - the cloud index
+ * @param metaChunk - the metadata entries of the segment
+ * @param numOfNodes - the number of metadata entries
+ * @param end - whether this is the last metadata chunk of the file
+ *
+ * @return - the time spent waiting on the uploader
+ */
+double Encoder::flushMetaChunk(int index, unsigned char* metaChunk, int numOfNodes, bool end)
+{
+    long dataSize = 0;
+    for (int i = 0; i < numOfNodes; i++) {
+        dataSize += ((metaNode*)metaChunk)[i].secretSize;
+    }
+
+    double waitTime = recipeTreeObj_->add(index, metaChunk, numOfNodes * sizeof(metaNode), dataSize, end);
+    memset(metaChunk, 0, SECRET_SIZE_META);
+
+    return waitTime;
+}
+
 /*
  * see if it's end of encoding file
  *
+ * @return - a boolean value that indicates if the key recipes of the file are written
  */
-void Encoder::indicateEnd()
+bool Encoder::indicateEnd()
 {
     pthread_join(tid_[NUM_THREADS], NULL);
+
+    /* the encoding threads wait on their input buffers, so they are stopped before the buffers are deleted */
+    Secret_Item_t stop;
+    stop.type = STOP_OBJECT;
+    for (int i = 0; i < NUM_THREADS; i++) {
+        inputbuffer_[i]->Insert(&stop, sizeof(stop));
+        pthread_join(tid_[i], NULL);
+    }
+    return !recipeTreeObj_->hasFailed();
 }
 
 /*
@@ -248,40 +340,85 @@ void Encoder::indicateEnd()
  * @param m - reliability degree
  * @param r - confidentiality degree
  * @param securetype - encryption and hash type
- * @param uploaderObj - pointer link to uploader object
+ * @param uploaderObj - pointer link to uploader object (NULL for dropping the shares after encoding)
+ * @param compressionLevel - deflate level applied to secrets before encoding (COMPRESSION_OFF for disabled)
+ * @param shareCacheSize - number of encoded secrets kept for repeated secrets (SHARE_CACHE_OFF for disabled)
+ * @param queueDepth - depth of the input and output ringbuffers of each thread (0 for RB_SIZE)
+ * @param shareCacheObj - cache kept across encoders (NULL for a cache of shareCacheSize entries of this encoder)
+ * @param minSegmentSize - minimum bytes of shares covered by a metadata chunk
+ * @param avgSegmentSize - average bytes of shares covered by a metadata chunk
+ * @param maxSegmentSize - maximum bytes of shares covered by a metadata chunk
  *
  */
-Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* uploaderObj)
+Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* uploaderObj, int compressionLevel, int shareCacheSize, int queueDepth,
+    ShareCache* shareCacheObj, int minSegmentSize, int avgSegmentSize, int maxSegmentSize)
 {
 
     /* initialization of variables */
     int i;
     n_ = n;
+    if (queueDepth <= 0) {
+        queueDepth = RB_SIZE;
+    }
     nextAddIndex_ = 0;
     cryptoObj_ = (CryptoPrimitive**)malloc(sizeof(CryptoPrimitive*) * (NUM_THREADS + 1));
     inputbuffer_ = (RingBuffer<Secret_Item_t>**)malloc(sizeof(RingBuffer<Secret_Item_t>*) * NUM_THREADS);
     outputbuffer_ = (RingBuffer<ShareChunk_Item_t>**)malloc(sizeof(RingBuffer<ShareChunk_Item_t>*) * NUM_THREADS);
+    ownShareCache_ = (shareCacheObj == NULL);
+    shareCacheObj_ = ownShareCache_ ? new ShareCache(shareCacheSize, n, HASH_SIZE) : shareCacheObj;
+    segmenterObj_ = new Segmenter(n, minSegmentSize, avgSegmentSize, maxSegmentSize, SECRET_SIZE_META / sizeof(metaNode));
+    stageStatInit(&collectStat_);
+    valid_ = shareCacheObj_->isValid() && segmenterObj_->isValid();
     /* initialization of objects */
     for (i = 0; i < NUM_THREADS; i++) {
-        inputbuffer_[i] = new RingBuffer<Secret_Item_t>(RB_SIZE, true, 1);
-        outputbuffer_[i] = new RingBuffer<ShareChunk_Item_t>(RB_SIZE, true, 1);
+        stageStatInit(&encodeStat_[i]);
+        inputbuffer_[i] = new RingBuffer<Secret_Item_t>(queueDepth, true, 1);
+        outputbuffer_[i] = new RingBuffer<ShareChunk_Item_t>(queueDepth, true, 1);
         cryptoObj_[i] = new CryptoPrimitive(securetype);
         encodeObj_[i] = new CDCodec(type, n, m, r, cryptoObj_[i]);
+        compressObj_[i] = new Compressor(compressionLevel);
+        valid_ = valid_ && compressObj_[i]->isValid();
+    }
+
+    uploadObj_ = uploaderObj;
+    cryptoObj_[NUM_THREADS] = new CryptoPrimitive(securetype);
+    encodeObj_[NUM_THREADS] = new CDCodec(type, n, m, r, cryptoObj_[NUM_THREADS]);
+    recipeTreeObj_ = new RecipeTree(n, cryptoObj_[NUM_THREADS], uploaderObj);
+
+    /* an invalid encoder starts no thread, so it is deleted without indicateEnd */
+    if (!valid_) {
+        return;
+    }
 
+    /* create encoding threads */
+    for (i = 0; i < NUM_THREADS; i++) {
         param_encoder* temp = (param_encoder*)malloc(sizeof(param_encoder));
         temp->index = i;
         temp->obj = this;
-
-        /* create encoding threads */
         pthread_create(&tid_[i], 0, &thread_handler, (void*)temp);
     }
 
-    uploadObj_ = uploaderObj;
-    cryptoObj_[NUM_THREADS] = new CryptoPrimitive(securetype);
     /* create collect thread */
     pthread_create(&tid_[NUM_THREADS], 0, &collect, (void*)this);
 }
 
+/*
+ * print the statistics of the encoding and collect stages
+ *
+ * @param wallTime - the wall time of the whole run in seconds
+ */
+void Encoder::reportStages(double wallTime)
+{
+    double inputOccupancy = 0, outputOccupancy = 0;
+
+    for (int i = 0; i < NUM_THREADS; i++) {
+        inputOccupancy += inputbuffer_[i]->AverageOccupancy();
+        outputOccupancy += outputbuffer_[i]->AverageOccupancy();
+    }
+    stageStatReport("encode", encodeStat_, NUM_THREADS, wallTime, inputOccupancy / NUM_THREADS);
+    stageStatReport("collect", &collectStat_, 1, wallTime, outputOccupancy / NUM_THREADS);
+}
+
 /*
  * destructor
  *
@@ -291,10 +428,20 @@ Encoder::~Encoder()
     for (int i = 0; i < NUM_THREADS; i++) {
         delete (cryptoObj_[i]);
         delete (encodeObj_[i]);
+        delete (compressObj_[i]);
         delete (inputbuffer_[i]);
         delete (outputbuffer_[i]);
     }
+    delete (recipeTreeObj_);
+    delete (encodeObj_[NUM_THREADS]);
     delete (cryptoObj_[NUM_THREADS]);
+    if (shareCacheObj_->isEnabled()) {
+        printf("share cache: %lld hits in %lld lookups\n", shareCacheObj_->hits_, shareCacheObj_->lookups_);
+    }
+    if (ownShareCache_) {
+        delete (shareCacheObj_);
+    }
+    delete (segmenterObj_);
     free(inputbuffer_);
     free(outputbuffer_);
     free(cryptoObj_);
@@ -5,11 +5,15 @@
 #ifndef __ENCODER_HH__
 #define __ENCODER_HH__
 
-//#define ENCODE_ONLY_MODE 1
 #include "BasicRingBuffer.hh"
 #include "CDCodec.hh"
 #include "CryptoPrimitive.hh"
+#include "compressor.hh"
 #include "conf.hh"
+#include "recipeTree.hh"
+#include "segmenter.hh"
+#include "shareCache.hh"
+#include "stageStat.hh"
 #include "uploader.hh"
 #include <openssl/bn.h>
 #include <openssl/md5.h>
@@ -26,24 +30,25 @@
 /* ringbuffer size */
 #define RB_SIZE (1024)
 
-/* max secret size */
-#define SECRET_SIZE (16 * 1024)
+/* max metadata chunk size (data secrets are bounded by MAX_SECRET_SIZE of CDCodec) */
 #define SECRET_SIZE_META (32 * 1024)
-/* max share buffer size */
-#define SHARE_BUFFER_SIZE (4 * 16 * 1024)
+/* max size of a single zero secret (longer zero runs are split) */
+#define MAX_ZERO_SECRET_SIZE (1 << 30)
 
 /* object type indicators */
 #define FILE_OBJECT 1
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
+#define ZERO_OBJECT (-7)
+#define ZERO_END (-28)
+/* tells an encoding thread to exit once the file is collected */
+#define STOP_OBJECT (-30)
 
-#define AVG_SEGMENT_SIZE ((2 << 19)) //0.5MB defaults
-#define MIN_SEGMENT_SIZE ((2 << 18)) //256KB
-#define MAX_SEGMENT_SIZE ((2 << 20)) //1MB
-
-#define DIVISOR ((AVG_SEGMENT_SIZE - MIN_SEGMENT_SIZE) / (8 * (2 << 10)))
-#define PATTERN ((AVG_SEGMENT_SIZE - MIN_SEGMENT_SIZE) / (8 * (2 << 10))) - 1
+/* default minimum, average and maximum bytes of shares covered by a metadata chunk */
+#define MIN_SEGMENT_SIZE (512 * 1024)
+#define AVG_SEGMENT_SIZE (1024 * 1024)
+#define MAX_SEGMENT_SIZE (2 * 1024 * 1024)
 
 class Encoder {
 public:
@@ -55,29 +60,45 @@ public:
 
     /* file head structure */
     typedef struct {
-        unsigned char data[SECRET_SIZE];
+        unsigned char data[DIR_MAX_SIZE + 1];
         int fullNameSize;
-        int fileSize;
+        long fileSize;
     } fileHead_t;
 
-    /* secret metadata structure */
+    /*
+     * secret metadata structure (a zero secret is a run of secretSize zero bytes without data)
+     *
+     * data is allocated with malloc by the producer and freed by the encoding thread
+     */
     typedef struct {
-        unsigned char data[SECRET_SIZE];
+        unsigned char* data;
         unsigned char key[KEY_SIZE];
         int secretID;
         int secretSize;
         int end;
+        int zero;
     } Secret_t;
 
-    /* share metadata structure */
+    /*
+     * share metadata structure
+     *
+     * data holds the n shares, allocated by the encoding thread and freed by the collect thread
+     */
     typedef struct {
-        unsigned char data[SHARE_BUFFER_SIZE];
+        unsigned char* data;
         unsigned char key[KEY_SIZE];
         char shareFP[FP_SIZE];
         int secretID;
         int secretSize;
         int shareSize;
+        int compressed;
         int end;
+        int zero;
+        /* whether key holds the convergent key of the encoded secret */
+        int keyed;
+        /* whether the shares are taken from the share cache, with their fingerprints in shareFPList */
+        int cached;
+        unsigned char shareFPList[SHARE_CACHE_MAX_SHARES * HASH_SIZE];
     } ShareChunk_t;
 
     /*the entry structure of the recipes of a file*/
@@ -120,8 +141,8 @@ public:
     /* index for sequencially adding object */
     int nextAddIndex_;
 
-    /* coding object array */
-    CDCodec* encodeObj_[NUM_THREADS];
+    /* coding object array, the last one encodes the file names in the collect thread */
+    CDCodec* encodeObj_[NUM_THREADS + 1];
 
     /* uploader object */
     Uploader* uploadObj_;
@@ -129,11 +150,35 @@ public:
     /* crypto object array */
     CryptoPrimitive** cryptoObj_;
 
+    /* compressor object array */
+    Compressor* compressObj_[NUM_THREADS];
+
+    /* cache of encoded secrets shared by all threads */
+    ShareCache* shareCacheObj_;
+
+    /* whether the cache is deleted with the encoder (not when it is shared with later encoders) */
+    bool ownShareCache_;
+
+    /* segmenter that groups the shares of each cloud into metadata chunks */
+    Segmenter* segmenterObj_;
+
+    /* tree of index chunks over the metadata chunks of each cloud */
+    RecipeTree* recipeTreeObj_;
+
+    /* whether the share cache, the segmenter and the compressors are valid */
+    bool valid_;
+
+    /* statistics of the encoding threads and the collect thread */
+    StageStat_t encodeStat_[NUM_THREADS];
+    StageStat_t collectStat_;
+
     // segment temp
 
     typedef struct {
         unsigned char shareFP[HASH_SIZE];
-        unsigned char other[18];
+        unsigned char compressed;
+        unsigned char zero;
+        unsigned char other[16];
         int secretID;
         int secretSize;
         int shareSize;
@@ -147,8 +192,14 @@ public:
      * @param m - reliability degree
      * @param r - confidentiality degree
      * @param securetype - encryption and hash type
-     * @param uploaderObj - pointer link to uploader object
-     *
+     * @param uploaderObj - pointer link to uploader object (NULL for dropping the shares after encoding)
+     * @param compressionLevel - deflate level applied to secrets before encoding (COMPRESSION_OFF for disabled)
+     * @param shareCacheSize - number of encoded secrets kept for repeated secrets (SHARE_CACHE_OFF for disabled)
+     * @param queueDepth - depth of the input and output ringbuffers of each thread (0 for RB_SIZE)
+     * @param shareCacheObj - cache kept across encoders (NULL for a cache of shareCacheSize entries of this encoder)
+     * @param minSegmentSize - minimum bytes of shares covered by a metadata chunk
+     * @param avgSegmentSize - average bytes of shares covered by a metadata chunk
+     * @param maxSegmentSize - maximum bytes of shares covered by a metadata chunk
      *
      */
     Encoder(int type,
@@ -156,7 +207,14 @@ public:
         int m,
         int r,
         int securetype,
-        Uploader* uploaderObj);
+        Uploader* uploaderObj,
+        int compressionLevel = COMPRESSION_OFF,
+        int shareCacheSize = SHARE_CACHE_OFF,
+        int queueDepth = 0,
+        ShareCache* shareCacheObj = NULL,
+        int minSegmentSize = MIN_SEGMENT_SIZE,
+        int avgSegmentSize = AVG_SEGMENT_SIZE,
+        int maxSegmentSize = MAX_SEGMENT_SIZE);
 
     /*
      * destructor of encoder
@@ -164,9 +222,44 @@ public:
     ~Encoder();
 
     /*
-     * test if it's end of encoding a file
+     * check if the encoder is constructed with valid parameters and started
+     *
+     * @return - a boolean value that indicates if the encoder can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * wait for the collect thread to finish the file
+     *
+     * @return - a boolean value that indicates if the key recipes of the file are written
+     */
+    bool indicateEnd();
+
+    /*
+     * print the statistics of the encoding and collect stages
+     *
+     * @param wallTime - the wall time of the whole run in seconds
+     */
+    void reportStages(double wallTime);
+
+    /*
+     * print the statistics of the metadata chunks after the file is collected
+     *
+     * @param duplicates - number of metadata chunks found duplicate by the servers
+     */
+    void reportSegments(long long duplicates);
+
+    /*
+     * encrypt a metadata chunk, hand it to the uploader and add its key to the metadata tree
+     *
+     * @param index - the cloud index
+     * @param metaChunk - the metadata entries of the segment
+     * @param numOfNodes - the number of metadata entries
+     * @param end - whether this is the last metadata chunk of the file
+     *
+     * @return - the time spent waiting on the uploader
      */
-    void indicateEnd();
+    double flushMetaChunk(int index, unsigned char* metaChunk, int numOfNodes, bool end);
 
     /*
      * add function for sequencially add items to each encode buffer
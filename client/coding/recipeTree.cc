@@ -0,0 +1,324 @@
+/*
+ * recipeTree.cc
+ */
+
+#include "recipeTree.hh"
+
+/*
+ * constructor of RecipeTree
+ *
+ * @param n - number of clouds
+ * @param cryptoObj - crypto object of the collect thread
+ * @param uploaderObj - uploader object
+ */
+RecipeTree::RecipeTree(int n, CryptoPrimitive* cryptoObj, Uploader* uploaderObj)
+{
+    n_ = n;
+    cryptoObj_ = cryptoObj;
+    uploadObj_ = uploaderObj;
+    maxRecords_ = RECIPE_TREE_CHUNK_SIZE / sizeof(keyRecord_t);
+
+    for (int l = 0; l < RECIPE_TREE_MAX_LEVELS - 1; l++) {
+        segmenterObj_[l] = new Segmenter(n_, RECIPE_TREE_MIN_SIZE, RECIPE_TREE_AVG_SIZE,
+            maxRecords_ * sizeof(keyRecord_t), maxRecords_);
+    }
+
+    records_ = (keyRecord_t**)malloc(sizeof(keyRecord_t*) * n_ * RECIPE_TREE_MAX_LEVELS);
+    numOfRecords_ = (int*)malloc(sizeof(int) * n_ * RECIPE_TREE_MAX_LEVELS);
+    numOfChunks_ = (long long*)malloc(sizeof(long long) * n_ * RECIPE_TREE_MAX_LEVELS);
+    for (int i = 0; i < n_ * RECIPE_TREE_MAX_LEVELS; i++) {
+        records_[i] = (keyRecord_t*)malloc(sizeof(keyRecord_t) * maxRecords_);
+        numOfRecords_[i] = 0;
+        numOfChunks_[i] = 0;
+    }
+    nextID_ = (int*)malloc(sizeof(int) * n_);
+    for (int i = 0; i < n_; i++) {
+        nextID_[i] = -1;
+    }
+
+    /* an index chunk is padded to whole encryption blocks */
+    plainBuffer_ = (unsigned char*)malloc(sizeof(unsigned char) * (RECIPE_TREE_CHUNK_SIZE + cryptoObj_->getBlockSize()));
+
+    totalChunks_ = 0;
+    totalIndexChunks_ = 0;
+    totalKeyRecords_ = 0;
+    maxLevel_ = 0;
+    failed_ = false;
+}
+
+/*
+ * destructor of RecipeTree
+ */
+RecipeTree::~RecipeTree()
+{
+    for (int l = 0; l < RECIPE_TREE_MAX_LEVELS - 1; l++) {
+        delete (segmenterObj_[l]);
+    }
+    for (int i = 0; i < n_ * RECIPE_TREE_MAX_LEVELS; i++) {
+        free(records_[i]);
+    }
+    free(records_);
+    free(numOfRecords_);
+    free(numOfChunks_);
+    free(nextID_);
+    free(plainBuffer_);
+}
+
+/*
+ * check if the records of a level form the key recipe when the file ends
+ *
+ * @param index - the cloud index
+ * @param level - the chunk level
+ * @param extra - number of records about to be added
+ *
+ * @return - a boolean value that indicates if the level is the root
+ */
+bool RecipeTree::isRoot(int index, int level, int extra)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + level;
+
+    if (level == RECIPE_TREE_MAX_LEVELS - 1) {
+        return 1;
+    }
+
+    /* once a chunk of the next level exists, it has to cover the rest of this level as well */
+    return (numOfChunks_[slot + 1] == 0) && (numOfRecords_[slot] + extra <= KEY_RECIPE_MAX_RECORDS);
+}
+
+/*
+ * encrypt a chunk and hand it to the uploader
+ *
+ * @param index - the cloud index
+ * @param level - the chunk level
+ * @param chunk - the plaintext of the chunk
+ * @param size - the size of the chunk
+ * @param dataSize - the bytes of the file covered by the chunk
+ * @param end - whether the file ends with this chunk or the index chunks above it
+ *
+ * @return - the time spent waiting on the uploader
+ */
+double RecipeTree::emit(int index, int level, unsigned char* chunk, int size, long dataSize, bool end)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + level;
+    keyRecord_t record;
+
+    /* the last chunk of the file is the one at the root, the uploader finishes the file with it */
+    bool last = end && isRoot(index, level, 1);
+
+    Uploader::ItemMeta_t item;
+    item.type = last ? SHARE_END : SHARE_OBJECT;
+    item.shareObj.share_header.secretID = nextID_[index];
+    item.shareObj.share_header.secretSize = size;
+    item.shareObj.share_header.shareSize = size;
+    nextID_[index]--;
+
+    /* convergent encryption, so identical chunks keep identical fingerprints */
+    record.chunkID = item.shareObj.share_header.secretID;
+    record.size = dataSize;
+    cryptoObj_->generateHash(chunk, size, record.key);
+    item.shareObj.data = (unsigned char*)malloc(sizeof(unsigned char) * size);
+    if (!cryptoObj_->encryptWithKey(chunk, size, record.key, item.shareObj.data)) {
+        fprintf(stderr, "Error: fail to encrypt the level-%d chunk %d!\n", level, record.chunkID);
+    }
+    cryptoObj_->generateHash(item.shareObj.data, size, item.shareObj.share_header.shareFP);
+    memcpy(record.chunkFP, item.shareObj.share_header.shareFP, FP_SIZE);
+    numOfChunks_[slot]++;
+    totalChunks_++;
+    if (level > 0) {
+        totalIndexChunks_++;
+    }
+
+    /* the key recipe is complete before the uploader sends it after the last chunk */
+    if (last) {
+        if (level == RECIPE_TREE_MAX_LEVELS - 1) {
+            addRoot(index, &record);
+        } else {
+            memcpy(&records_[slot][numOfRecords_[slot]], &record, sizeof(keyRecord_t));
+            numOfRecords_[slot]++;
+        }
+        writeKeyRecipe(index, level);
+    }
+
+    double addStart = stageTimeNow();
+    uploadObj_->addMeta(&item, sizeof(item), index);
+    double waitTime = stageTimeNow() - addStart;
+
+    if (last) {
+        return waitTime;
+    }
+    return waitTime + push(index, level, &record, end);
+}
+
+/*
+ * add the record of a chunk to its level and seal the level at a boundary
+ *
+ * @param index - the cloud index
+ * @param level - the chunk level
+ * @param record - the record of the chunk
+ * @param end - whether the chunk is the last one of its level
+ *
+ * @return - the time spent waiting on the uploader
+ */
+double RecipeTree::push(int index, int level, keyRecord_t* record, bool end)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + level;
+
+    /* the top level is never grouped, it only ends in the key recipe */
+    if (level == RECIPE_TREE_MAX_LEVELS - 1) {
+        addRoot(index, record);
+        return 0;
+    }
+
+    memcpy(&records_[slot][numOfRecords_[slot]], record, sizeof(keyRecord_t));
+    numOfRecords_[slot]++;
+
+    /* index chunks end at records whose chunk fingerprint hits, so they resynchronize after a shift like metadata chunks */
+    int reason = segmenterObj_[level]->add(index, record->chunkFP, sizeof(keyRecord_t), end);
+    if (reason == SEGMENT_OPEN) {
+        return 0;
+    }
+
+    return seal(index, level, reason, end);
+}
+
+/*
+ * add the record of a chunk to the top level, which is never grouped
+ *
+ * a file too large for the tree fails, and its key recipe is not written
+ *
+ * @param index - the cloud index
+ * @param record - the record of the chunk
+ */
+void RecipeTree::addRoot(int index, keyRecord_t* record)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + RECIPE_TREE_MAX_LEVELS - 1;
+
+    if (numOfRecords_[slot] == maxRecords_) {
+        if (!failed_) {
+            fprintf(stderr, "Error: the metadata tree of cloud %d exceeds %d levels!\n", index, RECIPE_TREE_MAX_LEVELS);
+        }
+        failed_ = true;
+        return;
+    }
+    memcpy(&records_[slot][numOfRecords_[slot]], record, sizeof(keyRecord_t));
+    numOfRecords_[slot]++;
+}
+
+/*
+ * group the pending records of a level into an index chunk of the next level
+ *
+ * @param index - the cloud index
+ * @param level - the level of the grouped chunks
+ * @param reason - the reason for ending the index chunk
+ * @param end - whether the file ends with the index chunk or the ones above it
+ *
+ * @return - the time spent waiting on the uploader
+ */
+double RecipeTree::seal(int index, int level, int reason, bool end)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + level;
+    int blockSize = cryptoObj_->getBlockSize();
+
+    int size = numOfRecords_[slot] * sizeof(keyRecord_t);
+    memcpy(plainBuffer_, records_[slot], size);
+    long dataSize = 0;
+    for (int i = 0; i < numOfRecords_[slot]; i++) {
+        dataSize += records_[slot][i].size;
+    }
+
+    /* zero padding reads as records of the header ID, which never names a chunk */
+    int paddedSize = (size + blockSize - 1) / blockSize * blockSize;
+    memset(plainBuffer_ + size, 0, paddedSize - size);
+
+    segmenterObj_[level]->endSegment(index, reason);
+    numOfRecords_[slot] = 0;
+
+    return emit(index, level + 1, plainBuffer_, paddedSize, dataSize, end);
+}
+
+/*
+ * write the pending records of the root level as the key recipe and reset the tree
+ *
+ * @param index - the cloud index
+ * @param level - the root level
+ */
+void RecipeTree::writeKeyRecipe(int index, int level)
+{
+    int slot = index * RECIPE_TREE_MAX_LEVELS + level;
+    char buffer[32];
+
+    sprintf(buffer, "share-%d.key", index);
+    FILE* fp = failed_ ? NULL : fopen(buffer, "wb");
+    if (failed_) {
+        /* an incomplete key recipe is not uploaded either */
+        remove(buffer);
+    } else if (fp == NULL) {
+        fprintf(stderr, "Error: can't open key file %s!\n", buffer);
+    } else {
+        if (level > 0) {
+            keyRecord_t header;
+            memset(&header, 0, sizeof(keyRecord_t));
+            header.chunkID = KEY_RECIPE_HEADER_ID;
+            memcpy(header.chunkFP, &level, sizeof(int));
+            fwrite(&header, sizeof(keyRecord_t), 1, fp);
+        }
+        fwrite(records_[slot], sizeof(keyRecord_t), numOfRecords_[slot], fp);
+        fclose(fp);
+    }
+
+    totalKeyRecords_ += numOfRecords_[slot];
+    if (level > maxLevel_) {
+        maxLevel_ = level;
+    }
+
+    /* the root level may still have an open index chunk */
+    if (level < RECIPE_TREE_MAX_LEVELS - 1) {
+        segmenterObj_[level]->reset(index);
+    }
+    for (int l = 0; l < RECIPE_TREE_MAX_LEVELS; l++) {
+        numOfRecords_[index * RECIPE_TREE_MAX_LEVELS + l] = 0;
+        numOfChunks_[index * RECIPE_TREE_MAX_LEVELS + l] = 0;
+    }
+    nextID_[index] = -1;
+}
+
+/*
+ * encrypt a metadata chunk, hand it to the uploader and add it to the tree
+ *
+ * @param index - the cloud index
+ * @param metaChunk - the plaintext of the metadata chunk
+ * @param size - the size of the metadata chunk
+ * @param dataSize - the bytes of the file covered by the metadata chunk
+ * @param end - whether this is the last metadata chunk of the file
+ *
+ * @return - the time spent waiting on the uploader
+ */
+double RecipeTree::add(int index, unsigned char* metaChunk, int size, long dataSize, bool end)
+{
+    return emit(index, 0, metaChunk, size, dataSize, end);
+}
+
+/*
+ * check if a file was too large for the tree
+ *
+ * @return - a boolean value that indicates if a key recipe was not written
+ */
+bool RecipeTree::hasFailed()
+{
+    return failed_;
+}
+
+/*
+ * print the statistics of the index chunks and key recipes
+ *
+ * @param duplicates - number of metadata and index chunks found duplicate by the servers
+ */
+void RecipeTree::report(long long duplicates)
+{
+    if (totalChunks_ == 0) {
+        return;
+    }
+
+    printf("metadata tree: %lld chunks uploaded (%.1f%% duplicate), %lld index chunks, %d levels, %lld key recipe records\n",
+        totalChunks_, 100.0 * duplicates / totalChunks_, totalIndexChunks_, maxLevel_ + 1, totalKeyRecords_);
+}
@@ -0,0 +1,206 @@
+/*
+ * recipeTree.hh
+ */
+
+#ifndef __RECIPETREE_HH__
+#define __RECIPETREE_HH__
+
+#include "CryptoPrimitive.hh"
+#include "segmenter.hh"
+#include "stageStat.hh"
+#include "uploader.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* max size of an index chunk, as of a metadata chunk */
+#define RECIPE_TREE_CHUNK_SIZE (32 * 1024)
+
+/* minimum and average bytes of records grouped into an index chunk */
+#define RECIPE_TREE_MIN_SIZE (8 * 1024)
+#define RECIPE_TREE_AVG_SIZE (16 * 1024)
+
+/* max number of chunk levels, counting the metadata chunks as level 0 */
+#define RECIPE_TREE_MAX_LEVELS 8
+
+/* max number of records kept in the key recipe of a cloud before another level is added */
+#define KEY_RECIPE_MAX_RECORDS 64
+
+/* chunk ID of the header record of a key recipe pointing to index chunks (chunk IDs are negative) */
+#define KEY_RECIPE_HEADER_ID 0
+
+/*
+ * record of a chunk in a key recipe or in an index chunk
+ *
+ * the header record of a key recipe keeps the level of the chunks pointed to by
+ * the following records in the first bytes of chunkFP; a key recipe without a header
+ * points to metadata chunks directly. the records of a level are in file order, so
+ * the offset of a chunk is the sum of the sizes before it, and a byte range is found
+ * by walking down from the key recipe. sizes do not depend on where a chunk is in the
+ * file, so identical chunks at different offsets are still deduplicated
+ */
+typedef struct {
+    int chunkID;
+    unsigned char chunkFP[FP_SIZE];
+    unsigned char key[FP_SIZE];
+    long size; // bytes of the file covered by the chunk
+} keyRecord_t;
+
+/*
+ * tree of the metadata chunks of a file
+ *
+ * each cloud gets its own tree. the records of the chunks of a level are grouped
+ * into index chunks at content-defined boundaries, and the index chunks are encrypted
+ * with the hash of their content and uploaded along with the metadata chunks, so they
+ * are deduplicated the same way. a level whose records fit in the key recipe when the
+ * file ends becomes the root, so the key recipe stays small however large the file is.
+ * chunks are uploaded bottom-up, so an index chunk follows the chunks it points to
+ */
+class RecipeTree {
+private:
+    /* number of clouds */
+    int n_;
+
+    /* crypto object for hashing and encrypting index chunks */
+    CryptoPrimitive* cryptoObj_;
+
+    /* uploader object */
+    Uploader* uploadObj_;
+
+    /* max number of records in an index chunk */
+    int maxRecords_;
+
+    /* segmenters that group the records of each level into index chunks */
+    Segmenter* segmenterObj_[RECIPE_TREE_MAX_LEVELS - 1];
+
+    /* records not yet grouped into an index chunk, per cloud and level */
+    keyRecord_t** records_;
+    int* numOfRecords_;
+
+    /* number of chunks uploaded per cloud and level for the current file */
+    long long* numOfChunks_;
+
+    /* ID of the next chunk of each cloud */
+    int* nextID_;
+
+    /* plaintext of an index chunk */
+    unsigned char* plainBuffer_;
+
+    /* statistics over all clouds */
+    long long totalChunks_;
+    long long totalIndexChunks_;
+    long long totalKeyRecords_;
+    int maxLevel_;
+
+    /* whether a file was too large for the tree */
+    bool failed_;
+
+    /*
+     * check if the records of a level form the key recipe when the file ends
+     *
+     * @param index - the cloud index
+     * @param level - the chunk level
+     * @param extra - number of records about to be added
+     *
+     * @return - a boolean value that indicates if the level is the root
+     */
+    bool isRoot(int index, int level, int extra);
+
+    /*
+     * encrypt a chunk and hand it to the uploader
+     *
+     * @param index - the cloud index
+     * @param level - the chunk level
+     * @param chunk - the plaintext of the chunk
+     * @param size - the size of the chunk
+     * @param dataSize - the bytes of the file covered by the chunk
+     * @param end - whether the file ends with this chunk or the index chunks above it
+     *
+     * @return - the time spent waiting on the uploader
+     */
+    double emit(int index, int level, unsigned char* chunk, int size, long dataSize, bool end);
+
+    /*
+     * add the record of a chunk to its level and seal the level at a boundary
+     *
+     * @param index - the cloud index
+     * @param level - the chunk level
+     * @param record - the record of the chunk
+     * @param end - whether the chunk is the last one of its level
+     *
+     * @return - the time spent waiting on the uploader
+     */
+    double push(int index, int level, keyRecord_t* record, bool end);
+
+    /*
+     * add the record of a chunk to the top level, which is never grouped
+     *
+     * @param index - the cloud index
+     * @param record - the record of the chunk
+     */
+    void addRoot(int index, keyRecord_t* record);
+
+    /*
+     * group the pending records of a level into an index chunk of the next level
+     *
+     * @param index - the cloud index
+     * @param level - the level of the grouped chunks
+     * @param reason - the reason for ending the index chunk
+     * @param end - whether the file ends with the index chunk or the ones above it
+     *
+     * @return - the time spent waiting on the uploader
+     */
+    double seal(int index, int level, int reason, bool end);
+
+    /*
+     * write the pending records of the root level as the key recipe and reset the tree
+     *
+     * @param index - the cloud index
+     * @param level - the root level
+     */
+    void writeKeyRecipe(int index, int level);
+
+public:
+    /*
+     * constructor of RecipeTree
+     *
+     * @param n - number of clouds
+     * @param cryptoObj - crypto object of the collect thread
+     * @param uploaderObj - uploader object
+     */
+    RecipeTree(int n, CryptoPrimitive* cryptoObj, Uploader* uploaderObj);
+
+    /*
+     * destructor of RecipeTree
+     */
+    ~RecipeTree();
+
+    /*
+     * encrypt a metadata chunk, hand it to the uploader and add it to the tree
+     *
+     * @param index - the cloud index
+     * @param metaChunk - the plaintext of the metadata chunk
+     * @param size - the size of the metadata chunk
+     * @param dataSize - the bytes of the file covered by the metadata chunk
+     * @param end - whether this is the last metadata chunk of the file
+     *
+     * @return - the time spent waiting on the uploader
+     */
+    double add(int index, unsigned char* metaChunk, int size, long dataSize, bool end);
+
+    /*
+     * check if a file was too large for the tree
+     *
+     * @return - a boolean value that indicates if a key recipe was not written
+     */
+    bool hasFailed();
+
+    /*
+     * print the statistics of the index chunks and key recipes
+     *
+     * @param duplicates - number of metadata and index chunks found duplicate by the servers
+     */
+    void report(long long duplicates);
+};
+
+#endif
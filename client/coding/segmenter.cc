@@ -0,0 +1,162 @@
+/*
+ * segmenter.cc
+ */
+
+#include "segmenter.hh"
+
+/*
+ * constructor of Segmenter
+ *
+ * @param n - number of share streams
+ * @param minSize - minimum bytes of shares covered by a segment
+ * @param avgSize - average bytes of shares covered by a segment
+ * @param maxSize - maximum bytes of shares covered by a segment
+ * @param maxEntries - maximum number of shares in a segment
+ */
+Segmenter::Segmenter(int n, long minSize, long avgSize, long maxSize, int maxEntries)
+{
+    valid_ = true;
+    if ((minSize <= 0) || (minSize > avgSize) || (avgSize > maxSize)) {
+        fprintf(stderr, "Error: segment sizes should satisfy 0 < min <= avg <= max!\n");
+        valid_ = false;
+    }
+    if (maxEntries <= 0) {
+        fprintf(stderr, "Error: a segment should hold at least one share!\n");
+        valid_ = false;
+    }
+
+    n_ = n;
+    minSize_ = minSize;
+    avgSize_ = avgSize;
+    maxSize_ = maxSize;
+    maxEntries_ = maxEntries;
+
+    segSize_ = (long*)malloc(sizeof(long) * n_);
+    numOfEntries_ = (int*)malloc(sizeof(int) * n_);
+    for (int i = 0; i < n_; i++) {
+        segSize_[i] = 0;
+        numOfEntries_[i] = 0;
+    }
+
+    numOfSegments_ = 0;
+    totalEntries_ = 0;
+    totalSize_ = 0;
+    minSegSize_ = 0;
+    maxSegSize_ = 0;
+    for (int i = 0; i < SEGMENT_NUM_REASONS; i++) {
+        reasons_[i] = 0;
+    }
+}
+
+/*
+ * destructor of Segmenter
+ */
+Segmenter::~Segmenter()
+{
+    free(segSize_);
+    free(numOfEntries_);
+}
+
+/*
+ * check if a share would take the open segment of a stream beyond the maximum size
+ *
+ * @param index - the stream index
+ * @param shareSize - the size of the share
+ *
+ * @return - a boolean value that indicates if the segment should end before the share
+ */
+bool Segmenter::exceeds(int index, int shareSize)
+{
+    return (numOfEntries_[index] > 0) && (segSize_[index] + shareSize > maxSize_);
+}
+
+/*
+ * add a share to the open segment of a stream
+ *
+ * @param index - the stream index
+ * @param shareFP - the fingerprint of the share (at least 8 bytes)
+ * @param shareSize - the size of the share
+ * @param end - whether the share is the last one of the file
+ *
+ * @return - the reason to end the segment after the share, or SEGMENT_OPEN
+ */
+int Segmenter::add(int index, unsigned char* shareFP, int shareSize, bool end)
+{
+    segSize_[index] += shareSize;
+    numOfEntries_[index]++;
+
+    if (end) {
+        return SEGMENT_END;
+    }
+    if (numOfEntries_[index] == maxEntries_) {
+        return SEGMENT_FULL;
+    }
+    if (segSize_[index] < minSize_) {
+        return SEGMENT_OPEN;
+    }
+
+    /* past the minimum, each byte of shares ends the segment with a probability of 1 / (avg - min),
+       so the segment does not depend on how the data was chunked */
+    if (avgSize_ == minSize_) {
+        return SEGMENT_CONTENT;
+    }
+    if (fpSlot(shareFP, avgSize_ - minSize_) < (unsigned long)shareSize) {
+        return SEGMENT_CONTENT;
+    }
+
+    return SEGMENT_OPEN;
+}
+
+/*
+ * end the open segment of a stream
+ *
+ * @param index - the stream index
+ * @param reason - the reason for ending the segment
+ */
+void Segmenter::endSegment(int index, int reason)
+{
+    if ((numOfSegments_ == 0) || (segSize_[index] < minSegSize_)) {
+        minSegSize_ = segSize_[index];
+    }
+    if (segSize_[index] > maxSegSize_) {
+        maxSegSize_ = segSize_[index];
+    }
+    numOfSegments_++;
+    totalEntries_ += numOfEntries_[index];
+    totalSize_ += segSize_[index];
+    reasons_[reason]++;
+
+    segSize_[index] = 0;
+    numOfEntries_[index] = 0;
+}
+
+/*
+ * drop the open segment of a stream without counting it
+ *
+ * @param index - the stream index
+ */
+void Segmenter::reset(int index)
+{
+    segSize_[index] = 0;
+    numOfEntries_[index] = 0;
+}
+
+/*
+ * print the statistics of the segments
+ *
+ * @param entrySize - size of a metadata chunk entry
+ */
+void Segmenter::report(int entrySize)
+{
+    if (numOfSegments_ == 0) {
+        printf("metadata chunks: none\n");
+        return;
+    }
+
+    printf("metadata chunks: %lld, %.1f entries = %.2f KB each, covering %.1f KB of shares (min %.1f KB, max %.1f KB)\n",
+        numOfSegments_, (double)totalEntries_ / numOfSegments_,
+        (double)totalEntries_ * entrySize / numOfSegments_ / 1024, (double)totalSize_ / numOfSegments_ / 1024,
+        minSegSize_ / 1024.0, maxSegSize_ / 1024.0);
+    printf("metadata chunk ends: %lld content, %lld max size, %lld full, %lld end of file\n",
+        reasons_[SEGMENT_CONTENT], reasons_[SEGMENT_MAX], reasons_[SEGMENT_FULL], reasons_[SEGMENT_END]);
+}
@@ -0,0 +1,129 @@
+/*
+ * segmenter.hh
+ */
+
+#ifndef __SEGMENTER_HH__
+#define __SEGMENTER_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fpSet.hh"
+
+/* reasons for ending a segment */
+#define SEGMENT_OPEN (-1)
+#define SEGMENT_CONTENT 0
+#define SEGMENT_MAX 1
+#define SEGMENT_FULL 2
+#define SEGMENT_END 3
+#define SEGMENT_NUM_REASONS 4
+
+/*
+ * content-defined segmenter of the share streams of a file
+ *
+ * the shares sent to each cloud are grouped into segments, and the metadata of a
+ * segment forms one metadata chunk. a segment covers at least minSize bytes of
+ * shares, and then ends after a share whose fingerprint hits with a probability
+ * proportional to the share size, so segments average avgSize bytes. a segment
+ * never grows beyond maxSize bytes (unless a single share is larger) or beyond
+ * maxEntries shares, which is the capacity of a metadata chunk
+ */
+class Segmenter {
+private:
+    /* number of share streams, one per cloud */
+    int n_;
+
+    /* minimum, average and maximum bytes of shares covered by a segment */
+    long minSize_;
+    long avgSize_;
+    long maxSize_;
+
+    /* maximum number of shares in a segment */
+    int maxEntries_;
+
+    /* bytes of shares and number of shares of the open segment of each stream */
+    long* segSize_;
+    int* numOfEntries_;
+
+    /* statistics of the ended segments over all streams */
+    long long numOfSegments_;
+    long long totalEntries_;
+    long long totalSize_;
+    long minSegSize_;
+    long maxSegSize_;
+    long long reasons_[SEGMENT_NUM_REASONS];
+
+    /* whether the segment sizes are valid */
+    bool valid_;
+
+public:
+    /*
+     * constructor of Segmenter
+     *
+     * @param n - number of share streams
+     * @param minSize - minimum bytes of shares covered by a segment
+     * @param avgSize - average bytes of shares covered by a segment
+     * @param maxSize - maximum bytes of shares covered by a segment
+     * @param maxEntries - maximum number of shares in a segment
+     */
+    Segmenter(int n, long minSize, long avgSize, long maxSize, int maxEntries);
+
+    /*
+     * destructor of Segmenter
+     */
+    ~Segmenter();
+
+    /*
+     * check if the segmenter is constructed with valid segment sizes
+     *
+     * @return - a boolean value that indicates if the segmenter can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * check if a share would take the open segment of a stream beyond the maximum size
+     *
+     * @param index - the stream index
+     * @param shareSize - the size of the share
+     *
+     * @return - a boolean value that indicates if the segment should end before the share
+     */
+    bool exceeds(int index, int shareSize);
+
+    /*
+     * add a share to the open segment of a stream
+     *
+     * @param index - the stream index
+     * @param shareFP - the fingerprint of the share (at least 8 bytes)
+     * @param shareSize - the size of the share
+     * @param end - whether the share is the last one of the file
+     *
+     * @return - the reason to end the segment after the share, or SEGMENT_OPEN
+     */
+    int add(int index, unsigned char* shareFP, int shareSize, bool end);
+
+    /*
+     * end the open segment of a stream
+     *
+     * @param index - the stream index
+     * @param reason - the reason for ending the segment
+     */
+    void endSegment(int index, int reason);
+
+    /*
+     * drop the open segment of a stream without counting it
+     *
+     * @param index - the stream index
+     */
+    void reset(int index);
+
+    /*
+     * print the statistics of the segments
+     *
+     * @param entrySize - size of a metadata chunk entry
+     */
+    void report(int entrySize);
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * shareCache.cc
+ */
+
+#include "shareCache.hh"
+
+/*
+ * constructor of ShareCache
+ *
+ * @param numOfEntries - number of cached secrets, or SHARE_CACHE_OFF
+ * @param n - number of shares per secret
+ * @param fpSize - size of each share fingerprint
+ */
+ShareCache::ShareCache(int numOfEntries, int n, int fpSize)
+{
+    valid_ = true;
+    if (numOfEntries < SHARE_CACHE_OFF) {
+        fprintf(stderr, "Error: number of share cache entries should be >= 0!\n");
+        valid_ = false;
+    }
+    if ((n <= 0) || (n > SHARE_CACHE_MAX_SHARES)) {
+        fprintf(stderr, "Error: n should be in (0, %d] for the share cache!\n", SHARE_CACHE_MAX_SHARES);
+        valid_ = false;
+    }
+
+    /*an invalid cache is left disabled*/
+    numOfEntries_ = valid_ ? numOfEntries : SHARE_CACHE_OFF;
+    n_ = n;
+    fpSize_ = fpSize;
+    hits_ = 0;
+    lookups_ = 0;
+    entries_ = NULL;
+
+    if (numOfEntries_ != SHARE_CACHE_OFF) {
+        entries_ = (cacheEntry_t*)malloc(sizeof(cacheEntry_t) * numOfEntries_);
+        for (int i = 0; i < numOfEntries_; i++) {
+            entries_[i].valid = 0;
+            entries_[i].capacity = 0;
+            entries_[i].shareData = NULL;
+            entries_[i].shareFP = (unsigned char*)malloc(sizeof(unsigned char) * fpSize_ * n_);
+        }
+    }
+    pthread_mutex_init(&cacheLock_, NULL);
+}
+
+/*
+ * destructor of ShareCache
+ */
+ShareCache::~ShareCache()
+{
+    if (entries_ != NULL) {
+        for (int i = 0; i < numOfEntries_; i++) {
+            free(entries_[i].shareFP);
+            free(entries_[i].shareData);
+        }
+        free(entries_);
+    }
+    pthread_mutex_destroy(&cacheLock_);
+}
+
+/*
+ * check if the cache is enabled
+ *
+ * @return - a boolean value that indicates if the cache is enabled
+ */
+bool ShareCache::isEnabled()
+{
+    return numOfEntries_ != SHARE_CACHE_OFF;
+}
+
+/*
+ * get the slot of a key
+ *
+ * @param key - the convergent key
+ *
+ * @return - the index of the slot in entries_
+ */
+int ShareCache::slot(unsigned char* key)
+{
+    return fpSlot(key, numOfEntries_);
+}
+
+/*
+ * look up an encoded secret
+ *
+ * @param key - the convergent key of the secret (SHARE_CACHE_KEY_SIZE bytes)
+ * @param secretSize - the size of the original secret
+ * @param compressed - whether the encoded secret is the compressed form
+ * @param shareBuffer - a buffer for storing the n shares <return>
+ * @param shareSize - the size of each share <return>
+ * @param shareFPList - a buffer for storing the n share fingerprints <return>
+ *
+ * @return - a boolean value that indicates if the secret is cached
+ */
+bool ShareCache::lookup(unsigned char* key, int secretSize, int compressed,
+    unsigned char* shareBuffer, int* shareSize, unsigned char* shareFPList)
+{
+    bool hit = 0;
+
+    if (numOfEntries_ == SHARE_CACHE_OFF) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&cacheLock_);
+    lookups_++;
+    cacheEntry_t* entry = &entries_[slot(key)];
+    if (entry->valid && (entry->secretSize == secretSize) && (entry->compressed == compressed)
+        && (memcmp(entry->key, key, SHARE_CACHE_KEY_SIZE) == 0)) {
+        memcpy(shareBuffer, entry->shareData, entry->shareSize * n_);
+        memcpy(shareFPList, entry->shareFP, fpSize_ * n_);
+        (*shareSize) = entry->shareSize;
+        hits_++;
+        hit = 1;
+    }
+    pthread_mutex_unlock(&cacheLock_);
+
+    return hit;
+}
+
+/*
+ * insert an encoded secret
+ *
+ * @param key - the convergent key of the secret (SHARE_CACHE_KEY_SIZE bytes)
+ * @param secretSize - the size of the original secret
+ * @param compressed - whether the encoded secret is the compressed form
+ * @param shareBuffer - a buffer that stores the n shares
+ * @param shareSize - the size of each share
+ * @param shareFPList - a buffer that stores the n share fingerprints
+ */
+void ShareCache::insert(unsigned char* key, int secretSize, int compressed,
+    unsigned char* shareBuffer, int shareSize, unsigned char* shareFPList)
+{
+    if (numOfEntries_ == SHARE_CACHE_OFF) {
+        return;
+    }
+
+    pthread_mutex_lock(&cacheLock_);
+    cacheEntry_t* entry = &entries_[slot(key)];
+    if (entry->capacity < shareSize * n_) {
+        free(entry->shareData);
+        entry->capacity = shareSize * n_;
+        entry->shareData = (unsigned char*)malloc(sizeof(unsigned char) * entry->capacity);
+    }
+    memcpy(entry->key, key, SHARE_CACHE_KEY_SIZE);
+    memcpy(entry->shareData, shareBuffer, shareSize * n_);
+    memcpy(entry->shareFP, shareFPList, fpSize_ * n_);
+    entry->secretSize = secretSize;
+    entry->compressed = compressed;
+    entry->shareSize = shareSize;
+    entry->valid = 1;
+    pthread_mutex_unlock(&cacheLock_);
+}
@@ -0,0 +1,135 @@
+/*
+ * shareCache.hh
+ */
+
+#ifndef __SHARECACHE_HH__
+#define __SHARECACHE_HH__
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fpSet.hh"
+
+/*maximum size of a convergent key in the cache*/
+#define SHARE_CACHE_KEY_SIZE 32
+
+/*maximum number of shares per secret in the cache*/
+#define SHARE_CACHE_MAX_SHARES 16
+
+/*macro for disabling the cache*/
+#define SHARE_CACHE_OFF 0
+
+/*
+ * bounded cache of encoded secrets, keyed by the CAONT-RS convergent key
+ *
+ * a repeated secret within one upload has the same key, so its n shares and their
+ * fingerprints can be reused instead of encoding and hashing the secret again.
+ * the cache is direct mapped (a colliding secret replaces the old entry), so its
+ * memory is bounded by the number of entries times n times the share size
+ */
+class ShareCache {
+private:
+    /*entry structure of the cache*/
+    typedef struct {
+        unsigned char key[SHARE_CACHE_KEY_SIZE];
+        int valid;
+        int secretSize;
+        int compressed;
+        int shareSize;
+        int capacity;
+        unsigned char* shareFP;
+        unsigned char* shareData;
+    } cacheEntry_t;
+
+    /*number of entries, SHARE_CACHE_OFF for disabled*/
+    int numOfEntries_;
+
+    /*number of shares per secret*/
+    int n_;
+
+    /*size of each share fingerprint*/
+    int fpSize_;
+
+    /*the entries*/
+    cacheEntry_t* entries_;
+
+    /*lock shared by encoding threads and the collect thread*/
+    pthread_mutex_t cacheLock_;
+
+    /*whether the cache is constructed with valid sizes*/
+    bool valid_;
+
+    /*
+     * get the slot of a key
+     *
+     * @param key - the convergent key
+     *
+     * @return - the index of the slot in entries_
+     */
+    int slot(unsigned char* key);
+
+public:
+    /*number of hits and lookups*/
+    long long hits_;
+    long long lookups_;
+
+    /*
+     * constructor of ShareCache
+     *
+     * @param numOfEntries - number of cached secrets, or SHARE_CACHE_OFF
+     * @param n - number of shares per secret
+     * @param fpSize - size of each share fingerprint
+     */
+    ShareCache(int numOfEntries, int n, int fpSize);
+
+    /*
+     * destructor of ShareCache
+     */
+    ~ShareCache();
+
+    /*
+     * check if the cache is constructed with valid sizes
+     *
+     * @return - a boolean value that indicates if the cache can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * check if the cache is enabled
+     *
+     * @return - a boolean value that indicates if the cache is enabled
+     */
+    bool isEnabled();
+
+    /*
+     * look up an encoded secret
+     *
+     * @param key - the convergent key of the secret (SHARE_CACHE_KEY_SIZE bytes)
+     * @param secretSize - the size of the original secret
+     * @param compressed - whether the encoded secret is the compressed form
+     * @param shareBuffer - a buffer for storing the n shares <return>
+     * @param shareSize - the size of each share <return>
+     * @param shareFPList - a buffer for storing the n share fingerprints <return>
+     *
+     * @return - a boolean value that indicates if the secret is cached
+     */
+    bool lookup(unsigned char* key, int secretSize, int compressed,
+        unsigned char* shareBuffer, int* shareSize, unsigned char* shareFPList);
+
+    /*
+     * insert an encoded secret
+     *
+     * @param key - the convergent key of the secret (SHARE_CACHE_KEY_SIZE bytes)
+     * @param secretSize - the size of the original secret
+     * @param compressed - whether the encoded secret is the compressed form
+     * @param shareBuffer - a buffer that stores the n shares
+     * @param shareSize - the size of each share
+     * @param shareFPList - a buffer that stores the n share fingerprints
+     */
+    void insert(unsigned char* key, int secretSize, int compressed,
+        unsigned char* shareBuffer, int shareSize, unsigned char* shareFPList);
+};
+
+#endif
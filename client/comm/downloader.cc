@@ -24,6 +24,9 @@ void* Downloader::thread_handler(void* param)
     /* get the download initiate signal */
     init_t signal;
     obj->signalBuffer_[cloudIndex]->Extract(&signal);
+    if (signal.type == STOP_SIGNAL) {
+        return NULL;
+    }
 
     /* get filename & name size*/
     char* filename = signal.filename;
@@ -31,53 +34,140 @@ void* Downloader::thread_handler(void* param)
     int retSize;
     int index = 0;
 
-    /* initiate download request */
-    obj->socketArray_[cloudIndex]->initDownload(filename, namesize);
-
-    /* start to download data into container */
-    obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
-    /* get the header */
-    shareFileHead_t* header = (shareFileHead_t*)obj->downloadContainer_[cloudIndex];
-    index = sizeof(shareFileHead_t);
+    /* the shares are passed on where they were received, each holding a reference to the receive buffer */
+    SharedBuffer_t* recv = sharedBufferCreate(0);
+
+    /*
+     * a streamed restore sends the shares of each recipe list in their own messages, and an empty
+     * message at the end; the shares come back in the order they were requested, so each one is
+     * tagged with its position from the ranges sent to the cloud
+     */
+    if (signal.type == STREAM_SIGNAL) {
+        int cloud = cloudIndex - obj->total_ / 2;
+        streamRange_t range;
+        range.start = 0;
+        range.size = 0;
+        bool valid = true;
+        while (true) {
+            streamItem_t output;
+            output.cloudIndex = cloud;
+            recv = sharedBufferRenew(recv);
+            if (!valid || (obj->socketArray_[cloudIndex]->downloadChunk(&recv->data, &recv->capacity, &retSize) == -1)
+                || (retSize == 0)) {
+                output.type = 2;
+                output.data = NULL;
+                output.buffer = NULL;
+                obj->streamBuffer_->Insert(&output, sizeof(output));
+                sharedBufferRelease(recv);
+                return NULL;
+            }
+            index = 0;
+            while (index < retSize) {
+                /* a share has to lie within the message, and has to be one that was requested */
+                shareEntry_t* temp = (shareEntry_t*)(recv->data + index);
+                if (retSize - index < (int)sizeof(shareEntry_t)) {
+                    valid = false;
+                    break;
+                }
+                int shareSize = temp->shareSize;
+                index += sizeof(shareEntry_t);
+                if ((shareSize < 0) || (shareSize > retSize - index)) {
+                    valid = false;
+                    break;
+                }
+
+                /* the range of a list is queued before the list is sent, so a share without one was never requested */
+                if ((range.size == 0) && (obj->rangeBuffer_[cloud]->ExtractTimeout(&range, 0) == -1)) {
+                    valid = false;
+                    break;
+                }
+                output.type = 1;
+                output.position = range.start;
+                range.start++;
+                range.size--;
+                memcpy(&(output.share_header), temp, sizeof(shareEntry_t));
+                output.data = recv->data + index;
+                output.buffer = recv;
+                sharedBufferHold(recv);
+                index += shareSize;
+
+                obj->streamBuffer_->Insert(&output, sizeof(output));
+                pthread_mutex_lock(&obj->streamLock_);
+                obj->recvCount_[cloud]++;
+                obj->recvPos_[cloud] = output.position + 1;
+                pthread_mutex_unlock(&obj->streamLock_);
+            }
+            if (!valid) {
+                printf("cloud %d sends a corrupt or unrequested share, the cloud is left out\n", cloud);
+            }
+        }
+    }
 
-    /* parse the header object */
-    Item_t headerObj;
-    headerObj.type = 0;
-    memcpy(&(headerObj.fileObj.file_header), header, sizeof(shareFileHead_t));
+    /* initiate download request, and get the header from the first container */
+    long count = 0;
+    long numOfChunk = -1;
+    if ((obj->socketArray_[cloudIndex]->initDownload(filename, namesize) == 0)
+        && (obj->socketArray_[cloudIndex]->downloadChunk(&recv->data, &recv->capacity, &retSize) == 0)
+        && (retSize >= (int)sizeof(shareFileHead_t))) {
+        shareFileHead_t* header = (shareFileHead_t*)recv->data;
+        index = sizeof(shareFileHead_t);
+
+        /* parse the header object */
+        Item_t headerObj;
+        headerObj.type = 0;
+        memcpy(&(headerObj.fileObj.file_header), header, sizeof(shareFileHead_t));
+
+        /* add the header object into ringbuffer */
+        obj->ringBuffer_[cloudIndex - obj->total_ / 2]->Insert(&headerObj, sizeof(headerObj));
+        numOfChunk = headerObj.fileObj.file_header.numOfShares;
+    }
 
-    /* add the header object into ringbuffer */
-    obj->ringBuffer_[cloudIndex - 3]->Insert(&headerObj, sizeof(headerObj));
-    /* main loop to get data */
-    int count = 0;
-    int numOfChunk = header->numOfShares;
-    while (true) {
+    /* main loop to get data (a file of zero secrets only has no share) */
+    while (count < numOfChunk) {
 
         /* if the current comtainer has been proceed, download next container */
         if (index == retSize) {
-            obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
+            recv = sharedBufferRenew(recv);
+            if (obj->socketArray_[cloudIndex]->downloadChunk(&recv->data, &recv->capacity, &retSize) == -1) {
+                break;
+            }
             index = 0;
         }
 
-        /* get the share object */
-        shareEntry_t* temp = (shareEntry_t*)(obj->downloadContainer_[cloudIndex] + index);
+        /* get the share object, which must lie within the container */
+        shareEntry_t* temp = (shareEntry_t*)(recv->data + index);
+        if (retSize - index < (int)sizeof(shareEntry_t)) {
+            break;
+        }
         int shareSize = temp->shareSize;
         index += sizeof(shareEntry_t);
+        if ((shareSize < 0) || (shareSize > retSize - index)) {
+            break;
+        }
 
         /* parse the share object */
         Item_t output;
         output.type = 1;
         memcpy(&(output.shareObj.share_header), temp, sizeof(shareEntry_t));
-        memcpy(output.shareObj.data, obj->downloadContainer_[cloudIndex] + index, shareSize);
+        output.shareObj.data = recv->data + index;
+        output.shareObj.buffer = recv;
+        sharedBufferHold(recv);
 
         index += shareSize;
 
         /* add the share object to ringbuffer */
-        obj->ringBuffer_[cloudIndex - 3]->Insert(&output, sizeof(output));
+        obj->ringBuffer_[cloudIndex - obj->total_ / 2]->Insert(&output, sizeof(output));
         count++;
-        if (count == numOfChunk) {
-            break;
-        }
     }
+    if (count < numOfChunk) {
+        printf("fail to download the shares from cloud %d\n", cloudIndex - obj->total_ / 2);
+    }
+
+    /* the end object comes before the last share if the download failed */
+    Item_t end;
+    end.type = 2;
+    obj->ringBuffer_[cloudIndex - obj->total_ / 2]->Insert(&end, sizeof(end));
+    sharedBufferRelease(recv);
     return NULL;
 }
 
@@ -99,6 +189,9 @@ void* Downloader::thread_handler_meta(void* param)
     /* get the download initiate signal */
     init_t signal;
     obj->signalBuffer_[cloudIndex]->Extract(&signal);
+    if (signal.type == STOP_SIGNAL) {
+        return NULL;
+    }
 
     /* get filename & name size*/
     char* filename = signal.filename;
@@ -106,41 +199,52 @@ void* Downloader::thread_handler_meta(void* param)
     int retSize;
     int index = 0;
 
-    /* initiate download request */
-    obj->socketArray_[cloudIndex]->initDownload(filename, namesize);
-    /* start to download data into container */
-    obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
-    /* get the header */
-    shareFileHead_t* header = (shareFileHead_t*)obj->downloadContainer_[cloudIndex];
-    index = sizeof(shareFileHead_t);
-
-    /* parse the header object */
-    ItemMeta_t headerObj;
-    headerObj.type = 0;
-    memcpy(&(headerObj.fileObj.file_header), header, sizeof(shareFileHead_t));
-
-    /* add the header object into ringbuffer */
-    obj->ringBufferMeta_[cloudIndex]->Insert(&headerObj, sizeof(headerObj));
-    /* main loop to get data */
-    int count = 0;
-    int numOfChunk = header->numOfShares;
-    while (true) {
+    /* initiate download request, and get the header from the first container */
+    long count = 0;
+    long numOfChunk = -1;
+    if ((obj->socketArray_[cloudIndex]->initDownload(filename, namesize) == 0)
+        && (obj->socketArray_[cloudIndex]->downloadChunk(&obj->downloadContainer_[cloudIndex], &obj->downloadCapacity_[cloudIndex], &retSize) == 0)
+        && (retSize >= (int)sizeof(shareFileHead_t))) {
+        shareFileHead_t* header = (shareFileHead_t*)obj->downloadContainer_[cloudIndex];
+        index = sizeof(shareFileHead_t);
+
+        /* parse the header object */
+        ItemMeta_t headerObj;
+        headerObj.type = 0;
+        memcpy(&(headerObj.fileObj.file_header), header, sizeof(shareFileHead_t));
+
+        /* add the header object into ringbuffer */
+        obj->ringBufferMeta_[cloudIndex]->Insert(&headerObj, sizeof(headerObj));
+        numOfChunk = headerObj.fileObj.file_header.numOfShares;
+    }
+
+    /* main loop to get data, until the cloud is left out of the restore */
+    while ((count < numOfChunk) && !obj->cloudLost_[cloudIndex]) {
 
         /* if the current comtainer has been proceed, download next container */
         if (index == retSize) {
-            obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
+            if (obj->socketArray_[cloudIndex]->downloadChunk(&obj->downloadContainer_[cloudIndex], &obj->downloadCapacity_[cloudIndex], &retSize) == -1) {
+                break;
+            }
             index = 0;
         }
 
-        /* get the share object */
+        /* get the share object, which must lie within the container */
         shareEntry_t* temp = (shareEntry_t*)(obj->downloadContainer_[cloudIndex] + index);
+        if (retSize - index < (int)sizeof(shareEntry_t)) {
+            break;
+        }
         int shareSize = temp->shareSize;
         index += sizeof(shareEntry_t);
+        if ((shareSize < 0) || (shareSize > retSize - index)) {
+            break;
+        }
 
         /* parse the share object */
         ItemMeta_t output;
         output.type = 1;
         memcpy(&(output.shareObj.share_header), temp, sizeof(shareEntry_t));
+        output.shareObj.data = (char*)malloc(sizeof(char) * shareSize);
         memcpy(output.shareObj.data, obj->downloadContainer_[cloudIndex] + index, shareSize);
 
         index += shareSize;
@@ -148,10 +252,175 @@ void* Downloader::thread_handler_meta(void* param)
         /* add the share object to ringbuffer */
         obj->ringBufferMeta_[cloudIndex]->Insert(&output, sizeof(output));
         count++;
-        if (count == numOfChunk) {
-            break;
+    }
+    if ((count < numOfChunk) && !obj->cloudLost_[cloudIndex]) {
+        printf("fail to download the metadata from cloud %d\n", cloudIndex);
+    }
+
+    /* the end object comes before the last metadata chunk if the download failed */
+    ItemMeta_t end;
+    end.type = 2;
+    obj->ringBufferMeta_[cloudIndex]->Insert(&end, sizeof(end));
+    return NULL;
+}
+
+/*
+ * thread handler that assembles the shares of a streamed restore and feeds the decoder
+ *
+ * @param param - the downloader
+ *
+ */
+void* Downloader::thread_handler_assemble(void* param)
+{
+    Downloader* obj = (Downloader*)param;
+    int k = obj->subset_;
+
+    /* the shares of a secret may come from any k clouds in any order, they wait in a window indexed by position */
+    streamSlot_t* slots = (streamSlot_t*)malloc(sizeof(streamSlot_t) * STREAM_WINDOW_SIZE);
+    for (int i = 0; i < STREAM_WINDOW_SIZE; i++) {
+        slots[i].position = -1;
+        slots[i].count = 0;
+        for (int j = 0; j < MAX_NUMBER_OF_CLOUDS; j++) {
+            slots[i].shares[j] = NULL;
+            slots[i].buffers[j] = NULL;
+        }
+    }
+
+    /* the number of secrets is only known at the end, so the last secret is held back until then */
+    obj->decodeObj_->setTotal(LONG_MAX);
+    Decoder::ShareChunk_t pending;
+    pending.shares[0] = NULL;
+
+    long count = 0;
+    long zeroIndex = 0;
+    long decodeCount = 0;
+    long total = -2;
+    bool finished = false;
+
+    /* the clouds lost before the restore started send no shares, and no end either */
+    int numOfEnded = 0;
+    for (int i = 0; i < obj->numOfStreamClouds_; i++) {
+        numOfEnded += obj->cloudLost_[i];
+    }
+    while ((numOfEnded < obj->numOfStreamClouds_) || !finished) {
+        streamItem_t input;
+        obj->streamBuffer_->Extract(&input);
+
+        if (input.type == 2) {
+            numOfEnded++;
+            pthread_mutex_lock(&obj->streamLock_);
+            obj->cloudDead_[input.cloudIndex] = true;
+            pthread_cond_broadcast(&obj->streamCond_);
+            pthread_mutex_unlock(&obj->streamLock_);
+            continue;
+        }
+        if (input.type == 3) {
+            total = input.position;
+        } else {
+            /* shares of secrets already decoded, or sent again to a spare cloud, are dropped */
+            streamSlot_t* slot = &slots[input.position % STREAM_WINDOW_SIZE];
+            if (finished || (input.position < count) || (slot->count == k)
+                || ((slot->count > 0) && (slot->position != input.position))
+                || (slot->shares[input.cloudIndex] != NULL)) {
+                sharedBufferRelease(input.buffer);
+                continue;
+            }
+            if (slot->count == 0) {
+                slot->position = input.position;
+                memcpy(&slot->share_header, &input.share_header, sizeof(shareEntry_t));
+            }
+            slot->shares[input.cloudIndex] = input.data;
+            slot->buffers[input.cloudIndex] = input.buffer;
+            slot->count++;
+        }
+
+        /* pass the secrets whose k shares are complete to the decoder in order */
+        long before = count;
+        while (!finished && (slots[count % STREAM_WINDOW_SIZE].count == k)) {
+            streamSlot_t* slot = &slots[count % STREAM_WINDOW_SIZE];
+            int shareSize = slot->share_header.shareSize;
+            Decoder::ShareChunk_t package;
+            package.secretSize = slot->share_header.secretSize;
+            package.shareSize = shareSize;
+            package.secretID = slot->share_header.secretID;
+            package.zero = 0;
+            package.cached = 0;
+            package.shareMask = 0;
+            obj->setCacheKey(count, &package);
+
+            /* hand the shares of a secret to the decoder in cloud order, together with their buffers */
+            int copied = 0;
+            for (int j = 0; j < obj->numOfStreamClouds_; j++) {
+                if (slot->shares[j] != NULL) {
+                    package.shares[copied] = slot->shares[j];
+                    package.buffers[copied] = slot->buffers[j];
+                    copied++;
+                    package.shareMask |= (1 << j);
+                    slot->shares[j] = NULL;
+                    slot->buffers[j] = NULL;
+                }
+            }
+            slot->count = 0;
+            slot->position = -1;
+
+            if (pending.shares[0] != NULL) {
+                obj->decodeObj_->add(&pending);
+                decodeCount++;
+            }
+            obj->addZeroSecrets(count, &zeroIndex, &decodeCount);
+            pending = package;
+            count++;
+        }
+        if (count != before) {
+            pthread_mutex_lock(&obj->streamLock_);
+            obj->dispatched_ = count;
+            pthread_cond_broadcast(&obj->streamCond_);
+            pthread_mutex_unlock(&obj->streamLock_);
+        }
+
+        if (finished || ((total != -1) && (total != count))) {
+            continue;
+        }
+        finished = true;
+
+        /* set the total before the last secret, which ends the collect thread */
+        long numOfSecrets;
+        if (total == -1) {
+            if (pending.shares[0] != NULL) {
+                for (int j = 0; j < k; j++) {
+                    sharedBufferRelease(pending.buffers[j]);
+                }
+                pending.shares[0] = NULL;
+            }
+            numOfSecrets = decodeCount;
+        } else {
+            pthread_mutex_lock(&obj->zeroLock_);
+            numOfSecrets = decodeCount + (pending.shares[0] != NULL) + obj->numOfZeroSecrets_ - zeroIndex;
+            pthread_mutex_unlock(&obj->zeroLock_);
+        }
+        obj->reportSecrets(count);
+
+        /* an empty or failed file ends with an empty zero secret, so the decoder still stops */
+        bool terminate = (total == -1) || (numOfSecrets == 0);
+        obj->decodeObj_->setTotal(terminate ? numOfSecrets + 1 : numOfSecrets);
+        if (pending.shares[0] != NULL) {
+            obj->decodeObj_->add(&pending);
+            decodeCount++;
+        }
+        if (total != -1) {
+            obj->addZeroSecrets(count, &zeroIndex, &decodeCount);
+        }
+        if (terminate) {
+            obj->decodeObj_->addEnd();
+        }
+    }
+
+    for (int i = 0; i < STREAM_WINDOW_SIZE; i++) {
+        for (int j = 0; j < MAX_NUMBER_OF_CLOUDS; j++) {
+            sharedBufferRelease(slots[i].buffers[j]);
         }
     }
+    free(slots);
     return NULL;
 }
 
@@ -162,43 +431,125 @@ void* Downloader::thread_handler_meta(void* param)
  * @param total - input total number of clouds
  * @param subset - input number of clouds to be chosen
  * @param obj - decoder pointer
+ * @param queueDepth - depth of the ringbuffer of each cloud (0 for DOWNLOAD_RB_SIZE)
+ * @param sockets - connected sockets of the clouds to reuse (NULL for connecting to ./config-d)
  */
-Downloader::Downloader(int total, int subset, int userID, Decoder* obj, char* fileName, int nameSize)
+Downloader::Downloader(int total, int subset, int userID, Decoder* obj, char* fileName, int nameSize, int queueDepth,
+    Socket** sockets)
 {
+    /* the shares of a secret are told apart by a bit per cloud */
+    valid_ = false;
+    if (total > MAX_NUMBER_OF_CLOUDS) {
+        fprintf(stderr, "Error: a restore reads from at most %d clouds!\n", MAX_NUMBER_OF_CLOUDS);
+        return;
+    }
+
+    /* open config file (not needed for reused sockets) */
+    FILE* fp = (sockets == NULL) ? fopen("./config-d", "rb") : NULL;
+    if ((sockets == NULL) && (fp == NULL)) {
+        fprintf(stderr, "Error: fail to open config file ./config-d!\n");
+        return;
+    }
+    valid_ = true;
+
     /* set private variables */
     total_ = total * 2;
     subset_ = subset;
     decodeObj_ = obj;
     memcpy(name_, fileName, nameSize);
     userID_ = userID;
+    ownSockets_ = (sockets == NULL);
+    numOfZeroSecrets_ = 0;
+    numOfDataSecrets_ = 0;
+    zeroSecretListSize_ = 1024;
+    zeroSecretList_ = (zeroSecret_t*)malloc(sizeof(zeroSecret_t) * zeroSecretListSize_);
+    pthread_mutex_init(&zeroLock_, NULL);
+    chunkCacheObj_ = NULL;
+    numOfCachedSecrets_ = 0;
+    cacheKeys_ = NULL;
+    cacheKeysSize_ = 0;
+    streamFailed_ = false;
+    numOfStreamClouds_ = 0;
+    listedID_ = INT_MIN;
+    dispatched_ = 0;
+    pthread_mutex_init(&streamLock_, NULL);
+    pthread_cond_init(&streamCond_, NULL);
+    if (queueDepth <= 0) {
+        queueDepth = DOWNLOAD_RB_SIZE;
+    }
 
     /* initialization*/
     ringBuffer_ = (RingBuffer<Item_t>**)malloc(sizeof(RingBuffer<Item_t>*) * total);
     ringBufferMeta_ = (RingBuffer<ItemMeta_t>**)malloc(sizeof(RingBuffer<ItemMeta_t>*) * total);
     signalBuffer_ = (RingBuffer<init_t>**)malloc(sizeof(RingBuffer<init_t>*) * total_);
-    downloadMetaBuffer_ = (char**)malloc(sizeof(char*) * total_);
+    signaled_ = (bool*)malloc(sizeof(bool) * total_);
     downloadContainer_ = (char**)malloc(sizeof(char*) * total_);
+    downloadCapacity_ = (int*)malloc(sizeof(int) * total_);
     socketArray_ = (Socket**)malloc(sizeof(Socket*) * total_);
     headerArray_ = (fileShareMDHead_t**)malloc(sizeof(fileShareMDHead_t*) * total_);
-    fileSizeCounter = (int*)malloc(sizeof(int) * total);
+    fileSizeCounter = (long*)malloc(sizeof(long) * total);
+    memset(fileSizeCounter, 0, sizeof(long) * total);
+    keyRecipe_ = (keyRecord_t**)malloc(sizeof(keyRecord_t*) * total);
+    numOfKeyRecords_ = (long*)malloc(sizeof(long) * total);
+    recipe_ = (fileRecipeEntry_t**)malloc(sizeof(fileRecipeEntry_t*) * total);
+    recipeSize_ = (long*)malloc(sizeof(long) * total);
+    numOfRecipeEntries_ = (long*)malloc(sizeof(long) * total);
+    recipeBase_ = (long*)malloc(sizeof(long) * total);
+    rangeStart_ = 0;
+    rangeEnd_ = LONG_MAX;
+    rangeFound_ = false;
+    keyRecipeData_ = (char**)malloc(sizeof(char*) * total);
+    keyRecipeSize_ = (long*)malloc(sizeof(long) * total);
+    firstChunkID_ = (int*)malloc(sizeof(int) * total);
+    lastChunkID_ = (int*)malloc(sizeof(int) * total);
+    cachedCursor_ = (long*)malloc(sizeof(long) * total);
+    streamBuffer_ = new RingBuffer<streamItem_t>(queueDepth, true, 1);
+    rangeBuffer_ = (RingBuffer<streamRange_t>**)malloc(sizeof(RingBuffer<streamRange_t>*) * total);
+    cloudState_ = (int*)malloc(sizeof(int) * total);
+    cloudDead_ = (bool*)malloc(sizeof(bool) * total);
+    cloudLost_ = (bool*)malloc(sizeof(bool) * total);
+    metaEnded_ = (bool*)malloc(sizeof(bool) * total);
+    numOfMetaClouds_ = 0;
+    sentCount_ = (long*)malloc(sizeof(long) * total);
+    recvCount_ = (long*)malloc(sizeof(long) * total);
+    recvPos_ = (long*)malloc(sizeof(long) * total);
+    for (int i = 0; i < total; i++) {
+        keyRecipe_[i] = NULL;
+        numOfKeyRecords_[i] = 0;
+        recipe_[i] = NULL;
+        recipeSize_[i] = 0;
+        numOfRecipeEntries_[i] = 0;
+        recipeBase_[i] = 0;
+        keyRecipeData_[i] = NULL;
+        keyRecipeSize_[i] = 0;
+        firstChunkID_[i] = -1;
+        lastChunkID_[i] = INT_MIN;
+        cachedCursor_[i] = 0;
+        cloudLost_[i] = false;
+        metaEnded_[i] = false;
+        rangeBuffer_[i] = new RingBuffer<streamRange_t>(STREAM_WINDOW_SIZE, true, 1);
+    }
 
-    /* open config file */
-    FILE* fp = fopen("./config-d", "rb");
     char line[225];
     const char ch[2] = ":";
 
     /* initialization loop  */
     for (int i = 0; i < total; i++) {
         signalBuffer_[i] = new RingBuffer<init_t>(DOWNLOAD_RB_SIZE, true, 1);
-        ringBufferMeta_[i] = new RingBuffer<ItemMeta_t>(DOWNLOAD_RB_SIZE, true, 1);
-        downloadMetaBuffer_[i] = (char*)malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
-        downloadContainer_[i] = (char*)malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
+        signaled_[i] = false;
+        ringBufferMeta_[i] = new RingBuffer<ItemMeta_t>(queueDepth, true, 1);
+        downloadContainer_[i] = NULL;
+        downloadCapacity_[i] = 0;
 
         /* create threads */
         param_t* param = (param_t*)malloc(sizeof(param_t)); // thread's parameter
         param->cloudIndex = i;
         param->obj = this;
         pthread_create(&tid_[i], 0, &thread_handler_meta, (void*)param);
+        if (!ownSockets_) {
+            socketArray_[i] = sockets[i];
+            continue;
+        }
         /* get config parameters */
         int ret = fscanf(fp, "%s", line);
         if (ret == 0)
@@ -213,15 +564,20 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj, char* fi
     }
     for (int i = total; i < total_; i++) {
         signalBuffer_[i] = new RingBuffer<init_t>(DOWNLOAD_RB_SIZE, true, 1);
-        ringBuffer_[i - total] = new RingBuffer<Item_t>(DOWNLOAD_RB_SIZE, true, 1);
-        downloadMetaBuffer_[i] = (char*)malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
-        downloadContainer_[i] = (char*)malloc(sizeof(char) * DOWNLOAD_BUFFER_SIZE);
+        signaled_[i] = false;
+        ringBuffer_[i - total] = new RingBuffer<Item_t>(queueDepth, true, 1);
+        downloadContainer_[i] = NULL;
+        downloadCapacity_[i] = 0;
 
         /* create threads */
         param_t* param = (param_t*)malloc(sizeof(param_t)); // thread's parameter
         param->cloudIndex = i;
         param->obj = this;
         pthread_create(&tid_[i], 0, &thread_handler, (void*)param);
+        if (!ownSockets_) {
+            socketArray_[i] = sockets[i];
+            continue;
+        }
         /* get config parameters */
         int ret = fscanf(fp, "%s", line);
         if (ret == 0)
@@ -234,7 +590,9 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj, char* fi
         /* create sockets */
         socketArray_[i] = new Socket(ip, port, userID);
     }
-    fclose(fp);
+    if (fp != NULL) {
+        fclose(fp);
+    }
     fileMDHeadSize_ = sizeof(fileShareMDHead_t);
     shareMDEntrySize_ = sizeof(shareMDEntry_t);
 }
@@ -245,23 +603,65 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj, char* fi
  */
 Downloader::~Downloader()
 {
+    /* an invalid downloader allocated nothing */
+    if (!valid_) {
+        return;
+    }
+
+    /* the decoder is done with the cached secrets, so their slots can be replaced again */
+    for (long i = 0; i < numOfZeroSecrets_; i++) {
+        if (zeroSecretList_[i].cached) {
+            chunkCacheObj_->release(zeroSecretList_[i].key);
+        }
+    }
     for (int i = 0; i < total_; i++) {
         delete (signalBuffer_[i]);
-        free(downloadMetaBuffer_[i]);
         free(downloadContainer_[i]);
-        delete (socketArray_[i]);
+        if (ownSockets_) {
+            delete (socketArray_[i]);
+        }
     }
     for (int i = 0; i < total_ / 2; i++) {
         delete (ringBufferMeta_[i]);
         delete (ringBuffer_[i]);
+        delete (rangeBuffer_[i]);
+        free(keyRecipe_[i]);
+        free(keyRecipeData_[i]);
+        free(recipe_[i]);
     }
+    delete (streamBuffer_);
+    free(rangeBuffer_);
+    free(cloudState_);
+    free(cloudDead_);
+    free(cloudLost_);
+    free(metaEnded_);
+    free(sentCount_);
+    free(recvCount_);
+    free(recvPos_);
+    free(recipeBase_);
+    free(signaled_);
+    free(keyRecipe_);
+    free(numOfKeyRecords_);
+    free(recipe_);
+    free(recipeSize_);
+    free(numOfRecipeEntries_);
+    free(keyRecipeData_);
+    free(keyRecipeSize_);
+    free(firstChunkID_);
+    free(lastChunkID_);
+    free(cachedCursor_);
+    free(cacheKeys_);
     free(signalBuffer_);
     free(ringBuffer_);
     free(ringBufferMeta_);
     free(headerArray_);
     free(socketArray_);
     free(downloadContainer_);
-    free(downloadMetaBuffer_);
+    free(downloadCapacity_);
+    free(zeroSecretList_);
+    pthread_mutex_destroy(&zeroLock_);
+    pthread_mutex_destroy(&streamLock_);
+    pthread_cond_destroy(&streamCond_);
 }
 
 /*
@@ -271,20 +671,17 @@ Downloader::~Downloader()
  * @param namesize - size of filename
  * @param numOfCloud - number of clouds that we download data
  *
+ * @return - a boolean value that indicates if all shares of the file were received
  */
 int Downloader::downloadFile(char* filename, int namesize, int numOfCloud)
 {
 
-    /* temp share buffer for assemble the ring buffer data chunks*/
-    unsigned char* shareBuffer;
-    shareBuffer = (unsigned char*)malloc(sizeof(unsigned char) * RING_BUFFER_DATA_SIZE * MAX_NUMBER_OF_CLOUDS);
-
     char buffer[256];
 
     /* add init object for download */
     int recipeIndex = 0;
     init_t input;
-    for (int i = total_ / 2; i < total_; i++) {
+    for (int i = total_ / 2; i < total_ / 2 + numOfCloud; i++) {
 
         input.type = 1;
         //copy the corresponding share as file name
@@ -294,49 +691,93 @@ int Downloader::downloadFile(char* filename, int namesize, int numOfCloud)
         input.namesize = uploadRecipeFileName.length();
         memcpy(&input.filename, uploadRecipeFileName.c_str(), input.namesize);
         signalBuffer_[i]->Insert(&input, sizeof(init_t));
+        signaled_[i] = true;
         recipeIndex++;
     }
     printf("data download thread start\n");
     /* get the header object from buffer */
     Item_t headerObj;
-    for (int i = 0; i < total_ / 2; i++) {
+    bool ended[numOfCloud];
+    bool failed = false;
+    long numOfShares = 0;
+    for (int i = 0; i < numOfCloud; i++) {
         ringBuffer_[i]->Extract(&headerObj);
+        ended[i] = (headerObj.type != 0);
+        if (ended[i]) {
+            failed = true;
+        } else {
+            numOfShares = headerObj.fileObj.file_header.numOfShares;
+        }
+    }
+    if (failed) {
+        endData(numOfCloud, ended);
+        decodeObj_->setTotal(1);
+        decodeObj_->addEnd();
+        return 0;
     }
     /* parse header object, tell decoder the total number of secret */
-    shareFileHead_t* header = &(headerObj.fileObj.file_header);
-    int numOfShares = header->numOfShares;
-    decodeObj_->setTotal(numOfShares);
-    printf("number of chunks = %d\n", numOfShares);
-    /* proceed each secret */
-    int count = 0;
+    reportSecrets(numOfShares);
+
+    /* a range past the end of the file has no secrets, so the decoder is stopped right away */
+    if (numOfShares + numOfZeroSecrets_ == 0) {
+        decodeObj_->setTotal(1);
+        decodeObj_->addEnd();
+        endData(numOfCloud, ended);
+        printf("download over!\n");
+        return 1;
+    }
+    decodeObj_->setTotal(numOfShares + numOfZeroSecrets_);
+    /* proceed each secret, with the zero secrets in between */
+    long count = 0;
+    long zeroIndex = 0;
+    long decodeCount = 0;
     while (count < numOfShares) {
-        int secretSize = 0;
-        int shareSize = 0;
-        int id = 0;
-        int shareBufferIndex = 0;
-        for (int i = 0; i < total_ / 2; i++) {
+        addZeroSecrets(count, &zeroIndex, &decodeCount);
+        Decoder::ShareChunk_t package;
+        int received = 0;
+        for (int i = 0; i < numOfCloud; i++) {
             Item_t output;
 
             ringBuffer_[i]->Extract(&output);
-            secretSize = output.shareObj.share_header.secretSize;
-            shareSize = output.shareObj.share_header.shareSize;
-            id = output.shareObj.share_header.secretID;
-            memcpy(shareBuffer + shareBufferIndex * shareSize, output.shareObj.data, shareSize);
-            shareBufferIndex++;
+            if (output.type != 1) {
+                ended[i] = true;
+                break;
+            }
+            received++;
+            package.secretSize = output.shareObj.share_header.secretSize;
+            package.shareSize = output.shareObj.share_header.shareSize;
+            package.secretID = output.shareObj.share_header.secretID;
+
+            /* the shares stay in their receive buffers, which the decoder releases */
+            package.shares[i] = output.shareObj.data;
+            package.buffers[i] = output.shareObj.buffer;
+        }
+
+        /* the shares of a cloud ended early, so the decoder is stopped after the secrets it got */
+        if (received < numOfCloud) {
+            for (int i = 0; i < received; i++) {
+                sharedBufferRelease(package.buffers[i]);
+            }
+            endData(numOfCloud, ended);
+            decodeObj_->setTotal(decodeCount + 1);
+            decodeObj_->addEnd();
+            fprintf(stderr, "Error: the shares of %s ended after %ld of %ld secrets!\n", name_, count, numOfShares);
+            return 0;
         }
 
         /* add the share buffer to the decoder ringbuffer */
-        Decoder::ShareChunk_t package;
-        package.secretSize = secretSize;
-        package.shareSize = shareSize;
-        package.secretID = id;
-        memcpy(&(package.data), shareBuffer, numOfCloud * shareSize);
-        decodeObj_->add(&package, count % DECODE_NUM_THREADS);
+        package.zero = 0;
+        package.cached = 0;
+        package.shareMask = 0;
+        setCacheKey(count, &package);
+        decodeObj_->add(&package);
+        decodeCount++;
         count++;
     }
-    free(shareBuffer);
+    addZeroSecrets(count, &zeroIndex, &decodeCount);
+    endData(numOfCloud, ended);
     printf("download over!\n");
-    return 0;
+    return 1;
 }
 
 /*
@@ -346,15 +787,68 @@ int Downloader::downloadFile(char* filename, int namesize, int numOfCloud)
  * @param namesize - size of filename
  * @param numOfCloud - number of clouds that we download data
  *
+ * @return - -1 once the file recipes are stored on the clouds, or 0 if the metadata of a cloud fails
  */
 int Downloader::preDownloadFile(char* filename, int namesize, int numOfCloud)
 {
+    long numOfShares[numOfCloud];
+    int levels[numOfCloud];
+
+    if (!startMetaDownload(filename, namesize, numOfCloud, numOfShares, levels)) {
+        return 0;
+    }
+
+    /* proceed each secret; the shares are read from these clouds, so none of them can be left out */
+    for (int i = 0; i < numOfCloud; i++) {
+        /* the keys of the metadata chunks under index chunks come after them, so they are kept until the tree is complete */
+        if (levels[i] > 0) {
+            if (!restoreRecipeTree(i, numOfShares[i], levels[i])) {
+                return 0;
+            }
+            continue;
+        }
+        for (long j = 0; j < numOfShares[i]; j++) {
+            ItemMeta_t output;
+            if (!extractMeta(i, &output)) {
+                return 0;
+            }
+            writeRetrivedFileRecipe(output, i);
+            free(output.shareObj.data);
+        }
+    }
+
+    for (int i = 0; i < numOfCloud; i++) {
+
+        uploadRetrivedRecipeFile(i);
+    }
+
+    /* the data servers read the recipes, so the shares are only requested once every recipe is stored */
+    for (int i = 0; i < numOfCloud; i++) {
+        int ack;
+        if ((socketArray_[i]->genericDownload((char*)&ack, sizeof(int)) != 0) || (ack != FILE_RECIPE)) {
+            printf("fail to store the file recipe on cloud %d\n", i);
+        }
+    }
+    printf("pre - download over!\n");
+    return -1;
+}
 
-    /* temp share buffer for assemble the ring buffer data chunks*/
-    unsigned char* shareBuffer;
-    shareBuffer = (unsigned char*)malloc(sizeof(unsigned char) * RING_BUFFER_DATA_SIZE * MAX_NUMBER_OF_CLOUDS);
+/*
+ * request the metadata chunks of a file and load the key recipe of each cloud
+ *
+ * @param filename - targeting filename
+ * @param namesize - size of filename
+ * @param numOfCloud - number of clouds that we download data
+ * @param numOfChunks - number of metadata and index chunks of each cloud <return>
+ * @param levels - the level of the chunks pointed to by the key recipe of each cloud <return>
+ *
+ * @return - a boolean value that indicates if the headers of at least k clouds are read
+ */
+int Downloader::startMetaDownload(char* filename, int namesize, int numOfCloud, long* numOfChunks, int* levels)
+{
 
-    unsigned char tmp[namesize * 32];
+    /* the name is padded to whole secret words, as in Encoder::collect */
+    unsigned char tmp[decodeObj_->n_ * (namesize + 32 * (decodeObj_->n_ + 1))];
     int tmp_s;
 
     // encode the filepath into shares
@@ -363,204 +857,1056 @@ int Downloader::preDownloadFile(char* filename, int namesize, int numOfCloud)
     /* add init object for download */
     init_t input;
     for (int i = 0; i < numOfCloud; i++) {
+        numOfChunks[i] = 0;
+        levels[i] = 0;
+        if (cloudLost_[i]) {
+            continue;
+        }
         input.type = 1;
 
         //copy the corresponding share as file name
         memcpy(&input.filename, tmp + i * tmp_s, tmp_s);
         input.namesize = tmp_s;
         signalBuffer_[i]->Insert(&input, sizeof(init_t));
+        signaled_[i] = true;
     }
 
     /* get the header object from buffer */
-    ItemMeta_t headerObj;
-    int numOfShares[numOfCloud];
-
+    long fileSize = 0;
     for (int i = 0; i < numOfCloud; i++) {
-        ringBufferMeta_[i]->Extract(&headerObj);
-        /* parse header object, tell decoder the total number of secret */
+        ItemMeta_t headerObj;
+        if (cloudLost_[i] || !extractMeta(i, &headerObj)) {
+            continue;
+        }
         shareFileHead_t* header = &(headerObj.fileObj.file_header);
-        numOfShares[i] = header->numOfShares;
+        numOfChunks[i] = header->numOfShares;
+        levels[i] = loadKeyRecipe(i, numOfChunks[i]);
+        if (levels[i] < 0) {
+            loseCloud(i);
+            continue;
+        }
+        fileSize = header->fileSize;
+    }
+    if (numOfLiveClouds() < subset_) {
+        fprintf(stderr, "Error: the metadata of %s is read from fewer than %d clouds!\n", name_, subset_);
+        return 0;
+    }
+
+    /* the header keeps the size of the original file, so the decoder can lay it out before any secret arrives */
+    decodeObj_->setFileSize(fileSize);
+    return 1;
+}
+
+/*
+ * main procedure for restoring a file by streaming its recipe
+ *
+ * @param filename - targeting filename
+ * @param namesize - size of filename
+ * @param numOfCloud - number of clouds that we download data
+ *
+ * @return - a boolean value that indicates if all shares of the file were received
+ */
+int Downloader::streamFile(char* filename, int namesize, int numOfCloud)
+{
+    long numOfChunks[numOfCloud];
+    int levels[numOfCloud];
+    long chunksLeft[numOfCloud];
+
+    /* without the metadata of k clouds nothing is restored, so the decoder is stopped right away */
+    bool started = startMetaDownload(filename, namesize, numOfCloud, numOfChunks, levels);
+
+    /* the chunks of a metadata tree arrive bottom-up, so its recipe is rebuilt in memory before it is streamed */
+    for (int i = 0; started && (i < numOfCloud); i++) {
+        chunksLeft[i] = 0;
+        if (cloudLost_[i]) {
+            continue;
+        }
+        if (levels[i] > 0) {
+            if (!restoreRecipeTree(i, numOfChunks[i], levels[i]) && !cloudLost_[i]) {
+                loseCloud(i);
+            }
+        } else {
+            chunksLeft[i] = numOfChunks[i];
+        }
+    }
+    if (!started || (numOfLiveClouds() < subset_)) {
+        decodeObj_->setTotal(1);
+        decodeObj_->addEnd();
+        return 0;
     }
-    /* proceed each secret */
 
+    /* the first k clouds that are not lost serve the file, the others are kept as spares */
+    numOfStreamClouds_ = numOfCloud;
+    dispatched_ = 0;
+    int numOfActive = 0;
     for (int i = 0; i < numOfCloud; i++) {
-        for (int j = 0; j < numOfShares[i]; j++) {
-            ItemMeta_t output;
-            ringBufferMeta_[i]->Extract(&output);
-            writeRetrivedFileRecipe(output, i);
+        cloudState_[i] = (!cloudLost_[i] && (numOfActive < subset_)) ? CLOUD_ACTIVE : CLOUD_SPARE;
+        numOfActive += (cloudState_[i] == CLOUD_ACTIVE);
+        cloudDead_[i] = cloudLost_[i];
+        sentCount_[i] = 0;
+        recvCount_[i] = 0;
+        recvPos_[i] = 0;
+        recipeBase_[i] = 0;
+    }
+
+    /* the data threads read the shares while the recipe lists are sent */
+    init_t input;
+    input.type = STREAM_SIGNAL;
+    input.namesize = 0;
+    int indicator = STREAM_RESTORE;
+    for (int i = 0; i < numOfCloud; i++) {
+        if (cloudLost_[i]) {
+            continue;
+        }
+        socketArray_[total_ / 2 + i]->genericSend((char*)&indicator, sizeof(int));
+        signalBuffer_[total_ / 2 + i]->Insert(&input, sizeof(init_t));
+        signaled_[total_ / 2 + i] = true;
+    }
+    streamFailed_ = false;
+    pthread_create(&assembleTid_, 0, &thread_handler_assemble, (void*)this);
+    printf("data download thread start\n");
+
+    /*
+     * the recipes of all clouds list the same secrets, so they are decrypted in lockstep and any
+     * cloud can take over the positions of another; the positions requested stay within a window
+     * ahead of the decoder, which bounds the shares waiting for the slowest cloud
+     */
+    long nextPos = 0;
+    while (true) {
+        long listSize = STREAM_LIST_SIZE;
+        for (int i = 0; i < numOfCloud; i++) {
+            if (cloudLost_[i]) {
+                continue;
+            }
+            while ((recipeBase_[i] + numOfRecipeEntries_[i] < nextPos + STREAM_LIST_SIZE) && (chunksLeft[i] > 0)) {
+                ItemMeta_t output;
+                if (!extractMeta(i, &output)) {
+                    break;
+                }
+                writeRetrivedFileRecipe(output, i);
+                free(output.shareObj.data);
+                chunksLeft[i]--;
+            }
+            if (cloudLost_[i]) {
+                continue;
+            }
+            if (recipeBase_[i] + numOfRecipeEntries_[i] - nextPos < listSize) {
+                listSize = recipeBase_[i] + numOfRecipeEntries_[i] - nextPos;
+            }
+        }
+        if (numOfLiveClouds() < subset_) {
+            fprintf(stderr, "Error: the metadata of %s is read from fewer than %d clouds!\n", name_, subset_);
+            streamFailed_ = true;
+            break;
+        }
+        if (listSize <= 0) {
+            break;
+        }
+        if (!waitForWindow(nextPos + listSize - STREAM_WINDOW_SIZE, nextPos)) {
+            streamFailed_ = true;
+            break;
+        }
+        for (int i = 0; i < numOfCloud; i++) {
+            if (cloudState_[i] == CLOUD_ACTIVE) {
+                sendStreamList(i, nextPos, listSize);
+            }
+        }
+        nextPos += listSize;
+
+        /* entries behind the decoder are never sent again, they are dropped once they fill a window */
+        pthread_mutex_lock(&streamLock_);
+        long done = dispatched_;
+        pthread_mutex_unlock(&streamLock_);
+        for (int i = 0; i < numOfCloud; i++) {
+            long drop = done - recipeBase_[i];
+            if (!cloudLost_[i] && (drop >= STREAM_WINDOW_SIZE)) {
+                memmove(recipe_[i], recipe_[i] + drop, sizeof(fileRecipeEntry_t) * (numOfRecipeEntries_[i] - drop));
+                numOfRecipeEntries_[i] -= drop;
+                recipeBase_[i] += drop;
+            }
+        }
+    }
+
+    for (int i = 0; i < numOfCloud; i++) {
+        if (cloudLost_[i]) {
+            continue;
         }
+        if (!streamFailed_ && ((recipeBase_[i] + numOfRecipeEntries_[i] != nextPos) || (chunksLeft[i] > 0))) {
+            fprintf(stderr, "Error: the file recipe of cloud %d does not match the others!\n", i);
+            streamFailed_ = true;
+        }
+    }
+    if (!streamFailed_ && !waitForWindow(nextPos, nextPos)) {
+        streamFailed_ = true;
     }
 
+    /* the assembler ends the file once the secrets are all decoded, or right away on a failure */
+    streamItem_t end;
+    end.type = 3;
+    end.cloudIndex = 0;
+    end.position = streamFailed_ ? -1 : nextPos;
+    end.data = NULL;
+    end.buffer = NULL;
+    streamBuffer_->Insert(&end, sizeof(end));
+
+    /* a replaced cloud may still owe many shares that are no longer needed, its connection is cut instead of drained */
     for (int i = 0; i < numOfCloud; i++) {
+        if (cloudLost_[i]) {
+            continue;
+        }
+        pthread_mutex_lock(&streamLock_);
+        bool owing = !streamFailed_ && (cloudState_[i] == CLOUD_RETIRED) && !cloudDead_[i] && (recvCount_[i] < sentCount_[i]);
+        pthread_mutex_unlock(&streamLock_);
+        if (owing) {
+            printf("hedged restore: cloud %d is cut off with %ld shares due\n", i, sentCount_[i] - recvCount_[i]);
+            socketArray_[total_ / 2 + i]->interrupt();
+        } else {
+            sendRecipeList(i, NULL, 0);
+        }
+    }
+    pthread_join(assembleTid_, NULL);
 
-        uploadRetrivedRecipeFile(i);
+    for (int i = 0; i < numOfCloud; i++) {
+        free(recipe_[i]);
+        recipe_[i] = NULL;
+        recipeSize_[i] = 0;
+        numOfRecipeEntries_[i] = 0;
+        recipeBase_[i] = 0;
+        free(keyRecipe_[i]);
+        keyRecipe_[i] = NULL;
+        numOfKeyRecords_[i] = 0;
     }
-    printf("pre - download over!\n");
-    free(shareBuffer);
-    return -1;
+    printf("download over!\n");
+    return !streamFailed_;
 }
 
 /*
- * test if it's the end of downloading a file
+ * send a list of recipe entries of a streamed restore to the data server of a cloud
+ *
+ * @param index - the cloud index
+ * @param entries - the recipe entries
+ * @param numOfEntries - the number of entries, 0 for ending the stream
  *
  */
-int Downloader::indicateEnd()
+void Downloader::sendRecipeList(int index, fileRecipeEntry_t* entries, int numOfEntries)
 {
-
-    for (int i = 0; i < total_; i++) {
-        /* trying to join all threads */
-        pthread_join(tid_[i], NULL);
+    socketArray_[total_ / 2 + index]->genericSend((char*)&numOfEntries, sizeof(int));
+    if (numOfEntries > 0) {
+        socketArray_[total_ / 2 + index]->genericSend((char*)entries, sizeof(fileRecipeEntry_t) * numOfEntries);
     }
-    return 1;
 }
 
 /*
- * download the file's keyRecipe from each cloud for decrypt metadata chunk
+ * request the shares at some positions of the file recipe from a cloud
  *
- * @param name - targeting filename
+ * @param index - the cloud index
+ * @param start - the first position
+ * @param size - the number of positions
  *
  */
-int Downloader::downloadKeyFile(char* name)
+void Downloader::sendStreamList(int index, long start, int size)
 {
+    pthread_mutex_lock(&streamLock_);
+    sentCount_[index] += size;
+    pthread_mutex_unlock(&streamLock_);
+
+    /* the range goes first, so the data thread knows the positions of the shares that come back */
+    streamRange_t range;
+    range.start = start;
+    range.size = size;
+    rangeBuffer_[index]->Insert(&range, sizeof(range));
+    sendRecipeList(index, recipe_[index] + (start - recipeBase_[index]), size);
+}
 
-    int indicator = GET_KEY_RECIPE;
-
-    char buffer[256];
-
-    for (int i = 0; i < subset_; i++) {
-
-        // download key recipe from each server
-        memset(buffer, 0, 256);
-        sprintf(buffer, "%s-share-%d-enc.key", name, i);
-        string encFileName(buffer);
-
-        int namesize = encFileName.length();
-        socketArray_[i]->genericSend((char*)&indicator, sizeof(int));
-        socketArray_[i]->genericSend((char*)&namesize, sizeof(int));
-        socketArray_[i]->genericSend((char*)encFileName.c_str(), namesize);
-        int length;
-        socketArray_[i]->genericDownload((char*)&length, sizeof(int));
-        char* keybuffer = (char*)malloc(sizeof(char) * length);
-        socketArray_[i]->genericDownload(keybuffer, length);
-        memset(buffer, 0, 256);
-        sprintf(buffer, "%s-share-%d-enc.key.d", name, i);
-        string downloadEncFileName(buffer);
-
-        FILE* wp = fopen(downloadEncFileName.c_str(), "w");
-        if (wp == NULL) {
-
-            printf("key-%d.d file can not creat\n", i);
-            return 0;
-        } else {
-
-            fwrite(keybuffer, 1, length, wp);
-            fclose(wp);
+/*
+ * wait until the secrets before a position are passed to the decoder, replacing the
+ * servers that end or hold the restore back by spare ones
+ *
+ * @param limit - the position to wait for
+ * @param nextPos - the number of positions requested so far
+ *
+ * @return - a boolean value that indicates if the restore can go on
+ */
+int Downloader::waitForWindow(long limit, long nextPos)
+{
+    pthread_mutex_lock(&streamLock_);
+    while (true) {
+        /* a cloud whose shares ended is replaced at once */
+        bool dead = false;
+        for (int i = 0; i < numOfStreamClouds_; i++) {
+            if ((cloudState_[i] == CLOUD_ACTIVE) && cloudDead_[i]) {
+                dead = true;
+                if (!replaceCloud(i, nextPos)) {
+                    pthread_mutex_unlock(&streamLock_);
+                    return 0;
+                }
+            }
+        }
+        if (dispatched_ >= limit) {
+            break;
         }
 
-        // decode key recipe
-        memset(buffer, 0, 256);
-        sprintf(buffer, "%s-share-%d-dec.key", name, i);
-        string keyFileName(buffer);
-
-        char cmd[256];
-        snprintf(cmd, sizeof(cmd), "openssl enc -d -aes-128-cbc -out %s -in %s -pass pass:test", keyFileName.c_str(), downloadEncFileName.c_str());
-        pid_t status = system(cmd);
-        if (status == -1) {
-            printf("error in system call function %s\n", cmd);
+        long before = dispatched_;
+        struct timeval now;
+        struct timespec deadline;
+        gettimeofday(&now, NULL);
+        long nsec = now.tv_usec * 1000L + STREAM_HEDGE_DELAY_MS * 1000000L;
+        deadline.tv_sec = now.tv_sec + nsec / 1000000000L;
+        deadline.tv_nsec = nsec % 1000000000L;
+        if ((pthread_cond_timedwait(&streamCond_, &streamLock_, &deadline) != ETIMEDOUT) || (dispatched_ != before) || dead) {
+            continue;
         }
-        snprintf(cmd, sizeof(cmd), "rm -rf %s", encFileName.c_str());
-        status = system(cmd);
-        if (status == -1) {
-            printf("error in system call function %s\n", cmd);
+
+        /* no secret was decoded for a while, the active cloud furthest behind the decoder is replaced */
+        int laggard = -1;
+        for (int i = 0; i < numOfStreamClouds_; i++) {
+            if ((cloudState_[i] == CLOUD_ACTIVE) && (recvCount_[i] < sentCount_[i]) && (recvPos_[i] <= dispatched_)
+                && ((laggard == -1) || (recvPos_[i] < recvPos_[laggard]))) {
+                laggard = i;
+            }
         }
-        snprintf(cmd, sizeof(cmd), "rm -rf %s", downloadEncFileName.c_str());
-        status = system(cmd);
-        if (status == -1) {
-            printf("error in system call function %s\n", cmd);
+        if ((laggard != -1) && !replaceCloud(laggard, nextPos)) {
+            pthread_mutex_unlock(&streamLock_);
+            return 0;
         }
     }
+    pthread_mutex_unlock(&streamLock_);
     return 1;
 }
 
 /*
- * rebuilt file recipe by downloaded metadata chunk & keyRecipe
+ * replace an active cloud of a streamed restore by a spare one, which must hold the lock
  *
- * @param input - metadata chunk object
- * @param index - cloud id that metadata chunk download 
- * @param numOfCloud - number of clouds that we download data
+ * @param index - the cloud to replace
+ * @param nextPos - the number of positions requested so far
  *
+ * @return - a boolean value that indicates if the restore can go on
  */
-int Downloader::writeRetrivedFileRecipe(ItemMeta_t& input, int index)
+int Downloader::replaceCloud(int index, long nextPos)
 {
-
-    char nameBuffer[256];
-    memset(nameBuffer, 0, 256);
-    sprintf(nameBuffer, "share-%d.recipe", index);
-    string writeName(nameBuffer);
-
-    int metaChunkID = ~input.shareObj.share_header.secretID + 1;
-
-    memset(nameBuffer, 0, 256);
-    sprintf(nameBuffer, "%s-share-%d-dec.key", name_, index);
-    string keyFileName(nameBuffer);
-
-    int metaKeySize = FP_SIZE * 2 + sizeof(int);
-
-    FILE* kfp = fopen(keyFileName.c_str(), "rb+");
-    if (kfp == NULL) {
-        printf("can't open recipe file %s\n", writeName.c_str());
-    } else {
-        char keyBuffer[metaKeySize];
-        for (int i = 0; i < metaChunkID; i++) {
-            int realRead = fread(keyBuffer, metaKeySize, 1, kfp);
-            if (realRead != 1) {
-                printf("read file error %s\n", keyFileName.c_str());
-            }
-        }
-        int metaChunkIDTemp;
-        memcpy(&metaChunkIDTemp, keyBuffer, sizeof(int));
-        metaChunkIDTemp = ~metaChunkIDTemp + 1;
-        if (metaChunkIDTemp != metaChunkID) {
-            printf("error in get metadata chunk key id = %d", metaChunkID);
-            return 0;
+    /* a retired cloud can serve again once it has sent back everything it was asked for */
+    int spare = -1;
+    bool waiting = false;
+    for (int i = 0; i < numOfStreamClouds_; i++) {
+        if (cloudDead_[i] || (cloudState_[i] == CLOUD_ACTIVE)) {
+            continue;
         }
-        char key[FP_SIZE];
-        memcpy(key, keyBuffer + sizeof(int) + FP_SIZE, FP_SIZE);
-        char decData[input.shareObj.share_header.shareSize];
-        bool decFlag = decodeObj_->cryptoObj_[0]->decryptWithKey((unsigned char*)input.shareObj.data, input.shareObj.share_header.shareSize, (unsigned char*)key, (unsigned char*)decData);
-        if (!decFlag) {
-            printf("error in decrypt first 32B of metadata chunk id = %d\n", metaChunkID);
-            return 0;
+        if ((cloudState_[i] == CLOUD_SPARE) || (recvCount_[i] == sentCount_[i])) {
+            spare = i;
+            break;
         }
-        memcpy(input.shareObj.data, decData, input.shareObj.share_header.shareSize);
-        fclose(kfp);
+        waiting = true;
+    }
+    if (spare == -1) {
+        if (cloudDead_[index] && !waiting) {
+            fprintf(stderr, "Error: cloud %d ended the restore and no other cloud is left!\n", index);
+            return 0;
+        }
+        return 1;
     }
 
-    FILE* fp = fopen(writeName.c_str(), "ab+");
-    if (fp == NULL) {
-        printf("can't open recipe file %s\n", writeName.c_str());
+    cloudState_[index] = CLOUD_RETIRED;
+    cloudState_[spare] = CLOUD_ACTIVE;
+    long start = dispatched_;
+    recvPos_[spare] = start;
+    pthread_mutex_unlock(&streamLock_);
+
+    /* the spare gets all positions not yet decoded, the shares the others already sent are dropped */
+    printf("hedged restore: cloud %d replaces cloud %d from secret %ld\n", spare, index, start);
+    while (start < nextPos) {
+        int size = (nextPos - start < STREAM_LIST_SIZE) ? (int)(nextPos - start) : STREAM_LIST_SIZE;
+        sendStreamList(spare, start, size);
+        start += size;
+    }
+
+    pthread_mutex_lock(&streamLock_);
+    return 1;
+}
+
+/*
+ * test if it's the end of downloading a file
+ *
+ */
+int Downloader::indicateEnd()
+{
+
+    /* the metadata threads add an end object when they stop, which is waited for as they may still be reading */
+    for (int i = 0; i < total_ / 2; i++) {
+        endMeta(i);
+    }
+
+    /* threads of the clouds left out of the file wait for a signal, so they are told to stop */
+    init_t stop;
+    stop.type = STOP_SIGNAL;
+    stop.namesize = 0;
+    for (int i = 0; i < total_; i++) {
+        if (!signaled_[i]) {
+            signalBuffer_[i]->Insert(&stop, sizeof(init_t));
+        }
+    }
+    for (int i = 0; i < total_; i++) {
+        /* trying to join all threads */
+        pthread_join(tid_[i], NULL);
+    }
+    return 1;
+}
+
+/*
+ * get the next metadata object of a cloud, leaving the cloud out of the restore if its metadata
+ * fails, or holds the restore back while other clouds can take its place
+ *
+ * @param index - the cloud index
+ * @param output - the object <return>
+ *
+ * @return - a boolean value that indicates if an object was extracted
+ */
+int Downloader::extractMeta(int index, ItemMeta_t* output)
+{
+    long waited = 0;
+    while (!cloudLost_[index]) {
+        if (ringBufferMeta_[index]->ExtractTimeout(output, STREAM_HEDGE_DELAY_MS) == 0) {
+            if (output->type != 2) {
+                return 1;
+            }
+            metaEnded_[index] = true;
+            printf("the metadata of %s from cloud %d ended early, the cloud is left out\n", name_, index);
+            loseCloud(index);
+            return 0;
+        }
+
+        /* as in the hedged restore of the shares, a spare takes the place of a cloud that stalls */
+        waited += STREAM_HEDGE_DELAY_MS;
+        if ((numOfLiveClouds() > subset_) || (waited >= STREAM_META_TIMEOUT_MS)) {
+            printf("cloud %d holds the metadata of %s back for %ldms, the cloud is left out\n", index, name_, waited);
+            loseCloud(index);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * leave a cloud out of the restore, cutting its connections off
+ *
+ * @param index - the cloud index
+ *
+ */
+void Downloader::loseCloud(int index)
+{
+    /* the metadata thread stops at its next object, or once its blocked read returns */
+    cloudLost_[index] = true;
+    socketArray_[index]->interrupt();
+    endMeta(index);
+
+    /* a cloud that already streams shares ends them, so it is replaced as if its data server failed */
+    if (signaled_[total_ / 2 + index]) {
+        socketArray_[total_ / 2 + index]->interrupt();
+        pthread_mutex_lock(&streamLock_);
+        cloudDead_[index] = true;
+        pthread_cond_broadcast(&streamCond_);
+        pthread_mutex_unlock(&streamLock_);
+    }
+}
+
+/*
+ * wait for the metadata thread of a cloud to end, dropping the objects it still adds
+ *
+ * @param index - the cloud index
+ *
+ */
+void Downloader::endMeta(int index)
+{
+    if (!signaled_[index]) {
+        return;
+    }
+    while (!metaEnded_[index]) {
+        ItemMeta_t output;
+        if (ringBufferMeta_[index]->ExtractTimeout(&output, STREAM_HEDGE_DELAY_MS) != 0) {
+            /* a thread still reading metadata that no one waits for is cut off */
+            cloudLost_[index] = true;
+            socketArray_[index]->interrupt();
+            continue;
+        }
+        if (output.type == 1) {
+            free(output.shareObj.data);
+        }
+        metaEnded_[index] = (output.type == 2);
+    }
+}
+
+/*
+ * wait for the data threads of the first clouds to end, dropping the shares they still add
+ *
+ * @param numOfCloud - the number of clouds
+ * @param ended - whether the end object of each cloud was extracted <return>
+ *
+ */
+void Downloader::endData(int numOfCloud, bool* ended)
+{
+    for (int i = 0; i < numOfCloud; i++) {
+        while (!ended[i]) {
+            Item_t output;
+            if (ringBuffer_[i]->ExtractTimeout(&output, STREAM_HEDGE_DELAY_MS) != 0) {
+                socketArray_[total_ / 2 + i]->interrupt();
+                continue;
+            }
+            if (output.type == 1) {
+                sharedBufferRelease(output.shareObj.buffer);
+            }
+            ended[i] = (output.type == 2);
+        }
+    }
+}
+
+/*
+ * count the clouds whose metadata is read and not left out of the restore
+ *
+ * @return - the number of clouds
+ */
+int Downloader::numOfLiveClouds()
+{
+    int count = 0;
+    for (int i = 0; i < numOfMetaClouds_; i++) {
+        count += !cloudLost_[i];
+    }
+    return count;
+}
+
+/*
+ * download the file's keyRecipe from each cloud for decrypt metadata chunk
+ *
+ * @param name - targeting filename
+ * @param numOfCloud - number of clouds that we download data
+ *
+ * @return - a boolean value that indicates if the key recipes of at least k clouds are loaded
+ */
+int Downloader::downloadKeyFile(char* name, int numOfCloud)
+{
+
+    int indicator = GET_KEY_RECIPE;
+
+    char buffer[256];
+    numOfMetaClouds_ = numOfCloud;
+
+    /*
+     * the requests go out to all clouds before any reply is read, so the clouds look their key recipes up at once;
+     * a cloud whose servers are not connected is left out, as any k clouds restore the file
+     */
+    for (int i = 0; i < numOfCloud; i++) {
+        cloudLost_[i] = socketArray_[i]->failed_ || socketArray_[total_ / 2 + i]->failed_;
+        if (cloudLost_[i]) {
+            printf("cloud %d is not connected, %s is restored without it\n", i, name);
+            continue;
+        }
+        memset(buffer, 0, 256);
+        sprintf(buffer, "%s-share-%d-enc.key", name, i);
+        int namesize = strlen(buffer);
+        if ((socketArray_[i]->genericSend((char*)&indicator, sizeof(int)) == -1)
+            || (socketArray_[i]->genericSend((char*)&namesize, sizeof(int)) == -1)
+            || (socketArray_[i]->genericSend(buffer, namesize) == -1)) {
+            printf("fail to request the key recipe of %s from cloud %d\n", name, i);
+            cloudLost_[i] = true;
+        }
+    }
+
+    /*
+     * the replies are read in the order they come, so a stalled cloud holds the restore back only while fewer than k
+     * key recipes are loaded; once k are, the clouds that are still silent are left out as in the rest of the restore
+     */
+    bool pending[numOfCloud];
+    for (int i = 0; i < numOfCloud; i++) {
+        pending[i] = !cloudLost_[i];
+    }
+    int numOfLoaded = 0;
+    long waited = 0;
+    while (true) {
+        struct pollfd fds[numOfCloud];
+        int clouds[numOfCloud];
+        int numOfPending = 0;
+        for (int i = 0; i < numOfCloud; i++) {
+            if (pending[i]) {
+                fds[numOfPending].fd = socketArray_[i]->hostSock_;
+                fds[numOfPending].events = POLLIN;
+                fds[numOfPending].revents = 0;
+                clouds[numOfPending] = i;
+                numOfPending++;
+            }
+        }
+        if (numOfPending == 0) {
+            break;
+        }
+        int ret = poll(fds, numOfPending, STREAM_HEDGE_DELAY_MS);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            waited += STREAM_HEDGE_DELAY_MS;
+            if (numOfLoaded < subset_ && waited < STREAM_META_TIMEOUT_MS) {
+                continue;
+            }
+            for (int j = 0; j < numOfPending; j++) {
+                printf("cloud %d holds the key recipe of %s back for %ldms, the cloud is left out\n", clouds[j], name, waited);
+                pending[clouds[j]] = false;
+                cloudLost_[clouds[j]] = true;
+                socketArray_[clouds[j]]->interrupt();
+            }
+            break;
+        }
+        waited = 0;
+        for (int j = 0; j < numOfPending; j++) {
+            if (fds[j].revents == 0) {
+                continue;
+            }
+            pending[clouds[j]] = false;
+            if (readKeyFile(name, clouds[j])) {
+                numOfLoaded++;
+            } else {
+                cloudLost_[clouds[j]] = true;
+            }
+        }
+    }
+    if (numOfLoaded < subset_) {
+        printf("the key recipes of %s are loaded from %d clouds, %d are needed\n", name, numOfLoaded, subset_);
         return 0;
-    } else {
-        fseek(fp, 0, SEEK_END);
-        int nodeNumber = input.shareObj.share_header.shareSize / sizeof(metaNode);
-        for (int i = 0; i < nodeNumber; i++) {
-
-            metaNode newNode;
-            memcpy(&newNode, input.shareObj.data + i * sizeof(metaNode), sizeof(metaNode));
-            fileRecipeEntry_t writeEntryNode;
-            memcpy(writeEntryNode.shareFP, newNode.shareFP, FP_SIZE);
-            writeEntryNode.secretID = newNode.secretID;
-            writeEntryNode.secretSize = newNode.secretSize;
-            fileSizeCounter[index] += newNode.secretSize;
-            fwrite(&writeEntryNode, sizeof(fileRecipeEntry_t), 1, fp);
+    }
+    return 1;
+}
+
+/*
+ * read the reply of a cloud to a key recipe request
+ *
+ * @param name - targeting filename
+ * @param index - the cloud index
+ *
+ * @return - a boolean value that indicates if the key recipe of the cloud is loaded
+ */
+int Downloader::readKeyFile(char* name, int index)
+{
+    long length;
+    if (socketArray_[index]->genericDownload((char*)&length, sizeof(long)) != 0) {
+        printf("fail to download the key recipe of %s from cloud %d\n", name, index);
+        return 0;
+    }
+    if (length < 0) {
+        printf("no key recipe of %s on cloud %d\n", name, index);
+        return 0;
+    }
+    char* keybuffer = (char*)malloc(sizeof(char) * length);
+    if (socketArray_[index]->genericDownload(keybuffer, length) != 0) {
+        printf("fail to download the key recipe of %s from cloud %d\n", name, index);
+        free(keybuffer);
+        return 0;
+    }
+
+    /* decrypted in memory, so no temporary files or openssl processes are needed per file */
+    free(keyRecipeData_[index]);
+    keyRecipeData_[index] = (char*)malloc(sizeof(char) * (length + EVP_MAX_BLOCK_LENGTH));
+    int ret = decryptKeyRecipe((unsigned char*)keybuffer, length, (unsigned char*)keyRecipeData_[index], &keyRecipeSize_[index]);
+    if (!ret) {
+        printf("fail to decrypt the key recipe of %s from cloud %d\n", name, index);
+        free(keyRecipeData_[index]);
+        keyRecipeData_[index] = NULL;
+        keyRecipeSize_[index] = 0;
+    }
+    free(keybuffer);
+    return ret;
+}
+
+/*
+ * decrypt a key recipe, encrypted by the uploader as by `openssl enc -aes-128-cbc -pass pass:test`
+ *
+ * @param input - the encrypted key recipe, starting with the salt header
+ * @param size - the size of the encrypted key recipe
+ * @param output - the key recipe <return>
+ * @param outputSize - the size of the key recipe <return>
+ *
+ * @return - a boolean value that indicates if the key recipe is decrypted
+ */
+int Downloader::decryptKeyRecipe(unsigned char* input, long size, unsigned char* output, long* outputSize)
+{
+    if ((size < KEY_RECIPE_SALT_HEADER_SIZE) || (memcmp(input, "Salted__", 8) != 0)) {
+        return 0;
+    }
+
+    /* openssl enc derives the key with SHA-256 since version 1.1.0, and with MD5 before */
+    const EVP_MD* digests[2] = { EVP_sha256(), EVP_md5() };
+    unsigned char key[EVP_MAX_KEY_LENGTH];
+    unsigned char iv[EVP_MAX_IV_LENGTH];
+    int ret = 0;
+    for (int d = 0; (d < 2) && !ret; d++) {
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        int len, finalLen;
+        EVP_BytesToKey(EVP_aes_128_cbc(), digests[d], input + 8, (unsigned char*)KEY_RECIPE_PASSWORD,
+            strlen(KEY_RECIPE_PASSWORD), 1, key, iv);
+        ret = EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv)
+            && EVP_DecryptUpdate(ctx, output, &len, input + KEY_RECIPE_SALT_HEADER_SIZE, size - KEY_RECIPE_SALT_HEADER_SIZE)
+            && EVP_DecryptFinal_ex(ctx, output + len, &finalLen);
+        if (ret) {
+            *outputSize = len + finalLen;
         }
-        fclose(fp);
+        EVP_CIPHER_CTX_free(ctx);
+    }
+    return ret;
+}
+
+/*
+ * restore only a byte range of the file, set before the file is downloaded
+ *
+ * @param offset - the offset of the range in the file
+ * @param length - the length of the range
+ *
+ */
+void Downloader::setRange(long offset, long length)
+{
+    rangeStart_ = offset;
+    rangeEnd_ = (length > LONG_MAX - offset) ? LONG_MAX : offset + length;
+    decodeObj_->setRange(offset, length);
+}
+
+/*
+ * restore the secrets found in a chunk cache from it, set before the file is downloaded
+ *
+ * @param cache - the cache (NULL for none)
+ */
+void Downloader::setChunkCache(ChunkCache* cache)
+{
+    chunkCacheObj_ = ((cache != NULL) && cache->isEnabled()) ? cache : NULL;
+    decodeObj_->setChunkCache(chunkCacheObj_);
+}
+
+/*
+ * find the metadata chunks covering the restored range in the flat key recipe of a cloud
+ *
+ * @param index - the cloud index
+ * @param records - the records of the key recipe, in file order
+ * @param numOfRecords - the number of records
+ *
+ */
+void Downloader::locateRange(int index, keyRecord_t* records, long numOfRecords)
+{
+    firstChunkID_[index] = -1;
+    lastChunkID_[index] = INT_MIN;
+    fileSizeCounter[index] = 0;
+    if ((numOfRecords == 0) || ((rangeStart_ == 0) && (rangeEnd_ == LONG_MAX))) {
+        return;
+    }
+
+    /* the last chunk starting at or before the range start, and the last one starting before its end */
+    long offset = 0;
+    long first = 0;
+    long last = 0;
+    long firstOffset = 0;
+    for (long j = 0; j < numOfRecords; j++) {
+        if (offset <= rangeStart_) {
+            first = j;
+            firstOffset = offset;
+        }
+        if (offset < rangeEnd_) {
+            last = j;
+        }
+        offset += records[j].size;
+    }
+
+    /* the chunks before the first one are skipped, so the offsets of the secrets start from it */
+    firstChunkID_[index] = records[first].chunkID;
+    lastChunkID_[index] = records[last].chunkID;
+    fileSizeCounter[index] = firstOffset;
+}
 
+/*
+ * rebuilt file recipe by downloaded metadata chunk & keyRecipe
+ *
+ * @param input - metadata chunk object
+ * @param index - cloud id that metadata chunk download 
+ * @param numOfCloud - number of clouds that we download data
+ *
+ */
+int Downloader::writeRetrivedFileRecipe(ItemMeta_t& input, int index)
+{
+
+    int metaChunkID = input.shareObj.share_header.secretID;
+    long chunkIndex = -(long)metaChunkID - 1;
+
+    /* a flat key recipe is indexed by chunk ID */
+    if ((keyRecipe_[index] == NULL) || (chunkIndex < 0) || (chunkIndex >= numOfKeyRecords_[index])
+        || (keyRecipe_[index][chunkIndex].chunkID != metaChunkID)) {
+        printf("error in get metadata chunk key id = %d\n", metaChunkID);
+        return 0;
+    }
+    /* the metadata chunks outside the restored range are left encrypted */
+    if ((metaChunkID > firstChunkID_[index]) || (metaChunkID < lastChunkID_[index])) {
         return 1;
     }
+    char decData[input.shareObj.share_header.shareSize];
+    bool decFlag = decodeObj_->cryptoObj_[0]->decryptWithKey((unsigned char*)input.shareObj.data, input.shareObj.share_header.shareSize, keyRecipe_[index][chunkIndex].key, (unsigned char*)decData);
+    if (!decFlag) {
+        printf("error in decrypt first 32B of metadata chunk id = %d\n", metaChunkID);
+        return 0;
+    }
+
+    return writeRecipeEntries(decData, input.shareObj.share_header.shareSize, index);
+}
+
+/*
+ * append the entries of a decrypted metadata chunk to the in-memory file recipe
+ *
+ * @param metaChunk - the plaintext of the metadata chunk
+ * @param size - the size of the metadata chunk
+ * @param index - cloud id that metadata chunk download
+ *
+ */
+int Downloader::writeRecipeEntries(char* metaChunk, int size, int index)
+{
+
+    int nodeNumber = size / sizeof(metaNode);
+    for (int i = 0; i < nodeNumber; i++) {
+
+        metaNode newNode;
+        memcpy(&newNode, metaChunk + i * sizeof(metaNode), sizeof(metaNode));
+        long offset = fileSizeCounter[index];
+        fileSizeCounter[index] += newNode.secretSize;
+
+        /* only the secrets overlapping the restored range are kept, the decoder trims their ends */
+        if ((offset >= rangeEnd_) || ((fileSizeCounter[index] <= rangeStart_) && ((newNode.secretSize > 0) || (offset < rangeStart_)))) {
+            continue;
+        }
+
+        /*
+         * each secret is listed by the first cloud that reaches it, cloud 0 unless it is lost; the
+         * secret IDs grow along the file, so the others go through the secrets after it
+         */
+        bool lister = (newNode.secretID > listedID_);
+        if (lister) {
+            listedID_ = newNode.secretID;
+        }
+        if (lister && !rangeFound_) {
+            decodeObj_->setNextOffset(offset);
+            rangeFound_ = true;
+        }
+
+        /* a zero secret has no share to fetch, so the decoder gets it from the zero secret list instead */
+        if (newNode.zero) {
+            if (lister) {
+                listZeroSecret(&newNode, 0);
+            }
+            continue;
+        }
+
+        /* a secret in the chunk cache is listed like a zero secret, so the other clouds drop it from their recipes as well */
+        if (chunkCacheObj_ != NULL) {
+            if (!lister) {
+                if (isCachedSecret(index, newNode.secretID)) {
+                    continue;
+                }
+            } else if (chunkCacheObj_->lookup(newNode.shareFP, newNode.secretSize)) {
+                listZeroSecret(&newNode, 1);
+                numOfCachedSecrets_++;
+                continue;
+            } else {
+                pthread_mutex_lock(&zeroLock_);
+                if (numOfDataSecrets_ == cacheKeysSize_) {
+                    cacheKeysSize_ = (cacheKeysSize_ == 0) ? 1024 : cacheKeysSize_ * 2;
+                    cacheKeys_ = (unsigned char*)realloc(cacheKeys_, sizeof(unsigned char) * FP_SIZE * cacheKeysSize_);
+                }
+                memcpy(cacheKeys_ + numOfDataSecrets_ * FP_SIZE, newNode.shareFP, FP_SIZE);
+                pthread_mutex_unlock(&zeroLock_);
+            }
+        }
+        if (lister) {
+            numOfDataSecrets_++;
+        }
+
+        if (numOfRecipeEntries_[index] == recipeSize_[index]) {
+            recipeSize_[index] = (recipeSize_[index] == 0) ? 1024 : recipeSize_[index] * 2;
+            recipe_[index] = (fileRecipeEntry_t*)realloc(recipe_[index], sizeof(fileRecipeEntry_t) * recipeSize_[index]);
+        }
+        fileRecipeEntry_t* entry = &recipe_[index][numOfRecipeEntries_[index]];
+        memcpy(entry->shareFP, newNode.shareFP, FP_SIZE);
+        entry->secretID = newNode.secretID;
+        /* a negative secret size tells the decoder that the secret was compressed before encoding */
+        entry->secretSize = newNode.compressed ? -newNode.secretSize : newNode.secretSize;
+        numOfRecipeEntries_[index]++;
+    }
+
     return 1;
 }
 
+/*
+ * load the key recipe of a cloud
+ *
+ * @param index - the cloud index
+ * @param numOfChunks - number of metadata and index chunks of the file
+ *
+ * @return - the level of the chunks pointed to by the key recipe, 0 for metadata chunks, or -1 on error
+ */
+int Downloader::loadKeyRecipe(int index, long numOfChunks)
+{
+    char* content = keyRecipeData_[index];
+    long fileSize = keyRecipeSize_[index];
+    if (content == NULL) {
+        printf("no key recipe of %s from cloud %d\n", name_, index);
+        return -1;
+    }
+
+    long numOfRecords = fileSize / sizeof(keyRecord_t);
+    keyRecord_t* records = (keyRecord_t*)malloc(sizeof(keyRecord_t) * (numOfRecords + 1));
+    memcpy(records, content, sizeof(keyRecord_t) * numOfRecords);
+    free(content);
+    keyRecipeData_[index] = NULL;
+    keyRecipeSize_[index] = 0;
+
+    /* a key recipe of index chunks keeps its records in order after the header, and the range is found while the tree is walked */
+    free(keyRecipe_[index]);
+    firstChunkID_[index] = -1;
+    lastChunkID_[index] = INT_MIN;
+    fileSizeCounter[index] = 0;
+    if ((numOfRecords > 0) && (records[0].chunkID == KEY_RECIPE_HEADER_ID)) {
+        int level;
+        memcpy(&level, records[0].chunkFP, sizeof(int));
+        memmove(records, records + 1, sizeof(keyRecord_t) * (numOfRecords - 1));
+        keyRecipe_[index] = records;
+        numOfKeyRecords_[index] = numOfRecords - 1;
+        return level;
+    }
+
+    /* a flat key recipe is indexed by chunk ID, so each metadata chunk finds its key directly */
+    locateRange(index, records, numOfRecords);
+    keyRecipe_[index] = (keyRecord_t*)calloc(numOfChunks + 1, sizeof(keyRecord_t));
+    numOfKeyRecords_[index] = numOfChunks;
+    for (long j = 0; j < numOfRecords; j++) {
+        long chunkIndex = -(long)records[j].chunkID - 1;
+        if ((chunkIndex >= 0) && (chunkIndex < numOfChunks)) {
+            memcpy(&keyRecipe_[index][chunkIndex], &records[j], sizeof(keyRecord_t));
+        }
+    }
+    free(records);
+
+    return 0;
+}
+
+/*
+ * rebuild the file recipe from the metadata tree of a cloud
+ *
+ * @param index - the cloud index
+ * @param numOfChunks - number of metadata and index chunks of the file
+ * @param level - the level of the chunks pointed to by the key recipe
+ *
+ * @return - a boolean value that indicates if the file recipe is rebuilt
+ */
+int Downloader::restoreRecipeTree(int index, long numOfChunks, int level)
+{
+    char nameBuffer[512];
+    int ret = 1;
+
+    /* the chunks arrive bottom-up, they are kept on disk by chunk ID so that the tree can be walked top-down (next to the file, as files may be restored at once) */
+    snprintf(nameBuffer, sizeof(nameBuffer), "%s-share-%d.meta", name_, index);
+    string metaFileName(nameBuffer);
+    FILE* fp = fopen(metaFileName.c_str(), "wb+");
+    metaChunkLoc_t* locs = (metaChunkLoc_t*)malloc(sizeof(metaChunkLoc_t) * numOfChunks);
+    for (long j = 0; j < numOfChunks; j++) {
+        locs[j].offset = -1;
+        locs[j].size = 0;
+    }
+    long offset = 0;
+    for (long j = 0; j < numOfChunks; j++) {
+        ItemMeta_t output;
+        if (!extractMeta(index, &output)) {
+            ret = 0;
+            break;
+        }
+        long chunkIndex = -(long)output.shareObj.share_header.secretID - 1;
+        if ((fp != NULL) && (chunkIndex >= 0) && (chunkIndex < numOfChunks)) {
+            fwrite(output.shareObj.data, 1, output.shareObj.share_header.shareSize, fp);
+            locs[chunkIndex].offset = offset;
+            locs[chunkIndex].size = output.shareObj.share_header.shareSize;
+            offset += output.shareObj.share_header.shareSize;
+        }
+        free(output.shareObj.data);
+    }
+    if (fp == NULL) {
+        printf("can't open metadata chunk file %s\n", metaFileName.c_str());
+        free(locs);
+        return 0;
+    }
+
+    /* walk the tree from the key recipe, whose records point to the root chunks in file order */
+    long chunkOffset = 0;
+    for (long j = 0; ret && (j < numOfKeyRecords_[index]); j++) {
+        if (!restoreTreeChunk(index, &keyRecipe_[index][j], level, fp, locs, numOfChunks, chunkOffset)) {
+            ret = 0;
+            break;
+        }
+        chunkOffset += keyRecipe_[index][j].size;
+    }
+
+    fclose(fp);
+    remove(metaFileName.c_str());
+    free(locs);
+    return ret;
+}
+
+/*
+ * decrypt a chunk of the metadata tree and rebuild the file recipe below it
+ *
+ * @param index - the cloud index
+ * @param record - the record of the chunk
+ * @param level - the level of the chunk
+ * @param fp - the file holding the downloaded chunks
+ * @param locs - the location of each chunk in fp by chunk ID
+ * @param numOfChunks - number of metadata and index chunks of the file
+ * @param offset - the offset in the file of the first byte covered by the chunk
+ *
+ */
+int Downloader::restoreTreeChunk(int index, keyRecord_t* record, int level, FILE* fp, metaChunkLoc_t* locs, long numOfChunks, long offset)
+{
+    /* a subtree without a byte of the restored range is skipped, as its secrets would all be dropped */
+    long end = offset + record->size;
+    if ((offset >= rangeEnd_) || (end < rangeStart_) || ((end == rangeStart_) && (record->size > 0))) {
+        return 1;
+    }
+
+    long chunkIndex = -(long)record->chunkID - 1;
+    if ((chunkIndex < 0) || (chunkIndex >= numOfChunks) || (locs[chunkIndex].offset < 0)) {
+        printf("error in get metadata tree chunk id = %d\n", record->chunkID);
+        return 0;
+    }
+    int size = locs[chunkIndex].size;
+
+    char* encData = (char*)malloc(sizeof(char) * size);
+    char* decData = (char*)malloc(sizeof(char) * size);
+    fseek(fp, locs[chunkIndex].offset, SEEK_SET);
+    int ret = (fread(encData, 1, size, fp) == (size_t)size);
+    if (!ret) {
+        printf("read file error of metadata tree chunk id = %d\n", record->chunkID);
+    } else if (!decodeObj_->cryptoObj_[0]->decryptWithKey((unsigned char*)encData, size, record->key, (unsigned char*)decData)) {
+        printf("error in decrypt metadata tree chunk id = %d\n", record->chunkID);
+        ret = 0;
+    } else if (level == 0) {
+        /* the chunks before this one may be skipped, so the offsets of its secrets start from its own */
+        fileSizeCounter[index] = offset;
+        ret = writeRecipeEntries(decData, size, index);
+    } else {
+        /* the records of an index chunk are followed by zero padding */
+        int numOfRecords = size / sizeof(keyRecord_t);
+        long childOffset = offset;
+        for (int i = 0; i < numOfRecords; i++) {
+            keyRecord_t child;
+            memcpy(&child, decData + i * sizeof(keyRecord_t), sizeof(keyRecord_t));
+            if (child.chunkID == KEY_RECIPE_HEADER_ID) {
+                break;
+            }
+            if (!restoreTreeChunk(index, &child, level - 1, fp, locs, numOfChunks, childOffset)) {
+                ret = 0;
+                break;
+            }
+            childOffset += child.size;
+        }
+    }
+    free(encData);
+    free(decData);
+    return ret;
+}
+
 /*
  * upload retrived file recipe to cloud server for next origin file retrive
  *
@@ -572,71 +1918,151 @@ int Downloader::uploadRetrivedRecipeFile(int index)
 
     char buffer[256];
     memset(buffer, 0, 256);
-    sprintf(buffer, "share-%d.recipe", index);
-    //client side recipe file name
-    string recipeFileName(buffer);
     sprintf(buffer, "%s-%d.recipe", name_, index);
     //server side recipe file name
     string uploadRecipeFileName(buffer);
-    memset(buffer, 0, 256);
-    sprintf(buffer, "%s-share-%d-dec.key", name_, index);
-    //the keyRecipe file name which need to clean
-    string keyFileName(buffer);
 
-    FILE* fp = fopen(recipeFileName.c_str(), "rb+");
-    if (fp == NULL) {
-        printf("can't open recipe file %d\n", index);
-    } else {
-        fseek(fp, 0, SEEK_END);
-        int size = ftell(fp);
-        int shareChunkNumber = size / sizeof(fileRecipeEntry_t);
-
-        fileRecipeHead_t fileRecipeHeader;
-        fileRecipeHeader.userID = userID_;
-        fileRecipeHeader.fileSize = fileSizeCounter[index];
-        fileRecipeHeader.numOfShares = shareChunkNumber;
-
-        fseek(fp, 0, SEEK_SET);
-        int uploadSize = size + sizeof(fileRecipeHead_t);
-        int indicator = FILE_RECIPE;
-        int fileNameSizeTemp = uploadRecipeFileName.length();
-        socketArray_[index]->genericSend((char*)&indicator, sizeof(int));
-        socketArray_[index]->genericSend((char*)&uploadSize, sizeof(int));
-        socketArray_[index]->genericSend((char*)&fileNameSizeTemp, sizeof(int));
-        socketArray_[index]->genericSend((char*)uploadRecipeFileName.c_str(), fileNameSizeTemp);
-
-        char uploadRecipeBuffer[sizeof(fileRecipeEntry_t) * 1000];
-        char uploadRecipeHeaderBuffer[sizeof(fileRecipeHead_t)];
-        memcpy(uploadRecipeHeaderBuffer, &fileRecipeHeader, sizeof(fileRecipeHead_t));
-        socketArray_[index]->genericSend(uploadRecipeHeaderBuffer, sizeof(fileRecipeHead_t));
-        int totalRead = 0;
-        int realRead = 0;
-        fseek(fp, 0, SEEK_SET);
-        while (totalRead < size) {
-            realRead = fread(uploadRecipeBuffer, sizeof(char), sizeof(fileRecipeEntry_t) * 1000, fp);
-            socketArray_[index]->genericSend(uploadRecipeBuffer, realRead);
-            totalRead += realRead;
+    long size = numOfRecipeEntries_[index] * sizeof(fileRecipeEntry_t);
+
+    fileRecipeHead_t fileRecipeHeader;
+    fileRecipeHeader.userID = userID_;
+    fileRecipeHeader.fileSize = fileSizeCounter[index];
+    fileRecipeHeader.numOfShares = numOfRecipeEntries_[index];
+
+    long uploadSize = size + sizeof(fileRecipeHead_t);
+    int indicator = FILE_RECIPE;
+    int fileNameSizeTemp = uploadRecipeFileName.length();
+    socketArray_[index]->genericSend((char*)&indicator, sizeof(int));
+    socketArray_[index]->genericSend((char*)&uploadSize, sizeof(long));
+    socketArray_[index]->genericSend((char*)&fileNameSizeTemp, sizeof(int));
+    socketArray_[index]->genericSend((char*)uploadRecipeFileName.c_str(), fileNameSizeTemp);
+    socketArray_[index]->genericSend((char*)&fileRecipeHeader, sizeof(fileRecipeHead_t));
+
+    /* the recipe is sent straight from memory, in pieces of a bounded size */
+    long totalSent = 0;
+    while (totalSent < size) {
+        long sendSize = size - totalSent;
+        if (sendSize > (long)sizeof(fileRecipeEntry_t) * 1000) {
+            sendSize = sizeof(fileRecipeEntry_t) * 1000;
         }
-        fclose(fp);
+        socketArray_[index]->genericSend((char*)recipe_[index] + totalSent, sendSize);
+        totalSent += sendSize;
     }
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", recipeFileName.c_str());
-    pid_t status;
-    status = system(cmd);
-    if (status == -1) {
-        printf("error in system call function %s\n", cmd);
+    free(recipe_[index]);
+    recipe_[index] = NULL;
+    recipeSize_[index] = 0;
+    numOfRecipeEntries_[index] = 0;
+    free(keyRecipe_[index]);
+    keyRecipe_[index] = NULL;
+    numOfKeyRecords_[index] = 0;
+
+    return -2;
+}
+
+/*
+ * pass the zero secrets at a position of the file recipe to the decoder
+ *
+ * @param position - the number of data secrets passed so far
+ * @param zeroIndex - the index of the next zero secret <return>
+ * @param decodeCount - the number of secrets passed to the decoder <return>
+ *
+ */
+void Downloader::addZeroSecrets(long position, long* zeroIndex, long* decodeCount)
+{
+    pthread_mutex_lock(&zeroLock_);
+    while ((*zeroIndex < numOfZeroSecrets_) && (zeroSecretList_[*zeroIndex].position == position)) {
+        Decoder::ShareChunk_t package;
+        package.secretSize = zeroSecretList_[*zeroIndex].secretSize;
+        package.shareSize = 0;
+        package.shares[0] = NULL;
+        package.secretID = zeroSecretList_[*zeroIndex].secretID;
+        package.cached = zeroSecretList_[*zeroIndex].cached;
+        package.zero = !package.cached;
+        package.shareMask = 0;
+        memcpy(package.key, zeroSecretList_[*zeroIndex].key, FP_SIZE);
+        (*zeroIndex)++;
+
+        /* the decoder may block, so the list is not held while the zero secret is added */
+        pthread_mutex_unlock(&zeroLock_);
+        decodeObj_->add(&package);
+        (*decodeCount)++;
+        pthread_mutex_lock(&zeroLock_);
     }
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", uploadRecipeFileName.c_str());
-    status = system(cmd);
-    if (status == -1) {
-        printf("error in system call function %s\n", cmd);
+    pthread_mutex_unlock(&zeroLock_);
+}
+
+/*
+ * add a secret restored without shares to the zero secret list (only by the cloud listing it)
+ *
+ * @param node - the metadata of the secret
+ * @param cached - whether the secret is in the chunk cache rather than a zero secret
+ *
+ */
+void Downloader::listZeroSecret(metaNode* node, int cached)
+{
+    pthread_mutex_lock(&zeroLock_);
+    if (numOfZeroSecrets_ == zeroSecretListSize_) {
+        zeroSecretListSize_ *= 2;
+        zeroSecretList_ = (zeroSecret_t*)realloc(zeroSecretList_, sizeof(zeroSecret_t) * zeroSecretListSize_);
+    }
+    zeroSecret_t* secret = &zeroSecretList_[numOfZeroSecrets_];
+    secret->position = numOfDataSecrets_;
+    secret->secretID = node->secretID;
+    secret->secretSize = node->secretSize;
+    secret->cached = cached;
+    memcpy(secret->key, node->shareFP, FP_SIZE);
+    numOfZeroSecrets_++;
+    pthread_mutex_unlock(&zeroLock_);
+}
+
+/*
+ * check if a secret was found in the chunk cache by the cloud listing it
+ *
+ * @param index - the cloud index
+ * @param secretID - the ID of the secret, which grows along the file
+ *
+ * @return - a boolean value that indicates if the secret is restored from the cache
+ */
+bool Downloader::isCachedSecret(int index, int secretID)
+{
+    /* the list is only extended by this thread, so it is read without the lock */
+    long* cursor = &cachedCursor_[index];
+    while ((*cursor < numOfZeroSecrets_) && (zeroSecretList_[*cursor].secretID < secretID)) {
+        (*cursor)++;
     }
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", keyFileName.c_str());
-    status = system(cmd);
-    if (status == -1) {
-        printf("error in system call function %s\n", cmd);
+    return (*cursor < numOfZeroSecrets_) && (zeroSecretList_[*cursor].secretID == secretID) && zeroSecretList_[*cursor].cached;
+}
+
+/*
+ * set the chunk cache key of the secret at a position of the file recipe in a package for the decoder
+ *
+ * @param position - the position of the secret
+ * @param package - the package <return>
+ *
+ */
+void Downloader::setCacheKey(long position, Decoder::ShareChunk_t* package)
+{
+    if (chunkCacheObj_ == NULL) {
+        return;
     }
+    pthread_mutex_lock(&zeroLock_);
+    memcpy(package->key, cacheKeys_ + position * FP_SIZE, FP_SIZE);
+    pthread_mutex_unlock(&zeroLock_);
+}
 
-    return -2;
+/*
+ * print the number of secrets of the file
+ *
+ * @param numOfShares - the number of secrets restored from shares
+ *
+ */
+void Downloader::reportSecrets(long numOfShares)
+{
+    if (chunkCacheObj_ == NULL) {
+        printf("number of chunks = %ld (and %ld zero chunks)\n", numOfShares, numOfZeroSecrets_);
+        return;
+    }
+    printf("number of chunks = %ld (and %ld zero chunks, %ld chunks from the chunk cache)\n", numOfShares,
+        numOfZeroSecrets_ - numOfCachedSecrets_, numOfCachedSecrets_);
 }
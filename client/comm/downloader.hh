@@ -10,27 +10,23 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <iostream>
+#include <limits.h>
 #include <netinet/in.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <poll.h>
 #include <pthread.h>
 #include <resolv.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 /* downloader ringbuffer size */
 #define DOWNLOAD_RB_SIZE 2048
 
-/* downloader ringbuffer data max size */
-#define RING_BUFFER_DATA_SIZE (16 * 1024)
-#define RING_BUFFER_META_SIZE (32 * 1024)
-
-/* downloader buffer size */
-#define DOWNLOAD_BUFFER_SIZE (4 * 1024 * 1024)
-
 /* length of hash 256 */
 #define HASH_LENGTH 32
 
@@ -46,10 +42,42 @@
 #define KEY_RECIPE (-101)
 #define GET_KEY_RECIPE (-102)
 #define FILE_RECIPE (-103)
+#define STREAM_RESTORE (-104)
+
+/* password of the key recipes, as given to openssl enc by the uploader */
+#define KEY_RECIPE_PASSWORD "test"
+
+/* size of the header of an encrypted key recipe ("Salted__" and an 8-byte salt) */
+#define KEY_RECIPE_SALT_HEADER_SIZE 16
+
+/* max number of recipe entries sent to a server in one list of a streamed restore */
+#define STREAM_LIST_SIZE 512
+
+/* max number of secrets requested but not yet passed to the decoder in a streamed restore */
+#define STREAM_WINDOW_SIZE 2048
+
+/* time without a decoded secret after which the slowest server of a hedged restore is replaced (ms) */
+#define STREAM_HEDGE_DELAY_MS 200
+
+/* time a restore waits for the metadata of a server when no other server can take its place (ms) */
+#define STREAM_META_TIMEOUT_MS 30000
+
+/* signal of a thread that is not used for the file */
+#define STOP_SIGNAL 0
+
+/* signal of a data thread to read the shares of a streamed restore */
+#define STREAM_SIGNAL 2
+
+/* roles of the clouds in a streamed restore */
+#define CLOUD_SPARE 0
+#define CLOUD_ACTIVE 1
+#define CLOUD_RETIRED 2
 
 #include "BasicRingBuffer.hh"
 #include "CryptoPrimitive.hh"
 #include "decoder.hh"
+#include "recipeTree.hh"
+#include "sharedBuffer.hh"
 #include "socket.hh"
 
 using namespace std;
@@ -73,9 +101,9 @@ public:
     typedef struct {
         int fullNameSize;
         long fileSize;
-        int numOfPastSecrets;
+        long numOfPastSecrets;
         long sizeOfPastSecrets;
-        int numOfComingSecrets;
+        long numOfComingSecrets;
         long sizeOfComingSecrets;
     } fileShareMDHead_t;
 
@@ -90,14 +118,14 @@ public:
     /* file share count struct for download */
     typedef struct {
         long fileSize;
-        int numOfShares;
+        long numOfShares;
     } shareFileHead_t;
 
     /*the head structure of the recipes of a file*/
     typedef struct {
         int userID;
         long fileSize;
-        int numOfShares;
+        long numOfShares;
     } fileRecipeHead_t;
 
     /*the entry structure of the recipes of a file*/
@@ -114,25 +142,34 @@ public:
         int shareSize;
     } shareEntry_t;
 
+    /*
+     * share objects only carry a pointer to their share, so their size does not depend on
+     * the chunk size; the share is allocated with malloc by the download thread and freed
+     * by its consumer
+     */
+
     /* file header object structure for ringbuffer */
     typedef struct {
         shareFileHead_t file_header;
-        char data[RING_BUFFER_DATA_SIZE];
     } fileHeaderObj_t;
 
-    /* share header object structure for ringbuffer */
+    /* share header object structure for ringbuffer (data points into buffer, which it holds a reference to) */
     typedef struct {
         shareEntry_t share_header;
-        char data[RING_BUFFER_DATA_SIZE];
+        char* data;
+        SharedBuffer_t* buffer;
     } shareHeaderObj_t;
 
     /* share header object structure for ringbuffer */
     typedef struct {
         shareEntry_t share_header;
-        char data[RING_BUFFER_META_SIZE];
+        char* data;
     } metaShareHeaderObj_t;
 
-    /* union of objects for unifying ringbuffer objects */
+    /*
+     * union of objects for unifying ringbuffer objects (type 0 for the header, 1 for a share, and 2 for
+     * the end of the objects of a cloud, which comes before all shares if the download fails)
+     */
     typedef struct {
         int type;
         union {
@@ -141,7 +178,7 @@ public:
         };
     } Item_t;
 
-    /* union of objects for unifying ringbuffer objects */
+    /* union of objects for unifying ringbuffer objects (types as in Item_t) */
     typedef struct {
         int type;
         union {
@@ -163,34 +200,129 @@ public:
         Downloader* obj;
     } param_t;
 
+    /* zero secret structure, which is restored without any share (also used for a secret in the chunk cache) */
+    typedef struct {
+        long position; // number of data secrets before it
+        int secretID;
+        int secretSize;
+        int cached;
+        unsigned char key[FP_SIZE]; // key of a cached secret in the chunk cache
+    } zeroSecret_t;
+
     typedef struct {
         unsigned char shareFP[HASH_SIZE];
-        unsigned char other[18];
+        unsigned char compressed;
+        unsigned char zero;
+        unsigned char other[16];
         int secretID;
         int secretSize;
         int shareSize;
     } metaNode;
 
+    /* location of a metadata or index chunk kept on disk while the metadata tree is walked */
+    typedef struct {
+        long offset;
+        int size;
+    } metaChunkLoc_t;
+
+    /*
+     * object of a streamed restore (type 1 for a share, 2 for the end of the shares of a cloud,
+     * 3 for the number of secrets in position, or -1 if the file failed); data points into buffer,
+     * which it holds a reference to
+     */
+    typedef struct {
+        int type;
+        int cloudIndex;
+        long position; // position of the secret in the file recipe
+        shareEntry_t share_header;
+        char* data;
+        SharedBuffer_t* buffer;
+    } streamItem_t;
+
+    /* positions of the file recipe sent to a cloud in one list */
+    typedef struct {
+        long start;
+        int size;
+    } streamRange_t;
+
+    /* slot of the reorder window, collecting the shares of a secret from any clouds */
+    typedef struct {
+        long position;
+        int count;
+        shareEntry_t share_header;
+        char* shares[MAX_NUMBER_OF_CLOUDS];
+        SharedBuffer_t* buffers[MAX_NUMBER_OF_CLOUDS];
+    } streamSlot_t;
+
     /* file header pointer array for modifying header */
     fileShareMDHead_t** headerArray_;
 
     /* socket array */
     Socket** socketArray_;
 
-    /* metadata buffer */
-    char** downloadMetaBuffer_;
+    /* whether the sockets are closed with the downloader (not when they are reused across files) */
+    bool ownSockets_;
 
-    /* container buffer */
+    /* container buffer of each metadata thread, allocated on demand (the data threads receive into shared buffers) */
     char** downloadContainer_;
 
+    /* size of each container buffer */
+    int* downloadCapacity_;
+
     /* size of file header */
     int fileMDHeadSize_;
 
     /* size of share header */
     int shareMDEntrySize_;
 
-    /* thread id array */
-    pthread_t tid_[DOWNLOAD_NUM_THREADS * 2];
+    /* thread id array, a metadata and a data thread per cloud */
+    pthread_t tid_[MAX_NUMBER_OF_CLOUDS * 2];
+
+    /* whether each thread got a signal for the current file */
+    bool* signaled_;
+
+    /* whether the downloader is connected to the clouds and started */
+    bool valid_;
+
+    /* thread that assembles the shares of a streamed restore for the decoder */
+    pthread_t assembleTid_;
+
+    /* whether the shares of a streamed restore ran out before the end of the file */
+    bool streamFailed_;
+
+    /* shares of a streamed restore from all clouds, tagged with their position in the file recipe */
+    RingBuffer<streamItem_t>* streamBuffer_;
+
+    /* positions requested from each cloud, in the order its shares come back */
+    RingBuffer<streamRange_t>** rangeBuffer_;
+
+    /* number of clouds taking part in a streamed restore */
+    int numOfStreamClouds_;
+
+    /* whether each cloud is left out of the restore, as it is not connected or its metadata is not read */
+    bool* cloudLost_;
+
+    /* number of clouds whose metadata is read for the file */
+    int numOfMetaClouds_;
+
+    /* whether the end of the metadata of each cloud was extracted, so its metadata thread is over */
+    bool* metaEnded_;
+
+    /*
+     * state of a streamed restore shared by the main thread, the data threads and the assembler;
+     * only the main thread changes the roles of the clouds
+     */
+    pthread_mutex_t streamLock_;
+    pthread_cond_t streamCond_;
+    long dispatched_; // number of secrets passed to the decoder
+    int* cloudState_;
+    bool* cloudDead_; // the shares of the cloud ended
+    long* sentCount_; // number of entries sent to each cloud
+    long* recvCount_; // number of shares received from each cloud
+    long* recvPos_; // position after the last share received from each cloud
+
+    /* position of the first entry kept in the file recipe of each cloud */
+    long* recipeBase_;
 
     /* decoder object pointer */
     Decoder* decodeObj_;
@@ -203,9 +335,58 @@ public:
     RingBuffer<ItemMeta_t>** ringBufferMeta_;
     char name_[256];
 
-    int* fileSizeCounter;
+    long* fileSizeCounter;
     int userID_;
 
+    /* zero secrets of the file (kept out of the file recipe) */
+    zeroSecret_t* zeroSecretList_;
+    long numOfZeroSecrets_;
+    long zeroSecretListSize_;
+
+    /* lock of the zero secret list and the cache keys, which a streamed restore fills while its shares are assembled */
+    pthread_mutex_t zeroLock_;
+
+    /* cache of decoded secrets (NULL for none), and the number of secrets of the file found in it */
+    ChunkCache* chunkCacheObj_;
+    long numOfCachedSecrets_;
+
+    /* chunk cache key of each data secret of the file recipe by position, the fingerprint of its share on the cloud listing it */
+    unsigned char* cacheKeys_;
+    long cacheKeysSize_;
+
+    /* index of each cloud in the zero secret list, for dropping the cached secrets found by another cloud */
+    long* cachedCursor_;
+
+    /* number of data secrets in the file recipe */
+    long numOfDataSecrets_;
+
+    /* ID of the last secret listed, by the first cloud whose metadata reaches it (normally cloud 0) */
+    int listedID_;
+
+    /* decrypted key recipe of each cloud as downloaded, until it is loaded */
+    char** keyRecipeData_;
+    long* keyRecipeSize_;
+
+    /* key recipe of each cloud, loaded once; a flat key recipe is indexed by chunk ID */
+    keyRecord_t** keyRecipe_;
+    long* numOfKeyRecords_;
+
+    /* file recipe of each cloud rebuilt from the metadata chunks, kept in memory until it is uploaded or streamed */
+    fileRecipeEntry_t** recipe_;
+    long* recipeSize_;
+    long* numOfRecipeEntries_;
+
+    /* byte range of the file that is restored (the whole file by default) */
+    long rangeStart_;
+    long rangeEnd_;
+
+    /* whether the first secret of the range was listed */
+    bool rangeFound_;
+
+    /* IDs of the metadata chunks covering the range in each cloud with a flat key recipe, found from the sizes of its records */
+    int* firstChunkID_;
+    int* lastChunkID_;
+
     /*
      * constructor
      *
@@ -213,8 +394,11 @@ public:
      * @param total - input total number of clouds
      * @param subset - input number of clouds to be chosen
      * @param obj - decoder pointer
+     * @param queueDepth - depth of the ringbuffer of each cloud (0 for DOWNLOAD_RB_SIZE)
+     * @param sockets - connected sockets of the clouds to reuse (NULL for connecting to ./config-d)
      */
-    Downloader(int total, int subset, int userID, Decoder* obj, char* fileName, int nameSize);
+    Downloader(int total, int subset, int userID, Decoder* obj, char* fileName, int nameSize, int queueDepth = 0,
+        Socket** sockets = NULL);
 
     /*
      * destructor
@@ -222,6 +406,13 @@ public:
      */
     ~Downloader();
 
+    /*
+     * check if the downloader is connected to the clouds and started
+     *
+     * @return - a boolean value that indicates if the downloader can be used
+     */
+    inline bool isValid() { return valid_; }
+
     /*
      * test if it's the end of downloading a file
      *
@@ -235,6 +426,7 @@ public:
      * @param namesize - size of filename
      * @param numOfCloud - number of clouds that we download data
      *
+     * @return - a boolean value that indicates if all shares of the file were received
      */
     int downloadFile(char* filename, int namesize, int numOfCloud);
 
@@ -245,8 +437,121 @@ public:
      * @param namesize - size of filename
      * @param numOfCloud - number of clouds that we download data
      *
+     * @return - -1 once the file recipes are stored on the clouds, or 0 if the metadata of a cloud fails
      */
     int preDownloadFile(char* filename, int namesize, int numOfCloud);
+
+    /*
+     * main procedure for restoring a file by streaming its recipe
+     *
+     * the share fingerprints of each metadata chunk are sent to the servers as soon as
+     * the chunk is decrypted, and the servers send the shares back while the rest of the
+     * recipe is still coming, so no recipe file is written or uploaded
+     *
+     * @param filename - targeting filename
+     * @param namesize - size of filename
+     * @param numOfCloud - number of clouds that we download data
+     *
+     * @return - a boolean value that indicates if all shares of the file were received
+     */
+    int streamFile(char* filename, int namesize, int numOfCloud);
+
+    /*
+     * request the metadata chunks of a file and load the key recipe of each cloud
+     *
+     * @param filename - targeting filename
+     * @param namesize - size of filename
+     * @param numOfCloud - number of clouds that we download data
+     * @param numOfChunks - number of metadata and index chunks of each cloud <return>
+     * @param levels - the level of the chunks pointed to by the key recipe of each cloud <return>
+     *
+     * @return - a boolean value that indicates if the headers of at least k clouds are read
+     */
+    int startMetaDownload(char* filename, int namesize, int numOfCloud, long* numOfChunks, int* levels);
+
+    /*
+     * get the next metadata object of a cloud, leaving the cloud out of the restore if its metadata
+     * fails, or holds the restore back while other clouds can take its place
+     *
+     * @param index - the cloud index
+     * @param output - the object <return>
+     *
+     * @return - a boolean value that indicates if an object was extracted
+     */
+    int extractMeta(int index, ItemMeta_t* output);
+
+    /*
+     * leave a cloud out of the restore, cutting its connections off
+     *
+     * @param index - the cloud index
+     *
+     */
+    void loseCloud(int index);
+
+    /*
+     * wait for the metadata thread of a cloud to end, dropping the objects it still adds
+     *
+     * @param index - the cloud index
+     *
+     */
+    void endMeta(int index);
+
+    /*
+     * wait for the data threads of the first clouds to end, dropping the shares they still add
+     *
+     * @param numOfCloud - the number of clouds
+     * @param ended - whether the end object of each cloud was extracted <return>
+     *
+     */
+    void endData(int numOfCloud, bool* ended);
+
+    /*
+     * count the clouds whose metadata is read and not left out of the restore
+     *
+     * @return - the number of clouds
+     */
+    int numOfLiveClouds();
+
+    /*
+     * send a list of recipe entries of a streamed restore to the data server of a cloud
+     *
+     * @param index - the cloud index
+     * @param entries - the recipe entries
+     * @param numOfEntries - the number of entries, 0 for ending the stream
+     *
+     */
+    void sendRecipeList(int index, fileRecipeEntry_t* entries, int numOfEntries);
+
+    /*
+     * request the shares at some positions of the file recipe from a cloud
+     *
+     * @param index - the cloud index
+     * @param start - the first position
+     * @param size - the number of positions
+     *
+     */
+    void sendStreamList(int index, long start, int size);
+
+    /*
+     * wait until the secrets before a position are passed to the decoder, replacing the
+     * servers that end or hold the restore back by spare ones
+     *
+     * @param limit - the position to wait for
+     * @param nextPos - the number of positions requested so far
+     *
+     * @return - a boolean value that indicates if the restore can go on
+     */
+    int waitForWindow(long limit, long nextPos);
+
+    /*
+     * replace an active cloud of a streamed restore by a spare one, which must hold the lock
+     *
+     * @param index - the cloud to replace
+     * @param nextPos - the number of positions requested so far
+     *
+     * @return - a boolean value that indicates if the restore can go on
+     */
+    int replaceCloud(int index, long nextPos);
     /*
      * downloader thread handler
      * 
@@ -263,13 +568,69 @@ public:
      */
     static void* thread_handler_meta(void* param);
 
+    /*
+     * thread handler that assembles the shares of a streamed restore and feeds the decoder
+     *
+     * @param param - the downloader
+     *
+     */
+    static void* thread_handler_assemble(void* param);
+
     /*
      * download the file's keyRecipe from each cloud for decrypt metadata chunk
      *
      * @param name - targeting filename
+     * @param numOfCloud - number of clouds that we download data
+     *
+     * @return - a boolean value that indicates if the key recipes of at least k clouds are loaded
+     */
+    int downloadKeyFile(char* name, int numOfCloud);
+
+    /*
+     * read the reply of a cloud to a key recipe request
+     *
+     * @param name - targeting filename
+     * @param index - the cloud index
+     *
+     * @return - a boolean value that indicates if the key recipe of the cloud is loaded
+     */
+    int readKeyFile(char* name, int index);
+
+    /*
+     * decrypt a key recipe, encrypted by the uploader as by `openssl enc -aes-128-cbc -pass pass:test`
+     *
+     * @param input - the encrypted key recipe, starting with the salt header
+     * @param size - the size of the encrypted key recipe
+     * @param output - the key recipe <return>
+     * @param outputSize - the size of the key recipe <return>
+     *
+     * @return - a boolean value that indicates if the key recipe is decrypted
+     */
+    int decryptKeyRecipe(unsigned char* input, long size, unsigned char* output, long* outputSize);
+
+    /*
+     * restore only a byte range of the file, set before the file is downloaded
+     *
+     * @param offset - the offset of the range in the file
+     * @param length - the length of the range
+     */
+    void setRange(long offset, long length);
+
+    /*
+     * restore the secrets found in a chunk cache from it, set before the file is downloaded
      *
+     * @param cache - the cache (NULL for none)
      */
-    int downloadKeyFile(char* name);
+    void setChunkCache(ChunkCache* cache);
+
+    /*
+     * find the metadata chunks covering the restored range in the flat key recipe of a cloud
+     *
+     * @param index - the cloud index
+     * @param records - the records of the key recipe, in file order
+     * @param numOfRecords - the number of records
+     */
+    void locateRange(int index, keyRecord_t* records, long numOfRecords);
 
     /*
      * rebuilt file recipe by downloaded metadata chunk & keyRecipe
@@ -281,6 +642,51 @@ public:
      */
     int writeRetrivedFileRecipe(ItemMeta_t& input, int index);
 
+    /*
+     * append the entries of a decrypted metadata chunk to the in-memory file recipe
+     *
+     * @param metaChunk - the plaintext of the metadata chunk
+     * @param size - the size of the metadata chunk
+     * @param index - cloud id that metadata chunk download
+     *
+     */
+    int writeRecipeEntries(char* metaChunk, int size, int index);
+
+    /*
+     * load the key recipe of a cloud
+     *
+     * @param index - the cloud index
+     * @param numOfChunks - number of metadata and index chunks of the file
+     *
+     * @return - the level of the chunks pointed to by the key recipe, 0 for metadata chunks, or -1 on error
+     */
+    int loadKeyRecipe(int index, long numOfChunks);
+
+    /*
+     * rebuild the file recipe from the metadata tree of a cloud
+     *
+     * @param index - the cloud index
+     * @param numOfChunks - number of metadata and index chunks of the file
+     * @param level - the level of the chunks pointed to by the key recipe
+     *
+     * @return - a boolean value that indicates if the file recipe is rebuilt
+     */
+    int restoreRecipeTree(int index, long numOfChunks, int level);
+
+    /*
+     * decrypt a chunk of the metadata tree and rebuild the file recipe below it
+     *
+     * @param index - the cloud index
+     * @param record - the record of the chunk
+     * @param level - the level of the chunk
+     * @param fp - the file holding the downloaded chunks
+     * @param locs - the location of each chunk in fp by chunk ID
+     * @param numOfChunks - number of metadata and index chunks of the file
+     * @param offset - the offset in the file of the first byte covered by the chunk
+     *
+     */
+    int restoreTreeChunk(int index, keyRecord_t* record, int level, FILE* fp, metaChunkLoc_t* locs, long numOfChunks, long offset);
+
     /*
      * upload retrived file recipe to cloud server for next origin file retrive
      *
@@ -288,5 +694,51 @@ public:
      *
      */
     int uploadRetrivedRecipeFile(int index);
+
+    /*
+     * pass the zero secrets at a position of the file recipe to the decoder
+     *
+     * @param position - the number of data secrets passed so far
+     * @param zeroIndex - the index of the next zero secret <return>
+     * @param decodeCount - the number of secrets passed to the decoder <return>
+     *
+     */
+    void addZeroSecrets(long position, long* zeroIndex, long* decodeCount);
+
+    /*
+     * add a secret restored without shares to the zero secret list (only by the cloud listing it)
+     *
+     * @param node - the metadata of the secret
+     * @param cached - whether the secret is in the chunk cache rather than a zero secret
+     *
+     */
+    void listZeroSecret(metaNode* node, int cached);
+
+    /*
+     * check if a secret was found in the chunk cache by the cloud listing it
+     *
+     * @param index - the cloud index
+     * @param secretID - the ID of the secret, which grows along the file
+     *
+     * @return - a boolean value that indicates if the secret is restored from the cache
+     */
+    bool isCachedSecret(int index, int secretID);
+
+    /*
+     * set the chunk cache key of the secret at a position of the file recipe in a package for the decoder
+     *
+     * @param position - the position of the secret
+     * @param package - the package <return>
+     *
+     */
+    void setCacheKey(long position, Decoder::ShareChunk_t* package);
+
+    /*
+     * print the number of secrets of the file
+     *
+     * @param numOfShares - the number of secrets restored from shares
+     *
+     */
+    void reportSecrets(long numOfShares);
 };
 #endif
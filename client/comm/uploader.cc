@@ -26,11 +26,31 @@ void* Uploader::thread_handler(void* param)
     while (true) {
         /* get object from ringbuffer */
         obj->ringBuffer_[cloudIndex - 4]->Extract(&output);
+        double start = stageTimeNow();
+
+        /* a failed cloud only drains its ringbuffer, so that the encoder never blocks on it */
+        if (obj->failed_[cloudIndex]) {
+            if (output.type == FILE_HEADER) {
+                free(output.fileObj.data);
+            } else {
+                free(output.shareObj.data);
+            }
+            if (output.type == SHARE_END || output.type == ZERO_END) {
+                break;
+            }
+            continue;
+        }
 
         /* IF this is a file header object.. */
         if (output.type == FILE_HEADER) {
 
             /* copy object content into metabuffer */
+            if (!obj->reserveBuffers(cloudIndex, obj->fileMDHeadSize_ + output.fileObj.file_header.fullNameSize, 0)) {
+                fprintf(stderr, "Error: fail to grow the upload buffers of cloud %d!\n", cloudIndex);
+                obj->failed_[cloudIndex] = true;
+                free(output.fileObj.data);
+                continue;
+            }
             memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex],
                 &(output.fileObj.file_header), obj->fileMDHeadSize_);
 
@@ -42,6 +62,7 @@ void* Uploader::thread_handler(void* param)
 
             /* copy file full path name */
             memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex], output.fileObj.data, output.fileObj.file_header.fullNameSize);
+            free(output.fileObj.data);
 
             /* meta index update */
             obj->metaWP_[cloudIndex] += obj->headerArray_[cloudIndex]->fullNameSize;
@@ -50,10 +71,24 @@ void* Uploader::thread_handler(void* param)
             /* IF this is share object */
             int shareSize = output.shareObj.share_header.shareSize;
 
-            /* see if the container buffer can hold the coming share, if not then perform upload */
-            if (shareSize + obj->containerWP_[cloudIndex] > UPLOAD_BUFFER_SIZE) {
+            /* a share repeated within the batch only takes a metadata entry, the server keeps its data once */
+            int dataSize = obj->batchFPs_[cloudIndex]->contains(output.shareObj.share_header.shareFP) ? 0 : shareSize;
+
+            /* see if the buffers can hold the coming share, if not then perform upload */
+            if ((dataSize + obj->containerWP_[cloudIndex] > obj->bufferSize_)
+                || (obj->shareMDEntrySize_ + obj->metaWP_[cloudIndex] > obj->bufferSize_)) {
                 obj->performUpload(cloudIndex);
                 obj->updateHeader(cloudIndex);
+                dataSize = shareSize;
+            }
+            if (!obj->reserveBuffers(cloudIndex, obj->shareMDEntrySize_, dataSize)) {
+                fprintf(stderr, "Error: fail to grow the upload buffers of cloud %d!\n", cloudIndex);
+                obj->failed_[cloudIndex] = true;
+                free(output.shareObj.data);
+                if (output.type == SHARE_END) {
+                    break;
+                }
+                continue;
             }
 
             /* copy share header into metabuffer */
@@ -61,11 +96,16 @@ void* Uploader::thread_handler(void* param)
             obj->metaWP_[cloudIndex] += obj->shareMDEntrySize_;
 
             /* copy share data into container buffer */
-            memcpy(obj->uploadContainer_[cloudIndex] + obj->containerWP_[cloudIndex], output.shareObj.data, shareSize);
-            obj->containerWP_[cloudIndex] += shareSize;
+            if (dataSize > 0) {
+                memcpy(obj->uploadContainer_[cloudIndex] + obj->containerWP_[cloudIndex], output.shareObj.data, dataSize);
+                obj->containerWP_[cloudIndex] += dataSize;
+                obj->batchFPs_[cloudIndex]->insert(output.shareObj.share_header.shareFP);
+            }
+            free(output.shareObj.data);
+            obj->accuData_[cloudIndex] += shareSize;
 
-            /* record share size */
-            obj->shareSizeArray_[cloudIndex][obj->numOfShares_[cloudIndex]] = shareSize;
+            /* record the size of the share data in the container buffer */
+            obj->shareSizeArray_[cloudIndex][obj->numOfShares_[cloudIndex]] = dataSize;
             obj->numOfShares_[cloudIndex]++;
 
             /* update file header pointer */
@@ -75,6 +115,18 @@ void* Uploader::thread_handler(void* param)
             /* IF this is the last share object, perform upload and exit thread */
             if (output.type == SHARE_END) {
                 obj->performUpload(cloudIndex);
+                stageStatAdd(&obj->uploadStat_[cloudIndex], start, shareSize);
+                break;
+            }
+            stageStatAdd(&obj->uploadStat_[cloudIndex], start, shareSize);
+        } else if (output.type == ZERO_OBJECT || output.type == ZERO_END) {
+            /* IF this is a zero secret, it has no share and only counts towards the file size */
+            obj->headerArray_[cloudIndex]->sizeOfComingSecrets += output.shareObj.share_header.secretSize;
+
+            /* IF this is the last secret, perform upload and exit thread */
+            if (output.type == ZERO_END) {
+                obj->performUpload(cloudIndex);
+                stageStatAdd(&obj->uploadStat_[cloudIndex], start, 0);
                 break;
             }
         }
@@ -102,11 +154,31 @@ void* Uploader::thread_handler_meta(void* param)
     while (true) {
         /* get object from ringbuffer */
         obj->ringBufferMeta_[cloudIndex]->Extract(&output);
+        double start = stageTimeNow();
+
+        /* a failed cloud only drains its ringbuffer, so that the encoder never blocks on it */
+        if (obj->failed_[cloudIndex]) {
+            if (output.type == FILE_HEADER) {
+                free(output.fileObj.data);
+            } else {
+                free(output.shareObj.data);
+            }
+            if (output.type == SHARE_END || output.type == ZERO_END) {
+                break;
+            }
+            continue;
+        }
 
         /* IF this is a file header object.. */
         if (output.type == FILE_HEADER) {
 
             /* copy object content into metabuffer */
+            if (!obj->reserveBuffers(cloudIndex, obj->fileMDHeadSize_ + output.fileObj.file_header.fullNameSize, 0)) {
+                fprintf(stderr, "Error: fail to grow the upload buffers of cloud %d!\n", cloudIndex);
+                obj->failed_[cloudIndex] = true;
+                free(output.fileObj.data);
+                continue;
+            }
             memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex],
                 &(output.fileObj.file_header), obj->fileMDHeadSize_);
 
@@ -118,6 +190,7 @@ void* Uploader::thread_handler_meta(void* param)
 
             /* copy file full path name */
             memcpy(obj->uploadMetaBuffer_[cloudIndex] + obj->metaWP_[cloudIndex], output.fileObj.data, output.fileObj.file_header.fullNameSize);
+            free(output.fileObj.data);
 
             /* meta index update */
             obj->metaWP_[cloudIndex] += obj->headerArray_[cloudIndex]->fullNameSize;
@@ -126,10 +199,24 @@ void* Uploader::thread_handler_meta(void* param)
             /* IF this is share object */
             int shareSize = output.shareObj.share_header.shareSize;
 
-            /* see if the container buffer can hold the coming share, if not then perform upload */
-            if (shareSize + obj->containerWP_[cloudIndex] > UPLOAD_BUFFER_SIZE) {
+            /* a share repeated within the batch only takes a metadata entry, the server keeps its data once */
+            int dataSize = obj->batchFPs_[cloudIndex]->contains(output.shareObj.share_header.shareFP) ? 0 : shareSize;
+
+            /* see if the buffers can hold the coming share, if not then perform upload */
+            if ((dataSize + obj->containerWP_[cloudIndex] > obj->bufferSize_)
+                || (obj->shareMDEntrySize_ + obj->metaWP_[cloudIndex] > obj->bufferSize_)) {
                 obj->performUpload(cloudIndex);
                 obj->updateHeader(cloudIndex);
+                dataSize = shareSize;
+            }
+            if (!obj->reserveBuffers(cloudIndex, obj->shareMDEntrySize_, dataSize)) {
+                fprintf(stderr, "Error: fail to grow the upload buffers of cloud %d!\n", cloudIndex);
+                obj->failed_[cloudIndex] = true;
+                free(output.shareObj.data);
+                if (output.type == SHARE_END) {
+                    break;
+                }
+                continue;
             }
 
             /* copy share header into metabuffer */
@@ -137,11 +224,16 @@ void* Uploader::thread_handler_meta(void* param)
             obj->metaWP_[cloudIndex] += obj->shareMDEntrySize_;
 
             /* copy share data into container buffer */
-            memcpy(obj->uploadContainer_[cloudIndex] + obj->containerWP_[cloudIndex], output.shareObj.data, shareSize);
-            obj->containerWP_[cloudIndex] += shareSize;
+            if (dataSize > 0) {
+                memcpy(obj->uploadContainer_[cloudIndex] + obj->containerWP_[cloudIndex], output.shareObj.data, dataSize);
+                obj->containerWP_[cloudIndex] += dataSize;
+                obj->batchFPs_[cloudIndex]->insert(output.shareObj.share_header.shareFP);
+            }
+            free(output.shareObj.data);
+            obj->accuData_[cloudIndex] += shareSize;
 
-            /* record share size */
-            obj->shareSizeArray_[cloudIndex][obj->numOfShares_[cloudIndex]] = shareSize;
+            /* record the size of the share data in the container buffer */
+            obj->shareSizeArray_[cloudIndex][obj->numOfShares_[cloudIndex]] = dataSize;
             obj->numOfShares_[cloudIndex]++;
 
             /* update file header pointer */
@@ -151,8 +243,10 @@ void* Uploader::thread_handler_meta(void* param)
             /* IF this is the last share object, perform upload and exit thread */
             if (output.type == SHARE_END) {
                 obj->performUpload(cloudIndex);
+                stageStatAdd(&obj->uploadStat_[cloudIndex], start, shareSize);
                 break;
             }
+            stageStatAdd(&obj->uploadStat_[cloudIndex], start, shareSize);
         }
     }
     int flagTemp = obj->uploadKeyFile(cloudIndex);
@@ -169,13 +263,25 @@ void* Uploader::thread_handler_meta(void* param)
  * @param p - input large prime number
  * @param total - input total number of clouds
  * @param subset - input number of clouds to be chosen
+ * @param nullSink - whether to drop all data instead of sending it to the clouds
+ * @param bufferSize - maximum size of the metadata and container buffers of each cloud
+ * @param queueDepth - depth of the ringbuffer of each cloud (0 for UPLOAD_RB_SIZE)
+ * @param sockets - connected sockets of the clouds to reuse (NULL for connecting to ./config-u)
  *
  */
-Uploader::Uploader(int total, int subset, int userID, char* fileName, int nameSize)
+Uploader::Uploader(int total, int subset, int userID, char* fileName, int nameSize, bool nullSink, int bufferSize, int queueDepth, Socket** sockets)
 {
 
     total_ = total * 2;
     subset_ = subset;
+    nullSink_ = nullSink;
+    ownSockets_ = (sockets == NULL);
+    bufferSize_ = bufferSize;
+    fileMDHeadSize_ = sizeof(fileShareMDHead_t);
+    shareMDEntrySize_ = sizeof(shareMDEntry_t);
+    if (queueDepth <= 0) {
+        queueDepth = UPLOAD_RB_SIZE;
+    }
 
     memcpy(name_, fileName, nameSize);
 
@@ -186,30 +292,60 @@ Uploader::Uploader(int total, int subset, int userID, char* fileName, int nameSi
     uploadContainer_ = (char**)malloc(sizeof(char*) * total_);
     containerWP_ = (int*)malloc(sizeof(int) * total_);
     metaWP_ = (int*)malloc(sizeof(int) * total_);
+    metaCapacity_ = (int*)malloc(sizeof(int) * total_);
+    containerCapacity_ = (int*)malloc(sizeof(int) * total_);
     numOfShares_ = (int*)malloc(sizeof(int) * total_);
     socketArray_ = (Socket**)malloc(sizeof(Socket*) * total_);
     headerArray_ = (fileShareMDHead_t**)malloc(sizeof(fileShareMDHead_t*) * total_);
     shareSizeArray_ = (int**)malloc(sizeof(int*) * total_);
+    batchFPs_ = (FPSet**)malloc(sizeof(FPSet*) * total_);
 
-    /* read server ip & port from config file */
-    FILE* fp = fopen("./config-u", "rb");
+    /* read server ip & port from config file (not needed by the null sink or for reused sockets) */
+    FILE* fp = (nullSink_ || !ownSockets_) ? NULL : fopen("./config-u", "rb");
     char line[225];
     const char ch[2] = ":";
+    if (!nullSink_ && ownSockets_ && fp == NULL) {
+        fprintf(stderr, "Error: fail to open config file ./config-u!\n");
+        /* nothing is started, so the destructor only frees the arrays */
+        valid_ = false;
+        total_ = 0;
+        return;
+    }
+    valid_ = true;
 
     for (int i = 0; i < total; i++) {
-        ringBufferMeta_[i] = new RingBuffer<ItemMeta_t>(UPLOAD_RB_SIZE, true, 1);
-        shareSizeArray_[i] = (int*)malloc(sizeof(int) * UPLOAD_BUFFER_SIZE);
-        uploadMetaBuffer_[i] = (char*)malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
-        uploadContainer_[i] = (char*)malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
+        ringBufferMeta_[i] = new RingBuffer<ItemMeta_t>(queueDepth, true, 1);
+        /* the buffers are allocated on demand, so a small file or a stream of zero secrets stays small */
+        shareSizeArray_[i] = NULL;
+        uploadMetaBuffer_[i] = NULL;
+        uploadContainer_[i] = NULL;
+        headerArray_[i] = NULL;
+        metaCapacity_[i] = 0;
+        containerCapacity_[i] = 0;
         containerWP_[i] = 0;
         metaWP_[i] = 0;
         numOfShares_[i] = 0;
+        failed_[i] = false;
+        batchFPs_[i] = new FPSet(FP_SIZE);
+        stageStatInit(&uploadStat_[i]);
 
         param_t* param = (param_t*)malloc(sizeof(param_t)); // thread's parameter
         param->cloudIndex = i;
         param->obj = this;
         pthread_create(&tid_[i], 0, &thread_handler_meta, (void*)param);
 
+        accuData_[i] = 0;
+        accuUnique_[i] = 0;
+        accuDuplicates_[i] = 0;
+        socketArray_[i] = NULL;
+        if (nullSink_) {
+            continue;
+        }
+        if (!ownSockets_) {
+            socketArray_[i] = sockets[i];
+            continue;
+        }
+
         /* line by line read config file*/
         int ret = fscanf(fp, "%s", line);
         if (ret == 0)
@@ -221,23 +357,40 @@ Uploader::Uploader(int total, int subset, int userID, char* fileName, int nameSi
 
         /* set sockets */
         socketArray_[i] = new Socket(ip, port, userID);
-        accuData_[i] = 0;
-        accuUnique_[i] = 0;
     }
     for (int i = total; i < total_; i++) {
-        ringBuffer_[i - total] = new RingBuffer<Item_t>(UPLOAD_RB_SIZE, true, 1);
-        shareSizeArray_[i] = (int*)malloc(sizeof(int) * UPLOAD_BUFFER_SIZE);
-        uploadMetaBuffer_[i] = (char*)malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
-        uploadContainer_[i] = (char*)malloc(sizeof(char) * UPLOAD_BUFFER_SIZE);
+        ringBuffer_[i - total] = new RingBuffer<Item_t>(queueDepth, true, 1);
+        /* the buffers are allocated on demand, so a small file or a stream of zero secrets stays small */
+        shareSizeArray_[i] = NULL;
+        uploadMetaBuffer_[i] = NULL;
+        uploadContainer_[i] = NULL;
+        headerArray_[i] = NULL;
+        metaCapacity_[i] = 0;
+        containerCapacity_[i] = 0;
         containerWP_[i] = 0;
         metaWP_[i] = 0;
         numOfShares_[i] = 0;
+        failed_[i] = false;
+        batchFPs_[i] = new FPSet(FP_SIZE);
+        stageStatInit(&uploadStat_[i]);
 
         param_t* param = (param_t*)malloc(sizeof(param_t)); // thread's parameter
         param->cloudIndex = i;
         param->obj = this;
         pthread_create(&tid_[i], 0, &thread_handler, (void*)param);
 
+        accuData_[i] = 0;
+        accuUnique_[i] = 0;
+        accuDuplicates_[i] = 0;
+        socketArray_[i] = NULL;
+        if (nullSink_) {
+            continue;
+        }
+        if (!ownSockets_) {
+            socketArray_[i] = sockets[i];
+            continue;
+        }
+
         /* line by line read config file*/
         int ret = fscanf(fp, "%s", line);
         if (ret == 0)
@@ -249,12 +402,53 @@ Uploader::Uploader(int total, int subset, int userID, char* fileName, int nameSi
 
         /* set sockets */
         socketArray_[i] = new Socket(ip, port, userID);
-        accuData_[i] = 0;
-        accuUnique_[i] = 0;
     }
-    fclose(fp);
-    fileMDHeadSize_ = sizeof(fileShareMDHead_t);
-    shareMDEntrySize_ = sizeof(shareMDEntry_t);
+    if (fp != NULL) {
+        fclose(fp);
+    }
+}
+
+/*
+ * stop the threads of an uploader that gets no file, e.g. when the encoder fails to start
+ *
+ * every cloud is marked as failed, so the end objects only stop its threads
+ */
+void Uploader::abort()
+{
+    Item_t item;
+    ItemMeta_t itemMeta;
+
+    item.type = ZERO_END;
+    item.shareObj.data = NULL;
+    itemMeta.type = SHARE_END;
+    itemMeta.shareObj.data = NULL;
+    for (int i = 0; i < total_; i++) {
+        failed_[i] = true;
+    }
+    for (int i = 0; i < total_ / 2; i++) {
+        addMeta(&itemMeta, sizeof(itemMeta), i);
+        add(&item, sizeof(item), i);
+    }
+    for (int i = 0; i < total_; i++) {
+        pthread_join(tid_[i], NULL);
+    }
+}
+
+/*
+ * print the statistics of the metadata and data upload stages
+ *
+ * @param wallTime - the wall time of the whole run in seconds
+ */
+void Uploader::reportStages(double wallTime)
+{
+    double metaOccupancy = 0, dataOccupancy = 0;
+
+    for (int i = 0; i < total_ / 2; i++) {
+        metaOccupancy += ringBufferMeta_[i]->AverageOccupancy();
+        dataOccupancy += ringBuffer_[i]->AverageOccupancy();
+    }
+    stageStatReport("upmeta", uploadStat_, total_ / 2, wallTime, metaOccupancy / (total_ / 2));
+    stageStatReport("updata", uploadStat_ + total_ / 2, total_ / 2, wallTime, dataOccupancy / (total_ / 2));
 }
 
 /*
@@ -266,7 +460,10 @@ Uploader::~Uploader()
         free(shareSizeArray_[i]);
         free(uploadMetaBuffer_[i]);
         free(uploadContainer_[i]);
-        delete (socketArray_[i]);
+        delete batchFPs_[i];
+        if (ownSockets_) {
+            delete (socketArray_[i]);
+        }
     }
     for (int i = 0; i < total_ / 2; i++) {
         delete (ringBuffer_[i]);
@@ -275,9 +472,12 @@ Uploader::~Uploader()
     free(ringBuffer_);
     free(ringBufferMeta_);
     free(shareSizeArray_);
+    free(batchFPs_);
     free(headerArray_);
     free(socketArray_);
     free(numOfShares_);
+    free(metaCapacity_);
+    free(containerCapacity_);
     free(metaWP_);
     free(containerWP_);
     free(uploadContainer_);
@@ -292,6 +492,12 @@ Uploader::~Uploader()
  */
 int Uploader::performUpload(int cloudIndex)
 {
+    /* the null sink takes every share that is not repeated within the batch as unique and drops it */
+    if (nullSink_) {
+        accuUnique_[cloudIndex] += containerWP_[cloudIndex];
+        return 0;
+    }
+
     /* 1st send metadata */
     socketArray_[cloudIndex]->sendMeta(uploadMetaBuffer_[cloudIndex], metaWP_[cloudIndex]);
 
@@ -301,28 +507,21 @@ int Uploader::performUpload(int cloudIndex)
     socketArray_[cloudIndex]->getStatus(statusList, &numOfshares);
 
     /* 3rd according to status list, reconstruct the container buffer */
-    int buffer_size = 0;
-    if (cloudIndex < total_ / 2) {
-        buffer_size = RING_BUFFER_META_SIZE;
-    } else {
-        buffer_size = RING_BUFFER_DATA_SIZE;
-    }
-    char temp[buffer_size];
     int indexCount = 0;
     int containerIndex = 0;
     int currentSize = 0;
     for (int i = 0; i < numOfshares; i++) {
         currentSize = shareSizeArray_[cloudIndex][i];
         if (statusList[i] == 0) {
-            memcpy(temp, uploadContainer_[cloudIndex] + containerIndex, currentSize);
-            memcpy(uploadContainer_[cloudIndex] + indexCount, temp, currentSize);
+            memmove(uploadContainer_[cloudIndex] + indexCount, uploadContainer_[cloudIndex] + containerIndex, currentSize);
             indexCount += currentSize;
+        } else {
+            accuDuplicates_[cloudIndex]++;
         }
         containerIndex += currentSize;
     }
 
     /* calculate the amount of sent data */
-    accuData_[cloudIndex] += containerIndex;
     accuUnique_[cloudIndex] += indexCount;
 
     /* finally send the unique data to the cloud */
@@ -359,6 +558,7 @@ int Uploader::updateHeader(int cloudIndex)
     containerWP_[cloudIndex] = 0;
     metaWP_[cloudIndex] = 0;
     numOfShares_[cloudIndex] = 0;
+    batchFPs_[cloudIndex]->clear();
 
     /* copy the header into metabuffer */
     memcpy(uploadMetaBuffer_[cloudIndex], headerArray_[cloudIndex], fileMDHeadSize_ + offset);
@@ -367,6 +567,70 @@ int Uploader::updateHeader(int cloudIndex)
     return 1;
 }
 
+/*
+ * grow the metadata and container buffers of a cloud to hold the coming data
+ *
+ * the buffers double up to bufferSize_, and the share size array grows with the
+ * metadata buffer since each share in a batch takes one metadata entry
+ *
+ * @param cloudIndex - indicating targeting cloud
+ * @param metaSize - size of the coming metadata
+ * @param containerSize - size of the coming share data
+ *
+ * @return - a boolean value that indicates if the buffers are grown
+ */
+bool Uploader::reserveBuffers(int cloudIndex, int metaSize, int containerSize)
+{
+    int capacity;
+
+    if (metaWP_[cloudIndex] + metaSize > metaCapacity_[cloudIndex]) {
+        capacity = (metaCapacity_[cloudIndex] > 0) ? metaCapacity_[cloudIndex] : UPLOAD_INIT_BUFFER_SIZE;
+        while (capacity < metaWP_[cloudIndex] + metaSize) {
+            capacity *= 2;
+        }
+        if (capacity > bufferSize_) {
+            capacity = bufferSize_;
+        }
+
+        /* the file header lives in the metadata buffer, so it moves with it */
+        long headerOffset = -1;
+        if (headerArray_[cloudIndex] != NULL) {
+            headerOffset = (char*)headerArray_[cloudIndex] - uploadMetaBuffer_[cloudIndex];
+        }
+        char* metaBuffer = (char*)realloc(uploadMetaBuffer_[cloudIndex], sizeof(char) * capacity);
+        if (metaBuffer == NULL) {
+            return false;
+        }
+        uploadMetaBuffer_[cloudIndex] = metaBuffer;
+        if (headerOffset >= 0) {
+            headerArray_[cloudIndex] = (fileShareMDHead_t*)(uploadMetaBuffer_[cloudIndex] + headerOffset);
+        }
+        int* sizeArray = (int*)realloc(shareSizeArray_[cloudIndex], sizeof(int) * (capacity / shareMDEntrySize_ + 1));
+        if (sizeArray == NULL) {
+            return false;
+        }
+        shareSizeArray_[cloudIndex] = sizeArray;
+        metaCapacity_[cloudIndex] = capacity;
+    }
+
+    if (containerWP_[cloudIndex] + containerSize > containerCapacity_[cloudIndex]) {
+        capacity = (containerCapacity_[cloudIndex] > 0) ? containerCapacity_[cloudIndex] : UPLOAD_INIT_BUFFER_SIZE;
+        while (capacity < containerWP_[cloudIndex] + containerSize) {
+            capacity *= 2;
+        }
+        if (capacity > bufferSize_) {
+            capacity = bufferSize_;
+        }
+        char* container = (char*)realloc(uploadContainer_[cloudIndex], sizeof(char) * capacity);
+        if (container == NULL) {
+            return false;
+        }
+        uploadContainer_[cloudIndex] = container;
+        containerCapacity_[cloudIndex] = capacity;
+    }
+    return true;
+}
+
 /*
  * interface for adding object to ringbuffer
  *
@@ -404,14 +668,33 @@ int Uploader::addMeta(ItemMeta_t* item, int size, int index)
  */
 int Uploader::indicateEnd(long long* total, long long* uniq)
 {
+    int ret = 1;
 
     for (int i = 0; i < UPLOAD_NUM_THREADS * 2; i++) {
 
         pthread_join(tid_[i], NULL);
         *total += accuData_[i];
         *uniq += accuUnique_[i];
+        if (failed_[i]) {
+            ret = 0;
+        }
     }
-    return 1;
+    return ret;
+}
+
+/*
+ * get the number of metadata chunks found duplicate by the clouds
+ *
+ * @return - the number of duplicate metadata chunks over all clouds
+ */
+long long Uploader::getMetaDuplicates()
+{
+    long long duplicates = 0;
+
+    for (int i = 0; i < total_ / 2; i++) {
+        duplicates += accuDuplicates_[i];
+    }
+    return duplicates;
 }
 
 /*
@@ -431,6 +714,16 @@ int Uploader::uploadKeyFile(int index)
     string encFileName(buffer);
     char cmd[256];
     snprintf(cmd, sizeof(cmd), "openssl enc -aes-128-cbc -in %s -out %s -pass pass:test", keyFileName.c_str(), encFileName.c_str());
+    if (nullSink_) {
+        /* the null sink keeps no key recipe */
+        remove(keyFileName.c_str());
+        return 1;
+    }
+    if (failed_[index]) {
+        /* the metadata chunks of the key recipe did not reach the cloud */
+        remove(keyFileName.c_str());
+        return 0;
+    }
     pid_t status = system(cmd);
     if (status == -1) {
         printf("error in system call function %s\n", cmd);
@@ -447,23 +740,24 @@ int Uploader::uploadKeyFile(int index)
     if (fp == NULL)
         printf("can't open key file\n");
     fseek(fp, 0, SEEK_END);
-    int size = ftell(fp);
+    long size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
-    char uploadEncBuffer[size + 1];
-    int realRead = fread(uploadEncBuffer, sizeof(char), size, fp);
+    /* the key recipe grows with the file, so it is kept off the stack */
+    char* uploadEncBuffer = (char*)malloc(sizeof(char) * size);
+    long realRead = fread(uploadEncBuffer, sizeof(char), size, fp);
     if (realRead != size) {
         printf("error in read file %s", encFileName.c_str());
     }
-    uploadEncBuffer[size] = '\0';
     fclose(fp);
 
     int indicator = KEY_RECIPE;
     int fileNameSizeTemp = encFileName.length();
     socketArray_[index]->genericSend((char*)&indicator, sizeof(int));
-    socketArray_[index]->genericSend((char*)&size, sizeof(int));
+    socketArray_[index]->genericSend((char*)&size, sizeof(long));
     socketArray_[index]->genericSend((char*)&fileNameSizeTemp, sizeof(int));
     socketArray_[index]->genericSend((char*)encFileName.c_str(), fileNameSizeTemp);
     socketArray_[index]->genericSend(uploadEncBuffer, size);
+    free(uploadEncBuffer);
 
     snprintf(cmd, sizeof(cmd), "rm -rf %s", encFileName.c_str());
     status = system(cmd);
@@ -24,18 +24,19 @@
 #include "BasicRingBuffer.hh"
 #include "CDCodec.hh"
 #include "CryptoPrimitive.hh"
+#include "fpSet.hh"
 #include "socket.hh"
+#include "stageStat.hh"
 
 /* upload ringbuffer size */
 #define UPLOAD_RB_SIZE 2048
 
-/* data buffer size for each object in ringbuffer */
-#define RING_BUFFER_DATA_SIZE (16 * 1024)
-#define RING_BUFFER_META_SIZE (32 * 1024)
-
 /* upload buffer size */
 #define UPLOAD_BUFFER_SIZE (4 * 1024 * 1024)
 
+/* initial size of the upload buffers, which grow up to the upload buffer size on demand */
+#define UPLOAD_INIT_BUFFER_SIZE (64 * 1024)
+
 /* max file full path name size */
 #define DIR_MAX_SIZE 255
 
@@ -58,6 +59,8 @@
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
+#define ZERO_OBJECT (-7)
+#define ZERO_END (-28)
 #define KEY_RECIPE (-101)
 #define GET_KEY_RECIPE (-102)
 
@@ -79,14 +82,17 @@ private:
     //number of a subset of clouds
     int subset_;
 
+    //whether data is dropped instead of sent to the clouds (pipeline benchmark)
+    bool nullSink_;
+
 public:
     /* file metadata header structure */
     typedef struct {
         int fullNameSize;
         long fileSize;
-        int numOfPastSecrets;
+        long numOfPastSecrets;
         long sizeOfPastSecrets;
-        int numOfComingSecrets;
+        long numOfComingSecrets;
         long sizeOfComingSecrets;
     } fileShareMDHead_t;
 
@@ -105,21 +111,27 @@ public:
         int secretSize;
     } fileRecipeEntry_t;
 
+    /*
+     * ringbuffer objects only carry a pointer to their payload (file name or share), so their
+     * size does not depend on the chunk size; the payload is allocated with malloc by the
+     * producer and freed by the upload thread once it is copied into the buffers
+     */
+
     /* file header object struct for ringbuffer */
     typedef struct {
         fileShareMDHead_t file_header;
-        unsigned char data[RING_BUFFER_DATA_SIZE];
+        unsigned char* data;
     } fileHeaderObj_t;
 
     /* share header object struct for ringbuffer */
     typedef struct {
         shareMDEntry_t share_header;
-        unsigned char data[RING_BUFFER_DATA_SIZE];
+        unsigned char* data;
     } shareHeaderObj_t;
     //meta chunk share
     typedef struct {
         shareMDEntry_t share_header;
-        unsigned char data[RING_BUFFER_META_SIZE];
+        unsigned char* data;
     } metaShareHeaderObj_t;
 
     /* union of objects for unifying ringbuffer objects */
@@ -151,6 +163,9 @@ public:
     /* socket array */
     Socket** socketArray_;
 
+    /* whether the sockets are closed with the uploader (not when they are reused across files) */
+    bool ownSockets_;
+
     /* metadata buffer */
     char** uploadMetaBuffer_;
 
@@ -163,12 +178,28 @@ public:
     /* metadata write pointer */
     int* metaWP_;
 
+    /* maximum size of the metadata and container buffers of each cloud */
+    int bufferSize_;
+
+    /* current capacity of the metadata and container buffers */
+    int* metaCapacity_;
+    int* containerCapacity_;
+
     /* indicate the number of shares in a buffer */
     int* numOfShares_;
 
-    /* array for record each share size */
+    /* array for record the size of each share in the container buffer (0 for a share repeated within the batch) */
     int** shareSizeArray_;
 
+    /* fingerprints of the shares whose data is in the container buffer */
+    FPSet** batchFPs_;
+
+    /* whether the buffers of a cloud could not be grown, so its shares are dropped */
+    bool failed_[UPLOAD_NUM_THREADS * 2];
+
+    /* whether the uploader is connected to the clouds and started */
+    bool valid_;
+
     /* size of file metadata header */
     int fileMDHeadSize_;
 
@@ -184,6 +215,12 @@ public:
     /* record accumulated unique data */
     long long accuUnique_[UPLOAD_NUM_THREADS * 2];
 
+    /* record the number of shares found duplicate by the cloud */
+    long long accuDuplicates_[UPLOAD_NUM_THREADS * 2];
+
+    /* statistics of each upload thread */
+    StageStat_t uploadStat_[UPLOAD_NUM_THREADS * 2];
+
     /* uploader ringbuffer array */
     RingBuffer<Item_t>** ringBuffer_;
     RingBuffer<ItemMeta_t>** ringBufferMeta_;
@@ -195,15 +232,32 @@ public:
      * @param p - input large prime number
      * @param total - input total number of clouds
      * @param subset - input number of clouds to be chosen
+     * @param nullSink - whether to drop all data instead of sending it to the clouds
+     * @param bufferSize - maximum size of the metadata and container buffers of each cloud
+     * @param queueDepth - depth of the ringbuffer of each cloud (0 for UPLOAD_RB_SIZE)
+     * @param sockets - connected sockets of the clouds to reuse (NULL for connecting to ./config-u)
      *
      */
-    Uploader(int total, int subset, int userID, char* fileName, int nameSize);
+    Uploader(int total, int subset, int userID, char* fileName, int nameSize, bool nullSink = false,
+        int bufferSize = UPLOAD_BUFFER_SIZE, int queueDepth = 0, Socket** sockets = NULL);
 
     /*
      * destructor
      */
     ~Uploader();
 
+    /*
+     * check if the uploader is connected to the clouds and started
+     *
+     * @return - a boolean value that indicates if the uploader can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * stop the threads of an uploader that gets no file, e.g. when the encoder fails to start
+     */
+    void abort();
+
     /*
      * Initiate upload
      *
@@ -217,10 +271,25 @@ public:
      * 
      * @return total - total amount of data that input to uploader
      * @return uniq - the amount of unique data that transferred in network
+     * @return - 0 if the buffers of a cloud could not be grown, 1 otherwise
      *
      */
     int indicateEnd(long long* total, long long* uniq);
 
+    /*
+     * get the number of metadata chunks found duplicate by the clouds
+     *
+     * @return - the number of duplicate metadata chunks over all clouds
+     */
+    long long getMetaDuplicates();
+
+    /*
+     * print the statistics of the metadata and data upload stages
+     *
+     * @param wallTime - the wall time of the whole run in seconds
+     */
+    void reportStages(double wallTime);
+
     /*
      * interface for adding object to ringbuffer
      *
@@ -251,6 +320,17 @@ public:
      */
     int updateHeader(int cloudIndex);
 
+    /*
+     * grow the metadata and container buffers of a cloud to hold the coming data
+     *
+     * @param cloudIndex - indicating targeting cloud
+     * @param metaSize - size of the coming metadata
+     * @param containerSize - size of the coming share data
+     *
+     * @return - a boolean value that indicates if the buffers are grown
+     */
+    bool reserveBuffers(int cloudIndex, int metaSize, int containerSize);
+
     /*
      * uploader thread handler
      *
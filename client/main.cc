@@ -2,33 +2,18 @@
  * main test program
  */
 #include <bits/stdc++.h>
+#include <errno.h>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <unistd.h>
 
-#include "CDCodec.hh"
-#include "CryptoPrimitive.hh"
-#include "chunker.hh"
-#include "conf.hh"
-#include "decoder.hh"
-#include "downloader.hh"
-#include "encoder.hh"
-#include "uploader.hh"
-
-#define MAIN_CHUNK
+#include "agent.hh"
+#include "metadedup.hh"
 
 using namespace std;
 
-Chunker* chunkerObj;
-Decoder* decoderObj;
-Encoder* encoderObj;
-Uploader* uploaderObj;
-CryptoPrimitive* cryptoObj;
-CDCodec* cdCodecObj;
-Downloader* downloaderObj;
-Configuration* confObj;
-
 struct timeval timestart;
 struct timeval timeend;
 
@@ -39,10 +24,115 @@ void usage(char* s)
     printf("\t- [filename]: full path of the file;\n");
     printf("\t- [userID]: use ID of current client;\n");
     printf("\t- [action]: [-u] upload; [-d] download;\n");
+    printf("\t            [-dl] download the files listed in [filename], one full path per line;\n");
+    printf("\t            [-bc] benchmark chunking; [-be] benchmark chunking & encoding;\n");
+    printf("\t            [-bn] benchmark the upload pipeline with a null sink instead of the servers;\n");
+    printf("\t            [-agent] serve the CLIENT runs that set METADEDUP_AGENT to [filename];\n");
     printf("\t- [securityType]: [HIGH] AES-256 & SHA-256; [LOW] AES-128 & SHA-1\n");
+    printf("\tset METADEDUP_RANGE=[offset]:[length] to download only a byte range of the file\n");
     exit(1);
 }
 
+/*
+ * run a request through the agent, or in this process if no agent is reachable
+ *
+ * @param session - the session of this process, created on first use <return>
+ * @param action - AGENT_UPLOAD or AGENT_RESTORE
+ * @param mode - upload mode
+ * @param name - full path of the file
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ *
+ * @return - a boolean value that indicates if the request succeeded
+ */
+static bool runRequest(MetadedupSession** session, int action, int mode, char* name, int userID, int securetype)
+{
+    char* agentPath = getenv("METADEDUP_AGENT");
+
+    /* a byte range is restored in this process, the agent only takes whole files */
+    char* rangeSetting = (action == AGENT_RESTORE) ? getenv("METADEDUP_RANGE") : NULL;
+    long offset, length;
+    if ((rangeSetting != NULL) && ((sscanf(rangeSetting, "%ld:%ld", &offset, &length) != 2) || (offset < 0) || (length < 0))) {
+        fprintf(stderr, "Error: METADEDUP_RANGE should be offset:length in bytes!\n");
+        return false;
+    }
+
+    if ((agentPath != NULL) && (rangeSetting == NULL)) {
+        int result = Agent::submit(agentPath, action, mode, name, userID, securetype);
+        if (result != AGENT_UNREACHABLE) {
+            return result == AGENT_OK;
+        }
+        fprintf(stderr, "no agent listens on %s, running without it\n", agentPath);
+    }
+
+    if (*session == NULL) {
+        *session = new MetadedupSession(userID, securetype);
+    }
+    if (action == AGENT_UPLOAD) {
+        return (*session)->uploadFile(name, mode);
+    }
+    char nameBuffer[DIR_MAX_SIZE + 3];
+    sprintf(nameBuffer, "%s.d", name);
+    if (rangeSetting != NULL) {
+        return (*session)->restoreRange(name, nameBuffer, offset, length);
+    }
+    return (*session)->restoreFile(name, nameBuffer);
+}
+
+/*
+ * restore the files listed in a file, several at a time, each to its path with .d appended
+ *
+ * @param session - the session of this process, created on first use <return>
+ * @param listName - the file that lists the full paths of the files, one per line
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ *
+ * @return - a boolean value that indicates if all files are restored
+ */
+static bool restoreList(MetadedupSession** session, char* listName, int userID, int securetype)
+{
+    FILE* fp = fopen(listName, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: fail to open %s!\n", listName);
+        return false;
+    }
+
+    int numOfFiles = 0;
+    int listSize = 1024;
+    char** names = (char**)malloc(sizeof(char*) * listSize);
+    char** outNames = (char**)malloc(sizeof(char*) * listSize);
+    char line[DIR_MAX_SIZE + 2];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (numOfFiles == listSize) {
+            listSize *= 2;
+            names = (char**)realloc(names, sizeof(char*) * listSize);
+            outNames = (char**)realloc(outNames, sizeof(char*) * listSize);
+        }
+        names[numOfFiles] = strdup(line);
+        outNames[numOfFiles] = (char*)malloc(strlen(line) + 3);
+        sprintf(outNames[numOfFiles], "%s.d", line);
+        numOfFiles++;
+    }
+    fclose(fp);
+
+    if (*session == NULL) {
+        *session = new MetadedupSession(userID, securetype);
+    }
+    int restored = (*session)->restoreFiles(names, outNames, numOfFiles);
+
+    for (int i = 0; i < numOfFiles; i++) {
+        free(names[i]);
+        free(outNames[i]);
+    }
+    free(names);
+    free(outNames);
+    return restored == numOfFiles;
+}
+
 int main(int argc, char* argv[])
 {
 
@@ -54,141 +144,48 @@ int main(int argc, char* argv[])
     int userID = atoi(argv[2]);
     char* opt = argv[3];
     char* securesetting = argv[4];
-    /* read file */
-    unsigned char* buffer;
-    int* chunkEndIndexList;
-    int numOfChunks;
-    int n, m, k, r, *kShareIDList;
-    /* initialize openssl locks */
-    if (!CryptoPrimitive::opensslLockSetup()) {
-        printf("fail to set up OpenSSL locks\n");
-        return 0;
-    }
 
-    confObj = new Configuration();
-    /* fix parameters here */
-    n = confObj->getN();
-    m = confObj->getM();
-    k = confObj->getK();
-    r = confObj->getR();
-    /* initialize buffers */
-    int bufferSize = confObj->getBufferSize();
-    int chunkEndIndexListSize = confObj->getListSize();
-    int secretBufferSize = confObj->getSecretBufferSize();
-    int shareBufferSize = confObj->getShareBufferSize();
-    unsigned char *secretBuffer, *shareBuffer;
-
-    delete confObj;
-    buffer = (unsigned char*)malloc(sizeof(unsigned char) * bufferSize);
-    chunkEndIndexList = (int*)malloc(sizeof(int) * chunkEndIndexListSize);
-    secretBuffer = (unsigned char*)malloc(sizeof(unsigned char) * secretBufferSize);
-    shareBuffer = (unsigned char*)malloc(sizeof(unsigned char) * shareBufferSize);
-    /* initialize share ID list */
-    kShareIDList = (int*)malloc(sizeof(int) * k);
-    for (int i = 0; i < k; i++)
-        kShareIDList[i] = i;
-
-    /* full file name size process */
-    int namesize = 0;
-    while (argv[1][namesize] != '\0') {
-        namesize++;
-    }
-    namesize++;
     /* parse secure parameters */
     int securetype = LOW_SEC_PAIR_TYPE;
     if (strncmp(securesetting, "HIGH", 4) == 0)
         securetype = HIGH_SEC_PAIR_TYPE;
 
-    if (strncmp(opt, "-u", 2) == 0 || strncmp(opt, "-a", 2) == 0) {
-
-        FILE* fin = fopen(argv[1], "r");
-        /* get file size */
-        fseek(fin, 0, SEEK_END);
-        long size = ftell(fin);
-        fseek(fin, 0, SEEK_SET);
-
-        uploaderObj = new Uploader(n, n, userID, argv[1], namesize);
-        encoderObj = new Encoder(CAONT_RS_TYPE, n, m, r, securetype, uploaderObj);
-        chunkerObj = new Chunker(VAR_SIZE_TYPE);
-
-        //chunking
-        Encoder::Secret_Item_t header;
-        header.type = 1;
-        memcpy(header.file_header.data, argv[1], namesize);
-        header.file_header.fullNameSize = namesize;
-        header.file_header.fileSize = size;
-
-        // do encode
-        encoderObj->add(&header);
-
-        long total = 0;
-        int totalChunks = 0;
-        while (total < size) {
-
-            int ret = fread(buffer, 1, bufferSize, fin);
-            chunkerObj->chunking(buffer, ret, chunkEndIndexList, &numOfChunks);
-            int count = 0;
-            int preEnd = -1;
-            while (count < numOfChunks) {
-
-                Encoder::Secret_Item_t input;
-                input.type = 0;
-                input.secret.secretID = totalChunks;
-                input.secret.secretSize = chunkEndIndexList[count] - preEnd;
-                memcpy(input.secret.data, buffer + preEnd + 1, input.secret.secretSize);
-                input.secret.end = 0;
-
-                if (total + ret == size && count + 1 == numOfChunks)
-                    input.secret.end = 1;
-                encoderObj->add(&input);
-
-                totalChunks++;
-                preEnd = chunkEndIndexList[count];
-                count++;
-            }
-            total += ret;
-        }
-        long long tt = 0, unique = 0;
-        uploaderObj->indicateEnd(&tt, &unique);
-
-        delete uploaderObj;
-        delete chunkerObj;
-        delete encoderObj;
-        fclose(fin);
+    /* the agent keeps its session until it is killed */
+    if (strcmp(opt, "-agent") == 0) {
+        Agent* agentObj = new Agent(argv[1], userID, securetype);
+        agentObj->run();
+        delete agentObj;
+        return 0;
     }
 
-    if (strncmp(opt, "-d", 2) == 0 || strncmp(opt, "-a", 2) == 0) {
-
-        decoderObj = new Decoder(CAONT_RS_TYPE, n, m, r, securetype);
-        downloaderObj = new Downloader(k, k, userID, decoderObj, argv[1], namesize);
-        char nameBuffer[256];
-        sprintf(nameBuffer, "%s.d", argv[1]);
-        downloaderObj->downloadKeyFile(argv[1]);
-        FILE* fw = fopen(nameBuffer, "wb");
+    /* benchmark modes stop the upload pipeline after a given stage */
+    int mode = -1;
+    if (strncmp(opt, "-u", 2) == 0 || strncmp(opt, "-a", 2) == 0)
+        mode = UPLOAD_FULL;
+    else if (strcmp(opt, "-bn") == 0)
+        mode = UPLOAD_NULL_SINK;
+    else if (strcmp(opt, "-be") == 0)
+        mode = UPLOAD_ENCODE_ONLY;
+    else if (strcmp(opt, "-bc") == 0)
+        mode = UPLOAD_CHUNK_ONLY;
+
+    MetadedupSession* session = NULL;
+    bool success = true;
+    if (mode != -1) {
+        success = runRequest(&session, AGENT_UPLOAD, mode, argv[1], userID, securetype) && success;
+    }
 
-        decoderObj->setFilePointer(fw);
-        decoderObj->setShareIDList(kShareIDList);
-        int preFlag = downloaderObj->preDownloadFile(argv[1], namesize, k);
-        if (preFlag == -1) {
-            downloaderObj->downloadFile(argv[1], namesize, k);
-        }
-        decoderObj->indicateEnd();
-        downloaderObj->indicateEnd();
-        fclose(fw);
-        delete downloaderObj;
-        delete decoderObj;
+    if (strcmp(opt, "-dl") == 0) {
+        success = restoreList(&session, argv[1], userID, securetype);
+    } else if (strncmp(opt, "-d", 2) == 0 || strncmp(opt, "-a", 2) == 0) {
+        success = runRequest(&session, AGENT_RESTORE, UPLOAD_FULL, argv[1], userID, securetype) && success;
     }
 
-    free(buffer);
-    free(chunkEndIndexList);
-    free(secretBuffer);
-    free(shareBuffer);
-    free(kShareIDList);
-    CryptoPrimitive::opensslLockCleanup();
+    delete session;
     gettimeofday(&timeend, NULL);
     long diff = 1000000 * (timeend.tv_sec - timestart.tv_sec) + timeend.tv_usec - timestart.tv_usec;
     double second = diff / 1000000.0;
     printf("the total work time is %ld us = %lf s\n", diff, second);
 
-    return 0;
+    return success ? 0 : 1;
 }
@@ -7,8 +7,10 @@
 #ifndef __BasicRingBuffer_h__
 #define __BasicRingBuffer_h__
 
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <sys/time.h>
 
 template <class T>
 class RingBuffer {
@@ -23,6 +25,8 @@ class RingBuffer {
     volatile int max; // capacity of the buffer
     volatile int run;
     volatile int blockOnEmpty;
+    volatile long long occupancySum; // sum of the occupied elements seen by each insert
+    volatile long long numOfInserts;
     pthread_mutex_t mAccess;
     pthread_cond_t cvEmpty;
     pthread_cond_t cvFull;
@@ -39,6 +43,8 @@ public:
         max = size;
         run = true;
         blockOnEmpty = block;
+        occupancySum = 0;
+        numOfInserts = 0;
         pthread_mutex_init(&mAccess, NULL);
         pthread_cond_init(&cvEmpty, NULL);
         pthread_cond_init(&cvFull, NULL);
@@ -49,13 +55,16 @@ public:
     int Insert(T* data, int len)
     {
         pthread_mutex_lock(&mAccess);
-        if (count == max) {
+        /* another producer may fill the buffer again before a woken one gets the lock */
+        while (count == max) {
             pthread_cond_wait(&cvFull, &mAccess);
         }
         buffer[writeIndex].len = len;
         memcpy(&(buffer[writeIndex].data), data, len);
         writeIndex = nextVal(writeIndex);
         count++;
+        occupancySum += count;
+        numOfInserts++;
         pthread_cond_signal(&cvEmpty);
         pthread_mutex_unlock(&mAccess);
         return 0;
@@ -70,7 +79,34 @@ public:
                 pthread_mutex_unlock(&mAccess);
                 return -1;
             }
-            pthread_cond_wait(&cvEmpty, &mAccess);
+            while (count == 0) {
+                pthread_cond_wait(&cvEmpty, &mAccess);
+            }
+        }
+        memcpy(data, &(buffer[readIndex].data), buffer[readIndex].len);
+        readIndex = nextVal(readIndex);
+        count--;
+        pthread_cond_signal(&cvFull);
+        pthread_mutex_unlock(&mAccess);
+        return 0;
+    }
+
+    /* extract an element, or give up with -1 once the buffer stayed empty for some milliseconds */
+    int ExtractTimeout(T* data, int ms)
+    {
+        struct timeval now;
+        struct timespec deadline;
+        gettimeofday(&now, NULL);
+        long nsec = now.tv_usec * 1000L + ms * 1000000L;
+        deadline.tv_sec = now.tv_sec + nsec / 1000000000L;
+        deadline.tv_nsec = nsec % 1000000000L;
+
+        pthread_mutex_lock(&mAccess);
+        while (count == 0) {
+            if (pthread_cond_timedwait(&cvEmpty, &mAccess, &deadline) == ETIMEDOUT) {
+                pthread_mutex_unlock(&mAccess);
+                return -1;
+            }
         }
         memcpy(data, &(buffer[readIndex].data), buffer[readIndex].len);
         readIndex = nextVal(readIndex);
@@ -80,6 +116,18 @@ public:
         return 0;
     }
 
+    /* average fraction of the buffer occupied right after an insert */
+    double AverageOccupancy()
+    {
+        double occupancy = 0;
+
+        pthread_mutex_lock(&mAccess);
+        if (numOfInserts > 0)
+            occupancy = (double)occupancySum / numOfInserts / max;
+        pthread_mutex_unlock(&mAccess);
+        return occupancy;
+    }
+
     void StopWhenEmptied()
     {
         pthread_mutex_lock(&mAccess);
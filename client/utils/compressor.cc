@@ -0,0 +1,110 @@
+/*
+ * compressor.cc
+ */
+
+#include "compressor.hh"
+
+/*
+ * constructor of Compressor
+ *
+ * @param level - the deflate level (1-9), or COMPRESSION_OFF
+ */
+Compressor::Compressor(int level)
+{
+    valid_ = true;
+    level_ = level;
+    if ((level < COMPRESSION_OFF) || (level > Z_BEST_COMPRESSION)) {
+        fprintf(stderr, "Error: compression level should be in [%d, %d]!\n", COMPRESSION_OFF, Z_BEST_COMPRESSION);
+        valid_ = false;
+        level_ = COMPRESSION_OFF;
+    }
+}
+
+/*
+ * destructor of Compressor
+ */
+Compressor::~Compressor()
+{
+}
+
+/*
+ * check if compression is enabled
+ *
+ * @return - a boolean value that indicates if compression is enabled
+ */
+bool Compressor::isEnabled()
+{
+    return level_ != COMPRESSION_OFF;
+}
+
+/*
+ * compress a secret if that makes it smaller
+ *
+ * @param secretBuffer - a buffer that stores the secret
+ * @param secretSize - the size of the secret
+ * @param outputBuffer - a buffer (of at least secretSize bytes) for storing the compressed secret <return>
+ * @param outputSize - the size of the compressed secret <return>
+ *
+ * @return - a boolean value that indicates if the secret is compressed
+ */
+bool Compressor::compress(unsigned char* secretBuffer, int secretSize, unsigned char* outputBuffer, int* outputSize)
+{
+    uLongf streamSize;
+    int compressedSize;
+
+    if ((level_ == COMPRESSION_OFF) || (secretSize <= (int)sizeof(int))) {
+        return 0;
+    }
+
+    /*only keep the compressed form if it is strictly smaller than the secret*/
+    streamSize = secretSize - sizeof(int) - 1;
+    if (compress2(outputBuffer + sizeof(int), &streamSize, secretBuffer, secretSize, level_) != Z_OK) {
+        return 0;
+    }
+
+    compressedSize = (int)streamSize;
+    memcpy(outputBuffer, &compressedSize, sizeof(int));
+    (*outputSize) = compressedSize + sizeof(int);
+
+    return 1;
+}
+
+/*
+ * restore a compressed secret
+ *
+ * @param inputBuffer - a buffer that stores the compressed secret (possibly zero padded)
+ * @param inputSize - the size of inputBuffer
+ * @param secretBuffer - a buffer for storing the secret <return>
+ * @param secretBufferSize - the size of secretBuffer
+ * @param secretSize - the size of the restored secret <return>
+ *
+ * @return - a boolean value that indicates if the restoration succeeds
+ */
+bool Compressor::decompress(unsigned char* inputBuffer, int inputSize, unsigned char* secretBuffer, int secretBufferSize, int* secretSize)
+{
+    uLongf restoredSize;
+    int compressedSize;
+
+    if (inputSize < (int)sizeof(int)) {
+        fprintf(stderr, "Error: the compressed secret (%d bytes) is too short!\n", inputSize);
+
+        return 0;
+    }
+
+    memcpy(&compressedSize, inputBuffer, sizeof(int));
+    if ((compressedSize <= 0) || (compressedSize > inputSize - (int)sizeof(int))) {
+        fprintf(stderr, "Error: invalid compressed secret size %d!\n", compressedSize);
+
+        return 0;
+    }
+
+    restoredSize = secretBufferSize;
+    if (uncompress(secretBuffer, &restoredSize, inputBuffer + sizeof(int), compressedSize) != Z_OK) {
+        fprintf(stderr, "Error: fail in the secret decompression!\n");
+
+        return 0;
+    }
+    (*secretSize) = (int)restoredSize;
+
+    return 1;
+}
@@ -0,0 +1,87 @@
+/*
+ * compressor.hh
+ */
+
+#ifndef __COMPRESSOR_HH__
+#define __COMPRESSOR_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*for the use of deflate*/
+#include <zlib.h>
+
+/*macro for disabling compression*/
+#define COMPRESSION_OFF 0
+
+/*
+ * deterministic per-secret compression applied before convergent dispersal
+ *
+ * a compressed secret is laid out as [int compressedSize][deflate stream], so that
+ * it can be restored from the (zero padded) aligned secret produced by decoding.
+ * the output only depends on the input and the level, so identical secrets still
+ * converge to identical shares (given the same zlib build on all clients)
+ */
+class Compressor {
+private:
+    /*the deflate level, COMPRESSION_OFF for disabled*/
+    int level_;
+
+    /*whether the level is valid*/
+    bool valid_;
+
+public:
+    /*
+     * constructor of Compressor
+     *
+     * @param level - the deflate level (1-9), or COMPRESSION_OFF
+     */
+    Compressor(int level = COMPRESSION_OFF);
+
+    /*
+     * destructor of Compressor
+     */
+    ~Compressor();
+
+    /*
+     * check if the compressor is constructed with a valid level
+     *
+     * @return - a boolean value that indicates if the compressor can be used
+     */
+    inline bool isValid() { return valid_; }
+
+    /*
+     * check if compression is enabled
+     *
+     * @return - a boolean value that indicates if compression is enabled
+     */
+    bool isEnabled();
+
+    /*
+     * compress a secret if that makes it smaller
+     *
+     * @param secretBuffer - a buffer that stores the secret
+     * @param secretSize - the size of the secret
+     * @param outputBuffer - a buffer (of at least secretSize bytes) for storing the compressed secret <return>
+     * @param outputSize - the size of the compressed secret <return>
+     *
+     * @return - a boolean value that indicates if the secret is compressed
+     */
+    bool compress(unsigned char* secretBuffer, int secretSize, unsigned char* outputBuffer, int* outputSize);
+
+    /*
+     * restore a compressed secret
+     *
+     * @param inputBuffer - a buffer that stores the compressed secret (possibly zero padded)
+     * @param inputSize - the size of inputBuffer
+     * @param secretBuffer - a buffer for storing the secret <return>
+     * @param secretBufferSize - the size of secretBuffer
+     * @param secretSize - the size of the restored secret <return>
+     *
+     * @return - a boolean value that indicates if the restoration succeeds
+     */
+    bool decompress(unsigned char* inputBuffer, int inputSize, unsigned char* secretBuffer, int secretBufferSize, int* secretSize);
+};
+
+#endif
@@ -10,6 +10,11 @@
 
 using namespace std;
 
+/* restore modes: upload the rebuilt file recipe first, stream it to k servers, or stream it to the fastest k of n servers */
+#define RESTORE_RECIPE 0
+#define RESTORE_STREAM 1
+#define RESTORE_HEDGED 2
+
 /*
  * configuration class
  */
@@ -28,11 +33,8 @@ private:
     /* security degree */
     int r_;
 
-    /* secret buffer size */
-    int secretBufferSize_;
-
-    /* share buffer size */
-    int shareBufferSize_;
+    /* memory budget of the client in MB, 0 for the default sizes */
+    int memoryBudget_;
 
     /* buffer size */
     int bufferSize_;
@@ -40,6 +42,41 @@ private:
     /* chunk end list size */
     int chunkEndIndexListSize_;
 
+    /* maximum size of the metadata and container buffers of each upload stream, and of the restore write buffer */
+    int streamBufferSize_;
+
+    /* depth of the pipeline queues, 0 for the default depth of each queue */
+    int queueDepth_;
+
+    /* average, minimum and maximum chunk size (the maximum is bounded by MAX_SECRET_SIZE of CDCodec) */
+    int avgChunkSize_;
+    int minChunkSize_;
+    int maxChunkSize_;
+
+    /* deflate level before encoding, 0 for disabled */
+    int compressionLevel_;
+
+    /* number of encoded secrets cached for repeated secrets, 0 for disabled */
+    int shareCacheSize_;
+
+    /* minimum, average and maximum bytes of shares covered by a metadata chunk */
+    int minSegmentSize_;
+    int avgSegmentSize_;
+    int maxSegmentSize_;
+
+    /* how a restore gets the shares of a file (RESTORE_RECIPE, RESTORE_STREAM or RESTORE_HEDGED) */
+    int restoreMode_;
+
+    /* number of threads decoding a restored file, 0 for one per online core */
+    int decodeThreads_;
+
+    /* number of files restored at once by a multi-file restore, which share the decoding threads */
+    int restoreLanes_;
+
+    /* size of the on-disk cache of decoded chunks in MB, 0 for disabled, and the path of its file */
+    int chunkCacheSize_;
+    const char* chunkCachePath_;
+
 public:
     /* constructor */
     Configuration()
@@ -48,11 +85,142 @@ public:
         m_ = 1;
         k_ = n_ - m_;
         r_ = k_ - 1;
-        secretBufferSize_ = 16 * 1024;
-        shareBufferSize_ = 16 * 1024 * n_;
+        memoryBudget_ = 0;
 
         bufferSize_ = 128 * 1024 * 1024;
-        chunkEndIndexListSize_ = 1024 * 1024;
+        streamBufferSize_ = 4 * 1024 * 1024;
+        queueDepth_ = 0;
+        avgChunkSize_ = 8 * 1024;
+        minChunkSize_ = 2 * 1024;
+        maxChunkSize_ = 16 * 1024;
+        compressionLevel_ = 0;
+        shareCacheSize_ = 512;
+        minSegmentSize_ = 512 * 1024;
+        avgSegmentSize_ = 1024 * 1024;
+        maxSegmentSize_ = 2 * 1024 * 1024;
+        restoreMode_ = RESTORE_HEDGED;
+        decodeThreads_ = 0;
+        restoreLanes_ = 4;
+        chunkCacheSize_ = 0;
+        chunkCachePath_ = "./chunk.cache";
+
+        /* a buffer holds at most one chunk per minChunkSize_ bytes, plus its tail chunk */
+        chunkEndIndexListSize_ = bufferSize_ / minChunkSize_ + 1;
+    }
+
+    /*
+     * size the buffers, queues and share cache to fit in memoryBudget_
+     *
+     * the budget is split evenly into the read buffer, the upload stream buffers,
+     * the queues and the share cache. a queued item or a cached entry is charged for
+     * the n shares of a maxChunkSize_ secret, so the budget bounds the worst case.
+     * each size stays within its default, so a large budget changes nothing
+     *
+     * @param numOfStreams - number of upload streams (metadata and data of each cloud)
+     * @param numOfQueues - number of pipeline queues that hold chunks
+     */
+    void applyMemoryBudget(int numOfStreams, int numOfQueues)
+    {
+        if (memoryBudget_ == 0) {
+            return;
+        }
+
+        long quarter = (long)memoryBudget_ * 1024 * 1024 / 4;
+        long itemSize = (long)maxChunkSize_ * n_ / k_;
+
+        /* the read buffer should hold a few chunks to keep chunk boundaries content defined */
+        bufferSize_ = boundSize(quarter, 4L * maxChunkSize_, bufferSize_);
+        chunkEndIndexListSize_ = bufferSize_ / minChunkSize_ + 1;
+
+        /* each stream has a metadata and a container buffer, which should hold at least two shares */
+        long minStreamBufferSize = 2L * maxChunkSize_;
+        if (minStreamBufferSize < 64 * 1024) {
+            minStreamBufferSize = 64 * 1024;
+        }
+        streamBufferSize_ = boundSize(quarter / (2 * numOfStreams), minStreamBufferSize, streamBufferSize_);
+
+        queueDepth_ = boundSize(quarter / (itemSize * numOfQueues), 8, 1024);
+
+        if (shareCacheSize_ != 0) {
+            shareCacheSize_ = boundSize(quarter / itemSize, 1, shareCacheSize_);
+        }
+    }
+
+    /*
+     * bound a size within [lower, upper]
+     *
+     * @param size - the size
+     * @param lower - the lower bound
+     * @param upper - the upper bound
+     *
+     * @return - the bounded size
+     */
+    inline int boundSize(long size, long lower, long upper)
+    {
+        if (size < lower) {
+            return lower;
+        }
+        return (size > upper) ? upper : size;
+    }
+
+    /*
+     * set the memory budget, applied by the next applyMemoryBudget
+     *
+     * @param budget - memory budget in MB (0 for the default sizes)
+     *
+     * @return - a boolean value that indicates if the budget is not negative
+     */
+    bool setMemoryBudget(int budget)
+    {
+        if (budget < 0) {
+            return false;
+        }
+        memoryBudget_ = budget;
+        return true;
+    }
+
+    /*
+     * set the sizes of the chunks of the next uploads
+     *
+     * @param minSize - minimum chunk size
+     * @param avgSize - average chunk size, a power of two
+     * @param maxSize - maximum chunk size (the caller bounds it by MAX_SECRET_SIZE of CDCodec)
+     *
+     * @return - a boolean value that indicates if 0 < minSize < avgSize < maxSize with avgSize a power of two
+     */
+    bool setChunkSize(int minSize, int avgSize, int maxSize)
+    {
+        if ((minSize <= 0) || (minSize >= avgSize) || (avgSize >= maxSize) || ((avgSize & (avgSize - 1)) != 0)) {
+            return false;
+        }
+        minChunkSize_ = minSize;
+        avgChunkSize_ = avgSize;
+        maxChunkSize_ = maxSize;
+        chunkEndIndexListSize_ = bufferSize_ / minChunkSize_ + 1;
+        return true;
+    }
+
+    /*
+     * set the sizes of the segments that form metadata chunks
+     *
+     * larger segments make fewer metadata chunks (a smaller key recipe and fewer
+     * restore round trips), smaller ones deduplicate more metadata
+     *
+     * @param minSize - minimum bytes of shares covered by a metadata chunk
+     * @param avgSize - average bytes of shares covered by a metadata chunk
+     * @param maxSize - maximum bytes of shares covered by a metadata chunk
+     *
+     * @return - a boolean value that indicates if 0 < minSize <= avgSize <= maxSize
+     */
+    bool setSegmentSize(int minSize, int avgSize, int maxSize)
+    {
+        if ((minSize <= 0) || (minSize > avgSize) || (avgSize > maxSize)) {
+            return false;
+        }
+        minSegmentSize_ = minSize;
+        avgSegmentSize_ = avgSize;
+        maxSegmentSize_ = maxSize;
+        return true;
     }
 
     inline int getN() { return n_; }
@@ -63,13 +231,45 @@ public:
 
     inline int getR() { return r_; }
 
-    inline int getSecretBufferSize() { return secretBufferSize_; }
-
-    inline int getShareBufferSize() { return shareBufferSize_; }
+    inline int getMemoryBudget() { return memoryBudget_; }
 
     inline int getBufferSize() { return bufferSize_; }
 
     inline int getListSize() { return chunkEndIndexListSize_; }
+
+    inline int getStreamBufferSize() { return streamBufferSize_; }
+
+    inline int getQueueDepth() { return queueDepth_; }
+
+    inline int getDecodeThreads() { return decodeThreads_; }
+
+    inline int getRestoreLanes() { return restoreLanes_; }
+
+    inline int getAvgChunkSize() { return avgChunkSize_; }
+
+    inline int getMinChunkSize() { return minChunkSize_; }
+
+    inline int getMaxChunkSize() { return maxChunkSize_; }
+
+    inline int getCompressionLevel() { return compressionLevel_; }
+
+    inline int getShareCacheSize() { return shareCacheSize_; }
+
+    inline int getMinSegmentSize() { return minSegmentSize_; }
+
+    inline int getAvgSegmentSize() { return avgSegmentSize_; }
+
+    inline int getMaxSegmentSize() { return maxSegmentSize_; }
+
+    inline int getRestoreMode() { return restoreMode_; }
+
+    inline void setRestoreMode(int restoreMode) { restoreMode_ = restoreMode; }
+
+    inline int getChunkCacheSize() { return chunkCacheSize_; }
+
+    inline void setChunkCacheSize(int chunkCacheSize) { chunkCacheSize_ = chunkCacheSize; }
+
+    inline const char* getChunkCachePath() { return chunkCachePath_; }
 };
 
 #endif
@@ -0,0 +1,121 @@
+/*
+ * fpSet.cc
+ */
+
+#include "fpSet.hh"
+
+/*
+ * constructor of FPSet
+ *
+ * @param fpSize - size of each fingerprint, at least sizeof(unsigned long)
+ */
+FPSet::FPSet(int fpSize)
+{
+    fpSize_ = fpSize;
+    numOfSlots_ = FP_SET_INIT_SLOTS;
+    numOfFPs_ = 0;
+    fps_ = (unsigned char*)malloc(sizeof(unsigned char) * fpSize_ * numOfSlots_);
+    used_ = (bool*)calloc(numOfSlots_, sizeof(bool));
+}
+
+/*
+ * destructor of FPSet
+ */
+FPSet::~FPSet()
+{
+    free(fps_);
+    free(used_);
+}
+
+/*
+ * find the slot of a fingerprint
+ *
+ * @param fp - the fingerprint
+ *
+ * @return - the index of the slot that stores fp, or of the free slot for it
+ */
+int FPSet::find(unsigned char* fp)
+{
+    int index = fpSlot(fp, numOfSlots_);
+
+    while (used_[index] && (memcmp(fps_ + index * fpSize_, fp, fpSize_) != 0)) {
+        index = (index + 1) & (numOfSlots_ - 1);
+    }
+
+    return index;
+}
+
+/*
+ * double the number of slots
+ */
+void FPSet::grow()
+{
+    unsigned char* oldFPs = fps_;
+    bool* oldUsed = used_;
+    int oldNumOfSlots = numOfSlots_;
+
+    numOfSlots_ *= 2;
+    fps_ = (unsigned char*)malloc(sizeof(unsigned char) * fpSize_ * numOfSlots_);
+    used_ = (bool*)calloc(numOfSlots_, sizeof(bool));
+
+    for (int i = 0; i < oldNumOfSlots; i++) {
+        if (oldUsed[i]) {
+            int index = find(oldFPs + i * fpSize_);
+            memcpy(fps_ + index * fpSize_, oldFPs + i * fpSize_, fpSize_);
+            used_[index] = 1;
+        }
+    }
+
+    free(oldFPs);
+    free(oldUsed);
+}
+
+/*
+ * check if a fingerprint is in the set
+ *
+ * @param fp - the fingerprint
+ *
+ * @return - a boolean value that indicates if fp is in the set
+ */
+bool FPSet::contains(unsigned char* fp)
+{
+    return used_[find(fp)];
+}
+
+/*
+ * insert a fingerprint
+ *
+ * @param fp - the fingerprint
+ *
+ * @return - a boolean value that indicates if fp is new to the set
+ */
+bool FPSet::insert(unsigned char* fp)
+{
+    int index = find(fp);
+
+    if (used_[index]) {
+        return 0;
+    }
+
+    /*keep at least half of the slots free so that probes stay short*/
+    if (2 * (numOfFPs_ + 1) > numOfSlots_) {
+        grow();
+        index = find(fp);
+    }
+    memcpy(fps_ + index * fpSize_, fp, fpSize_);
+    used_[index] = 1;
+    numOfFPs_++;
+
+    return 1;
+}
+
+/*
+ * remove all fingerprints
+ */
+void FPSet::clear()
+{
+    if (numOfFPs_ > 0) {
+        memset(used_, 0, sizeof(bool) * numOfSlots_);
+        numOfFPs_ = 0;
+    }
+}
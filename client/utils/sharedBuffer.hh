@@ -0,0 +1,81 @@
+/*
+ * sharedBuffer.hh
+ */
+
+#ifndef __SHAREDBUFFER_HH__
+#define __SHAREDBUFFER_HH__
+
+#include <stdlib.h>
+
+/*
+ * reference-counted buffer, which holds a received message while the shares in it are in use
+ *
+ * the receiving thread holds one reference and each share handed out holds another,
+ * so the shares are decoded where they were received instead of being copied out
+ */
+typedef struct {
+    int refs;
+    int capacity;
+    char* data;
+} SharedBuffer_t;
+
+/*
+ * create a buffer, referenced by its creator
+ *
+ * @param capacity - the initial size of the buffer
+ *
+ * @return - the buffer
+ */
+static inline SharedBuffer_t* sharedBufferCreate(int capacity)
+{
+    SharedBuffer_t* buffer = (SharedBuffer_t*)malloc(sizeof(SharedBuffer_t));
+
+    buffer->refs = 1;
+    buffer->capacity = capacity;
+    buffer->data = (char*)malloc(sizeof(char) * capacity);
+    return buffer;
+}
+
+/*
+ * take a reference to a buffer
+ *
+ * @param buffer - the buffer
+ */
+static inline void sharedBufferHold(SharedBuffer_t* buffer)
+{
+    __sync_add_and_fetch(&buffer->refs, 1);
+}
+
+/*
+ * drop a reference to a buffer, and free it with the last one
+ *
+ * @param buffer - the buffer (NULL for none)
+ */
+static inline void sharedBufferRelease(SharedBuffer_t* buffer)
+{
+    if ((buffer != NULL) && (__sync_sub_and_fetch(&buffer->refs, 1) == 0)) {
+        free(buffer->data);
+        free(buffer);
+    }
+}
+
+/*
+ * get a buffer to receive the next message into, which is the current one unless shares still use it
+ *
+ * @param buffer - the buffer of the previous message, referenced by the caller
+ *
+ * @return - a buffer only referenced by the caller
+ */
+static inline SharedBuffer_t* sharedBufferRenew(SharedBuffer_t* buffer)
+{
+    if (__sync_add_and_fetch(&buffer->refs, 0) == 1) {
+        return buffer;
+    }
+
+    /* the next message is likely as large as this one */
+    SharedBuffer_t* next = sharedBufferCreate(buffer->capacity);
+    sharedBufferRelease(buffer);
+    return next;
+}
+
+#endif
@@ -12,6 +12,7 @@ Socket::Socket(char* ip, int port, int userID)
     /* get port and ip */
     hostPort_ = port;
     hostName_ = ip;
+    failed_ = false;
     int err;
 
     /* initializing socket object */
@@ -50,15 +51,18 @@ Socket::Socket(char* ip, int port, int userID)
     /* trying to connect socket */
     if (connect(hostSock_, (struct sockaddr*)&myAddr_, sizeof(myAddr_)) == -1) {
         if ((err = errno) != EINPROGRESS) {
-            fprintf(stderr, "Error connecting socket %d\n", errno);
+            fprintf(stderr, "Error connecting socket %s:%d %d\n", ip, port, errno);
+            failed_ = true;
+            return;
         }
     }
 
     /* prepare user ID and send it to server */
     int netorder = htonl(userID);
     int bytecount;
-    if ((bytecount = send(hostSock_, &netorder, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &netorder, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending userID %d\n", errno);
+        failed_ = true;
     }
 }
 
@@ -70,20 +74,33 @@ Socket::~Socket()
     close(hostSock_);
 }
 
+/*
+ * stop the connection in both directions, so that a thread blocked on it returns
+ */
+void Socket::interrupt()
+{
+    shutdown(hostSock_, SHUT_RDWR);
+    failed_ = true;
+}
+
 /*
  * basic send function
  * 
  * @param raw - raw data buffer_
  * @param rawSize - size of raw data
  */
-int Socket::genericSend(char* raw, int rawSize)
+long Socket::genericSend(char* raw, long rawSize)
 {
 
     int bytecount;
-    int total = 0;
+    long total = 0;
+    if (failed_) {
+        return -1;
+    }
     while (total < rawSize) {
-        if ((bytecount = send(hostSock_, raw + total, rawSize - total, 0)) == -1) {
+        if ((bytecount = send(hostSock_, raw + total, rawSize - total, MSG_NOSIGNAL)) == -1) {
             fprintf(stderr, "Error sending data %d\n", errno);
+            failed_ = true;
             return -1;
         }
         total += bytecount;
@@ -102,14 +119,21 @@ int Socket::sendMeta(char* raw, int rawSize)
 {
     int indicator = SEND_META;
 
+    /* a failed connection is out of sync with its server, or not connected at all */
+    if (failed_) {
+        return -1;
+    }
+
     int bytecount;
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &indicator, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
-    if ((bytecount = send(hostSock_, &rawSize, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &rawSize, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
@@ -128,14 +152,21 @@ int Socket::sendData(char* raw, int rawSize)
 {
     int indicator = SEND_DATA;
 
+    /* a failed connection is out of sync with its server, or not connected at all */
+    if (failed_) {
+        return -1;
+    }
+
     int bytecount;
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &indicator, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
-    if ((bytecount = send(hostSock_, &rawSize, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &rawSize, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
@@ -150,14 +181,20 @@ int Socket::sendData(char* raw, int rawSize)
  * @param rawSize - the size of data to be downloaded
  * @return raw
  */
-int Socket::genericDownload(char* raw, int rawSize)
+int Socket::genericDownload(char* raw, long rawSize)
 {
 
     int bytecount;
-    int total = 0;
+    long total = 0;
+    if (failed_) {
+        return -1;
+    }
     while (total < rawSize) {
-        if ((bytecount = recv(hostSock_, raw + total, rawSize - total, 0)) == -1) {
-            fprintf(stderr, "Error sending data %d\n", errno);
+        bytecount = recv(hostSock_, raw + total, rawSize - total, 0);
+        if (bytecount <= 0) {
+            /* a closed connection would otherwise spin here forever */
+            fprintf(stderr, "Error receiving data %d\n", (bytecount == 0) ? ECONNRESET : errno);
+            failed_ = true;
             return -1;
         }
         total += bytecount;
@@ -175,24 +212,22 @@ int Socket::genericDownload(char* raw, int rawSize)
  */
 int Socket::getStatus(bool* statusList, int* num)
 {
-
-    int bytecount;
     int indicator = 0;
 
-    if ((bytecount = recv(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    if (genericDownload((char*)&indicator, sizeof(int)) == -1) {
         return -1;
     }
     if (indicator != GET_STAT) {
         fprintf(stderr, "Status wrong %d\n", errno);
         return -1;
     }
-    if ((bytecount = recv(hostSock_, num, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error sending data %d\n", errno);
+    if (genericDownload((char*)num, sizeof(int)) == -1) {
         return -1;
     }
 
-    genericDownload((char*)statusList, sizeof(bool) * (*num));
+    if (genericDownload((char*)statusList, sizeof(bool) * (*num)) == -1) {
+        return -1;
+    }
     return 0;
 }
 
@@ -208,19 +243,27 @@ int Socket::initDownload(char* filename, int namesize)
 {
     int indicator = INIT_DOWNLOAD;
 
+    /* a failed connection is out of sync with its server, or not connected at all */
+    if (failed_) {
+        return -1;
+    }
+
     int bytecount;
-    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &indicator, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
-    if ((bytecount = send(hostSock_, &namesize, sizeof(int), 0)) == -1) {
+    if ((bytecount = send(hostSock_, &namesize, sizeof(int), MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
-    if ((bytecount = send(hostSock_, filename, namesize, 0)) == -1) {
+    if ((bytecount = send(hostSock_, filename, namesize, MSG_NOSIGNAL)) == -1) {
         fprintf(stderr, "Error sending data %d\n", errno);
+        failed_ = true;
         return -1;
     }
 
@@ -230,29 +273,82 @@ int Socket::initDownload(char* filename, int namesize)
 /*
  * download a chunk of data
  *
- * @param raw - the returned raw data chunk
+ * @param raw - the buffer for the returned raw data chunk, grown if it is too small <return>
+ * @param capacity - the size of the buffer <return>
  * @param retSize - the size of returned data chunk
  * @return raw 
  * @return retSize
  */
-int Socket::downloadChunk(char* raw, int* retSize)
+int Socket::downloadChunk(char** raw, int* capacity, int* retSize)
 {
     int indicator;
 
-    int bytecount;
-    if ((bytecount = recv(hostSock_, &indicator, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error receiving data %d\n", errno);
+    if (genericDownload((char*)&indicator, sizeof(int)) == -1) {
         return -1;
     }
 
     int size;
-    if ((bytecount = recv(hostSock_, &size, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error receiving data %d\n", errno);
+    if (genericDownload((char*)&size, sizeof(int)) == -1) {
         return -1;
     }
     *retSize = ntohl(size);
+    if (*retSize < 0) {
+        fprintf(stderr, "Error: invalid chunk size %d from the server!\n", *retSize);
+        failed_ = true;
+        return -1;
+    }
 
-    genericDownload(raw, *retSize);
+    /* the chunk size is decided by the server, so the buffer only grows as large as the server sends */
+    if (*retSize > *capacity) {
+        char* grown = (char*)realloc(*raw, sizeof(char) * (*retSize));
+        if (grown == NULL) {
+            /* the chunk is left unread, so the connection is out of step with the server */
+            fprintf(stderr, "Error: fail to allocate %d bytes for a chunk!\n", *retSize);
+            failed_ = true;
+            return -1;
+        }
+        *raw = grown;
+        *capacity = *retSize;
+    }
+    if (genericDownload(*raw, *retSize) == -1) {
+        return -1;
+    }
 
     return 0;
 }
+
+/*
+ * connect to the servers listed in a config file (one ip:port per line)
+ *
+ * @param configName - the config file
+ * @param num - the number of servers to connect to
+ * @param userID - ID of the user
+ *
+ * @return - an array of num sockets, or NULL if the config file cannot be read
+ */
+Socket** Socket::connectConfig(const char* configName, int num, int userID)
+{
+    FILE* fp = fopen(configName, "rb");
+    char line[225];
+    const char ch[2] = ":";
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: fail to open config file %s!\n", configName);
+        return NULL;
+    }
+    Socket** socketArray = (Socket**)malloc(sizeof(Socket*) * num);
+    for (int i = 0; i < num; i++) {
+        /* line by line read config file*/
+        int ret = fscanf(fp, "%s", line);
+        if (ret == 0)
+            printf("fail to load config file\n");
+        char* token = strtok(line, ch);
+        char* ip = token;
+        token = strtok(NULL, ch);
+        int port = atoi(token);
+
+        socketArray[i] = new Socket(ip, port, userID);
+    }
+    fclose(fp);
+    return socketArray;
+}
@@ -37,6 +37,10 @@ public:
 
     /* host socket */
     int hostSock_;
+
+    /* whether the connection failed, after which the socket is out of sync with the server */
+    bool failed_;
+
     /*
      * constructor: initialize sock structure and connect
      *
@@ -50,13 +54,18 @@ public:
      */
     ~Socket();
 
+    /*
+     * stop the connection in both directions, so that a thread blocked on it returns
+     */
+    void interrupt();
+
     /*
      * basic send function
      * 
      * @param raw - raw data buffer_
      * @param rawSize - size of raw data
      */
-    int genericSend(char* raw, int rawSize);
+    long genericSend(char* raw, long rawSize);
 
     /*
      * metadata send function
@@ -99,12 +108,13 @@ public:
     /*
      * download a chunk of data
      *
-     * @param raw - the returned raw data chunk
+     * @param raw - the buffer for the returned raw data chunk, grown if it is too small <return>
+     * @param capacity - the size of the buffer <return>
      * @param retSize - the size of returned data chunk
      * @return raw 
      * @return retSize
      */
-    int downloadChunk(char* raw, int* retSize);
+    int downloadChunk(char** raw, int* capacity, int* retSize);
 
     /*
      * data download function
@@ -113,7 +123,18 @@ public:
      * @param rawSize - the size of data to be downloaded
      * @return raw
      */
-    int genericDownload(char* raw, int rawSize);
+    int genericDownload(char* raw, long rawSize);
+
+    /*
+     * connect to the servers listed in a config file (one ip:port per line)
+     *
+     * @param configName - the config file
+     * @param num - the number of servers to connect to
+     * @param userID - ID of the user
+     *
+     * @return - an array of num sockets, or NULL if the config file cannot be read
+     */
+    static Socket** connectConfig(const char* configName, int num, int userID);
 };
 
 #endif
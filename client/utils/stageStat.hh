@@ -0,0 +1,105 @@
+/*
+ * stageStat.hh
+ */
+
+#ifndef __STAGESTAT_HH__
+#define __STAGESTAT_HH__
+
+#include <stdio.h>
+#include <sys/time.h>
+
+/*
+ * per-thread statistics of a pipeline stage
+ *
+ * busyTime only covers processing, not the waits on the ringbuffers around the stage,
+ * so that a stage blocked by a slow neighbour does not look slow itself
+ */
+typedef struct {
+    long long items;
+    long long bytes;
+    double busyTime;
+} StageStat_t;
+
+/*
+ * get the current time
+ *
+ * @return - the current time in seconds
+ */
+static inline double stageTimeNow()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * reset the statistics of a stage thread
+ *
+ * @param stat - the statistics
+ */
+static inline void stageStatInit(StageStat_t* stat)
+{
+    stat->items = 0;
+    stat->bytes = 0;
+    stat->busyTime = 0;
+}
+
+/*
+ * account for an item processed by a stage thread
+ *
+ * @param stat - the statistics
+ * @param start - the time when processing the item started
+ * @param bytes - the size of the item
+ */
+static inline void stageStatAdd(StageStat_t* stat, double start, long long bytes)
+{
+    stat->items++;
+    stat->bytes += bytes;
+    stat->busyTime += stageTimeNow() - start;
+}
+
+/*
+ * print the header line of the stage report
+ */
+static inline void stageStatReportHead()
+{
+    printf("%-10s %7s %10s %10s %10s %10s %8s %8s\n", "stage", "threads", "items", "MB", "busy(s)", "MB/s", "util(%)", "queue(%)");
+}
+
+/*
+ * print the statistics of a stage over its threads
+ *
+ * MB/s is the throughput the stage sustains when all its threads are busy, and
+ * util is the share of the wall time its threads were busy, so the stage with the
+ * highest util bounds the pipeline
+ *
+ * @param name - the stage name
+ * @param statList - the statistics of each thread of the stage
+ * @param numOfThreads - the number of threads of the stage
+ * @param wallTime - the wall time of the whole run in seconds
+ * @param occupancy - the average occupancy of the input ringbuffers of the stage (negative for none)
+ */
+static inline void stageStatReport(const char* name, StageStat_t* statList, int numOfThreads, double wallTime, double occupancy)
+{
+    long long items = 0, bytes = 0;
+    double busyTime = 0;
+    double mb, throughput, util;
+
+    for (int i = 0; i < numOfThreads; i++) {
+        items += statList[i].items;
+        bytes += statList[i].bytes;
+        busyTime += statList[i].busyTime;
+    }
+    mb = bytes / 1048576.0;
+    throughput = (busyTime > 0) ? mb / (busyTime / numOfThreads) : 0;
+    util = (wallTime > 0) ? 100.0 * busyTime / numOfThreads / wallTime : 0;
+
+    if (occupancy < 0) {
+        printf("%-10s %7d %10lld %10.2f %10.3f %10.2f %8.1f %8s\n", name, numOfThreads, items, mb, busyTime, throughput, util, "-");
+    } else {
+        printf("%-10s %7d %10lld %10.2f %10.3f %10.2f %8.1f %8.1f\n", name, numOfThreads, items, mb, busyTime, throughput, util, 100.0 * occupancy);
+    }
+}
+
+#endif
@@ -5,10 +5,12 @@
 #include "server.hh"
 #include <string.h>
 #include <string>
+#include <poll.h>
 #include <sys/time.h>
 
 DedupCore* dedupObj_;
 minDedupCore* dataDedupObj_;
+/* orders the stores and removals of recipe files, so a restore never takes the recipe of a later one */
 pthread_mutex_t mutex;
 using namespace std;
 /*
@@ -18,10 +20,24 @@ using namespace std;
  * @param dataPort - data service port number
  * @param dedupObj - meta dedup object passed in
  * @param minDedupObj - data dedup object passed in
+ * @param numOfWorkers - number of worker threads of each port
+ * @param maxConnections - maximum number of open connections
+ * @param backlog - length of the queue of connections waiting to be accepted on each port
  *
  */
-Server::Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* dataDedupObj)
+Server::Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* dataDedupObj, int numOfWorkers, int maxConnections, int backlog)
 {
+    //worker pools and admission
+    numOfWorkers_ = (numOfWorkers > 0) ? numOfWorkers : SERVER_NUM_WORKERS;
+    maxConnections_ = (maxConnections > 0) ? maxConnections : SERVER_MAX_CONNECTIONS;
+    if (backlog <= 0) {
+        backlog = SERVER_LISTEN_BACKLOG;
+    }
+    numOfConnections_ = 0;
+    paused_ = false;
+    pthread_mutex_init(&connLock_, NULL);
+    epollFd_ = -1;
+
     //dedup. object
     dedupObj_ = dedupObj;
     dataDedupObj_ = dataDedupObj;
@@ -75,7 +91,7 @@ Server::Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* da
     }
 
     //start to listen
-    if (listen(dataHostSock_, 10) == -1) {
+    if (listen(dataHostSock_, backlog) == -1) {
         fprintf(stderr, "Error listening %d\n", errno);
     }
 
@@ -91,9 +107,19 @@ Server::Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* da
     }
 
     //start to listen
-    if (listen(metaHostSock_, 10) == -1) {
+    if (listen(metaHostSock_, backlog) == -1) {
         fprintf(stderr, "Error listening %d\n", errno);
     }
+
+    //the listening sockets are watched by epoll like the connections
+    memset(&metaListener_, 0, sizeof(connection_t));
+    metaListener_.fd = metaHostSock_;
+    metaListener_.type = META;
+    metaListener_.state = CONN_LISTEN;
+    memset(&dataListener_, 0, sizeof(connection_t));
+    dataListener_.fd = dataHostSock_;
+    dataListener_.type = DATA;
+    dataListener_.state = CONN_LISTEN;
 }
 
 void timerStart(double* t)
@@ -113,496 +139,760 @@ double timerSplit(const double* t)
 }
 
 /*
- * Meta Thread function: each thread maintains a socket from a certain client
+ * wait until a connection can be read or written, within the deadline of its request
  *
- * @param lp - input parameter structure
+ * @param conn - the connection
+ * @param events - POLLIN or POLLOUT
  *
+ * @return - a boolean value that indicates if the connection is ready (false if the deadline passed)
  */
-void* SocketHandlerMeta(void* lp)
+static bool waitConnection(Server::connection_t* conn, short events)
 {
-    //double timer,split,bw;
-
-    //get socket from input param
-    int* clientSock = (int*)lp;
-
-    //variable initialization
-    int bytecount;
-    char* buffer = (char*)malloc(sizeof(char) * BUFFER_LEN);
-    char* metaBuffer = (char*)malloc(sizeof(char) * META_LEN);
-    bool* statusList = (bool*)malloc(sizeof(bool) * BUFFER_LEN);
-    memset(statusList, 0, sizeof(bool) * BUFFER_LEN);
-    int metaSize;
-    int user = 0;
-    int dataSize = 0;
-    //get user ID
-    if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error recv userID %d\n", errno);
-    }
-    user = ntohl(*(int*)buffer);
-
-    memset(buffer, 0, BUFFER_LEN);
-    int numOfShare = 0;
-
-    //initialize hash object
-    CryptoPrimitive* hashObj = new CryptoPrimitive(SHA256_TYPE);
-
-    //main loop for recv data package
     while (true) {
-
-        /*recv indicator first*/
-        if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-            fprintf(stderr, "Error receiving data %d\n", errno);
+        double now;
+        timerStart(&now);
+        int timeout = (int)((conn->deadline - now) * 1000);
+        struct pollfd pollFd;
+        pollFd.fd = conn->fd;
+        pollFd.events = events;
+        int ready = (timeout > 0) ? poll(&pollFd, 1, timeout) : 0;
+        if (ready > 0) {
+            return true;
         }
+        if (ready == 0) {
+            fprintf(stderr, "Error: a request of connection %d is not served in time\n", conn->fd);
+            errno = ETIMEDOUT;
+            return false;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
 
-        /*if client closes, break loop*/
-        if (bytecount == 0)
-            break;
-
-        int indicator = *(int*)buffer;
-
-        if (indicator == KEY_RECIPE) {
-
-            /* get key file size */
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-            int length = *(int*)buffer;
-            /* get file name size */
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-            int namesize = *(int*)buffer;
-            printf("namesize = %d\n", namesize);
-
-            char* keybuffer = (char*)malloc(sizeof(char) * length);
-
-            char namebuffer[namesize + 1];
-            if ((bytecount = recv(*clientSock, namebuffer, namesize, 0)) == -1) {
-
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-
-            namebuffer[namesize] = '\0';
-            int id = 0;
-            while (namebuffer[id] != '\0') {
-                id++;
-                if (namebuffer[id] == '/') {
-                    namebuffer[id] = '_';
-                }
-            }
-            /* create a new cipher file */
-            char name[256];
-            sprintf(name, "meta/keystore/%s", namebuffer);
-            printf("key file name : %s\n", name);
-            FILE* wp = fopen(name, "wb+");
-            if (wp == NULL) {
-                printf("key file can not creat\n");
-            }
-            /* get stub */
-            int total = 0;
-            printf("key file length = %d\n", length);
-            while (total < length) {
-
-                if ((bytecount = recv(*clientSock, keybuffer + total, length - total, 0)) == -1) {
-
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                total += bytecount;
+/*
+ * receive a number of bytes from a connection
+ *
+ * the socket is read only when it has data, so a client that sends a byte at a time
+ * still runs out of the time of its request
+ *
+ * @param conn - the connection
+ * @param buffer - the buffer for the bytes <return>
+ * @param size - the number of bytes
+ *
+ * @return - a boolean value that indicates if all bytes are received (false if the client closed or timed out)
+ */
+static bool recvFull(Server::connection_t* conn, char* buffer, long size)
+{
+    conn->deadline += (double)size / SERVER_MIN_RATE;
+    long total = 0;
+    while (total < size) {
+        if (!waitConnection(conn, POLLIN)) {
+            return false;
+        }
+        long bytecount = recv(conn->fd, buffer + total, size - total, MSG_DONTWAIT);
+        if (bytecount == -1) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                continue;
             }
-
-            fwrite(keybuffer, 1, length, wp);
-            fclose(wp);
-            free(keybuffer);
-            continue;
+            fprintf(stderr, "Error receiving data %d\n", errno);
+            return false;
         }
+        if (bytecount == 0) {
+            return false;
+        }
+        total += bytecount;
+    }
+    return true;
+}
 
-        /* if it's key download */
-        if (indicator == GET_KEY_RECIPE) {
-
-            /* get file name size */
-
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
+/*
+ * send a number of bytes through a connection, within the time of its request
+ *
+ * @param conn - the connection
+ * @param buffer - the bytes
+ * @param size - the number of bytes
+ *
+ * @return - a boolean value that indicates if all bytes are sent (false if the client closed or timed out)
+ */
+static bool sendFull(Server::connection_t* conn, const void* buffer, long size)
+{
+    conn->deadline += (double)size / SERVER_MIN_RATE;
+    long total = 0;
+    while (total < size) {
+        if (!waitConnection(conn, POLLOUT)) {
+            return false;
+        }
+        long bytecount = send(conn->fd, (const char*)buffer + total, size - total, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytecount == -1) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                continue;
             }
-            int namesize = *(int*)buffer;
-            char namebuffer[namesize + 1];
+            fprintf(stderr, "Error sending data %d\n", errno);
+            return false;
+        }
+        total += bytecount;
+    }
+    return true;
+}
 
-            if ((bytecount = recv(*clientSock, namebuffer, namesize, 0)) == -1) {
+/*
+ * check if a failed send was due to the client closing its connection or not taking
+ * the data in time, which then ends
+ *
+ * @return - a boolean value that indicates if the connection is lost
+ */
+static bool connectionLost()
+{
+    return (errno == EPIPE) || (errno == ECONNRESET) || (errno == ETIMEDOUT);
+}
 
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-            namebuffer[namesize] = '\0';
-            int id = 0;
-            while (namebuffer[id] != '\0') {
-                id++;
-                if (namebuffer[id] == '/') {
-                    namebuffer[id] = '_';
-                }
-            }
-            /* find stub file */
-            char name[256];
-            sprintf(name, "meta/keystore/%s", namebuffer);
-            FILE* rp = fopen(name, "r");
-            if (rp == NULL) {
+/*
+ * replace the slashes of a received file name, after its first character
+ *
+ * @param name - the name
+ */
+static void flattenName(char* name)
+{
+    int id = 0;
+    while (name[id] != '\0') {
+        id++;
+        if (name[id] == '/') {
+            name[id] = '_';
+        }
+    }
+}
 
-                printf("file not exist\ndownload fail\n");
-                break;
-            }
+/*
+ * receive the share metadata of a META request into the connection, which keeps it for the DATA request
+ *
+ * @param conn - the connection
+ *
+ * @return - a boolean value that indicates if the share metadata is received
+ */
+static bool recvShareMetadata(Server::connection_t* conn)
+{
+    int packageSize;
+    if (!recvFull(conn, (char*)&packageSize, sizeof(int)) || (packageSize < 0) || (packageSize > BUFFER_LEN)) {
+        return false;
+    }
 
-            fseek(rp, 0, SEEK_END);
-            int length = ftell(rp);
-            fseek(rp, 0, SEEK_SET);
-            char* stubtemp = (char*)malloc(sizeof(char) * length);
+    /* the buffers are sized to the requests, so connections that only restore hold none */
+    if (conn->metaCapacity < packageSize) {
+        conn->metaCapacity = packageSize;
+        conn->metaBuffer = (char*)realloc(conn->metaBuffer, sizeof(char) * conn->metaCapacity);
+    }
+    /* each share takes more than a byte of metadata, so its status fits in a list of the same size */
+    if (conn->statusCapacity < packageSize) {
+        conn->statusCapacity = packageSize;
+        conn->statusList = (bool*)realloc(conn->statusList, sizeof(bool) * conn->statusCapacity);
+    }
+    if (!recvFull(conn, conn->metaBuffer, packageSize)) {
+        return false;
+    }
+    memset(conn->statusList, 0, sizeof(bool) * packageSize);
+    conn->metaSize = packageSize;
+    return true;
+}
 
-            int ret;
-            ret = fread(stubtemp, 1, length, rp);
-            if (ret != length) {
-                printf("error reading cipher file\n");
-            }
-            /* send key size back */
+/*
+ * send the status list of the shares of a META request back
+ *
+ * @param conn - the connection
+ *
+ * @return - a boolean value that indicates if the status list is sent
+ */
+static bool sendStatusList(Server::connection_t* conn)
+{
+    int ind = STAT;
+    return sendFull(conn, &ind, sizeof(int)) && sendFull(conn, &conn->numOfShare, sizeof(int))
+        && sendFull(conn, conn->statusList, sizeof(bool) * conn->numOfShare);
+}
 
-            printf("key file length = %d\n", length);
-            if ((bytecount = send(*clientSock, &length, sizeof(int), 0)) == -1) {
+/*
+ * receive a length-prefixed package (of a DATA or DOWNLOAD request) into the buffer of a worker
+ *
+ * @param conn - the connection
+ * @param buffer - the buffer of the worker (BUFFER_LEN + 1 bytes) <return>
+ * @param packageSize - the size of the package <return>
+ *
+ * @return - a boolean value that indicates if the package is received
+ */
+static bool recvPackage(Server::connection_t* conn, char* buffer, int* packageSize)
+{
+    if (!recvFull(conn, (char*)packageSize, sizeof(int)) || (*packageSize < 0) || (*packageSize > BUFFER_LEN)) {
+        return false;
+    }
+    return recvFull(conn, buffer, *packageSize);
+}
 
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
-            int total = 0;
+/*
+ * send the empty message that ends a streamed restore, or a restore that failed
+ *
+ * @param conn - the connection
+ *
+ * @return - a boolean value that indicates if the message is sent
+ */
+static bool sendRestoreEnd(Server::connection_t* conn)
+{
+    /* the shares before it were sent within the deadlines of the dedup core, so the message gets its own time */
+    timerStart(&conn->deadline);
+    conn->deadline += SERVER_REQUEST_TIMEOUT;
+
+    uint32_t endMsg[2];
+    endMsg[0] = htonl(-5);
+    endMsg[1] = htonl(0);
+    return sendFull(conn, endMsg, sizeof(endMsg));
+}
 
-            while (total < length) {
+/*
+ * serve a request on a meta connection
+ *
+ * @param conn - the connection
+ * @param worker - the worker serving it
+ * @param indicator - the indicator of the request
+ *
+ * @return - a boolean value that indicates if the connection stays open
+ */
+static bool serveMetaRequest(Server::connection_t* conn, Server::worker_t* worker, int indicator)
+{
+    char* buffer = worker->buffer;
 
-                if ((bytecount = send(*clientSock, stubtemp + total, length - total, 0)) == -1) {
+    if (indicator == KEY_RECIPE) {
 
-                    fprintf(stderr, "Error sending data %d\n", errno);
-                }
-                total += bytecount;
-            }
-            free(stubtemp);
-            fclose(rp);
-            continue;
+        /* get key file size and file name size */
+        long length;
+        int namesize;
+        if (!recvFull(conn, (char*)&length, sizeof(long)) || !recvFull(conn, (char*)&namesize, sizeof(int))
+            || (length < 0) || (namesize <= 0) || (namesize > 255)) {
+            return false;
         }
+        printf("namesize = %d\n", namesize);
 
-        if (indicator == FILE_RECIPE) {
+        char namebuffer[namesize + 1];
+        if (!recvFull(conn, namebuffer, namesize)) {
+            return false;
+        }
+        namebuffer[namesize] = '\0';
+        flattenName(namebuffer);
+
+        /* create a new cipher file */
+        char name[256 + 16];
+        sprintf(name, "meta/keystore/%s", namebuffer);
+        printf("key file name : %s\n", name);
+        printf("key file length = %ld\n", length);
+        char* keybuffer = (char*)malloc(sizeof(char) * length);
+        if (!recvFull(conn, keybuffer, length)) {
+            free(keybuffer);
+            return false;
+        }
+        FILE* wp = fopen(name, "wb+");
+        if (wp == NULL) {
+            printf("key file can not creat\n");
+        } else {
+            fwrite(keybuffer, 1, length, wp);
+            fclose(wp);
+        }
+        free(keybuffer);
+        return true;
+    }
 
-            pthread_mutex_lock(&mutex);
+    /* if it's key download */
+    if (indicator == GET_KEY_RECIPE) {
 
-            /* get key file size */
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-            int length = *(int*)buffer;
-            char* keybuffer = (char*)malloc(sizeof(char) * sizeof(fileRecipeEntry_t) * 1000);
-            /* get file name size */
+        /* get file name size */
+        int namesize;
+        if (!recvFull(conn, (char*)&namesize, sizeof(int)) || (namesize <= 0) || (namesize > 255)) {
+            return false;
+        }
+        char namebuffer[namesize + 1];
+        if (!recvFull(conn, namebuffer, namesize)) {
+            return false;
+        }
+        namebuffer[namesize] = '\0';
+        flattenName(namebuffer);
+
+        /* find stub file */
+        char name[256 + 16];
+        sprintf(name, "meta/keystore/%s", namebuffer);
+        FILE* rp = fopen(name, "r");
+        if (rp == NULL) {
+
+            /* a negative length tells the client, which keeps the connection for its next file */
+            printf("file not exist\ndownload fail\n");
+            long length = -1;
+            return sendFull(conn, &length, sizeof(long));
+        }
 
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-            int namesize = *(int*)buffer;
-            char namebuffer[namesize + 1];
+        fseek(rp, 0, SEEK_END);
+        long length = ftell(rp);
+        fseek(rp, 0, SEEK_SET);
+        char* stubtemp = (char*)malloc(sizeof(char) * length);
 
-            if ((bytecount = recv(*clientSock, namebuffer, namesize, 0)) == -1) {
+        long ret;
+        ret = fread(stubtemp, 1, length, rp);
+        if (ret != length) {
+            printf("error reading cipher file\n");
+        }
+        /* send key size back */
 
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+        printf("key file length = %ld\n", length);
+        bool sent = sendFull(conn, &length, sizeof(long)) && sendFull(conn, stubtemp, length);
+        free(stubtemp);
+        fclose(rp);
+        return sent;
+    }
 
-            namebuffer[namesize] = '\0';
-            int id = 0;
-            while (namebuffer[id] != '\0') {
-                id++;
-                if (namebuffer[id] == '/') {
-                    namebuffer[id] = '_';
-                }
-            }
-            /* create a new cipher file */
-            char name[256];
-            sprintf(name, "meta/RecipeFiles/%s", namebuffer);
+    if (indicator == FILE_RECIPE) {
 
-            FILE* wp = fopen(name, "ab+");
-            if (wp == NULL) {
-                printf("recipe file can not creat\n");
+        /* get recipe size and file name size */
+        long length;
+        int namesize;
+        if (!recvFull(conn, (char*)&length, sizeof(long)) || !recvFull(conn, (char*)&namesize, sizeof(int))
+            || (length < (long)sizeof(fileRecipeHead_t)) || (namesize <= 0) || (namesize > 255)) {
+            return false;
+        }
+        char namebuffer[namesize + 1];
+        if (!recvFull(conn, namebuffer, namesize)) {
+            return false;
+        }
+        namebuffer[namesize] = '\0';
+        flattenName(namebuffer);
+
+        char name[256 + 32];
+        sprintf(name, "meta/RecipeFiles/%s", namebuffer);
+
+        /* the recipe is received into a file of its own, so a slow client holds no lock */
+        char tempName[] = "meta/RecipeFiles/.incoming-XXXXXX";
+        int tempFd = mkstemp(tempName);
+        FILE* wp = (tempFd == -1) ? NULL : fdopen(tempFd, "wb");
+        if (wp == NULL) {
+            printf("recipe file can not creat\n");
+            if (tempFd != -1) {
+                close(tempFd);
+                unlink(tempName);
             }
-            /* get stub */
-            int total = 0;
-            char* headerbuffer = (char*)malloc(sizeof(char) * sizeof(fileRecipeHead_t));
-            if ((bytecount = recv(*clientSock, headerbuffer, sizeof(fileRecipeHead_t), 0)) == -1) {
-
-                fprintf(stderr, "Error receiving data %d\n", errno);
+        }
+        /* the recipe is written as it comes, in pieces of the worker buffer */
+        bool received = true;
+        long total = 0;
+        while (total < length) {
+            long size = (length - total < BUFFER_LEN) ? length - total : BUFFER_LEN;
+            if (!recvFull(conn, buffer, size)) {
+                received = false;
+                break;
             }
-            fwrite(headerbuffer, 1, sizeof(fileRecipeHead_t), wp);
-            length -= sizeof(fileRecipeHead_t);
-            while (total < length) {
-                if (length - total >= sizeof(fileRecipeEntry_t) * 1000) {
-                    if ((bytecount = recv(*clientSock, keybuffer, sizeof(fileRecipeEntry_t) * 1000, 0)) == -1) {
-
-                        fprintf(stderr, "Error receiving data %d\n", errno);
-                    }
-                } else {
-                    if ((bytecount = recv(*clientSock, keybuffer, length - total, 0)) == -1) {
-
-                        fprintf(stderr, "Error receiving data %d\n", errno);
-                    }
-                }
-                total += bytecount;
-                fwrite(keybuffer, 1, bytecount, wp);
+            if (wp != NULL) {
+                fwrite(buffer, 1, size, wp);
             }
-            fclose(wp);
-            free(headerbuffer);
-            free(keybuffer);
-            pthread_mutex_unlock(&mutex);
-            break;
+            total += size;
         }
-        /*while metadata recv.ed, perform first stage deduplication*/
-        if (indicator == META) {
-
-            /*recv following package size*/
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
-
-            int packageSize = *(int*)buffer;
-            int count = 0;
-
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
+        if (wp != NULL) {
+            fclose(wp);
+            if (!received) {
+                unlink(tempName);
+            } else {
+                /* the complete recipe replaces any recipe of the same name left by a failed restore */
+                pthread_mutex_lock(&mutex);
+                if (rename(tempName, name) == -1) {
+                    printf("recipe file can not creat\n");
+                    unlink(tempName);
                 }
-                count += bytecount;
-            }
-
-            memcpy(metaBuffer, buffer, count);
-            metaSize = count;
-
-            dedupObj_->firstStageDedup(user, (unsigned char*)metaBuffer, count, statusList, numOfShare, dataSize);
-
-            int ind = STAT;
-            memcpy(buffer, &ind, sizeof(int));
-
-            /*return the status list*/
-            int bytecount;
-            if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
+                pthread_mutex_unlock(&mutex);
             }
+        }
+        if (!received) {
+            return false;
+        }
 
-            memcpy(buffer, &numOfShare, sizeof(int));
-            if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
+        /* the data connection reads the recipe, so the client waits until it is stored */
+        int ack = FILE_RECIPE;
+        /* keep the connection, a client agent reuses it for its next file */
+        return sendFull(conn, &ack, sizeof(int));
+    }
 
-            if ((bytecount = send(*clientSock, statusList, sizeof(bool) * numOfShare, 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
+    /*while metadata recv.ed, perform first stage deduplication*/
+    if (indicator == META) {
+        int dataSize = 0;
+        if (!recvShareMetadata(conn)) {
+            return false;
         }
+        dedupObj_->firstStageDedup(conn->user, (unsigned char*)conn->metaBuffer, conn->metaSize, conn->statusList, conn->numOfShare, dataSize);
+        return sendStatusList(conn);
+    }
 
-        /*while data recv.ed, perform second stage deduplication*/
-        if (indicator == DATA) {
-
-            /*recv following package size*/
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+    /*while data recv.ed, perform second stage deduplication*/
+    if (indicator == DATA) {
+        int packageSize;
+        if (!recvPackage(conn, buffer, &packageSize)) {
+            return false;
+        }
+        dedupObj_->secondStageDedup(conn->user, (unsigned char*)conn->metaBuffer, conn->metaSize, conn->statusList, (unsigned char*)buffer, worker->hashObj);
+        return true;
+    }
 
-            int packageSize = *(int*)buffer;
-            int count = 0;
+    /*while download request recv.ed, perform restore*/
+    if (indicator == DOWNLOAD) {
+        int packageSize;
+        if (!recvPackage(conn, buffer, &packageSize)) {
+            return false;
+        }
+        std::string fullFileName;
+        fullFileName.assign(buffer, packageSize);
+        errno = 0;
+        bool restored = dedupObj_->restoreShareFile(conn->user, fullFileName, 0, conn->fd, worker->hashObj);
+        /*a failed restore is ended, so that the client does not wait for the rest of it*/
+        return restored || (!connectionLost() && sendRestoreEnd(conn));
+    }
 
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                count += bytecount;
-            }
+    return true;
+}
 
-            dedupObj_->secondStageDedup(user, (unsigned char*)metaBuffer, metaSize, statusList, (unsigned char*)buffer, hashObj);
-        }
 
-        /*while download request recv.ed, perform restore*/
-        if (indicator == DOWNLOAD) {
+/*
+ * serve the next list of recipe entries of a streamed restore
+ *
+ * the restore waits for its next list in epoll rather than in a worker, since the client
+ * sends it only once it has decrypted more of the recipe
+ *
+ * @param conn - the connection
+ * @param worker - the worker serving it
+ *
+ * @return - a boolean value that indicates if the connection stays open
+ */
+static bool serveStreamList(Server::connection_t* conn, Server::worker_t* worker)
+{
+    /*recv the number of following entries, an empty list ends the stream*/
+    int numOfEntries = 0;
+    if (!recvFull(conn, (char*)&numOfEntries, sizeof(int))) {
+        return false;
+    }
+    if (numOfEntries <= 0) {
+        conn->state = CONN_IDLE;
+        return !conn->restoreStat || sendRestoreEnd(conn);
+    }
 
-            /*recv following package size*/
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+    if (numOfEntries > BUFFER_LEN / (int)sizeof(fileRecipeEntry_t)) {
+        fprintf(stderr, "Error: a list of %d recipe entries exceeds the buffer!\n", numOfEntries);
+        return false;
+    }
 
-            int packageSize = *(int*)buffer;
-            int count = 0;
+    /*recv following entries*/
+    if (!recvFull(conn, worker->buffer, numOfEntries * sizeof(fileRecipeEntry_t))) {
+        return false;
+    }
 
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                count += bytecount;
-            }
-            std::string fullFileName;
-            fullFileName.assign(buffer, count);
-            dedupObj_->restoreShareFile(user, fullFileName, 0, *clientSock, hashObj);
+    /*after a failure the remaining lists are only drained, unless the client is gone*/
+    if (conn->restoreStat && (worker->restorer.shareFileBuffer == NULL)) {
+        dataDedupObj_->initShareRestorer(&worker->restorer);
+    }
+    errno = 0;
+    if (conn->restoreStat && !dataDedupObj_->restoreShareList((fileRecipeEntry_t*)worker->buffer, numOfEntries, &worker->restorer, conn->fd)) {
+        if (connectionLost()) {
+            return false;
         }
+        conn->restoreStat = 0;
+        return sendRestoreEnd(conn);
     }
-    delete hashObj;
-    free(buffer);
-    free(statusList);
-    free(metaBuffer);
-    free(clientSock);
-    return 0;
+    return true;
 }
 
 /*
- * Data Thread function: each thread maintains a socket from a certain client
+ * serve a request on a data connection
  *
- * @param lp - input parameter structure
+ * @param conn - the connection
+ * @param worker - the worker serving it
+ * @param indicator - the indicator of the request
  *
+ * @return - a boolean value that indicates if the connection stays open
  */
-void* SocketHandlerData(void* lp)
+static bool serveDataRequest(Server::connection_t* conn, Server::worker_t* worker, int indicator)
 {
-    //get socket from input param
-    int* clientSock = (int*)lp;
-
-    //variable initialization
-    int bytecount;
-    char* buffer = (char*)malloc(sizeof(char) * BUFFER_LEN);
-    char* metaBuffer = (char*)malloc(sizeof(char) * META_LEN);
-    bool* statusList = (bool*)malloc(sizeof(bool) * BUFFER_LEN);
-    memset(statusList, 0, sizeof(bool) * BUFFER_LEN);
-    int metaSize;
-    int user = 0;
-    int dataSize = 0;
-    //get user ID
-    if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-        fprintf(stderr, "Error recv userID %d\n", errno);
-    }
-    user = ntohl(*(int*)buffer);
-
-    memset(buffer, 0, BUFFER_LEN);
-    int numOfShare = 0;
-
-    //initialize hash object
-    CryptoPrimitive* hashObj = new CryptoPrimitive(SHA256_TYPE);
-
-    //main loop for recv data package
-    while (true) {
+    char* buffer = worker->buffer;
 
-        /*recv indicator first*/
-        if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-            fprintf(stderr, "Error receiving data %d\n", errno);
+    /*while metadata recv.ed, perform first stage deduplication*/
+    if (indicator == META) {
+        int dataSize = 0;
+        if (!recvShareMetadata(conn)) {
+            return false;
         }
+        dataDedupObj_->firstStageDedup(conn->user, (unsigned char*)conn->metaBuffer, conn->metaSize, conn->statusList, conn->numOfShare, dataSize);
+        return sendStatusList(conn);
+    }
 
-        /*if client closes, break loop*/
-        if (bytecount == 0)
-            break;
+    /*while data recv.ed, perform second stage deduplication*/
+    if (indicator == DATA) {
+        int packageSize;
+        if (!recvPackage(conn, buffer, &packageSize)) {
+            return false;
+        }
+        dataDedupObj_->secondStageDedup(conn->user, (unsigned char*)conn->metaBuffer, conn->metaSize, conn->statusList, (unsigned char*)buffer, worker->hashObj);
+        return true;
+    }
 
-        int indicator = *(int*)buffer;
-        /*while metadata recv.ed, perform first stage deduplication*/
-        if (indicator == META) {
+    /*while download request recv.ed, perform restore*/
+    if (indicator == DOWNLOAD) {
+        int packageSize;
+        if (!recvPackage(conn, buffer, &packageSize) || (packageSize > 255)) {
+            return false;
+        }
+        buffer[packageSize] = '\0';
+        flattenName(buffer);
+        char name[256 + 32];
+        sprintf(name, "meta/RecipeFiles/%s", buffer);
+
+        /*the recipe is taken from its name under the lock, then its shares are sent without it*/
+        pthread_mutex_lock(&mutex);
+        FILE* rp = fopen(name, "rb");
+        if (rp != NULL) {
+            unlink(name);
+        }
+        pthread_mutex_unlock(&mutex);
+        printf("restore - file name = %s\n", name);
 
-            /*recv following package size*/
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+        errno = 0;
+        bool restored = false;
+        if (rp == NULL) {
+            printf("can not start restore data chunks because recipefile = NULL\n");
+        } else {
+            restored = dataDedupObj_->restoreShareFile(conn->user, rp, 0, conn->fd, worker->hashObj);
+            fclose(rp);
+        }
+        /*a failed restore is ended, so that the client does not wait for the rest of it*/
+        return restored || (!connectionLost() && sendRestoreEnd(conn));
+    }
 
-            int packageSize = *(int*)buffer;
-            int count = 0;
+    /*while a streamed restore recv.ed, restore the shares of each list of recipe entries as it comes*/
+    if (indicator == STREAM_RESTORE) {
 
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                count += bytecount;
-            }
+        /*no recipe file is written, so the restore needs no global lock*/
+        conn->restoreStat = 1;
+        conn->state = CONN_STREAM;
+        return true;
+    }
 
-            memcpy(metaBuffer, buffer, count);
-            metaSize = count;
-            dataDedupObj_->firstStageDedup(user, (unsigned char*)metaBuffer, count, statusList, numOfShare, dataSize);
+    return true;
+}
 
-            int ind = STAT;
-            memcpy(buffer, &ind, sizeof(int));
+/*
+ * serve the next request of a connection
+ *
+ * @param conn - the connection
+ * @param worker - the worker serving it
+ *
+ * @return - a boolean value that indicates if the connection stays open
+ */
+static bool serveConnection(Server::connection_t* conn, Server::worker_t* worker)
+{
+    timerStart(&conn->deadline);
+    conn->deadline += SERVER_REQUEST_TIMEOUT;
+
+    /*get user ID*/
+    if (conn->state == CONN_USER) {
+        int user;
+        if (!recvFull(conn, (char*)&user, sizeof(int))) {
+            return false;
+        }
+        conn->user = ntohl(user);
+        conn->state = CONN_IDLE;
+        return true;
+    }
+    if (conn->state == CONN_STREAM) {
+        return serveStreamList(conn, worker);
+    }
 
-            /*return the status list*/
-            int bytecount;
-            if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
+    /*recv indicator first, if client closes, the connection is closed*/
+    int indicator;
+    if (!recvFull(conn, (char*)&indicator, sizeof(int))) {
+        return false;
+    }
+    if (conn->type == META) {
+        return serveMetaRequest(conn, worker, indicator);
+    }
+    return serveDataRequest(conn, worker, indicator);
+}
 
-            memcpy(buffer, &numOfShare, sizeof(int));
-            if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
+/*
+ * worker thread that serves one request of a connection at a time
+ *
+ * @param param - the worker
+ */
+void* Server::workerThread(void* param)
+{
+    worker_t* worker = (worker_t*)param;
+    Server* obj = worker->obj;
+    workerPool_t* pool = worker->pool;
 
-            if ((bytecount = send(*clientSock, statusList, sizeof(bool) * numOfShare, 0)) == -1) {
-                fprintf(stderr, "Error sending data %d\n", errno);
-            }
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->size == 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
         }
+        connection_t* conn = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->size--;
+        pthread_mutex_unlock(&pool->lock);
 
-        /*while data recv.ed, perform second stage deduplication*/
-        if (indicator == DATA) {
-
-            /*recv following package size*/
+        if (serveConnection(conn, worker)) {
+            obj->rearm(conn);
+        } else {
+            obj->closeConnection(conn);
+        }
+    }
+    return NULL;
+}
 
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+/*
+ * start the worker threads of a pool
+ *
+ * @param pool - the pool
+ * @param numOfWorkers - the number of worker threads
+ */
+void Server::startPool(workerPool_t* pool, int numOfWorkers)
+{
+    /* a connection is queued at most once, so the queue never fills */
+    pool->capacity = maxConnections_;
+    pool->queue = (connection_t**)malloc(sizeof(connection_t*) * pool->capacity);
+    pool->head = 0;
+    pool->size = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->numOfWorkers = numOfWorkers;
+    pool->tid = (pthread_t*)malloc(sizeof(pthread_t) * numOfWorkers);
+    for (int i = 0; i < numOfWorkers; i++) {
+        worker_t* worker = (worker_t*)malloc(sizeof(worker_t));
+        worker->obj = this;
+        worker->pool = pool;
+        worker->buffer = (char*)malloc(sizeof(char) * (BUFFER_LEN + 1));
+        worker->hashObj = new CryptoPrimitive(SHA256_TYPE);
+        worker->restorer.shareFileBuffer = NULL;
+        pthread_create(&pool->tid[i], 0, &workerThread, (void*)worker);
+    }
+}
 
-            int packageSize = *(int*)buffer;
-            int count = 0;
+/*
+ * accept the pending connections of a listening socket, until maxConnections_ is reached
+ *
+ * @param listener - the listening socket
+ */
+void Server::acceptConnections(connection_t* listener)
+{
+    while (true) {
+        /* at the limit the listening sockets are left alone, so further clients wait in the backlog */
+        pthread_mutex_lock(&connLock_);
+        if (numOfConnections_ >= maxConnections_) {
+            setListening(false);
+            pthread_mutex_unlock(&connLock_);
+            return;
+        }
+        pthread_mutex_unlock(&connLock_);
 
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                count += bytecount;
+        int fd = accept(listener->fd, (sockaddr*)&sadr_, &addrSize_);
+        if (fd == -1) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                fprintf(stderr, "Error accepting %d\n", errno);
             }
-
-            dataDedupObj_->secondStageDedup(user, (unsigned char*)metaBuffer, metaSize, statusList, (unsigned char*)buffer, hashObj);
+            return;
         }
+        printf("Received %s connection from %s\n", (listener->type == META) ? "meta" : "data", inet_ntoa(sadr_.sin_addr));
+
+        connection_t* conn = (connection_t*)malloc(sizeof(connection_t));
+        memset(conn, 0, sizeof(connection_t));
+        conn->fd = fd;
+        conn->type = listener->type;
+        conn->state = CONN_USER;
+
+        pthread_mutex_lock(&connLock_);
+        numOfConnections_++;
+        pthread_mutex_unlock(&connLock_);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = conn;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+            fprintf(stderr, "Error watching a connection %d\n", errno);
+            closeConnection(conn);
+        }
+    }
+}
 
-        /*while download request recv.ed, perform restore*/
-        if (indicator == DOWNLOAD) {
+/*
+ * pass a connection with a request to the worker pool of its port
+ *
+ * @param conn - the connection
+ */
+void Server::dispatch(connection_t* conn)
+{
+    workerPool_t* pool = (conn->type == META) ? &metaPool_ : &dataPool_;
 
-            /*recv following package size*/
-            if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1) {
-                fprintf(stderr, "Error receiving data %d\n", errno);
-            }
+    pthread_mutex_lock(&pool->lock);
+    pool->queue[(pool->head + pool->size) % pool->capacity] = conn;
+    pool->size++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
 
-            int packageSize = *(int*)buffer;
-            int count = 0;
+/*
+ * watch a connection for its next request
+ *
+ * @param conn - the connection
+ */
+void Server::rearm(connection_t* conn)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = conn;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn->fd, &event) == -1) {
+        fprintf(stderr, "Error watching a connection %d\n", errno);
+        closeConnection(conn);
+    }
+}
 
-            /*recv following data*/
-            while (count < packageSize) {
-                if ((bytecount = recv(*clientSock, buffer + count, packageSize - count, 0)) == -1) {
-                    fprintf(stderr, "Error receiving data %d\n", errno);
-                }
-                count += bytecount;
-            }
-            buffer[packageSize] = '\0';
-            int id = 0;
-            while (buffer[id] != '\0') {
-                id++;
-                if (buffer[id] == '/') {
-                    buffer[id] = '_';
-                }
-            }
-            char name[256];
-            sprintf(name, "meta/RecipeFiles/%s", buffer);
-            std::string fullFileName(name);
-            //fullFileName.assign(buffer, count);
+/*
+ * close a connection and free its state
+ *
+ * @param conn - the connection
+ */
+void Server::closeConnection(connection_t* conn)
+{
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->metaBuffer);
+    free(conn->statusList);
+    free(conn);
+
+    pthread_mutex_lock(&connLock_);
+    numOfConnections_--;
+    if (paused_ && (numOfConnections_ < maxConnections_)) {
+        setListening(true);
+    }
+    pthread_mutex_unlock(&connLock_);
+}
 
-            pthread_mutex_lock(&mutex);
-            dataDedupObj_->restoreShareFile(user, fullFileName, 0, *clientSock, hashObj);
-            pthread_mutex_unlock(&mutex);
+/*
+ * watch the listening sockets or stop watching them (with connLock_ held)
+ *
+ * @param listening - whether the listening sockets are watched
+ */
+void Server::setListening(bool listening)
+{
+    if (paused_ == !listening) {
+        return;
+    }
+    connection_t* listeners[2] = { &metaListener_, &dataListener_ };
+    for (int i = 0; i < 2; i++) {
+        struct epoll_event event;
+        event.events = listening ? EPOLLIN : 0;
+        event.data.ptr = listeners[i];
+        if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, listeners[i]->fd, &event) == -1) {
+            fprintf(stderr, "Error watching a listening socket %d\n", errno);
         }
     }
-
-    delete hashObj;
-    free(buffer);
-    free(statusList);
-    free(metaBuffer);
-    free(clientSock);
-    return 0;
+    paused_ = !listening;
 }
 
 /*
- * start linsten sockets and bind correct thread for coming connection
+ * start linsten sockets and serve the coming connections with the worker pools
  *
  */
 void Server::runReceive()
@@ -610,35 +900,43 @@ void Server::runReceive()
 
     addrSize_ = sizeof(sockaddr_in);
     pthread_mutex_init(&mutex, NULL);
-    //create a thread whenever a client connects
-    while (true) {
-
-        printf("waiting for a connection\n");
-        dataclientSock_ = (int*)malloc(sizeof(int));
-        metaclientSock_ = (int*)malloc(sizeof(int));
 
-        if ((*dataclientSock_ = accept(dataHostSock_, (sockaddr*)&sadr_, &addrSize_)) != -1) {
-
-            printf("Received data connection from %s\n", inet_ntoa(sadr_.sin_addr));
-            pthread_create(&threadId_, 0, &SocketHandlerData, (void*)dataclientSock_);
-
-            pthread_detach(threadId_);
-
-        } else {
-
-            fprintf(stderr, "Error accepting %d\n", errno);
+    epollFd_ = epoll_create1(0);
+    if (epollFd_ == -1) {
+        fprintf(stderr, "Error creating epoll %d\n", errno);
+        return;
+    }
+    connection_t* listeners[2] = { &metaListener_, &dataListener_ };
+    for (int i = 0; i < 2; i++) {
+        /* the listening sockets do not block, so the loop accepts until the backlog is empty */
+        fcntl(listeners[i]->fd, F_SETFL, fcntl(listeners[i]->fd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = listeners[i];
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, listeners[i]->fd, &event) == -1) {
+            fprintf(stderr, "Error watching a listening socket %d\n", errno);
         }
+    }
+    startPool(&metaPool_, numOfWorkers_);
+    startPool(&dataPool_, numOfWorkers_);
+    printf("waiting for connections (%d workers per port, at most %d connections)\n", numOfWorkers_, maxConnections_);
 
-        if ((*metaclientSock_ = accept(metaHostSock_, (sockaddr*)&sadr_, &addrSize_)) != -1) {
-
-            printf("Received meta connection from %s\n", inet_ntoa(sadr_.sin_addr));
-            pthread_create(&threadId_, 0, &SocketHandlerMeta, (void*)metaclientSock_);
-
-            pthread_detach(threadId_);
-
-        } else {
-
-            fprintf(stderr, "Error accepting %d\n", errno);
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (true) {
+        int num = epoll_wait(epollFd_, events, SERVER_MAX_EVENTS, -1);
+        if (num == -1) {
+            if (errno != EINTR) {
+                fprintf(stderr, "Error waiting for events %d\n", errno);
+            }
+            continue;
+        }
+        for (int i = 0; i < num; i++) {
+            connection_t* conn = (connection_t*)events[i].data.ptr;
+            if (conn->state == CONN_LISTEN) {
+                acceptConnections(conn);
+            } else {
+                dispatch(conn);
+            }
         }
     }
     pthread_mutex_destroy(&mutex);
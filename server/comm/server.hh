@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -31,6 +32,32 @@
 #define KEY_RECIPE (-101)
 #define GET_KEY_RECIPE (-102)
 #define FILE_RECIPE (-103)
+#define STREAM_RESTORE (-104)
+
+/* default number of worker threads serving the connections of each port */
+#define SERVER_NUM_WORKERS 16
+
+/* default maximum number of open connections, further clients wait in the listen backlog */
+#define SERVER_MAX_CONNECTIONS 1024
+
+/* default length of the queue of connections waiting to be accepted on each port */
+#define SERVER_LISTEN_BACKLOG 128
+
+/* max number of events taken from epoll at a time */
+#define SERVER_MAX_EVENTS 64
+
+/*
+ * time a request has from its first byte until it is received and answered (s), plus the
+ * time of its bytes at SERVER_MIN_RATE bytes per second; a connection over it is closed
+ */
+#define SERVER_REQUEST_TIMEOUT 60
+#define SERVER_MIN_RATE (64 * 1024)
+
+/* states of a connection */
+#define CONN_LISTEN 0 // a listening socket
+#define CONN_USER 1 // waiting for the user ID
+#define CONN_IDLE 2 // waiting for the next request
+#define CONN_STREAM 3 // in a streamed restore, waiting for the next list of recipe entries
 
 using namespace std;
 
@@ -52,14 +79,127 @@ private:
     //socket size
     socklen_t addrSize_;
 
-    //client socket
-    int* dataclientSock_;
-    int* metaclientSock_;
     //socket address
     struct sockaddr_in sadr_;
 
-    //thread ID
-    pthread_t threadId_;
+public:
+    /*
+     * state of a connection, kept between its requests
+     *
+     * the share metadata of a META request is kept for the DATA request that follows it;
+     * a streamed restore keeps nothing between its lists of recipe entries, as each list is
+     * restored in the buffers of the worker serving it, so an idle stream holds no buffers.
+     * a connection names its user in its first message and shares no state with the
+     * connections of the other port, so the meta and data connections of a client may be
+     * accepted in any order; the one dependency between them, a recipe stored on the meta
+     * port and read on the data port, is ordered by the acknowledgement of FILE_RECIPE
+     */
+    typedef struct {
+        int fd;
+        int type; // META or DATA, the port of the connection
+        int state;
+        int user;
+        char* metaBuffer;
+        int metaCapacity;
+        int metaSize;
+        bool* statusList;
+        int statusCapacity;
+        int numOfShare;
+        bool restoreStat;
+        double deadline; // time by which the request being served has to be received and answered
+    } connection_t;
+
+    /* connections of a port that have a request to serve, each queued at most once */
+    typedef struct {
+        connection_t** queue;
+        int capacity;
+        int head;
+        int size;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        int numOfWorkers;
+        pthread_t* tid;
+    } workerPool_t;
+
+    /* worker thread parameter structure, with the buffers of the worker */
+    typedef struct {
+        Server* obj;
+        workerPool_t* pool;
+        char* buffer;
+        CryptoPrimitive* hashObj;
+        shareRestorer_t restorer; // allocated when the worker first serves a list of a streamed restore
+    } worker_t;
+
+private:
+    /* epoll instance watching the listening sockets and the connections waiting for a request */
+    int epollFd_;
+
+    /* the listening sockets, as connections for epoll */
+    connection_t metaListener_;
+    connection_t dataListener_;
+
+    /* worker pools of the meta and data ports, kept apart so that a restore never waits for the other port */
+    workerPool_t metaPool_;
+    workerPool_t dataPool_;
+
+    /* number of worker threads of each port */
+    int numOfWorkers_;
+
+    /* number of open connections, and whether accepting is paused at maxConnections_ */
+    int numOfConnections_;
+    int maxConnections_;
+    bool paused_;
+    pthread_mutex_t connLock_;
+
+    /*
+     * start the worker threads of a pool
+     *
+     * @param pool - the pool
+     * @param numOfWorkers - the number of worker threads
+     */
+    void startPool(workerPool_t* pool, int numOfWorkers);
+
+    /*
+     * accept the pending connections of a listening socket, until maxConnections_ is reached
+     *
+     * @param listener - the listening socket
+     */
+    void acceptConnections(connection_t* listener);
+
+    /*
+     * pass a connection with a request to the worker pool of its port
+     *
+     * @param conn - the connection
+     */
+    void dispatch(connection_t* conn);
+
+    /*
+     * watch a connection for its next request
+     *
+     * @param conn - the connection
+     */
+    void rearm(connection_t* conn);
+
+    /*
+     * close a connection and free its state
+     *
+     * @param conn - the connection
+     */
+    void closeConnection(connection_t* conn);
+
+    /*
+     * watch the listening sockets or stop watching them
+     *
+     * @param listening - whether the listening sockets are watched
+     */
+    void setListening(bool listening);
+
+    /*
+     * worker thread that serves one request of a connection at a time
+     *
+     * @param param - the worker
+     */
+    static void* workerThread(void* param);
 
 public:
     /*the entry structure of the recipes of a file*/
@@ -73,7 +213,7 @@ public:
     typedef struct {
         int userID;
         long fileSize;
-        int numOfShares;
+        long numOfShares;
     } fileRecipeHead_t;
 
     /*
@@ -83,12 +223,20 @@ public:
  	 * @param dataPort - data service port number
  	 * @param dedupObj - meta dedup object passed in
  	 * @param minDedupObj - data dedup object passed in
+ 	 * @param numOfWorkers - number of worker threads of each port
+ 	 * @param maxConnections - maximum number of open connections
+	 * @param backlog - length of the queue of connections waiting to be accepted on each port
  	 *
  	 */
-    Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* dataDedupObj);
+    Server(int metaPort, int dataPort, DedupCore* dedupObj, minDedupCore* dataDedupObj,
+        int numOfWorkers = SERVER_NUM_WORKERS, int maxConnections = SERVER_MAX_CONNECTIONS,
+        int backlog = SERVER_LISTEN_BACKLOG);
 
     /*
- 	 * start linsten sockets and bind correct thread for coming connection
+ 	 * start linsten sockets and serve the coming connections with the worker pools
+ 	 *
+ 	 * one thread waits for new connections and requests with epoll, and the workers
+ 	 * serve each request as it comes, so idle connections hold no thread or buffer
  	 *
  	 */
     void runReceive();
@@ -3,9 +3,58 @@
  */
 
 #include "DedupCore.hh"
+#include <poll.h>
 
 using namespace std;
 
+/*
+ * send a buffer through a socket, without raising SIGPIPE if the client is gone
+ *
+ * the whole buffer has to be taken by its deadline, so a client that reads it
+ * a few bytes at a time cannot hold the worker sending it
+ *
+ * @param socketFD - the file descriptor of the sending socket
+ * @param buffer - the buffer
+ * @param size - the size of the buffer
+ *
+ * @return - the number of bytes sent, less than size if the send fails
+ */
+static ssize_t sendBuffer(int socketFD, unsigned char* buffer, int size)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    double deadline = now.tv_sec + now.tv_usec * 1e-6 + SHARE_SEND_TIMEOUT + (double)size / SHARE_SEND_MIN_RATE;
+
+    ssize_t total = 0;
+    while (total < size) {
+        gettimeofday(&now, NULL);
+        int timeout = (int)((deadline - now.tv_sec - now.tv_usec * 1e-6) * 1000);
+        struct pollfd pollFd;
+        pollFd.fd = socketFD;
+        pollFd.events = POLLOUT;
+        int ready = (timeout > 0) ? poll(&pollFd, 1, timeout) : 0;
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            break;
+        }
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        ssize_t sentSize = send(socketFD, buffer + total, size - total, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sentSize == -1) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                continue;
+            }
+            break;
+        }
+        total += sentSize;
+    }
+    return total;
+}
+
 /*
  * constructor of DedupCore
  *
@@ -1273,10 +1322,10 @@ bool DedupCore::interUserIndexUpdate_(char* shareFP, const int& userID, const in
         pShareIndexValueHead = (shareIndexValueHead_t*)(valueString.data() + valueOffset);
         valueOffset += shareIndexValueHeadSize_;
 
-        /*note: we here still check if the user owns the share, in consideration of the special case 
-		  where the received package of shares contain repeated shares. The underlying reason is 
-		  that in the first stage of deduplication, we do not check if there is any repeated share contained 
-		  in the coming package of shares*/
+        /*note: we here still check if the user owns the share, although the first stage already leaves 
+		  a share repeated within the coming package to its first occurrence. The underlying reason is 
+		  that another package of the same user (e.g., from a concurrent upload) may store the share 
+		  between the two stages of deduplication*/
 
         /*check if the user owns the share corresponding to the key*/
         int ownerStat = 0;
@@ -1822,6 +1871,9 @@ bool DedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuffer,
     int shareMDBufferOffset = 0;
     int i;
 
+    /*fingerprints of the shares in this package that are not stored yet*/
+    FPSet batchFPs(FP_SIZE);
+
     numOfShares = 0;
     sentShareDataSize = 0;
 
@@ -1839,6 +1891,13 @@ bool DedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuffer,
             pShareMDEntry = (shareMDEntry_t*)(shareMDBuffer + shareMDBufferOffset);
             shareMDBufferOffset += shareMDEntrySize_;
 
+            /*a share repeated within the package is a duplicate of its first occurrence, whose data is sent once*/
+            if (batchFPs.contains((unsigned char*)pShareMDEntry->shareFP)) {
+                intraUserDupStatList[numOfShares] = 1;
+                numOfShares++;
+                continue;
+            }
+
             /*check the intra-user duplicate status*/
             if (!intraUserIndexUpdate_(pShareMDEntry->shareFP, userID, intraUserDupStatList[numOfShares])) {
                 fprintf(stderr, "Error: fail to update the share index for intra-user duplication in the database!\n");
@@ -1847,6 +1906,7 @@ bool DedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuffer,
             }
             if (intraUserDupStatList[numOfShares] == 0) {
                 sentShareDataSize += pShareMDEntry->shareSize;
+                batchFPs.insert((unsigned char*)pShareMDEntry->shareFP);
             }
 
             numOfShares++;
@@ -1883,6 +1943,10 @@ bool DedupCore::secondStageDedup(const int& userID, unsigned char* shareMDBuffer
     std::string recipeFileName;
     int numOfShares = 0;
     int i;
+    bool ownerStat;
+
+    /*fingerprints of the shares in this package that are stored by their first occurrence*/
+    FPSet batchFPs(FP_SIZE);
 
     if (cryptoObj == NULL) {
         fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");
@@ -2029,8 +2093,18 @@ bool DedupCore::secondStageDedup(const int& userID, unsigned char* shareMDBuffer
                     return 0;
                 }
 
+                batchFPs.insert((unsigned char*)shareFP);
+
                 shareDataBufferOffset += pShareMDEntry->shareSize;
             }
+            /*a share repeated within the package was left to its first occurrence, count its reference now*/
+            else if (batchFPs.contains((unsigned char*)pShareMDEntry->shareFP)) {
+                if (!intraUserIndexUpdate_(pShareMDEntry->shareFP, userID, ownerStat) || (ownerStat == 0)) {
+                    fprintf(stderr, "Error: fail to update the share index for a repeated share in the database!\n");
+
+                    return 0;
+                }
+            }
 
             /*put the file recipe entry into recipeFileBuffer*/
             pFileRecipeEntry = (fileRecipeEntry_t*)(targetBufferNode->recipeFileBuffer + targetBufferNode->recipeFileBufferCurrLen);
@@ -2201,7 +2275,7 @@ bool DedupCore::restoreShareFile(const int& userID, const std::string& fullFileN
     int *shareContainerCacheIndex, numOfCachedShareContainers;
     FILE *recipeFilePointer, *containerFilePointer;
     std::string fullRecipeFileName, fullShareContainerName;
-    int numOfShares;
+    long numOfShares, i;
     inodeIndexValueHead_t* pInodeIndexValueHead;
     inodeFileEntry_t* pInodeFileEntry;
     shareIndexValueHead_t* pShareIndexValueHead;
@@ -2212,7 +2286,7 @@ bool DedupCore::restoreShareFile(const int& userID, const std::string& fullFileN
     ssize_t sentSize;
     uint32_t indicator;
     uint32_t sentDataSize;
-    int i, j, k;
+    int j, k;
 
     if (cryptoObj == NULL) {
         fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");
@@ -2540,7 +2614,7 @@ bool DedupCore::restoreShareFile(const int& userID, const std::string& fullFileN
                     memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
 
                     /*send the data of the share file buffer through the socket with socketFD*/
-                    if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset) {
+                    if ((sentSize = sendBuffer(socketFD, shareFileBuffer, shareFileBufferOffset)) != shareFileBufferOffset) {
                         fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) \
 								through the socket %d --- return %ld!\n",
                             shareFileBufferOffset, socketFD, sentSize);
@@ -2646,7 +2720,7 @@ bool DedupCore::restoreShareFile(const int& userID, const std::string& fullFileN
             memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
 
             /*send the data of the share file buffer through the socket with socketFD*/
-            if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset) {
+            if ((sentSize = sendBuffer(socketFD, shareFileBuffer, shareFileBufferOffset)) != shareFileBufferOffset) {
                 fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) \
 						through the socket %d --- return %ld!\n",
                     shareFileBufferOffset, socketFD, sentSize);
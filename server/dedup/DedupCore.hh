@@ -39,6 +39,9 @@
 
 #include "dataStruct.hh"
 
+/*for detecting repeated shares within a package*/
+#include "fpSet.hh"
+
 class DedupCore {
 private:
     /*the name of the deduplication directory*/
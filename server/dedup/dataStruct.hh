@@ -28,6 +28,10 @@
 /*macro for share file buffer size*/
 #define SHARE_FILE_BUFFER_SIZE (4 << 20)
 
+/*macros for the time a client has to take a share file buffer: SHARE_SEND_TIMEOUT seconds, plus the time of its bytes at SHARE_SEND_MIN_RATE bytes per second*/
+#define SHARE_SEND_TIMEOUT 60
+#define SHARE_SEND_MIN_RATE (64 << 10)
+
 /*macro for the number of cached share containers*/
 #define NUM_OF_CACHED_CONTAINERS 4
 
@@ -40,9 +44,9 @@ using namespace std;
 typedef struct {
     int fullNameSize;
     long fileSize;
-    int numOfPastSecrets;
+    long numOfPastSecrets;
     long sizeOfPastSecrets;
-    int numOfComingSecrets;
+    long numOfComingSecrets;
     long sizeOfComingSecrets;
 } fileShareMDHead_t;
 
@@ -99,7 +103,7 @@ typedef struct {
 typedef struct {
     int userID;
     long fileSize;
-    int numOfShares;
+    long numOfShares;
 } fileRecipeHead_t;
 
 /*the entry structure of the recipes of a file*/
@@ -129,7 +133,7 @@ typedef struct perUserBufferNode {
 /*the head structure of the restored share file*/
 typedef struct {
     long fileSize;
-    int numOfShares;
+    long numOfShares;
 } shareFileHead_t;
 
 /*the entry structure of the restored share file*/
@@ -145,4 +149,13 @@ typedef struct {
     unsigned char shareContainer[CONTAINER_BUFFER_SIZE];
 } shareContainerCacheNode_t;
 
+/*the state of restoring the shares of a file, kept across the lists of a streamed restore*/
+typedef struct {
+    unsigned char* shareFileBuffer;
+    int shareFileBufferOffset;
+    shareContainerCacheNode_t* shareContainerCache;
+    int* shareContainerCacheIndex;
+    int numOfCachedShareContainers;
+} shareRestorer_t;
+
 #endif
@@ -3,9 +3,58 @@
  */
 
 #include "minDedupCore.hh"
+#include <poll.h>
 
 using namespace std;
 
+/*
+ * send a buffer through a socket, without raising SIGPIPE if the client is gone
+ *
+ * the whole buffer has to be taken by its deadline, so a client that reads it
+ * a few bytes at a time cannot hold the worker sending it
+ *
+ * @param socketFD - the file descriptor of the sending socket
+ * @param buffer - the buffer
+ * @param size - the size of the buffer
+ *
+ * @return - the number of bytes sent, less than size if the send fails
+ */
+static ssize_t sendBuffer(int socketFD, unsigned char* buffer, int size)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    double deadline = now.tv_sec + now.tv_usec * 1e-6 + SHARE_SEND_TIMEOUT + (double)size / SHARE_SEND_MIN_RATE;
+
+    ssize_t total = 0;
+    while (total < size) {
+        gettimeofday(&now, NULL);
+        int timeout = (int)((deadline - now.tv_sec - now.tv_usec * 1e-6) * 1000);
+        struct pollfd pollFd;
+        pollFd.fd = socketFD;
+        pollFd.events = POLLOUT;
+        int ready = (timeout > 0) ? poll(&pollFd, 1, timeout) : 0;
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            break;
+        }
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        ssize_t sentSize = send(socketFD, buffer + total, size - total, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sentSize == -1) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                continue;
+            }
+            break;
+        }
+        total += sentSize;
+    }
+    return total;
+}
+
 /*
  * constructor of DedupCore
  *
@@ -700,10 +749,10 @@ bool minDedupCore::interUserIndexUpdate_(char* shareFP, const int& userID, const
         pShareIndexValueHead = (shareIndexValueHead_t*)(valueString.data() + valueOffset);
         valueOffset += shareIndexValueHeadSize_;
 
-        /*note: we here still check if the user owns the share, in consideration of the special case 
-		  where the received package of shares contain repeated shares. The underlying reason is 
-		  that in the first stage of deduplication, we do not check if there is any repeated share contained 
-		  in the coming package of shares*/
+        /*note: we here still check if the user owns the share, although the first stage already leaves 
+		  a share repeated within the coming package to its first occurrence. The underlying reason is 
+		  that another package of the same user (e.g., from a concurrent upload) may store the share 
+		  between the two stages of deduplication*/
 
         /*check if the user owns the share corresponding to the key*/
         int ownerStat = 0;
@@ -997,6 +1046,9 @@ bool minDedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuff
     int shareMDBufferOffset = 0;
     int i;
 
+    /*fingerprints of the shares in this package that are not stored yet*/
+    FPSet batchFPs(FP_SIZE);
+
     numOfShares = 0;
     sentShareDataSize = 0;
 
@@ -1015,6 +1067,13 @@ bool minDedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuff
             pShareMDEntry = (shareMDEntry_t*)(shareMDBuffer + shareMDBufferOffset);
             shareMDBufferOffset += shareMDEntrySize_;
 
+            /*a share repeated within the package is a duplicate of its first occurrence, whose data is sent once*/
+            if (batchFPs.contains((unsigned char*)pShareMDEntry->shareFP)) {
+                intraUserDupStatList[numOfShares] = 1;
+                numOfShares++;
+                continue;
+            }
+
             /*check the intra-user duplicate status*/
             if (!intraUserIndexUpdate_(pShareMDEntry->shareFP, userID, intraUserDupStatList[numOfShares])) {
                 fprintf(stderr, "Error: fail to update the share index for intra-user duplication in the database!\n");
@@ -1023,6 +1082,7 @@ bool minDedupCore::firstStageDedup(const int& userID, unsigned char* shareMDBuff
             }
             if (intraUserDupStatList[numOfShares] == 0) {
                 sentShareDataSize += pShareMDEntry->shareSize;
+                batchFPs.insert((unsigned char*)pShareMDEntry->shareFP);
             }
 
             numOfShares++;
@@ -1055,6 +1115,10 @@ bool minDedupCore::secondStageDedup(const int& userID, unsigned char* shareMDBuf
     char shareFP[FP_SIZE];
     int shareMDBufferOffset = 0, shareDataBufferOffset = 0;
     int numOfShares = 0;
+    bool ownerStat;
+
+    /*fingerprints of the shares in this package that are stored by their first occurrence*/
+    FPSet batchFPs(FP_SIZE);
 
     if (cryptoObj == NULL) {
         fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");
@@ -1106,8 +1170,17 @@ bool minDedupCore::secondStageDedup(const int& userID, unsigned char* shareMDBuf
                     fprintf(stderr, "Error: fail to update the share ind)ex for inter-user duplication in the database!\n");
                     return 0;
                 }
+                batchFPs.insert((unsigned char*)shareFP);
                 shareDataBufferOffset += pShareMDEntry->shareSize;
             }
+            /*a share repeated within the package was left to its first occurrence, count its reference now*/
+            else if (batchFPs.contains((unsigned char*)pShareMDEntry->shareFP)) {
+                if (!intraUserIndexUpdate_(pShareMDEntry->shareFP, userID, ownerStat) || (ownerStat == 0)) {
+                    fprintf(stderr, "Error: fail to update the share index for a repeated share in the database!\n");
+
+                    return 0;
+                }
+            }
             numOfShares++;
         }
     }
@@ -1219,320 +1292,324 @@ bool minDedupCore::cleanupAllBufferNodes()
 }
 
 /*
- * restore a share file for a user and send it through the socket
+ * send the data of the share file buffer of a restorer through the socket
  *
- * @param userID - the user id
- * @param fullFileName - the full name of the original file 
- * @param versionNumber - the version number (<=0) of the original file 
+ * @param restorer - the restorer state
  * @param socketFD - the file descriptor of the sending socket
- * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
  *
- * @return - a boolean value that indicates if the restore op succeeds
+ * @return - a boolean value that indicates if the send op succeeds
  */
-bool minDedupCore::restoreShareFile(const int& userID, const std::string& fullRecipeFileName, const int& versionNumber, int socketFD, CryptoPrimitive* cryptoObj)
+bool minDedupCore::flushShareFileBuffer_(shareRestorer_t* restorer, int socketFD)
 {
+    int sentMsgHeadSize = sizeof(uint32_t) * 2;
+    uint32_t indicator;
+    uint32_t sentDataSize;
+    ssize_t sentSize;
 
-    leveldb::Status inodeStat, shareStat;
-    std::string formatedFullFileName;
+    /*add the message head before sending the data of the share file buffer*/
+    indicator = htonl(-5);
+    sentDataSize = htonl(restorer->shareFileBufferOffset - sentMsgHeadSize);
+    memcpy(restorer->shareFileBuffer, &indicator, sizeof(uint32_t));
+    memcpy(restorer->shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
+    /*send the data of the share file buffer through the socket with socketFD*/
+    if ((sentSize = sendBuffer(socketFD, restorer->shareFileBuffer, restorer->shareFileBufferOffset)) != restorer->shareFileBufferOffset) {
+        fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) through the socket %d --- return %ld!\n", restorer->shareFileBufferOffset, socketFD, sentSize);
+        return 0;
+    }
+
+    /*reset shareFileBufferOffset*/
+    restorer->shareFileBufferOffset = sentMsgHeadSize;
+
+    return 1;
+}
+
+/*
+ * read a share of a file recipe entry into the share file buffer of a restorer
+ *
+ * @param pFileRecipeEntry - the file recipe entry of the share
+ * @param restorer - the restorer state
+ * @param socketFD - the file descriptor of the sending socket (for sending a full share file buffer)
+ *
+ * @return - a boolean value that indicates if the restore op succeeds
+ */
+bool minDedupCore::restoreShare_(fileRecipeEntry_t* pFileRecipeEntry, shareRestorer_t* restorer, int socketFD)
+{
+    leveldb::Status shareStat;
     char key[KEY_SIZE];
-    leveldb::Slice* shareKeySlice;
     std::string valueString;
-    int valueOffset;
-    unsigned char *recipeFileBuffer, *shareFileBuffer;
-    int shareFileBufferOffset;
-    shareContainerCacheNode_t* shareContainerCache;
-    int *shareContainerCacheIndex, numOfCachedShareContainers;
-    FILE *recipeFilePointer, *containerFilePointer;
+    FILE* containerFilePointer;
     std::string fullShareContainerName;
-    int numOfShares;
-
     shareIndexValueHead_t* pShareIndexValueHead;
-    fileRecipeHead_t* pFileRecipeHead;
-    fileRecipeEntry_t* pFileRecipeEntry;
-    shareFileHead_t* pShareFileHead;
     shareEntry_t* pShareEntry;
-    ssize_t sentSize;
-    uint32_t indicator;
-    uint32_t sentDataSize;
+    int sentShareFileBufferSize = sizeof(uint32_t) * 2 + SHARE_FILE_BUFFER_SIZE;
+    shareContainerCacheNode_t* shareContainerCache = restorer->shareContainerCache;
+    int* shareContainerCacheIndex = restorer->shareContainerCacheIndex;
     int j, k;
 
-    if (cryptoObj == NULL) {
-        fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");
+    /*generate the key for the corresponding share*/
+    shareFP2IndexKey_(pFileRecipeEntry->shareFP, key);
+    leveldb::Slice shareKeySlice(key, KEY_SIZE);
+
+    /*get the mutex lock DBLock_*/
+    pthread_mutex_lock(&DBLock_);
+
+    /*enquire the key in the database*/
+    shareStat = db_->Get(readOptions_, shareKeySlice, &valueString);
+
+    /*release the mutex lock DBLock_*/
+    pthread_mutex_unlock(&DBLock_);
+
+    /*if such a share does not exist*/
+    if (shareStat.IsNotFound()) {
+        fprintf(stderr, "Error: cannot find a share for the key '%s' in the database!\n", shareKeySlice.ToString().c_str());
         return 0;
     }
 
-    recipeFilePointer = fopen(fullRecipeFileName.c_str(), "rb+");
-    printf("restore - file name = %s\n", fullRecipeFileName.c_str());
-    /*if such an inode for fullFileName exists*/
-    if (recipeFilePointer != NULL) {
-
-        printf("start restore file\n");
-        /*enlarge the share file buffer size with a message head (indicator, sentDataSize)*/
-        int sentMsgHeadSize = sizeof(uint32_t) * 2;
-        int sentShareFileBufferSize = sentMsgHeadSize + SHARE_FILE_BUFFER_SIZE;
-
-        /*allocate some caches and buffers for accelerating file restoring speed*/
-        recipeFileBuffer = (unsigned char*)malloc(sizeof(unsigned char) * RECIPE_BUFFER_SIZE);
-        shareFileBuffer = (unsigned char*)malloc(sentShareFileBufferSize);
-        shareContainerCache = (shareContainerCacheNode_t*)malloc(sizeof(shareContainerCacheNode_t) * NUM_OF_CACHED_CONTAINERS);
-        shareContainerCacheIndex = (int*)malloc(sizeof(int) * NUM_OF_CACHED_CONTAINERS);
-        numOfCachedShareContainers = 0;
-
-        /*read the first RECIPE_BUFFER_SIZE bytes of the recipe file and store them into recipeFileBuffer*/
-        fseek(recipeFilePointer, 0, SEEK_SET);
-
-        if (fread(recipeFileBuffer, 1, sizeof(fileRecipeHead_t), recipeFilePointer) == 0) {
-
-            fprintf(stderr, "Error: fail to read the recipe file '%s'!\n", fullRecipeFileName.c_str());
-            fclose(recipeFilePointer);
-            free(recipeFileBuffer);
-            free(shareFileBuffer);
-            free(shareContainerCache);
-            free(shareContainerCacheIndex);
-            return 0;
-        }
+    if (shareStat.IsCorruption()) {
+        fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", shareKeySlice.ToString().c_str());
+        return 0;
+    }
 
-        /*read the file recipe head*/
-        pFileRecipeHead = (fileRecipeHead_t*)(recipeFileBuffer);
+    if (shareStat.IsIOError()) {
+        fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", shareKeySlice.ToString().c_str());
+        return 0;
+    }
 
-        /*generate and store the share file head into shareFileBuffer*/
-        shareFileBufferOffset = sentMsgHeadSize;
-        pShareFileHead = (shareFileHead_t*)(shareFileBuffer + shareFileBufferOffset);
-        pShareFileHead->fileSize = pFileRecipeHead->fileSize;
-        pShareFileHead->numOfShares = pFileRecipeHead->numOfShares;
-        printf("share number = %d\n", pShareFileHead->numOfShares);
-        shareFileBufferOffset += shareFileHeadSize_;
+    if (!shareStat.ok()) {
+        return 0;
+    }
 
-        /*restore each share*/
-        numOfShares = pShareFileHead->numOfShares;
+    /*read the head of the share index value*/
+    pShareIndexValueHead = (shareIndexValueHead_t*)(valueString.data());
 
-        for (int i = 0; i < numOfShares; i++) {
+    /*check if the share container has been cached in shareContainerCache*/
+    j = 0;
+    while ((j < restorer->numOfCachedShareContainers) && (strcmp(pShareIndexValueHead->shareContainerName, shareContainerCache[shareContainerCacheIndex[j]].shareContainerName) != 0)) {
+        j++;
+    }
 
-            if (fread(recipeFileBuffer, 1, sizeof(fileRecipeEntry_t), recipeFilePointer) == 0) {
-                fprintf(stderr, "Error: fail to read the recipe file '%s'!\n", fullRecipeFileName.c_str());
+    /*if the share container is cached in shareContainerCache*/
+    if (j < restorer->numOfCachedShareContainers) {
+        /*move the found share container to the beginning of the cache*/
+        if (j > 0) {
+            int tmp = shareContainerCacheIndex[j];
+            for (k = j; k > 0; k--) {
+                shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
+            }
+            shareContainerCacheIndex[0] = tmp;
+        }
+    }
+    /*if the share container is not cached in shareContainerCache*/
+    else {
+        /*move the evicted share container to the beginning of the cache*/
+        if (restorer->numOfCachedShareContainers < NUM_OF_CACHED_CONTAINERS) {
+            /*in this case, the evicted one is a new cache entry*/
+            for (k = restorer->numOfCachedShareContainers; k > 0; k--) {
+                shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
+            }
+            shareContainerCacheIndex[0] = restorer->numOfCachedShareContainers;
+            restorer->numOfCachedShareContainers++;
+        } else {
+            /*in this case, the evicted one is the last cache entry*/
+            int tmp = shareContainerCacheIndex[NUM_OF_CACHED_CONTAINERS - 1];
+            for (k = NUM_OF_CACHED_CONTAINERS - 1; k > 0; k--) {
+                shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
+            }
+            shareContainerCacheIndex[0] = tmp;
+        }
 
-                fclose(recipeFilePointer);
+        /*the cache entry is overwritten, so it is not valid until the new share container is read*/
+        shareContainerCache[shareContainerCacheIndex[0]].shareContainerName[0] = '\0';
 
-                free(recipeFileBuffer);
-                free(shareFileBuffer);
-                free(shareContainerCache);
-                free(shareContainerCacheIndex);
+        /*first read share container from the buffer; if it is not in the buffer, then read it from the disk. 
+		  besides, store the new share container in the beginning of the cache to overwrite the evicted one*/
+        if (!readShareContainerFromBuffer_(pShareIndexValueHead->shareContainerName, shareContainerCache[shareContainerCacheIndex[0]].shareContainer)) {
+            /*generate the full share container name*/
+            fullShareContainerName = pShareIndexValueHead->shareContainerName;
+            if (!addPrefixDir_(shareContainerDirName_, fullShareContainerName)) {
+                fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", shareContainerDirName_.c_str(), fullShareContainerName.c_str());
                 return 0;
             }
-            /*read the file recipe entry*/
-            pFileRecipeEntry = (fileRecipeEntry_t*)(recipeFileBuffer);
-            /*
-                char szTmp[3];
-                printf("share - id = %d\t",pFileRecipeEntry->secretID);
-                for(int l = 0; l < 32; l++){
-                    sprintf( szTmp, "%02X", (unsigned char)pFileRecipeEntry->shareFP[l]);
-                    printf("%s",szTmp);
-                }
-                printf("\n");
-*/
 
-            /*generate the key for the corresponding share*/
-            shareFP2IndexKey_(pFileRecipeEntry->shareFP, key);
-            shareKeySlice = new leveldb::Slice(key, KEY_SIZE);
+            /*open the container file for reading the share*/
+            if (containerStorerObj_ != NULL) {
+                containerStorerObj_->openOldFile(fullShareContainerName, containerFilePointer);
+            } else {
+                containerFilePointer = fopen(fullShareContainerName.c_str(), "rb");
+            }
 
-            /*get the mutex lock DBLock_*/
-            pthread_mutex_lock(&DBLock_);
+            if (containerFilePointer == NULL) {
+                fprintf(stderr, "Error: fail to open the share container file '%s'!\n", fullShareContainerName.c_str());
+                return 0;
+            }
 
-            /*enquire the key in thshareBufferIndexe database*/
-            shareStat = db_->Get(readOptions_, *shareKeySlice, &valueString);
+            if (fread(shareContainerCache[shareContainerCacheIndex[0]].shareContainer, 1, CONTAINER_BUFFER_SIZE, containerFilePointer) == 0) {
+                fprintf(stderr, "Error: fail to read the share container file '%s'!\n", fullShareContainerName.c_str());
+                fclose(containerFilePointer);
+                return 0;
+            }
 
-            /*release the mutex lock DBLock_*/
-            pthread_mutex_unlock(&DBLock_);
+            fclose(containerFilePointer);
+        }
 
-            /*if such a share exists*/
-            if (shareStat.ok()) {
-                /*read the head of the share index value*/
-                valueOffset = 0;
-                pShareIndexValueHead = (shareIndexValueHead_t*)(valueString.data() + valueOffset);
-                valueOffset += shareIndexValueHeadSize_;
-
-                /*check if the share container has been cached in shareContainerCache*/
-                j = 0;
-                while ((j < numOfCachedShareContainers) && (strcmp(pShareIndexValueHead->shareContainerName, shareContainerCache[shareContainerCacheIndex[j]].shareContainerName) != 0)) {
-                    j++;
-                }
+        /*then update the cached share container name*/
+        memcpy(shareContainerCache[shareContainerCacheIndex[0]].shareContainerName,
+            pShareIndexValueHead->shareContainerName, INTERNAL_FILE_NAME_SIZE);
+    }
 
-                /*if the share container is cached in shareContainerCache*/
-                if (j < numOfCachedShareContainers) {
-                    /*move the found share container to the beginning of the cache*/
-                    if (j > 0) {
-                        int tmp = shareContainerCacheIndex[j];
-                        for (k = j; k > 0; k--) {
-                            shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-                        }
-                        shareContainerCacheIndex[0] = tmp;
-                    }
-                }
-                /*if the share container is not cached in shareContainerCache*/
-                else {
-                    /*move the evicted share container to the beginning of the cache*/
-                    if (numOfCachedShareContainers < NUM_OF_CACHED_CONTAINERS) {
-                        /*in this case, the evicted one is a new cache entry*/
-                        for (k = numOfCachedShareContainers; k > 0; k--) {
-                            shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-                        }
-                        shareContainerCacheIndex[0] = numOfCachedShareContainers;
-                        numOfCachedShareContainers++;
-                    } else {
-                        /*in this case, the evicted one is the last cache entry*/
-                        int tmp = shareContainerCacheIndex[NUM_OF_CACHED_CONTAINERS - 1];
-                        for (k = NUM_OF_CACHED_CONTAINERS - 1; k > 0; k--) {
-                            shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-                        }
-                        shareContainerCacheIndex[0] = tmp;
-                    }
+    /*check if shareFileBuffer has enough space for keeping the share info and data*/
+    if (restorer->shareFileBufferOffset + shareEntrySize_ + pShareIndexValueHead->shareSize > sentShareFileBufferSize) {
+        if (!flushShareFileBuffer_(restorer, socketFD)) {
+            return 0;
+        }
+    }
 
-                    /*first read share container from the buffer; if it is not in the buffer, then read it from the disk. 
-					  besides, store the new share container in the beginning of the cache to overwrite the evicted one*/
-                    if (!readShareContainerFromBuffer_(pShareIndexValueHead->shareContainerName, shareContainerCache[shareContainerCacheIndex[0]].shareContainer)) {
-                        /*generate the full share container name*/
-                        fullShareContainerName = pShareIndexValueHead->shareContainerName;
-                        if (!addPrefixDir_(shareContainerDirName_, fullShareContainerName)) {
-                            fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", shareContainerDirName_.c_str(), fullShareContainerName.c_str());
-                            free(recipeFileBuffer);
-                            free(shareFileBuffer);
-                            free(shareContainerCache);
-                            free(shareContainerCacheIndex);
-                            return 0;
-                        }
-
-                        /*open the container file for reading the share*/
-                        if (containerStorerObj_ != NULL) {
-                            containerStorerObj_->openOldFile(fullShareContainerName, containerFilePointer);
-                        } else {
-                            containerFilePointer = fopen(fullShareContainerName.c_str(), "rb");
-                        }
-
-                        if (containerFilePointer == NULL) {
-                            fprintf(stderr, "Error: fail to open the share container file '%s'!\n", fullShareContainerName.c_str());
-                            free(recipeFileBuffer);
-                            free(shareFileBuffer);
-                            free(shareContainerCache);
-                            free(shareContainerCacheIndex);
-                            return 0;
-                        }
-
-                        if (fread(shareContainerCache[shareContainerCacheIndex[0]].shareContainer, 1, CONTAINER_BUFFER_SIZE, containerFilePointer) == 0) {
-                            fprintf(stderr, "Error: fail to read the share container file '%s'!\n", fullShareContainerName.c_str());
-                            fclose(containerFilePointer);
-
-                            free(recipeFileBuffer);
-                            free(shareFileBuffer);
-                            free(shareContainerCache);
-                            free(shareContainerCacheIndex);
-                            return 0;
-                        }
-
-                        fclose(containerFilePointer);
-                    }
+    /*generate and store the share info into shareFileBuffer*/
+    pShareEntry = (shareEntry_t*)(restorer->shareFileBuffer + restorer->shareFileBufferOffset);
+    pShareEntry->secretID = pFileRecipeEntry->secretID;
+    pShareEntry->secretSize = pFileRecipeEntry->secretSize;
+    pShareEntry->shareSize = pShareIndexValueHead->shareSize;
+    restorer->shareFileBufferOffset += shareEntrySize_;
 
-                    /*then update the cached share container name*/
-                    memcpy(shareContainerCache[shareContainerCacheIndex[0]].shareContainerName,
-                        pShareIndexValueHead->shareContainerName, INTERNAL_FILE_NAME_SIZE);
-                }
+    /*store the share data into shareFileBuffer*/
+    memcpy(restorer->shareFileBuffer + restorer->shareFileBufferOffset, shareContainerCache[shareContainerCacheIndex[0]].shareContainer + pShareIndexValueHead->shareContainerOffset, pShareIndexValueHead->shareSize);
+    restorer->shareFileBufferOffset += pShareIndexValueHead->shareSize;
 
-                /*check if shareFileBuffer has enough space for keeping the share info and data*/
-                if (shareFileBufferOffset + shareEntrySize_ + pShareIndexValueHead->shareSize > sentShareFileBufferSize) {
-                    /*add the message head before sending the data of the share file buffer*/
-                    indicator = htonl(-5);
-                    sentDataSize = htonl(shareFileBufferOffset - sentMsgHeadSize);
-                    memcpy(shareFileBuffer, &indicator, sizeof(uint32_t));
-                    memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
-                    /*send the data of the share file buffer through the socket with socketFD*/
-                    if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset) {
-                        fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) through the socket %d --- return %ld!\n", shareFileBufferOffset, socketFD, sentSize);
-                        free(recipeFileBuffer);
-                        free(shareFileBuffer);
-                        free(shareContainerCache);
-                        free(shareContainerCacheIndex);
-                        return 0;
-                    }
+    return 1;
+}
 
-                    /*reset shareFileBufferOffset*/
-                    shareFileBufferOffset = sentMsgHeadSize;
-                }
+/*
+ * initialize the state for restoring the shares of a file
+ *
+ * @param restorer - the restorer state <return>
+ */
+void minDedupCore::initShareRestorer(shareRestorer_t* restorer)
+{
+    /*enlarge the share file buffer size with a message head (indicator, sentDataSize)*/
+    int sentMsgHeadSize = sizeof(uint32_t) * 2;
+    int sentShareFileBufferSize = sentMsgHeadSize + SHARE_FILE_BUFFER_SIZE;
+
+    /*allocate some caches and buffers for accelerating file restoring speed*/
+    restorer->shareFileBuffer = (unsigned char*)malloc(sentShareFileBufferSize);
+    restorer->shareFileBufferOffset = sentMsgHeadSize;
+    restorer->shareContainerCache = (shareContainerCacheNode_t*)malloc(sizeof(shareContainerCacheNode_t) * NUM_OF_CACHED_CONTAINERS);
+    restorer->shareContainerCacheIndex = (int*)malloc(sizeof(int) * NUM_OF_CACHED_CONTAINERS);
+    restorer->numOfCachedShareContainers = 0;
+}
 
-                /*generate and store the share info into shareFileBuffer*/
-                pShareEntry = (shareEntry_t*)(shareFileBuffer + shareFileBufferOffset);
-                pShareEntry->secretID = pFileRecipeEntry->secretID;
-                pShareEntry->secretSize = pFileRecipeEntry->secretSize;
-                pShareEntry->shareSize = pShareIndexValueHead->shareSize;
-                shareFileBufferOffset += shareEntrySize_;
+/*
+ * release the state for restoring the shares of a file
+ *
+ * @param restorer - the restorer state
+ */
+void minDedupCore::destroyShareRestorer(shareRestorer_t* restorer)
+{
+    free(restorer->shareFileBuffer);
+    free(restorer->shareContainerCache);
+    free(restorer->shareContainerCacheIndex);
+}
 
-                /*store the share data into shareFileBuffer*/
-                memcpy(shareFileBuffer + shareFileBufferOffset, shareContainerCache[shareContainerCacheIndex[0]].shareContainer + pShareIndexValueHead->shareContainerOffset, pShareIndexValueHead->shareSize);
-                shareFileBufferOffset += pShareIndexValueHead->shareSize;
-            }
+/*
+ * restore the shares of a list of file recipe entries and send them through the socket
+ *
+ * @param recipeEntryList - the file recipe entries
+ * @param numOfEntries - the number of file recipe entries
+ * @param restorer - the restorer state, whose buffers are reused by the next list of any restore
+ * @param socketFD - the file descriptor of the sending socket
+ *
+ * @return - a boolean value that indicates if the restore op succeeds
+ */
+bool minDedupCore::restoreShareList(fileRecipeEntry_t* recipeEntryList, const int& numOfEntries, shareRestorer_t* restorer, int socketFD)
+{
+    int sentMsgHeadSize = sizeof(uint32_t) * 2;
 
-            /*if such a share does not exist*/
-            if (shareStat.IsNotFound()) {
-                fprintf(stderr, "Error: cannot find a share for the key '%s' in the database!\n", shareKeySlice->ToString().c_str());
-                free(recipeFileBuffer);
-                free(shareFileBuffer);
-                free(shareContainerCache);
-                free(shareContainerCacheIndex);
-                return 0;
-            }
+    /*the restorer may come from another restore, and a cached share container may be rewritten between lists*/
+    restorer->shareFileBufferOffset = sentMsgHeadSize;
+    restorer->numOfCachedShareContainers = 0;
 
-            if (shareStat.IsCorruption()) {
-                fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", shareKeySlice->ToString().c_str());
-                free(recipeFileBuffer);
-                free(shareFileBuffer);
-                free(shareContainerCache);
-                free(shareContainerCacheIndex);
-                return 0;
-            }
+    for (int i = 0; i < numOfEntries; i++) {
+        if (!restoreShare_(&recipeEntryList[i], restorer, socketFD)) {
+            return 0;
+        }
+    }
 
-            if (shareStat.IsIOError()) {
-                fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", shareKeySlice->ToString().c_str());
+    /*the shares of a list are sent as soon as they are restored, so the client is never kept waiting for the next list*/
+    if (restorer->shareFileBufferOffset > sentMsgHeadSize) {
+        return flushShareFileBuffer_(restorer, socketFD);
+    }
 
-                free(recipeFileBuffer);
-                free(shareFileBuffer);
-                free(shareContainerCache);
-                free(shareContainerCacheIndex);
-                return 0;
-            }
+    return 1;
+}
 
-            delete shareKeySlice;
-        }
+/*
+ * restore a share file for a user and send it through the socket
+ *
+ * @param userID - the user id
+ * @param recipeFilePointer - the file recipe, opened and closed by the caller
+ * @param versionNumber - the version number (<=0) of the original file 
+ * @param socketFD - the file descriptor of the sending socket
+ * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
+ *
+ * @return - a boolean value that indicates if the restore op succeeds
+ */
+bool minDedupCore::restoreShareFile(const int& userID, FILE* recipeFilePointer, const int& versionNumber, int socketFD, CryptoPrimitive* cryptoObj)
+{
+    fileRecipeHead_t fileRecipeHead;
+    fileRecipeEntry_t fileRecipeEntry;
+    shareFileHead_t* pShareFileHead;
+    shareRestorer_t restorer;
+    long numOfShares;
 
-        if (shareFileBufferOffset > sentMsgHeadSize) {
-            /*add the message head before sending the data of the share file buffer*/
-            indicator = htonl(-5);
-            sentDataSize = htonl(shareFileBufferOffset - sentMsgHeadSize);
-            memcpy(shareFileBuffer, &indicator, sizeof(uint32_t));
-            memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
-            /*send the data of the share file buffer through the socket with socketFD*/
-            if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset) {
-                fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) through the socket %d --- return %ld!\n", shareFileBufferOffset, socketFD, sentSize);
-
-                free(recipeFileBuffer);
-                free(shareFileBuffer);
-                free(shareContainerCache);
-                free(shareContainerCacheIndex);
-                return 0;
-            }
+    if (cryptoObj == NULL) {
+        fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");
+        return 0;
+    }
+
+    printf("start restore file\n");
+    initShareRestorer(&restorer);
+
+    /*read the file recipe head*/
+    fseek(recipeFilePointer, 0, SEEK_SET);
+    if (fread(&fileRecipeHead, 1, sizeof(fileRecipeHead_t), recipeFilePointer) == 0) {
+
+        fprintf(stderr, "Error: fail to read the recipe file!\n");
+        destroyShareRestorer(&restorer);
+        return 0;
+    }
+
+    /*generate and store the share file head into shareFileBuffer*/
+    pShareFileHead = (shareFileHead_t*)(restorer.shareFileBuffer + restorer.shareFileBufferOffset);
+    pShareFileHead->fileSize = fileRecipeHead.fileSize;
+    pShareFileHead->numOfShares = fileRecipeHead.numOfShares;
+    printf("share number = %ld\n", pShareFileHead->numOfShares);
+    restorer.shareFileBufferOffset += shareFileHeadSize_;
+
+    /*restore each share*/
+    numOfShares = fileRecipeHead.numOfShares;
+
+    for (long i = 0; i < numOfShares; i++) {
+
+        /*read the file recipe entry*/
+        if (fread(&fileRecipeEntry, 1, sizeof(fileRecipeEntry_t), recipeFilePointer) == 0) {
+            fprintf(stderr, "Error: fail to read the recipe file!\n");
+            destroyShareRestorer(&restorer);
+            return 0;
         }
 
-        free(recipeFileBuffer);
-        free(shareFileBuffer);
-        free(shareContainerCache);
-        free(shareContainerCacheIndex);
-    } else {
-        printf("can not start restore data chunks because recipefile = NULL\n");
+        if (!restoreShare_(&fileRecipeEntry, &restorer, socketFD)) {
+            destroyShareRestorer(&restorer);
+            return 0;
+        }
     }
 
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", fullRecipeFileName.c_str());
-    pid_t status = system(cmd);
-    if (status == -1) {
-        printf("error in system call function %s\n", cmd);
+    if (restorer.shareFileBufferOffset > (int)(sizeof(uint32_t) * 2)) {
+        if (!flushShareFileBuffer_(&restorer, socketFD)) {
+            destroyShareRestorer(&restorer);
+            return 0;
+        }
     }
 
+    destroyShareRestorer(&restorer);
+
     return 1;
 }
@@ -38,6 +38,9 @@
 #include "CryptoPrimitive.hh"
 #include "dataStruct.hh"
 
+/*for detecting repeated shares within a package*/
+#include "fpSet.hh"
+
 class minDedupCore {
 private:
     /*the name of the deduplication directory*/
@@ -308,6 +311,27 @@ private:
     bool readShareContainerFromBuffer_(char* shareContainerName,
         unsigned char* shareContainerBuffer);
 
+    /*
+	 * send the data of the share file buffer of a restorer through the socket
+	 *
+	 * @param restorer - the restorer state
+	 * @param socketFD - the file descriptor of the sending socket
+	 *
+	 * @return - a boolean value that indicates if the send op succeeds
+	 */
+    bool flushShareFileBuffer_(shareRestorer_t* restorer, int socketFD);
+
+    /*
+	 * read a share of a file recipe entry into the share file buffer of a restorer
+	 *
+	 * @param pFileRecipeEntry - the file recipe entry of the share
+	 * @param restorer - the restorer state
+	 * @param socketFD - the file descriptor of the sending socket (for sending a full share file buffer)
+	 *
+	 * @return - a boolean value that indicates if the restore op succeeds
+	 */
+    bool restoreShare_(fileRecipeEntry_t* pFileRecipeEntry, shareRestorer_t* restorer, int socketFD);
+
 public:
     /*
 	 * constructor of DedupCore
@@ -379,14 +403,40 @@ public:
 	 * restore a share file for a user and send it through the socket
 	 *
 	 * @param userID - the user id
-	 * @param fullFileName - the full name of the original file 
+	 * @param recipeFilePointer - the file recipe, opened and closed by the caller
 	 * @param versionNumber - the version number (<=0) of the original file 
 	 * @param socketFD - the file descriptor of the sending socket
 	 * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
 	 *
 	 * @return - a boolean value that indicates if the restore op succeeds
 	 */
-    bool restoreShareFile(const int& userID, const std::string& fullFileName, const int& versionNumber, int socketFD, CryptoPrimitive* cryptoObj);
+    bool restoreShareFile(const int& userID, FILE* recipeFilePointer, const int& versionNumber, int socketFD, CryptoPrimitive* cryptoObj);
+
+    /*
+	 * initialize the state for restoring the shares of a file
+	 *
+	 * @param restorer - the restorer state <return>
+	 */
+    void initShareRestorer(shareRestorer_t* restorer);
+
+    /*
+	 * release the state for restoring the shares of a file
+	 *
+	 * @param restorer - the restorer state
+	 */
+    void destroyShareRestorer(shareRestorer_t* restorer);
+
+    /*
+	 * restore the shares of a list of file recipe entries and send them through the socket
+	 *
+	 * @param recipeEntryList - the file recipe entries
+	 * @param numOfEntries - the number of file recipe entries
+	 * @param restorer - the restorer state, whose buffers are reused by the next list of any restore
+	 * @param socketFD - the file descriptor of the sending socket
+	 *
+	 * @return - a boolean value that indicates if the restore op succeeds
+	 */
+    bool restoreShareList(fileRecipeEntry_t* recipeEntryList, const int& numOfEntries, shareRestorer_t* restorer, int socketFD);
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include "DedupCore.hh"
 #include "minDedupCore.hh"
 #include "server.hh"
+#include <signal.h>
 
 using namespace std;
 
@@ -20,13 +21,19 @@ int main(int argv, char** argc)
         exit(1);
     }
 
+    /* a client that closes its connection while shares are sent to it only ends that connection */
+    signal(SIGPIPE, SIG_IGN);
+
     /* initialize objects */
     BackendStorer* recipeStorerObj = NULL;
     BackendStorer* containerStorerObj = NULL;
     dedupObj = new DedupCore("./", "meta/DedupDB", "meta/RecipeFiles", "meta/ShareContainers", recipeStorerObj, containerStorerObj);
     minDedupObj = new minDedupCore("./", "meta/minDedupDB", "meta/RecipeFiles", "meta/minShareContainers", containerStorerObj);
     /* initialize server object */
-    server = new Server(atoi(argc[1]), atoi(argc[2]), dedupObj, minDedupObj);
+    int numOfWorkers = (argv > 3) ? atoi(argc[3]) : SERVER_NUM_WORKERS;
+    int maxConnections = (argv > 4) ? atoi(argc[4]) : SERVER_MAX_CONNECTIONS;
+    int backlog = (argv > 5) ? atoi(argc[5]) : SERVER_LISTEN_BACKLOG;
+    server = new Server(atoi(argc[1]), atoi(argc[2]), dedupObj, minDedupObj, numOfWorkers, maxConnections, backlog);
 
     /* run server service */
     server->runReceive();
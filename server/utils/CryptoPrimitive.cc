@@ -22,7 +22,10 @@ void CryptoPrimitive::opensslLockingCallback_(int mode, int type, const char* fi
 
     if (mode & CRYPTO_LOCK) {
         pthread_mutex_lock(&(opensslLock_->lockList[type]));
+#if OPENSSL_DEBUG
+        /*lock statistics are only kept for debugging, as they are bumped on every lock*/
         CryptoPrimitive::opensslLock_->cntList[type]++;
+#endif
     } else {
         pthread_mutex_unlock(&(opensslLock_->lockList[type]));
     }
@@ -153,6 +156,8 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType)
         iv_ = (unsigned char*)malloc(sizeof(unsigned char) * blockSize_);
         memset(iv_, 0, blockSize_);
 
+        cipherContextSetup();
+
         fprintf(stderr, "\nA CryptoPrimitive based on a pair of SHA-256 and AES-256 has been constructed! \n");
         fprintf(stderr, "Parameters: \n");
         fprintf(stderr, "      hashSize_: %d \n", hashSize_);
@@ -188,6 +193,8 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType)
         iv_ = (unsigned char*)malloc(sizeof(unsigned char) * blockSize_);
         memset(iv_, 0, blockSize_);
 
+        cipherContextSetup();
+
         fprintf(stderr, "\nA CryptoPrimitive based on a pair of MD5 and AES-128 has been constructed! \n");
         fprintf(stderr, "Parameters: \n");
         fprintf(stderr, "      hashSize_: %d \n", hashSize_);
@@ -238,6 +245,13 @@ CryptoPrimitive::CryptoPrimitive(int cryptoType)
         fprintf(stderr, "\n");
     }
 
+    /*bind the digest to mdctx_ once, so that each hash generation only resets the state*/
+#if defined(OPENSSL_VERSION_1_1)
+    EVP_DigestInit_ex(mdctx_, md_, NULL);
+#else
+    EVP_DigestInit_ex(&mdctx_, md_, NULL);
+#endif
+
 #else
     fprintf(stderr, "Error: OpenSSL was not configured with thread support!\n");
     exit(1);
@@ -251,13 +265,14 @@ CryptoPrimitive::~CryptoPrimitive()
     if ((cryptoType_ == HIGH_SEC_PAIR_TYPE) || (cryptoType_ == LOW_SEC_PAIR_TYPE)) {
         /*clean up the digest context mdctx_ and free up the space allocated to it*/
 #if defined(OPENSSL_VERSION_1_1)
-
-        EVP_MD_CTX_reset(mdctx_);
-        EVP_CIPHER_CTX_reset(cipherctx_);
+        EVP_MD_CTX_free(mdctx_);
+        EVP_CIPHER_CTX_free(cipherctx_);
+        EVP_CIPHER_CTX_free(decipherctx_);
 #else
         EVP_MD_CTX_cleanup(&mdctx_);
-        /**clean up the cipher context cipherctx_ and free up the space allocated to it */
+        /**clean up the cipher contexts and free up the space allocated to them */
         EVP_CIPHER_CTX_cleanup(&cipherctx_);
+        EVP_CIPHER_CTX_cleanup(&decipherctx_);
 
 #endif
         free(iv_);
@@ -266,8 +281,9 @@ CryptoPrimitive::~CryptoPrimitive()
     if ((cryptoType_ == SHA256_TYPE) || (cryptoType_ == SHA1_TYPE)) {
         /*clean up the digest context mdctx_ and free up the space allocated to it*/
 #if defined(OPENSSL_VERSION_1_1)
-        /**allocate, initialize and return the digest context mdctx_ */
-        EVP_MD_CTX_reset(mdctx_);
+        EVP_MD_CTX_free(mdctx_);
+        EVP_CIPHER_CTX_free(cipherctx_);
+        EVP_CIPHER_CTX_free(decipherctx_);
 #else
         EVP_MD_CTX_cleanup(&mdctx_);
 #endif
@@ -277,6 +293,32 @@ CryptoPrimitive::~CryptoPrimitive()
     fprintf(stderr, "\n");
 }
 
+/*
+ * bind the cipher to the encryption and decryption contexts and disable padding once,
+ * so that each encryption or decryption only loads the key and the IV
+ */
+void CryptoPrimitive::cipherContextSetup()
+{
+#if defined(OPENSSL_VERSION_1_1)
+    EVP_CIPHER_CTX_init(decipherctx_);
+    EVP_EncryptInit_ex(cipherctx_, cipher_, NULL, NULL, NULL);
+    /*disable padding to ensure that the generated ciphertext has the same size as the input data*/
+    EVP_CIPHER_CTX_set_padding(cipherctx_, 0);
+    EVP_DecryptInit_ex(decipherctx_, cipher_, NULL, NULL, NULL);
+    EVP_CIPHER_CTX_set_padding(decipherctx_, 0);
+#else
+    EVP_CIPHER_CTX_init(&decipherctx_);
+    EVP_EncryptInit_ex(&cipherctx_, cipher_, NULL, NULL, NULL);
+    /*disable padding to ensure that the generated ciphertext has the same size as the input data*/
+    EVP_CIPHER_CTX_set_padding(&cipherctx_, 0);
+    EVP_DecryptInit_ex(&decipherctx_, cipher_, NULL, NULL, NULL);
+    EVP_CIPHER_CTX_set_padding(&decipherctx_, 0);
+#endif
+
+    encKeyLoaded_ = false;
+    decKeyLoaded_ = false;
+}
+
 /*
  * get the hash size
  *
@@ -321,8 +363,12 @@ bool CryptoPrimitive::generateHash(unsigned char* dataBuffer, const int& dataSiz
     int hashSize;
 
 #if defined(OPENSSL_VERSION_1_1)
-
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    /*reuse the digest bound in the constructor instead of fetching it again from the provider*/
+    EVP_DigestInit_ex2(mdctx_, NULL, NULL);
+#else
     EVP_DigestInit_ex(mdctx_, md_, NULL);
+#endif
     EVP_DigestUpdate(mdctx_, dataBuffer, dataSize);
     EVP_DigestFinal_ex(mdctx_, hash, (unsigned int*)&hashSize);
 #else
@@ -363,18 +409,20 @@ bool CryptoPrimitive::encryptWithKey(unsigned char* dataBuffer, const int& dataS
         return 0;
     }
 
+    /*the cipher is bound in the constructor; only rerun the key schedule if the key changes*/
+    if (encKeyLoaded_ && (memcmp(encKey_, key, keySize_) == 0)) {
+        key = NULL;
+    } else {
+        memcpy(encKey_, key, keySize_);
+        encKeyLoaded_ = true;
+    }
+
 #if defined(OPENSSL_VERSION_1_1)
-    //TODO: this part may be replaced by new library
-    EVP_EncryptInit_ex(cipherctx_, cipher_, NULL, key, iv_);
-    /*disable padding to ensure that the generated ciphertext has the same size as the input data*/
-    EVP_CIPHER_CTX_set_padding(cipherctx_, 0);
+    EVP_EncryptInit_ex(cipherctx_, NULL, NULL, key, iv_);
     EVP_EncryptUpdate(cipherctx_, ciphertext, &ciphertextSize, dataBuffer, dataSize);
     EVP_EncryptFinal_ex(cipherctx_, ciphertext + ciphertextSize, &ciphertextTailSize);
 #else
-    //TODO: this part may be replaced by new library
-    EVP_EncryptInit_ex(&cipherctx_, cipher_, NULL, key, iv_);
-    /*disable padding to ensure that the generated ciphertext has the same size as the input data*/
-    EVP_CIPHER_CTX_set_padding(&cipherctx_, 0);
+    EVP_EncryptInit_ex(&cipherctx_, NULL, NULL, key, iv_);
     EVP_EncryptUpdate(&cipherctx_, ciphertext, &ciphertextSize, dataBuffer, dataSize);
     EVP_EncryptFinal_ex(&cipherctx_, ciphertext + ciphertextSize, &ciphertextTailSize);
 #endif
@@ -412,16 +460,22 @@ bool CryptoPrimitive::decryptWithKey(unsigned char* ciphertext, const int& dataS
 
         return 0;
     }
+
+    if (decKeyLoaded_ && (memcmp(decKey_, key, keySize_) == 0)) {
+        key = NULL;
+    } else {
+        memcpy(decKey_, key, keySize_);
+        decKeyLoaded_ = true;
+    }
+
 #if defined(OPENSSL_VERSION_1_1)
-    EVP_DecryptInit_ex(cipherctx_, cipher_, NULL, key, iv_);
-    EVP_CIPHER_CTX_set_padding(cipherctx_, 0);
-    EVP_DecryptUpdate(cipherctx_, dataBuffer, &plaintextSize, ciphertext, dataSize);
-    EVP_DecryptFinal_ex(cipherctx_, dataBuffer + plaintextSize, &plaintextTailSize);
+    EVP_DecryptInit_ex(decipherctx_, NULL, NULL, key, iv_);
+    EVP_DecryptUpdate(decipherctx_, dataBuffer, &plaintextSize, ciphertext, dataSize);
+    EVP_DecryptFinal_ex(decipherctx_, dataBuffer + plaintextSize, &plaintextTailSize);
 #else
-    EVP_DecryptInit_ex(&cipherctx_, cipher_, NULL, key, iv_);
-    EVP_CIPHER_CTX_set_padding(&cipherctx_, 0);
-    EVP_DecryptUpdate(&cipherctx_, dataBuffer, &plaintextSize, ciphertext, dataSize);
-    EVP_DecryptFinal_ex(&cipherctx_, dataBuffer + plaintextSize, &plaintextTailSize);
+    EVP_DecryptInit_ex(&decipherctx_, NULL, NULL, key, iv_);
+    EVP_DecryptUpdate(&decipherctx_, dataBuffer, &plaintextSize, ciphertext, dataSize);
+    EVP_DecryptFinal_ex(&decipherctx_, dataBuffer + plaintextSize, &plaintextTailSize);
 #endif
 
     plaintextSize += plaintextTailSize;
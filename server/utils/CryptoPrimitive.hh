@@ -48,6 +48,7 @@ private:
 #if defined(OPENSSL_VERSION_1_1)
 
     EVP_CIPHER_CTX *cipherctx_ = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX *decipherctx_ = EVP_CIPHER_CTX_new();
     EVP_MD_CTX *mdctx_ = EVP_MD_CTX_new();
 
 #else
@@ -55,9 +56,17 @@ private:
     EVP_MD_CTX mdctx_;
     /*variables used in encryption*/
     EVP_CIPHER_CTX cipherctx_;
+    /*variables used in decryption*/
+    EVP_CIPHER_CTX decipherctx_;
 	
 #endif 
 
+    /*the keys whose schedules are currently loaded into cipherctx_ and decipherctx_*/
+    unsigned char encKey_[EVP_MAX_KEY_LENGTH];
+    bool encKeyLoaded_;
+    unsigned char decKey_[EVP_MAX_KEY_LENGTH];
+    bool decKeyLoaded_;
+
     const EVP_CIPHER* cipher_;
     unsigned char* iv_;
 
@@ -81,6 +90,11 @@ private:
 	 */
     static void opensslThreadID_(CRYPTO_THREADID* id);
 
+    /*
+	 * bind the cipher to the encryption and decryption contexts once
+	 */
+    void cipherContextSetup();
+
 public:
     /*
 	 * constructor of CryptoPrimitive
@@ -0,0 +1,108 @@
+/*
+ * fpSet.hh
+ */
+
+#ifndef __FPSET_HH__
+#define __FPSET_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*initial number of slots of a set*/
+#define FP_SET_INIT_SLOTS 1024
+
+/*
+ * pick the slot of a fingerprint in a table, or more generally map it to [0, numOfSlots)
+ *
+ * fingerprints and convergent keys are cryptographic hashes, so their leading bytes are
+ * uniformly distributed and serve as the hash of the table directly
+ *
+ * @param fp - the fingerprint (at least sizeof(unsigned long) bytes)
+ * @param numOfSlots - the number of slots
+ *
+ * @return - the index of the slot
+ */
+inline unsigned long fpSlot(const unsigned char* fp, unsigned long numOfSlots)
+{
+    unsigned long hash;
+    memcpy(&hash, fp, sizeof(unsigned long));
+    return hash % numOfSlots;
+}
+
+/*
+ * set of share fingerprints for detecting repeated shares within one batch
+ *
+ * the set uses open addressing with linear probing and doubles when it is half
+ * full; clearing only resets the slot flags, so the memory of a batch is kept
+ * for the next one. it is not thread-safe, each batch owns its set
+ */
+class FPSet {
+private:
+    /*size of each fingerprint*/
+    int fpSize_;
+
+    /*number of slots, always a power of 2*/
+    int numOfSlots_;
+
+    /*number of stored fingerprints*/
+    int numOfFPs_;
+
+    /*fingerprints of the slots*/
+    unsigned char* fps_;
+
+    /*whether each slot is used*/
+    bool* used_;
+
+    /*
+     * find the slot of a fingerprint
+     *
+     * @param fp - the fingerprint
+     *
+     * @return - the index of the slot that stores fp, or of the free slot for it
+     */
+    int find(unsigned char* fp);
+
+    /*
+     * double the number of slots
+     */
+    void grow();
+
+public:
+    /*
+     * constructor of FPSet
+     *
+     * @param fpSize - size of each fingerprint, at least sizeof(unsigned long)
+     */
+    FPSet(int fpSize);
+
+    /*
+     * destructor of FPSet
+     */
+    ~FPSet();
+
+    /*
+     * check if a fingerprint is in the set
+     *
+     * @param fp - the fingerprint
+     *
+     * @return - a boolean value that indicates if fp is in the set
+     */
+    bool contains(unsigned char* fp);
+
+    /*
+     * insert a fingerprint
+     *
+     * @param fp - the fingerprint
+     *
+     * @return - a boolean value that indicates if fp is new to the set
+     */
+    bool insert(unsigned char* fp);
+
+    /*
+     * remove all fingerprints
+     */
+    void clear();
+};
+
+#endif